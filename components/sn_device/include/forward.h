@@ -4,6 +4,8 @@
 
 typedef uint16_t local_id_t;
 
+typedef struct sn_bus_s sn_bus_t; // see sn_bus.h
+
 #define INVALID_LOCAL_ID 0
 #define LOCAL_ID_MAX     0xff
 #define LOCAL_ID_MIN     0x01
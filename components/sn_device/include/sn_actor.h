@@ -0,0 +1,114 @@
+// --------------------------------------------------------------------------------
+// sn_actor.h
+//
+// description: per-instance mailboxes drained by a small shared worker pool. Every
+// access to a driver ctx after binding goes through the owning instance's mailbox,
+// so at most one worker touches a ctx at any time and drivers need no locks.
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_ACTOR_H
+#define SN_ACTOR_H
+
+#include "cJSON.h"
+#include "esp_err.h"
+#include "sn_driver/driver_inst.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SN_ACTOR_WORKER_COUNT      2
+#define SN_ACTOR_WORKER_STACK_SIZE 4096
+#define SN_ACTOR_WORKER_PRIORITY   5
+#define SN_ACTOR_MAILBOX_LEN       4
+// max messages handled per activation before the instance gives its worker back
+#define SN_ACTOR_BATCH             4
+// how long a poster waits for room in a full mailbox
+#define SN_ACTOR_POST_TIMEOUT_MS   100
+
+typedef enum {
+  SN_ACTOR_MSG_CONTROL = 0, // run driver->control with params
+  SN_ACTOR_MSG_SET_INTERVAL,
+  SN_ACTOR_MSG_CALL, // run fn against the instance (driver internal work, timers...)
+} sn_actor_msg_type_e;
+
+// called on the worker once the message is handled, takes ownership of result
+typedef void (*sn_actor_done_cb_t)(esp_err_t rc, cJSON *result, void *arg);
+
+typedef void (*sn_actor_fn_t)(sn_device_instance_t *inst, void *arg);
+
+// called on the worker after a message that may have changed the driver state
+typedef void (*sn_actor_observer_t)(sn_device_instance_t *inst);
+
+typedef struct {
+  sn_actor_msg_type_e type;
+  union {
+    struct {
+      cJSON *params;
+      bool owns_params; // delete params once handled
+    } control;
+    struct {
+      sn_actor_fn_t fn;
+      void *arg;
+    } call;
+    uint32_t interval_ms;
+  };
+  sn_actor_done_cb_t done; // optional
+  void *done_arg;
+} sn_actor_msg_t;
+
+/*
+ * @brief Create the mailbox of a bound instance
+ */
+esp_err_t sn_actor_mailbox_init(sn_device_instance_t *inst);
+
+/*
+ * @brief Start the shared worker pool (idempotent)
+ */
+esp_err_t sn_actor_pool_start(void);
+
+/*
+ * @brief Post a message to the instance's mailbox
+ * @return ESP_ERR_TIMEOUT if the mailbox stayed full for wait ticks. The caller keeps
+ * ownership of the message params in that case
+ */
+esp_err_t sn_actor_post(sn_device_instance_t *inst, const sn_actor_msg_t *msg, TickType_t wait);
+
+/*
+ * @brief Run driver->control on the instance's actor and wait for the result.
+ * Must not be called from an actor worker, post asynchronously there instead
+ */
+esp_err_t sn_actor_control(sn_device_instance_t *inst, const cJSON *params, cJSON **out_result);
+
+/*
+ * @brief Run driver->control on the instance's actor without waiting.
+ * params is consumed, done (optional) receives the result on the worker
+ */
+esp_err_t sn_actor_control_async(
+  sn_device_instance_t *inst, cJSON *params, sn_actor_done_cb_t done, void *done_arg
+);
+
+/*
+ * @brief Run fn serialized with every other access to the instance
+ */
+esp_err_t sn_actor_call(sn_device_instance_t *inst, sn_actor_fn_t fn, void *arg);
+
+/*
+ * @brief Run fn serialized with every other access to the instance and wait for it to
+ * return, so arg may live on the caller's stack. Must not be called from an actor worker
+ * @return ESP_ERR_TIMEOUT if the mailbox stayed full for SN_ACTOR_POST_TIMEOUT_MS, fn
+ * did not run in that case
+ */
+esp_err_t sn_actor_call_sync(sn_device_instance_t *inst, sn_actor_fn_t fn, void *arg);
+
+/*
+ * @brief Set the observer run after every control or call message handled by an
+ * instance whose driver implements report_state (one observer, NULL to remove)
+ */
+void sn_actor_set_state_observer(sn_actor_observer_t observer);
+
+/*
+ * @brief true if the calling task is one of the pool workers
+ */
+bool sn_actor_in_worker(void);
+
+#endif // !SN_ACTOR_H
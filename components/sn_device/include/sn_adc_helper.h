@@ -1,32 +1,51 @@
 // adc_helper.h
 #pragma once
 #include "esp_err.h"
-#include "driver/adc.h"
+#include "driver/adc_types_legacy.h"
+#include "hal/adc_types.h"
+#include "soc/gpio_num.h"
+#include <stdbool.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// Initialize helper (call once at startup)
+// Initialize helper (call once at startup). ADC1 is sampled by the continuous (DMA)
+// driver in the background, every configured channel is oversampled and low-pass
+// filtered into its latest value
 esp_err_t adc_helper_init(void);
 
-// Configure attenuation for a channel (optional; helper will set default if not)
+// Add a channel to the sampled pattern or change its attenuation, restarts the sampling
 esp_err_t adc_helper_config_channel_atten(adc1_channel_t ch, adc_atten_t atten);
 
-// Read raw ADC value from ADC1 channel (0..4095) or return negative on error
+// Latest filtered raw value of a configured channel (0..4095), does not block. Negative
+// if the channel is not configured or has no full oversampling window yet
 int adc_helper_read_raw(adc1_channel_t ch);
 
-// Read averaged raw ADC value (samples > 0)
-int adc_helper_read_raw_avg(adc1_channel_t ch, int samples);
+// Correction of the millivolts of a channel fitted against a reference meter, in fixed
+// point: mv' = offset + gain * mv + curve * mv^2
+typedef struct {
+  int32_t offset; // mV, Q16
+  int32_t gain;   // Q16, 65536 is 1.0
+  int32_t curve;  // per mV, Q32
+} adc_helper_fit_t;
 
-// Convert raw sample -> millivolts using esp_adc_cal characteristic
+// Convert raw sample -> millivolts with the calibration of the channel attenuation and
+// the fitted curve of the channel, if any
 uint32_t adc_helper_raw_to_mv(adc1_channel_t ch, int raw);
 
-// Convenience: read mv averaged
-esp_err_t adc_helper_read_mv_avg(adc1_channel_t ch, int samples, uint32_t *out_mv);
+// Store the fitted curve of a channel in NVS and apply it from the next conversion, NULL
+// removes it. Curves are loaded when their channel is configured
+esp_err_t adc_helper_set_fit(adc1_channel_t ch, const adc_helper_fit_t *fit);
 
-// Helper: map a GPIO pin to ADC1 channel (returns -1 if not supported)
+// false if the channel has no fitted curve
+bool adc_helper_get_fit(adc1_channel_t ch, adc_helper_fit_t *out);
+
+// Convenience: latest filtered value in mv, ESP_ERR_INVALID_STATE before the first one
+esp_err_t adc_helper_read_mv(adc1_channel_t ch, uint32_t *out_mv);
+
+// Helper: map a GPIO pin to ADC1 channel (returns ADC1_CHANNEL_MAX if not supported)
 adc1_channel_t adc_helper_pin_to_channel(gpio_num_t pin);
 
 #ifdef __cplusplus
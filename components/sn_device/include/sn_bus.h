@@ -0,0 +1,91 @@
+// --------------------------------------------------------------------------------
+// sn_bus.h
+//
+// description: shared i2c/spi buses. The bus of a port is created from its usage the
+// first time a port on it is bound and handed to the driver in its instance. Drivers
+// never lock a bus, they submit transactions to the bus worker, which runs them by
+// priority, several back to back per wake up, and accounts the time the bus was busy
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_BUS_H
+#define SN_BUS_H
+
+#include "cJSON.h"
+#include "driver/i2c_master.h"
+#include "driver/spi_master.h"
+#include "esp_err.h"
+#include "forward.h"
+#include "sn_driver/port_desc.h"
+#include <stdint.h>
+
+// i2c controllers plus spi hosts
+#define SN_BUS_MAX                  4
+#define SN_BUS_QUEUE_LEN            8 // per priority
+// transactions run before the worker yields to other tasks of its priority
+#define SN_BUS_BATCH                4
+#define SN_BUS_WORKER_STACK         3072
+#define SN_BUS_WORKER_PRIORITY      6 // above the actors, transactions are short and waited on
+#define SN_BUS_POST_TIMEOUT_MS      100
+#define SN_BUS_I2C_PROBE_TIMEOUT_MS 50
+
+typedef enum {
+  SN_BUS_PRIO_LOW = 0, // bulk transfers that can wait (display flushes)
+  SN_BUS_PRIO_NORMAL,
+  SN_BUS_PRIO_HIGH, // sensor reads with a deadline
+  SN_BUS_PRIO_MAX
+} sn_bus_prio_e;
+
+// runs on the bus worker, the only code touching the bus at that time
+typedef esp_err_t (*sn_bus_fn_t)(sn_bus_t *bus, void *arg);
+
+// called on the bus worker once the transaction ran
+typedef void (*sn_bus_done_cb_t)(esp_err_t rc, void *arg);
+
+/*
+ * @brief Create the lock of the bus table (idempotent), before the first bind
+ */
+esp_err_t sn_bus_init(void);
+
+/*
+ * @brief Bus of an i2c or spi port, created with its worker on first use. i2c ports
+ * with the same sda/scl share a controller, spi ports with the same host share it.
+ * Ports on gpio or virtual get NULL and ESP_OK
+ */
+esp_err_t sn_bus_acquire(const sn_device_port_desc_t *port, sn_bus_t **out);
+
+/*
+ * @brief Underlying handles, only to be used from inside a transaction (or to attach
+ * devices like a panel io before the first one)
+ */
+i2c_master_bus_handle_t sn_bus_i2c_handle(const sn_bus_t *bus);
+spi_host_device_t sn_bus_spi_host(const sn_bus_t *bus);
+
+/*
+ * @brief Run fn on the bus and wait for its result. Runs inline when called from a
+ * transaction of the same bus
+ */
+esp_err_t sn_bus_submit(sn_bus_t *bus, sn_bus_prio_e prio, sn_bus_fn_t fn, void *arg);
+
+/*
+ * @brief Queue fn without waiting, done (optional) receives its result on the worker
+ * @return ESP_ERR_TIMEOUT if the queue of prio stayed full, fn will not run
+ */
+esp_err_t sn_bus_submit_async(
+  sn_bus_t *bus, sn_bus_prio_e prio, sn_bus_fn_t fn, void *arg, sn_bus_done_cb_t done,
+  void *done_arg
+);
+
+/*
+ * @brief ESP_OK if a device acks addr on the i2c bus
+ */
+esp_err_t sn_bus_i2c_probe(sn_bus_t *bus, uint16_t addr);
+
+/*
+ * @brief Utilization of every bus since the previous call, util in per-mille:
+ * { "i2c0": {"util": 41, "txn": 52, "wakeups": 17, "hwm": 3, "waitMax": 1830}, ... }
+ * waitMax (us) and hwm (queued transactions) are since boot
+ */
+cJSON *sn_bus_stats_to_json(void);
+
+#endif // !SN_BUS_H
@@ -5,6 +5,7 @@
 #include "esp_chip_info.h"
 #include "esp_err.h"
 #include "esp_mac.h"
+#include "sn_driver/driver_inst.h"
 #include "sn_driver/port_desc.h"
 #include "sn_json.h"
 #include <stdint.h>
@@ -63,6 +64,27 @@ cJSON *device_ports_to_capabilities_json();
 
 int dispatch_command(const char *payload_json, cJSON **out_result);
 
+// same as dispatch_command but for an already parsed command object (not consumed)
+int sn_dispatch_command_json(const cJSON *root, cJSON **out_result);
+
+/*
+ * @brief Resolve the instance targeted by a command object and check that it can run
+ * the action. Does not look at params
+ * @param out_params - borrowed from root (may be NULL if the command has none)
+ * @return ESP_OK or the negative code dispatch would return, with an error result
+ */
+int sn_resolve_command_json(
+  const cJSON *root, sn_device_instance_t **out_inst, const cJSON **out_params, cJSON **out_result
+);
+
+/*
+ * @brief sn_resolve_command_json plus a check of params against the command schema.
+ * Nothing is executed
+ */
+int sn_validate_command_json(
+  const cJSON *root, sn_device_instance_t **out_inst, cJSON **out_result
+);
+
 int sn_dispatch_command_struct(const sn_command_t *command, cJSON **out_result);
 
 #endif // !SN_CAPABILITY_H
@@ -7,9 +7,14 @@
 #include "sn_driver/driver_type.h" // IWYU pragma: export
 #include "sn_driver/port_desc.h"   // IWYU pragma: export
 #include "sn_driver/sensor.h"      // IWYU pragma: export
+#include "sdkconfig.h"
 #include <string.h>
 
+#ifdef CONFIG_SN_MAX_INSTANCES
+#define MAX_INSTANCES CONFIG_SN_MAX_INSTANCES
+#else
 #define MAX_INSTANCES 16
+#endif
 
 /* --------------------------------------------------------------------
  *  Global registry definition (declared in a .c file)
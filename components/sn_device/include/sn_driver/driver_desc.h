@@ -19,6 +19,12 @@ typedef struct {
   void (*deinit)(void *ctx);
   read_multi_fn_t read_multi; // NULL if actuator-only
   control_fn_t control;       // NULL if sensor-only
+  // optional: current actuator state as an object whose keys mirror the control params,
+  // called on the instance's actor (see sn_shadow.h)
+  cJSON *(*report_state)(void *ctx);
+  // optional: calibration of a sensor, reported with its capabilities, called on the
+  // instance's actor like control
+  cJSON *(*report_calibration)(void *ctx);
 } sn_driver_desc_t;
 
 #endif // !SN_DRIVER_DESC_H
@@ -6,6 +6,7 @@
 #include "sn_driver/port_desc.h"
 
 #include "freertos/idf_additions.h"
+#include <stddef.h>
 #include <stdint.h>
 
 typedef enum { CTX_NONE = 0, CTX_GENERIC } ctx_tag_e;
@@ -25,20 +26,34 @@ typedef struct {
   sn_driver_ctx_u              ctx;
   const sn_device_port_desc_t *port;
   const sn_driver_desc_t      *driver;
-  SemaphoreHandle_t            bus_lock; // optional per-instance bus lock pointer if needed
+  sn_bus_t                    *bus;     // shared i2c/spi bus of the port (see sn_bus.h)
+  QueueHandle_t                mailbox;  // actor mailbox (see sn_actor.h)
   uint64_t                     last_read_ms;
-  uint32_t                     interval_ms;
+  uint32_t                     interval_ms; // written by the actor only, read atomically
+  uint32_t                     mailbox_scheduled;
   ctx_tag_e                    ctx_tag;
   int                          consecutive_failures;
+  uint64_t                     next_recovery_ms;  // see sn_recovery.h
+  uint32_t                     recovery_pending;  // attempt posted to the actor
+  uint16_t                     recovery_attempts; // failed since the port went offline
+  uint8_t                      health;            // 0..100 from the recent reads
   bool                         online;
 } sn_device_instance_t;
 //clang-format on
 
-static inline esp_err_t sn_device_instance_set_interval(sn_device_instance_t*inst, uint64_t new_interval) {
-  if (!inst->online) return ESP_FAIL;
-  if (new_interval <= 0) return ESP_ERR_INVALID_ARG;
-  inst->interval_ms = new_interval;
-  return ESP_OK;
+// The driver ctx lives inline in the instance, so drivers can find their instance back
+static inline sn_device_instance_t *sn_device_instance_from_ctx(void *ctx) {
+  return (sn_device_instance_t *)((uint8_t *)ctx - offsetof(sn_device_instance_t, ctx));
 }
 
+/*
+ * @brief Request a new sample interval, applied asynchronously by the instance's actor
+ */
+esp_err_t sn_device_instance_set_interval(sn_device_instance_t *inst, uint32_t new_interval);
+
+/*
+ * @brief Current sample interval (safe to call from any task)
+ */
+uint32_t sn_device_instance_get_interval(const sn_device_instance_t *inst);
+
 #endif // !SN_DRIVER_INSTANCE_H
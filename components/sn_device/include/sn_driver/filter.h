@@ -0,0 +1,109 @@
+// --------------------------------------------------------------------------------
+// filter.h
+//
+// description: signal conditioning of a measurement. A chain is a const list of stages
+// (median spike rejection, ema, 1-d kalman, range clamp) with a fixed-size state per
+// stage, declared next to its measurement map entry in device_port_specs.c. The poll
+// task runs the chain on every reading of the measurement after read_multi
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_FILTER_H
+#define SN_FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// widest median window, the window is sorted on the stack on every sample
+#define SN_FILTER_MEDIAN_MAX 9
+
+#define SN_FILTER_KINDS(X)                                                                         \
+  X(MEDIAN)                                                                                        \
+  X(EMA)                                                                                           \
+  X(KALMAN)                                                                                        \
+  X(CLAMP)
+
+typedef enum {
+#define GEN_FILTER_ENUM(NAME) SN_FILTER_##NAME,
+  SN_FILTER_KINDS(GEN_FILTER_ENUM)
+#undef GEN_FILTER_ENUM
+} sn_filter_kind_e;
+
+typedef struct {
+  sn_filter_kind_e kind;
+  union {
+    struct {
+      uint8_t n; // window, 1..SN_FILTER_MEDIAN_MAX
+    } median;
+    struct {
+      float alpha; // weight of the new sample, 0..1
+    } ema;
+    struct {
+      float q; // process noise variance, how fast the true value drifts per sample
+      float r; // measurement noise variance of the sensor
+    } kalman;
+    struct {
+      float min;
+      float max;
+    } clamp;
+  };
+} sn_filter_stage_t;
+
+typedef struct {
+  bool primed; // false until the first sample, which seeds the stage
+  union {
+    struct {
+      float window[SN_FILTER_MEDIAN_MAX];
+      uint8_t len;
+      uint8_t head;
+    } median;
+    struct {
+      float y;
+    } ema;
+    struct {
+      float x; // estimate
+      float p; // estimate variance
+    } kalman;
+  };
+} sn_filter_state_t;
+
+typedef struct {
+  const sn_filter_stage_t *stages;
+  sn_filter_state_t *state; // one per stage
+  uint8_t len;
+} sn_filter_chain_t;
+
+/* --------------------------------------------------------------------
+ *  Creation helpers
+ * ------------------------------------------------------------------*/
+
+#define SN_FILTER_MEDIAN(N)    {.kind = SN_FILTER_MEDIAN, .median = {.n = (N)}}
+#define SN_FILTER_EMA(ALPHA)   {.kind = SN_FILTER_EMA, .ema = {.alpha = (ALPHA)}}
+#define SN_FILTER_KALMAN(Q, R) {.kind = SN_FILTER_KALMAN, .kalman = {.q = (Q), .r = (R)}}
+#define SN_FILTER_CLAMP(MIN, MAX)                                                                  \
+  {.kind = SN_FILTER_CLAMP, .clamp = {.min = (MIN), .max = (MAX)}}
+
+// Define a chain and its state, stages run in the given order. A chain keeps the
+// history of one signal, it cannot be shared between measurements
+#define SN_FILTER_CHAIN(NAME, ...)                                                                 \
+  static const sn_filter_stage_t NAME##_stages[] = {__VA_ARGS__};                                  \
+  static sn_filter_state_t NAME##_state[sizeof(NAME##_stages) / sizeof(NAME##_stages[0])];         \
+  static sn_filter_chain_t NAME = {                                                                \
+    .stages = NAME##_stages,                                                                       \
+    .state = NAME##_state,                                                                         \
+    .len = sizeof(NAME##_stages) / sizeof(NAME##_stages[0]),                                       \
+  }
+
+/*
+ * @brief Run a sample through the chain and return the conditioned value. Not thread
+ * safe, a chain is only fed by the task that reads its port
+ */
+float sn_filter_chain_apply(sn_filter_chain_t *chain, float value);
+
+/*
+ * @brief Forget the history, the next sample seeds every stage again
+ */
+void sn_filter_chain_reset(sn_filter_chain_t *chain);
+
+#endif // !SN_FILTER_H
@@ -16,13 +16,20 @@ typedef enum {
 typedef enum {
   PUT_GPIO = 0,
   PUT_I2C,
-  PUT_SPI
+  PUT_SPI,
+  PUT_VIRTUAL // no hardware, see sn_virtual_driver.c
 } sn_port_usage_type_e;
 
 typedef union {
   struct { gpio_num_t pin; } gpio;
   struct { int addr; gpio_num_t sda; gpio_num_t scl; } i2c;
-  struct { int host; gpio_num_t cs; } spi;
+  struct { int host; gpio_num_t cs; gpio_num_t sclk; gpio_num_t mosi; gpio_num_t miso; } spi;
+  // base + amplitude * sin(2pi t / period_ms) + uniform noise in [-noise, noise]
+  struct {
+    float base; float amplitude; float noise;
+    uint32_t period_ms;
+    uint16_t fail_permille; // failed reads per 1000
+  } virt;
 } sn_port_usage_u;
 // clang-format on
 
@@ -4,6 +4,7 @@
 #include "esp_err.h"
 #include "esp_log.h"
 #include "forward.h"
+#include "sn_driver/filter.h"
 #include <time.h>
 
 #define SENSOR_TYPE(X)                                                                             \
@@ -39,9 +40,12 @@ typedef struct {
   const char *unit;   // "C", "%"
   sensor_type_e type; // measurement type: TEMPERATURE etc
   local_id_t local_id;
+  sn_filter_chain_t *filter; // optional conditioning of the readings (filter.h)
 } sn_port_measurement_map_t;
 
-// read_multi: fill measurements into out_buf (max_out entries), set out_count
+// read_multi: fill measurements into out_buf (max_out entries), set out_count. A driver
+// that acquires in the background returns ESP_ERR_NOT_FINISHED while the values are not
+// ready yet, the caller reads again later without counting a failure
 typedef esp_err_t (*read_multi_fn_t)(
   void *ctx, sn_sensor_reading_t *outBuf, int maxOut, int *outCount
 );
@@ -52,6 +56,9 @@ typedef esp_err_t (*read_multi_fn_t)(
 
 #define MEASUREMENT_MAP_ENTRY(ID, TYPE, UNIT) {.unit = UNIT, .type = TYPE, .local_id = ID}
 
+#define MEASUREMENT_MAP_ENTRY_FILTERED(ID, TYPE, UNIT, CHAIN)                                      \
+  {.unit = UNIT, .type = TYPE, .local_id = ID, .filter = &(CHAIN)}
+
 #define MEASUREMENT_MAP_ENTRY_NULL() {.unit = NULL, .type = 0, .local_id = 0}
 
 /* --------------------------------------------------------------------
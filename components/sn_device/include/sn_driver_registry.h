@@ -11,7 +11,11 @@
   X(soil_moisture)                                                                                 \
   X(light_intensity)                                                                               \
   X(screen_i2c)                                                                                    \
-  X(sensor_control)
+  X(sensor_control)                                                                                \
+  X(state)                                                                                         \
+  X(metrics)                                                                                       \
+  X(profile)                                                                                       \
+  X(virtual)
 
 #define FORWARD_DECLARE_CTX_DRIVER_EXTERN(DRV_NAME)                                                \
   struct DRV_NAME##_ctx_s;                                                                         \
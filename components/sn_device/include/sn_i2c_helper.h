@@ -1,6 +0,0 @@
-#ifndef SN_I2C_HELPER_H
-#define SN_I2C_HELPER_H
-
-void sn_i2c_helper_find_master_bus_handle();
-
-#endif // !SN_I2C_HELPER_H
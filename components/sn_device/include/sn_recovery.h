@@ -0,0 +1,56 @@
+// --------------------------------------------------------------------------------
+// sn_recovery.h
+//
+// description: brings offline instances back. The poll task records every read in a
+// per-instance health score and takes a port offline after a run of failures, the
+// recovery then re-probes and re-inits the port on its actor with exponential backoff
+// so the poll schedule never waits on a dead device
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_RECOVERY_H
+#define SN_RECOVERY_H
+
+#include "esp_err.h"
+#include "sn_device_event.h"
+#include "sn_driver/driver_inst.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// consecutive failed reads that take a port offline
+#define SN_RECOVERY_FAIL_THRESHOLD 3
+// delay before the first attempt, doubled after every failed one up to the max
+#define SN_RECOVERY_BACKOFF_MIN_MS 2000
+#define SN_RECOVERY_BACKOFF_MAX_MS (5 * 60 * 1000)
+
+typedef esp_err_t (*sn_recovery_event_cb_t)(const sn_device_event_t *event);
+
+/*
+ * @brief Set the handler of the PORT_OFFLINE and PORT_ONLINE events (one handler,
+ * NULL to remove). Called from the poll task and from the actor workers
+ */
+void sn_recovery_set_event_handler(sn_recovery_event_cb_t cb);
+
+/*
+ * @brief Account a read of an online instance, updates its health and takes it offline
+ * after SN_RECOVERY_FAIL_THRESHOLD failures in a row. Poll task only
+ */
+void sn_recovery_record_read(sn_device_instance_t *inst, bool ok);
+
+/*
+ * @brief Take an instance offline and schedule its first recovery attempt
+ */
+void sn_recovery_mark_offline(sn_device_instance_t *inst);
+
+/*
+ * @brief Post the recovery attempts that are due to the actors of their instances.
+ * Never waits, an attempt that finds the mailbox full is retried on the next call
+ */
+void sn_recovery_poll(uint64_t now_ms);
+
+/*
+ * @brief Health of every bound port: { "soil": 100, "dht22": 42, ... }
+ */
+cJSON *sn_recovery_health_to_json(void);
+
+#endif // !SN_RECOVERY_H
@@ -1,12 +1,54 @@
 #ifndef SN_RULE_ENGINE_H
 #define SN_RULE_ENGINE_H
 
+#include "esp_err.h"
+#include "sn_driver/sensor.h"
 #include "sn_rules/sn_rule_desc.h"
 #include <stddef.h>
 
 extern const sn_rule_desc_t gRules[];
 extern const size_t gRulesLen;
 
+typedef enum {
+  RS_NORMAL,
+  RS_HIGH,
+  RS_LOW,
+} sn_rule_state_e;
+
+// band of the value, bounds are inclusive to the normal state
+static inline sn_rule_state_e sn_rule_eval_band(double low, double high, double value) {
+  if (value < low) return RS_LOW;
+  if (value > high) return RS_HIGH;
+  return RS_NORMAL;
+}
+
+static inline sn_rule_state_e sn_rule_eval_state(const sn_rule_desc_t *d, double value) {
+  return sn_rule_eval_band(d->low, d->high, value);
+}
+
+/*
+ * @brief Validate gRules and reset every rule to the normal state
+ */
+esp_err_t sn_rule_engine_init(void);
+
+/*
+ * @brief Evaluate the rules of the reading's source and dispatch the commands of their
+ * transitions, on the caller's task. rule_engine_task calls it for every reading
+ */
+void sn_rule_engine_process(const sn_sensor_reading_t *reading);
+
+/*
+ * @brief Replace the thresholds of a rule until the next sn_rule_engine_init
+ * @return ESP_ERR_NOT_FOUND if no valid rule has the id
+ */
+esp_err_t sn_rule_engine_set_band(local_id_t rule_id, double low, double high);
+
+/*
+ * @brief Put a rule in a state without running any command, to resume from a known
+ * state (a replay starting mid log)
+ */
+esp_err_t sn_rule_engine_set_state(local_id_t rule_id, sn_rule_state_e state);
+
 void rule_engine_task(void *pvParams);
 
 #endif // !SN_RULE_ENGINE_H
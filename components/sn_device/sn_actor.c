@@ -0,0 +1,208 @@
+#include "sn_actor.h"
+#include "cJSON.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "sn_driver.h"
+#include "freertos/idf_additions.h"
+#include "freertos/projdefs.h"
+
+static const char *TAG = "SN_ACTOR";
+
+// Instances with pending messages. Each instance is queued at most once (guarded by
+// mailbox_scheduled) so the run queue can never overflow
+static QueueHandle_t s_runq = NULL;
+static TaskHandle_t s_workers[SN_ACTOR_WORKER_COUNT];
+static sn_actor_observer_t s_state_observer = NULL;
+
+typedef struct {
+  TaskHandle_t waiter;
+  esp_err_t rc;
+  cJSON *result;
+} sync_call_t;
+
+static void schedule(sn_device_instance_t *inst) {
+  // only the caller flipping the flag 0 -> 1 pushes the instance
+  if (__atomic_exchange_n(&inst->mailbox_scheduled, 1, __ATOMIC_ACQ_REL) == 0) {
+    xQueueSend(s_runq, &inst, portMAX_DELAY);
+  }
+}
+
+static void handle_msg(sn_device_instance_t *inst, sn_actor_msg_t *msg) {
+  esp_err_t rc = ESP_OK;
+  cJSON *result = NULL;
+
+  switch (msg->type) {
+    case SN_ACTOR_MSG_CONTROL:
+      if (inst->driver && inst->driver->control) {
+        rc = inst->driver->control((void *)&inst->ctx, msg->control.params, &result);
+      } else {
+        rc = ESP_ERR_NOT_SUPPORTED;
+      }
+      if (msg->control.owns_params) cJSON_Delete(msg->control.params);
+      break;
+    case SN_ACTOR_MSG_SET_INTERVAL:
+      __atomic_store_n(&inst->interval_ms, msg->interval_ms, __ATOMIC_RELAXED);
+      break;
+    case SN_ACTOR_MSG_CALL:
+      if (msg->call.fn) msg->call.fn(inst, msg->call.arg);
+      break;
+  }
+
+  // interval changes don't touch the driver state
+  if (msg->type != SN_ACTOR_MSG_SET_INTERVAL && s_state_observer && inst->driver
+      && inst->driver->report_state) {
+    s_state_observer(inst);
+  }
+
+  if (msg->done) {
+    msg->done(rc, result, msg->done_arg);
+  } else if (result) {
+    cJSON_Delete(result);
+  }
+}
+
+static void worker_task(void *pvParams) {
+  sn_device_instance_t *inst = NULL;
+  sn_actor_msg_t msg;
+
+  for (;;) {
+    if (xQueueReceive(s_runq, &inst, portMAX_DELAY) != pdTRUE) continue;
+
+    for (int n = 0; n < SN_ACTOR_BATCH && xQueueReceive(inst->mailbox, &msg, 0) == pdTRUE; n++) {
+      handle_msg(inst, &msg);
+    }
+
+    __atomic_store_n(&inst->mailbox_scheduled, 0, __ATOMIC_RELEASE);
+    // messages posted after the last receive (or left over by the batch limit) would be
+    // stranded since their poster saw the flag still set
+    if (uxQueueMessagesWaiting(inst->mailbox) > 0) schedule(inst);
+  }
+}
+
+static void on_sync_done(esp_err_t rc, cJSON *result, void *arg) {
+  sync_call_t *call = (sync_call_t *)arg;
+  call->rc = rc;
+  call->result = result;
+  xTaskNotifyGive(call->waiter);
+}
+
+// --------------------------------------------------------------------------------
+// API
+// --------------------------------------------------------------------------------
+
+esp_err_t sn_actor_mailbox_init(sn_device_instance_t *inst) {
+  if (!inst) return ESP_ERR_INVALID_ARG;
+  if (inst->mailbox) return ESP_OK;
+  inst->mailbox = xQueueCreate(SN_ACTOR_MAILBOX_LEN, sizeof(sn_actor_msg_t));
+  inst->mailbox_scheduled = 0;
+  return inst->mailbox ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t sn_actor_pool_start(void) {
+  if (s_runq) return ESP_OK;
+
+  s_runq = xQueueCreate(MAX_INSTANCES, sizeof(sn_device_instance_t *));
+  if (!s_runq) return ESP_ERR_NO_MEM;
+
+  for (int i = 0; i < SN_ACTOR_WORKER_COUNT; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "actor_wk%d", i);
+    if (xTaskCreate(
+          worker_task, name, SN_ACTOR_WORKER_STACK_SIZE, NULL, SN_ACTOR_WORKER_PRIORITY,
+          &s_workers[i]
+        )
+        != pdPASS) {
+      ESP_LOGE(TAG, "Failed to create %s", name);
+      return ESP_ERR_NO_MEM;
+    }
+  }
+
+  ESP_LOGI(TAG, "Actor pool started (%d workers)", SN_ACTOR_WORKER_COUNT);
+  return ESP_OK;
+}
+
+esp_err_t sn_actor_post(sn_device_instance_t *inst, const sn_actor_msg_t *msg, TickType_t wait) {
+  if (!inst || !msg) return ESP_ERR_INVALID_ARG;
+  if (!inst->mailbox || !s_runq) return ESP_ERR_INVALID_STATE;
+
+  if (xQueueSend(inst->mailbox, msg, wait) != pdTRUE) {
+    ESP_LOGW(TAG, "Mailbox of %s is full", inst->port->port_name);
+    return ESP_ERR_TIMEOUT;
+  }
+  schedule(inst);
+  return ESP_OK;
+}
+
+esp_err_t sn_actor_control(sn_device_instance_t *inst, const cJSON *params, cJSON **out_result) {
+  // a worker blocking on another actor could starve the pool
+  if (sn_actor_in_worker()) return ESP_ERR_INVALID_STATE;
+
+  sync_call_t call = {.waiter = xTaskGetCurrentTaskHandle(), .rc = ESP_OK, .result = NULL};
+  sn_actor_msg_t msg = {
+    .type = SN_ACTOR_MSG_CONTROL,
+    .control = {.params = (cJSON *)params, .owns_params = false},
+    .done = on_sync_done,
+    .done_arg = &call,
+  };
+
+  esp_err_t err = sn_actor_post(inst, &msg, pdMS_TO_TICKS(SN_ACTOR_POST_TIMEOUT_MS));
+  if (err != ESP_OK) return err;
+
+  // the message references this stack frame so wait for it unconditionally
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  if (out_result) {
+    *out_result = call.result;
+  } else if (call.result) {
+    cJSON_Delete(call.result);
+  }
+  return call.rc;
+}
+
+esp_err_t sn_actor_control_async(
+  sn_device_instance_t *inst, cJSON *params, sn_actor_done_cb_t done, void *done_arg
+) {
+  sn_actor_msg_t msg = {
+    .type = SN_ACTOR_MSG_CONTROL,
+    .control = {.params = params, .owns_params = true},
+    .done = done,
+    .done_arg = done_arg,
+  };
+  esp_err_t err = sn_actor_post(inst, &msg, pdMS_TO_TICKS(SN_ACTOR_POST_TIMEOUT_MS));
+  if (err != ESP_OK) cJSON_Delete(params);
+  return err;
+}
+
+esp_err_t sn_actor_call(sn_device_instance_t *inst, sn_actor_fn_t fn, void *arg) {
+  sn_actor_msg_t msg = {.type = SN_ACTOR_MSG_CALL, .call = {.fn = fn, .arg = arg}};
+  return sn_actor_post(inst, &msg, pdMS_TO_TICKS(SN_ACTOR_POST_TIMEOUT_MS));
+}
+
+esp_err_t sn_actor_call_sync(sn_device_instance_t *inst, sn_actor_fn_t fn, void *arg) {
+  if (sn_actor_in_worker()) return ESP_ERR_INVALID_STATE;
+
+  sync_call_t call = {.waiter = xTaskGetCurrentTaskHandle(), .rc = ESP_OK, .result = NULL};
+  sn_actor_msg_t msg = {
+    .type = SN_ACTOR_MSG_CALL,
+    .call = {.fn = fn, .arg = arg},
+    .done = on_sync_done,
+    .done_arg = &call,
+  };
+
+  esp_err_t err = sn_actor_post(inst, &msg, pdMS_TO_TICKS(SN_ACTOR_POST_TIMEOUT_MS));
+  if (err != ESP_OK) return err;
+
+  // arg may live on the caller's stack, wait for fn to return unconditionally
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  return call.rc;
+}
+
+void sn_actor_set_state_observer(sn_actor_observer_t observer) { s_state_observer = observer; }
+
+bool sn_actor_in_worker(void) {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  for (int i = 0; i < SN_ACTOR_WORKER_COUNT; i++) {
+    if (s_workers[i] == self) return true;
+  }
+  return false;
+}
@@ -1,30 +1,193 @@
 #include "sn_adc_helper.h"
-#include "driver/adc_types_legacy.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_attr.h"
 #include "esp_log.h"
-#include "esp_adc_cal.h"
-#include "driver/adc.h"
 #include "freertos/FreeRTOS.h"
-#include <stdlib.h>
+#include "freertos/task.h"
+#include "nvs.h"
+#include "sn_storage.h"
+#include <stdio.h>
 
 static const char *TAG = "ADC_HELPER";
 
+#define ADC_FRAME_BYTES 256  // one dma frame, 128 conversions
+#define ADC_POOL_BYTES  1024 // frames kept while the task is late
+#define ADC_Q           4    // fractional bits of the filtered values
+#define ADC_ATTENS      4
+
+typedef struct {
+  bool enabled;
+  adc_atten_t atten;
+  uint32_t sum; // current oversampling window
+  uint32_t n;
+  int32_t iir;    // Q4 raw
+  int32_t latest; // Q4 raw, -1 until the first window, read without the mutex
+  adc_cali_handle_t cali;
+  bool fit_loaded;
+  bool has_fit;
+  adc_helper_fit_t fit;
+} adc_channel_state_t;
+
 static SemaphoreHandle_t s_adc_mutex = NULL;
+static adc_continuous_handle_t s_handle = NULL;
+static TaskHandle_t s_task = NULL;
+static bool s_running = false;
+static adc_channel_state_t s_channels[ADC1_CHANNEL_MAX];
+static portMUX_TYPE s_fit_lock = portMUX_INITIALIZER_UNLOCKED;
 
-// We keep characteristics per attenuation (0/2.5/6/11 dB)
-static esp_adc_cal_characteristics_t *s_chars = NULL;
-static bool s_chars_ready = false;
+// Calibration handles per attenuation (0/2.5/6/12 dB), created for the attenuations
+// in use when their first channel is configured
+static adc_cali_handle_t s_cali[ADC_ATTENS];
+static bool s_cali_tried[ADC_ATTENS];
 
-// default global width & default attenuation
-static const adc_bits_width_t DEFAULT_WIDTH = ADC_WIDTH_BIT_12;
+// default attenuation
 static const adc_atten_t DEFAULT_ATTEN = ADC_ATTEN_DB_12;
 static const uint32_t DEFAULT_VREF = 1100; // mV (used if no eFuse Vref)
 
-static inline int atten_index(adc_atten_t a) {
-  // ADC_ATTEN_DB_0 = 0, DB_2_5 =1, DB_6=2, DB_11=3
-  return (int)a;
+// Full scale of each attenuation in mV, when the chip has no calibration
+static const uint32_t NOMINAL_FULL_SCALE_MV[ADC_ATTENS] = {950, 1250, 1750, 3100};
+
+// --------------------------------------------------------------------------------
+// Calibration
+// --------------------------------------------------------------------------------
+
+// caller holds the mutex
+static adc_cali_handle_t cali_for(adc_atten_t atten) {
+  if (atten >= ADC_ATTENS) return NULL;
+  if (!s_cali_tried[atten]) {
+    s_cali_tried[atten] = true;
+    adc_cali_line_fitting_config_t cfg = {
+      .unit_id = ADC_UNIT_1,
+      .atten = atten,
+      .bitwidth = ADC_BITWIDTH_12,
+      .default_vref = DEFAULT_VREF,
+    };
+    esp_err_t err = adc_cali_create_scheme_line_fitting(&cfg, &s_cali[atten]);
+    if (err != ESP_OK) {
+      s_cali[atten] = NULL;
+      ESP_LOGW(TAG, "No calibration for atten=%d: %s", atten, esp_err_to_name(err));
+    }
+  }
+  return s_cali[atten];
 }
 
+static void fit_key(adc1_channel_t ch, char key[16]) { snprintf(key, 16, "adc_fit_%d", ch); }
+
+// caller holds the mutex
+static void load_fit(adc1_channel_t ch) {
+  adc_channel_state_t *c = &s_channels[ch];
+  if (c->fit_loaded) return;
+  c->fit_loaded = true;
+
+  char key[16];
+  fit_key(ch, key);
+  adc_helper_fit_t fit;
+  size_t len = sizeof(fit);
+  if (sn_storage_get_blob(key, &fit, &len) != ESP_OK || len != sizeof(fit)) return;
+  taskENTER_CRITICAL(&s_fit_lock);
+  c->fit = fit;
+  c->has_fit = true;
+  taskEXIT_CRITICAL(&s_fit_lock);
+  ESP_LOGI(TAG, "ch%d: fitted curve loaded", ch);
+}
+
+// mv' = offset + gain * mv + curve * mv^2 in Q16
+static int32_t apply_fit(const adc_helper_fit_t *fit, int32_t mv) {
+  int64_t x = mv;
+  int64_t y = (int64_t)fit->offset + (int64_t)fit->gain * x;
+  y += ((int64_t)fit->curve * x * x) >> 16;
+  return (int32_t)((y + (1 << 15)) >> 16);
+}
+
+// --------------------------------------------------------------------------------
+// Sampling
+// --------------------------------------------------------------------------------
+
+static bool IRAM_ATTR on_conv_done(
+  adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *user_data
+) {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(s_task, &woken);
+  return woken == pdTRUE;
+}
+
+// Decimate by the oversampling ratio, the mean keeps ADC_Q more bits, then a first
+// order low-pass: y += (x - y) / 2^shift
+static void accumulate(uint32_t ch, uint32_t raw) {
+  if (ch >= ADC1_CHANNEL_MAX || !s_channels[ch].enabled) return;
+  adc_channel_state_t *c = &s_channels[ch];
+  c->sum += raw;
+  if (++c->n < CONFIG_SN_ADC_OVERSAMPLE) return;
+
+  int32_t mean = (int32_t)(((uint64_t)c->sum << ADC_Q) / c->n);
+  c->sum = 0;
+  c->n = 0;
+  if (c->latest < 0) {
+    c->iir = mean;
+  } else {
+    c->iir += (mean - c->iir) >> CONFIG_SN_ADC_IIR_SHIFT;
+  }
+  __atomic_store_n(&c->latest, c->iir, __ATOMIC_RELAXED);
+}
+
+static void adc_task(void *arg) {
+  static uint8_t frame[ADC_FRAME_BYTES];
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    xSemaphoreTake(s_adc_mutex, portMAX_DELAY);
+    uint32_t len = 0;
+    while (s_running && adc_continuous_read(s_handle, frame, sizeof(frame), &len, 0) == ESP_OK) {
+      // esp32 frames are 16 bit conversions tagged with their channel
+      for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        const adc_digi_output_data_t *p = (const adc_digi_output_data_t *)&frame[i];
+        accumulate(p->type1.channel, p->type1.data);
+      }
+    }
+    xSemaphoreGive(s_adc_mutex);
+  }
+}
+
+// The pattern can only change while the driver is stopped, caller holds the mutex
+static esp_err_t restart_locked(void) {
+  if (s_running) {
+    adc_continuous_stop(s_handle);
+    s_running = false;
+  }
+
+  adc_digi_pattern_config_t pattern[ADC1_CHANNEL_MAX] = {0};
+  uint32_t len = 0;
+  for (int ch = 0; ch < ADC1_CHANNEL_MAX; ++ch) {
+    if (!s_channels[ch].enabled) continue;
+    pattern[len++] = (adc_digi_pattern_config_t){
+      .atten = s_channels[ch].atten,
+      .channel = ch,
+      .unit = ADC_UNIT_1,
+      .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+    };
+  }
+  if (!len) return ESP_OK;
+
+  adc_continuous_config_t cfg = {
+    .pattern_num = len,
+    .adc_pattern = pattern,
+    .sample_freq_hz = CONFIG_SN_ADC_SAMPLE_HZ,
+    .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+    .format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+  };
+  esp_err_t err = adc_continuous_config(s_handle, &cfg);
+  if (err == ESP_OK) err = adc_continuous_start(s_handle);
+  s_running = err == ESP_OK;
+  return err;
+}
+
+// --------------------------------------------------------------------------------
+// API
+// --------------------------------------------------------------------------------
+
 esp_err_t adc_helper_init(void) {
+  if (s_task) return ESP_OK;
   if (s_adc_mutex == NULL) {
     s_adc_mutex = xSemaphoreCreateMutex();
     if (!s_adc_mutex) {
@@ -33,73 +196,120 @@ esp_err_t adc_helper_init(void) {
     }
   }
 
-  // set ADC1 global width
-  adc1_config_width(DEFAULT_WIDTH);
-
-  // allocate characteristics for 4 attenuation levels
-  if (!s_chars) {
-    s_chars = calloc(4, sizeof(esp_adc_cal_characteristics_t));
-    if (!s_chars) return ESP_ERR_NO_MEM;
+  if (!s_handle) {
+    adc_continuous_handle_cfg_t handle_cfg = {
+      .max_store_buf_size = ADC_POOL_BYTES,
+      .conv_frame_size = ADC_FRAME_BYTES,
+    };
+    esp_err_t err = adc_continuous_new_handle(&handle_cfg, &s_handle);
+    if (err != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to create the continuous driver: %s", esp_err_to_name(err));
+      return err;
+    }
+    adc_continuous_evt_cbs_t cbs = {.on_conv_done = on_conv_done};
+    ESP_ERROR_CHECK(adc_continuous_register_event_callbacks(s_handle, &cbs, NULL));
   }
+  for (int ch = 0; ch < ADC1_CHANNEL_MAX; ++ch) s_channels[ch].latest = -1;
 
-  // characterize for each attenuation
-  for (int i = 0; i < 4; ++i) {
-    esp_adc_cal_value_t val = esp_adc_cal_characterize(
-      ADC_UNIT_1, (adc_atten_t)i, DEFAULT_WIDTH, DEFAULT_VREF, &s_chars[i]
-    );
-    ESP_LOGI(TAG, "ADC char att=%d: type=%d", i, val);
+  if (xTaskCreate(adc_task, "adc_task", 2560, NULL, 6, &s_task) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create the ADC task");
+    return ESP_ERR_NO_MEM;
   }
-  s_chars_ready = true;
-  ESP_LOGI(TAG, "adc_helper initialized");
+  ESP_LOGI(
+    TAG, "adc_helper initialized (%d Hz, x%d oversampling)", CONFIG_SN_ADC_SAMPLE_HZ,
+    CONFIG_SN_ADC_OVERSAMPLE
+  );
   return ESP_OK;
 }
 
 esp_err_t adc_helper_config_channel_atten(adc1_channel_t ch, adc_atten_t atten) {
-  if (ch < ADC1_CHANNEL_0 || ch >= ADC1_CHANNEL_MAX) return ESP_ERR_INVALID_ARG;
+  if (ch < ADC1_CHANNEL_0 || ch >= ADC1_CHANNEL_MAX || atten >= ADC_ATTENS)
+    return ESP_ERR_INVALID_ARG;
   // caller must ensure adc_helper_init() called
-  adc1_config_channel_atten(ch, atten);
-  return ESP_OK;
+  if (!s_adc_mutex || !s_handle) return ESP_ERR_INVALID_STATE;
+  xSemaphoreTake(s_adc_mutex, portMAX_DELAY);
+  adc_channel_state_t *c = &s_channels[ch];
+  if (c->enabled && c->atten == atten) {
+    xSemaphoreGive(s_adc_mutex);
+    return ESP_OK;
+  }
+  // samples of another attenuation do not mix
+  c->sum = 0;
+  c->n = 0;
+  c->latest = -1;
+  c->cali = cali_for(atten);
+  c->atten = atten;
+  c->enabled = true;
+  load_fit(ch);
+  esp_err_t err = restart_locked();
+  xSemaphoreGive(s_adc_mutex);
+  if (err != ESP_OK) ESP_LOGE(TAG, "Failed to start sampling: %s", esp_err_to_name(err));
+  return err;
 }
 
 int adc_helper_read_raw(adc1_channel_t ch) {
   if (ch < ADC1_CHANNEL_0 || ch >= ADC1_CHANNEL_MAX) return -1;
-  if (!s_adc_mutex) return -1;
-  if (xSemaphoreTake(s_adc_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) return -1;
-  // perform single raw read
-  int raw = adc1_get_raw(ch);
-  xSemaphoreGive(s_adc_mutex);
-  return raw;
+  int32_t q = __atomic_load_n(&s_channels[ch].latest, __ATOMIC_RELAXED);
+  if (q < 0) return -1;
+  return (int)((q + (1 << (ADC_Q - 1))) >> ADC_Q);
 }
 
-int adc_helper_read_raw_avg(adc1_channel_t ch, int samples) {
-  if (samples <= 0) samples = 1;
-  long sum = 0;
-  for (int i = 0; i < samples; ++i) {
-    int r = adc_helper_read_raw(ch);
-    if (r < 0) return r;
-    sum += r;
-    // small settlement delay to reduce channel switching artifacts
-    esp_rom_delay_us(100); // microseconds; short busy wait (safe in small loops)
+uint32_t adc_helper_raw_to_mv(adc1_channel_t ch, int raw) {
+  if (ch < ADC1_CHANNEL_0 || ch >= ADC1_CHANNEL_MAX || raw < 0) return 0;
+  const adc_channel_state_t *c = &s_channels[ch];
+  adc_atten_t atten = c->enabled ? c->atten : DEFAULT_ATTEN;
+
+  int mv = 0;
+  if (!c->cali || adc_cali_raw_to_voltage(c->cali, raw, &mv) != ESP_OK) {
+    mv = (int)((uint32_t)raw * NOMINAL_FULL_SCALE_MV[atten] / 4095);
   }
-  return (int)(sum / samples);
-}
 
-uint32_t adc_helper_raw_to_mv(adc1_channel_t ch, int raw) {
-  (void)ch; // characteristic depends on configured attenuation, we assume default
-  if (!s_chars_ready || !s_chars) return 0;
-  // We don't know which attenuation the channel currently has here.
-  // Use the highest attenuation characteristic (DB_11) by default for better dynamic range.
-  return esp_adc_cal_raw_to_voltage(raw, &s_chars[atten_index(DEFAULT_ATTEN)]);
+  if (c->has_fit) {
+    taskENTER_CRITICAL(&s_fit_lock);
+    adc_helper_fit_t fit = c->fit;
+    bool has_fit = c->has_fit;
+    taskEXIT_CRITICAL(&s_fit_lock);
+    if (has_fit) mv = apply_fit(&fit, mv);
+  }
+  return mv > 0 ? (uint32_t)mv : 0;
 }
 
-esp_err_t adc_helper_read_mv_avg(adc1_channel_t ch, int samples, uint32_t *out_mv) {
+esp_err_t adc_helper_read_mv(adc1_channel_t ch, uint32_t *out_mv) {
   if (!out_mv) return ESP_ERR_INVALID_ARG;
-  int raw = adc_helper_read_raw_avg(ch, samples);
-  if (raw < 0) return ESP_FAIL;
+  int raw = adc_helper_read_raw(ch);
+  if (raw < 0) return ESP_ERR_INVALID_STATE;
   *out_mv = adc_helper_raw_to_mv(ch, raw);
   return ESP_OK;
 }
 
+esp_err_t adc_helper_set_fit(adc1_channel_t ch, const adc_helper_fit_t *fit) {
+  if (ch < ADC1_CHANNEL_0 || ch >= ADC1_CHANNEL_MAX) return ESP_ERR_INVALID_ARG;
+  if (fit && fit->gain <= 0) return ESP_ERR_INVALID_ARG;
+  char key[16];
+  fit_key(ch, key);
+  esp_err_t err = fit ? sn_storage_set_blob(key, fit, sizeof(*fit)) : sn_storage_erase_key(key);
+  if (err == ESP_ERR_NVS_NOT_FOUND) err = ESP_OK;
+  if (err != ESP_OK) return err;
+
+  adc_channel_state_t *c = &s_channels[ch];
+  taskENTER_CRITICAL(&s_fit_lock);
+  if (fit) c->fit = *fit;
+  c->has_fit = fit != NULL;
+  c->fit_loaded = true;
+  taskEXIT_CRITICAL(&s_fit_lock);
+  return ESP_OK;
+}
+
+bool adc_helper_get_fit(adc1_channel_t ch, adc_helper_fit_t *out) {
+  if (ch < ADC1_CHANNEL_0 || ch >= ADC1_CHANNEL_MAX || !out) return false;
+  adc_channel_state_t *c = &s_channels[ch];
+  taskENTER_CRITICAL(&s_fit_lock);
+  bool has_fit = c->has_fit;
+  if (has_fit) *out = c->fit;
+  taskEXIT_CRITICAL(&s_fit_lock);
+  return has_fit;
+}
+
 adc1_channel_t adc_helper_pin_to_channel(gpio_num_t pin) {
   switch (pin) {
     case GPIO_NUM_32:
@@ -0,0 +1,343 @@
+#include "sn_bus.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sn_metrics.h"
+#include "freertos/idf_additions.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "SN_BUS";
+
+typedef struct {
+  sn_bus_fn_t fn;
+  void *arg;
+  sn_bus_done_cb_t done;
+  void *done_arg;
+  int64_t queued_us;
+} bus_txn_t;
+
+typedef struct {
+  TaskHandle_t waiter;
+  esp_err_t rc;
+} sync_txn_t;
+
+struct sn_bus_s {
+  sn_port_usage_type_e type;
+  union {
+    struct {
+      i2c_master_bus_handle_t handle;
+      gpio_num_t sda;
+      gpio_num_t scl;
+    } i2c;
+    struct {
+      spi_host_device_t host;
+    } spi;
+  };
+  char name[8];
+  QueueHandle_t queues[SN_BUS_PRIO_MAX];
+  TaskHandle_t worker;
+  // written by the worker (hwm by the submitters), single words read by the status task
+  uint32_t busy_us;
+  uint32_t txn;
+  uint32_t wakeups;
+  uint32_t wait_max_us;
+  uint32_t depth_hwm;
+  // window of the last stats call, status task only
+  int64_t window_start_us;
+  uint32_t window_busy_us;
+  uint32_t window_txn;
+  uint32_t window_wakeups;
+};
+
+static sn_bus_t s_buses[SN_BUS_MAX];
+static int s_buses_len = 0;
+static int s_i2c_ports = 0;
+static SemaphoreHandle_t s_lock = NULL;
+
+// --------------------------------------------------------------------------------
+// Worker
+// --------------------------------------------------------------------------------
+
+static bool next_txn(sn_bus_t *bus, bus_txn_t *out) {
+  for (int p = SN_BUS_PRIO_MAX - 1; p >= 0; p--) {
+    if (xQueueReceive(bus->queues[p], out, 0) == pdTRUE) return true;
+  }
+  return false;
+}
+
+static void run_txn(sn_bus_t *bus, const bus_txn_t *txn) {
+  int64_t start = esp_timer_get_time();
+  uint32_t wait = (uint32_t)(start - txn->queued_us);
+  sn_metric_observe(SN_MH_bus_wait, wait);
+  sn_metric_store_max(&bus->wait_max_us, wait);
+
+  esp_err_t rc = txn->fn(bus, txn->arg);
+  int64_t end = esp_timer_get_time();
+  sn_metric_observe(SN_MH_bus_txn_time, (uint32_t)(end - start));
+  __atomic_fetch_add(&bus->busy_us, (uint32_t)(end - start), __ATOMIC_RELAXED);
+  __atomic_fetch_add(&bus->txn, 1, __ATOMIC_RELAXED);
+  if (txn->done) txn->done(rc, txn->done_arg);
+}
+
+// One notification per queued transaction, a wake up drains every queue highest
+// priority first. A late submit leaves a notification behind, the next take returns
+// right away and finds it
+static void bus_worker(void *pvParams) {
+  sn_bus_t *bus = (sn_bus_t *)pvParams;
+  bus_txn_t txn;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    __atomic_fetch_add(&bus->wakeups, 1, __ATOMIC_RELAXED);
+    for (int n = 1; next_txn(bus, &txn); n++) {
+      run_txn(bus, &txn);
+      if (n % SN_BUS_BATCH == 0) taskYIELD();
+    }
+  }
+}
+
+static uint32_t queued(const sn_bus_t *bus) {
+  uint32_t n = 0;
+  for (int p = 0; p < SN_BUS_PRIO_MAX; p++) n += uxQueueMessagesWaiting(bus->queues[p]);
+  return n;
+}
+
+static esp_err_t post(sn_bus_t *bus, sn_bus_prio_e prio, const bus_txn_t *txn, TickType_t wait) {
+  if (!bus || !txn->fn || prio < 0 || prio >= SN_BUS_PRIO_MAX) return ESP_ERR_INVALID_ARG;
+  if (xQueueSend(bus->queues[prio], txn, wait) != pdTRUE) {
+    sn_metric_inc(SN_MC_bus_drop);
+    ESP_LOGW(TAG, "Queue %d of %s is full", prio, bus->name);
+    return ESP_ERR_TIMEOUT;
+  }
+  sn_metric_store_max(&bus->depth_hwm, queued(bus));
+  xTaskNotifyGive(bus->worker);
+  return ESP_OK;
+}
+
+static void on_sync_done(esp_err_t rc, void *arg) {
+  sync_txn_t *sync = (sync_txn_t *)arg;
+  sync->rc = rc;
+  xTaskNotifyGive(sync->waiter);
+}
+
+// --------------------------------------------------------------------------------
+// Creation
+// --------------------------------------------------------------------------------
+
+static bool port_usage(
+  const sn_device_port_desc_t *port, const sn_port_usage_u **usage, sn_port_usage_type_e *type
+) {
+  switch (port->drv_type) {
+    case DRIVER_TYPE_SENSOR:
+      *usage = &port->desc.s.usage;
+      *type = port->desc.s.usage_type;
+      return true;
+    case DRIVER_TYPE_ACTUATOR:
+      *usage = &port->desc.a.usage;
+      *type = port->desc.a.usage_type;
+      return true;
+    case DRIVER_TYPE_COMMAND_API:
+      break;
+  }
+  return false;
+}
+
+static sn_bus_t *find_bus(sn_port_usage_type_e type, const sn_port_usage_u *usage) {
+  for (int i = 0; i < s_buses_len; i++) {
+    sn_bus_t *bus = &s_buses[i];
+    if (bus->type != type) continue;
+    if (type == PUT_I2C && bus->i2c.sda == usage->i2c.sda && bus->i2c.scl == usage->i2c.scl) {
+      return bus;
+    }
+    if (type == PUT_SPI && bus->spi.host == (spi_host_device_t)usage->spi.host) return bus;
+  }
+  return NULL;
+}
+
+static esp_err_t open_i2c(sn_bus_t *bus, const sn_port_usage_u *usage) {
+  if (s_i2c_ports >= I2C_NUM_MAX) return ESP_ERR_NO_MEM;
+  i2c_master_bus_config_t config = {
+    .clk_source = I2C_CLK_SRC_DEFAULT,
+    .glitch_ignore_cnt = 7,
+    .i2c_port = s_i2c_ports,
+    .sda_io_num = usage->i2c.sda,
+    .scl_io_num = usage->i2c.scl,
+    .flags.enable_internal_pullup = true,
+  };
+  esp_err_t err = i2c_new_master_bus(&config, &bus->i2c.handle);
+  if (err != ESP_OK) return err;
+  bus->i2c.sda = usage->i2c.sda;
+  bus->i2c.scl = usage->i2c.scl;
+  snprintf(bus->name, sizeof(bus->name), "i2c%d", s_i2c_ports++);
+  return ESP_OK;
+}
+
+static esp_err_t open_spi(sn_bus_t *bus, const sn_port_usage_u *usage) {
+  spi_bus_config_t config = {
+    .mosi_io_num = usage->spi.mosi,
+    .miso_io_num = usage->spi.miso,
+    .sclk_io_num = usage->spi.sclk,
+    .quadwp_io_num = -1,
+    .quadhd_io_num = -1,
+  };
+  esp_err_t err = spi_bus_initialize(usage->spi.host, &config, SPI_DMA_CH_AUTO);
+  if (err != ESP_OK) return err;
+  bus->spi.host = usage->spi.host;
+  snprintf(bus->name, sizeof(bus->name), "spi%d", usage->spi.host);
+  return ESP_OK;
+}
+
+static void close_bus(sn_bus_t *bus) {
+  if (bus->type == PUT_I2C && bus->i2c.handle) i2c_del_master_bus(bus->i2c.handle);
+  if (bus->type == PUT_SPI && bus->name[0]) spi_bus_free(bus->spi.host);
+  for (int p = 0; p < SN_BUS_PRIO_MAX; p++) {
+    if (bus->queues[p]) vQueueDelete(bus->queues[p]);
+  }
+  memset(bus, 0, sizeof(*bus));
+}
+
+static esp_err_t open_bus(sn_bus_t *bus, sn_port_usage_type_e type, const sn_port_usage_u *usage) {
+  memset(bus, 0, sizeof(*bus));
+  bus->type = type;
+  esp_err_t err = type == PUT_I2C ? open_i2c(bus, usage) : open_spi(bus, usage);
+  for (int p = 0; p < SN_BUS_PRIO_MAX && err == ESP_OK; p++) {
+    bus->queues[p] = xQueueCreate(SN_BUS_QUEUE_LEN, sizeof(bus_txn_t));
+    if (!bus->queues[p]) err = ESP_ERR_NO_MEM;
+  }
+  if (err == ESP_OK) {
+    char task_name[16];
+    snprintf(task_name, sizeof(task_name), "bus_%s", bus->name);
+    if (xTaskCreate(
+          bus_worker, task_name, SN_BUS_WORKER_STACK, bus, SN_BUS_WORKER_PRIORITY, &bus->worker
+        )
+        != pdPASS) {
+      err = ESP_ERR_NO_MEM;
+    }
+  }
+  if (err != ESP_OK) {
+    close_bus(bus);
+    return err;
+  }
+  bus->window_start_us = esp_timer_get_time();
+  return ESP_OK;
+}
+
+// --------------------------------------------------------------------------------
+// API
+// --------------------------------------------------------------------------------
+
+esp_err_t sn_bus_init(void) {
+  if (s_lock) return ESP_OK;
+  s_lock = xSemaphoreCreateMutex();
+  return s_lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t sn_bus_acquire(const sn_device_port_desc_t *port, sn_bus_t **out) {
+  if (!port || !out) return ESP_ERR_INVALID_ARG;
+  *out = NULL;
+  const sn_port_usage_u *usage = NULL;
+  sn_port_usage_type_e type = PUT_GPIO;
+  if (!port_usage(port, &usage, &type) || (type != PUT_I2C && type != PUT_SPI)) return ESP_OK;
+  if (!s_lock) return ESP_ERR_INVALID_STATE;
+
+  esp_err_t err = ESP_OK;
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  sn_bus_t *bus = find_bus(type, usage);
+  if (!bus && s_buses_len >= SN_BUS_MAX) {
+    err = ESP_ERR_NO_MEM;
+  } else if (!bus) {
+    err = open_bus(&s_buses[s_buses_len], type, usage);
+    if (err == ESP_OK) {
+      bus = &s_buses[s_buses_len++];
+      ESP_LOGI(TAG, "Bus %s opened for port %s", bus->name, port->port_name);
+    }
+  }
+  xSemaphoreGive(s_lock);
+
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "No bus for port %s err=%d", port->port_name, err);
+    return err;
+  }
+  *out = bus;
+  return ESP_OK;
+}
+
+i2c_master_bus_handle_t sn_bus_i2c_handle(const sn_bus_t *bus) {
+  return bus && bus->type == PUT_I2C ? bus->i2c.handle : NULL;
+}
+
+spi_host_device_t sn_bus_spi_host(const sn_bus_t *bus) {
+  return bus && bus->type == PUT_SPI ? bus->spi.host : (spi_host_device_t)-1;
+}
+
+esp_err_t sn_bus_submit(sn_bus_t *bus, sn_bus_prio_e prio, sn_bus_fn_t fn, void *arg) {
+  if (!bus || !fn) return ESP_ERR_INVALID_ARG;
+  // a transaction waiting on its own bus would never run
+  if (xTaskGetCurrentTaskHandle() == bus->worker) return fn(bus, arg);
+
+  sync_txn_t sync = {.waiter = xTaskGetCurrentTaskHandle(), .rc = ESP_OK};
+  bus_txn_t txn = {
+    .fn = fn,
+    .arg = arg,
+    .done = on_sync_done,
+    .done_arg = &sync,
+    .queued_us = esp_timer_get_time(),
+  };
+  esp_err_t err = post(bus, prio, &txn, pdMS_TO_TICKS(SN_BUS_POST_TIMEOUT_MS));
+  if (err != ESP_OK) return err;
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  return sync.rc;
+}
+
+esp_err_t sn_bus_submit_async(
+  sn_bus_t *bus, sn_bus_prio_e prio, sn_bus_fn_t fn, void *arg, sn_bus_done_cb_t done,
+  void *done_arg
+) {
+  bus_txn_t txn = {
+    .fn = fn,
+    .arg = arg,
+    .done = done,
+    .done_arg = done_arg,
+    .queued_us = esp_timer_get_time(),
+  };
+  return post(bus, prio, &txn, 0);
+}
+
+static esp_err_t i2c_probe_txn(sn_bus_t *bus, void *arg) {
+  return i2c_master_probe(bus->i2c.handle, (uint16_t)(uintptr_t)arg, SN_BUS_I2C_PROBE_TIMEOUT_MS);
+}
+
+esp_err_t sn_bus_i2c_probe(sn_bus_t *bus, uint16_t addr) {
+  if (!bus || bus->type != PUT_I2C) return ESP_ERR_INVALID_ARG;
+  return sn_bus_submit(bus, SN_BUS_PRIO_NORMAL, i2c_probe_txn, (void *)(uintptr_t)addr);
+}
+
+cJSON *sn_bus_stats_to_json(void) {
+  cJSON *json = cJSON_CreateObject();
+  if (!json) return NULL;
+  int64_t now = esp_timer_get_time();
+  for (int i = 0; i < s_buses_len; i++) {
+    sn_bus_t *bus = &s_buses[i];
+    uint32_t busy = __atomic_load_n(&bus->busy_us, __ATOMIC_RELAXED);
+    uint32_t txn = __atomic_load_n(&bus->txn, __ATOMIC_RELAXED);
+    uint32_t wakeups = __atomic_load_n(&bus->wakeups, __ATOMIC_RELAXED);
+    int64_t window = now - bus->window_start_us;
+
+    cJSON *entry = cJSON_AddObjectToObject(json, bus->name);
+    // counters wrap, the differences stay right over a window shorter than ~71 min
+    uint32_t util = window > 0 ? (uint32_t)((uint64_t)(busy - bus->window_busy_us) * 1000 / window)
+                               : 0;
+    cJSON_AddNumberToObject(entry, "util", util < 1000 ? util : 1000);
+    cJSON_AddNumberToObject(entry, "txn", txn - bus->window_txn);
+    cJSON_AddNumberToObject(entry, "wakeups", wakeups - bus->window_wakeups);
+    cJSON_AddNumberToObject(entry, "hwm", __atomic_load_n(&bus->depth_hwm, __ATOMIC_RELAXED));
+    cJSON_AddNumberToObject(
+      entry, "waitMax", __atomic_load_n(&bus->wait_max_us, __ATOMIC_RELAXED)
+    );
+
+    bus->window_start_us = now;
+    bus->window_busy_us = busy;
+    bus->window_txn = txn;
+    bus->window_wakeups = wakeups;
+  }
+  return json;
+}
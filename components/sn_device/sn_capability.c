@@ -1,12 +1,17 @@
 #include "sn_capability.h"
 #include "esp_err.h"
+#include "sn_actor.h"
 #include "sdkconfig.h"
 #include "sn_driver.h"
 #include "sn_driver/driver_inst.h"
 #include "sn_driver/port_desc.h"
 #include "sn_driver/sensor.h"
 #include "sn_json.h"
+#include "sn_metrics.h"
+#include "sn_prof.h"
+#include "sn_trace.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "cJSON.h"
 #include "esp_mac.h"
 #include <esp_efuse.h>
@@ -41,6 +46,8 @@ static cJSON *create_command_capability_json(const sn_driver_desc_t *desc) {
  *   hw_id: ""
  *   sensors: [
  *     {localId: 1, name: 'temp-1', type: 'dht11', unit: "C"},
+ *     {localId: 3, name: 'soil-1', type: 'MOISTURE', unit: "%",
+ *      calibration: {dry_mv: 2900, wet_mv: 1200}}, // drivers with report_calibration
  *     ...
  *   ],
  *   actuators: [
@@ -57,6 +64,10 @@ static cJSON *create_command_capability_json(const sn_driver_desc_t *desc) {
  *   ]
  * }
  */
+static void collect_calibration(sn_device_instance_t *inst, void *arg) {
+  *(cJSON **)arg = inst->driver->report_calibration((void *)&inst->ctx);
+}
+
 cJSON *device_ports_to_capabilities_json() {
   if (gDevicePortsLen <= 0) {
     ESP_LOGW(TAG, "No ports defined");
@@ -93,18 +104,26 @@ cJSON *device_ports_to_capabilities_json() {
 
     switch (it->port->drv_type) {
       case DRIVER_TYPE_SENSOR: {
+        // on the actor, where calibrate writes it. Waits for collect_calibration, cal
+        // lives on this stack
+        cJSON *cal = NULL;
+        if (it->online && it->driver->report_calibration) {
+          sn_actor_call_sync(it, collect_calibration, &cal);
+        }
         FOR_EACH_MEASUREMENT(m_it, it->port->desc.s.measurements) {
           cJSON *entry = cJSON_CreateObject();
           cJSON_AddNumberToObject(entry, "localId", m_it->local_id);
           cJSON_AddStringToObject(entry, "type", sensorTypeStr[m_it->type]);
           cJSON_AddItemToObject(entry, "name", cJSON_CreateString(it->port->port_name));
           cJSON_AddStringToObject(entry, "unit", m_it->unit);
+          if (cal) cJSON_AddItemToObject(entry, "calibration", cJSON_Duplicate(cal, true));
           cJSON_AddItemToArray(sensor_capability, entry);
           if (command) {
             cJSON_AddNumberToObject(command_obj, "local_id", m_it->local_id);
             cJSON_AddItemToArray(command_capability, command_obj);
           }
         }
+        cJSON_Delete(cal);
       } break;
       case DRIVER_TYPE_ACTUATOR: {
         const sn_actuator_port_t *a = &it->port->desc.a;
@@ -133,7 +152,19 @@ cJSON *device_ports_to_capabilities_json() {
   return json;
 }
 
+// counts executed commands only, latency covers the round trip through the actor
+static inline int run_on_actor(sn_device_instance_t *inst, const cJSON *params, cJSON **out) {
+  int64_t start = esp_timer_get_time();
+  SN_TRACE_BEGIN("cmd.dispatch", inst - gDeviceInstances);
+  int r = sn_actor_control(inst, params, out);
+  SN_TRACE_END("cmd.dispatch", r == ESP_OK);
+  sn_metric_observe(SN_MH_cmd_latency, (uint32_t)(esp_timer_get_time() - start));
+  sn_metric_inc(r == ESP_OK ? SN_MC_cmd_ok : SN_MC_cmd_fail);
+  return r;
+}
+
 int sn_dispatch_command_struct(const sn_command_t *command, cJSON **out_result) {
+  SN_PROF_SCOPE("dispatch.rule");
   cJSON *result = NULL;
 
   if (command->local_id > LOCAL_ID_MAX || command->local_id < LOCAL_ID_MIN) {
@@ -159,7 +190,7 @@ int sn_dispatch_command_struct(const sn_command_t *command, cJSON **out_result)
     return -3;
   }
 
-  const sn_command_desc_t *command_desc = inst->driver->command_desc;
+  const sn_command_desc_t *command_desc = inst->driver ? inst->driver->command_desc : NULL;
   if (!command_desc
       || strncmp(command_desc->action, command->action, strlen(command_desc->action)) != 0) {
     if (out_result)
@@ -173,8 +204,13 @@ int sn_dispatch_command_struct(const sn_command_t *command, cJSON **out_result)
     return -5;
   }
 
+  if (!inst->online) {
+    if (out_result) *out_result = build_error_fmt("%s is offline", inst->port->port_name);
+    return -6;
+  }
+
   cJSON *params = cJSON_Parse(command->params_json);
-  int r = inst->driver->control((void *)&inst->ctx, params, &result);
+  int r = run_on_actor((sn_device_instance_t *)inst, params, &result);
 
   if (r != ESP_OK) {
     ESP_LOGE(TAG, "%s Encountered an error (%s)", inst->port->port_name, esp_err_to_name(r));
@@ -185,16 +221,9 @@ int sn_dispatch_command_struct(const sn_command_t *command, cJSON **out_result)
   return r;
 }
 
-// pseudo: command JSON format from backend:
-// {
-//   "localId": number,
-//   "action": "set_pump_state",
-//   "params": { "actuatorId": 5, "enable": true }
-// }
-int dispatch_command(const char *payload_json, cJSON **out_result) {
-  cJSON *root = cJSON_Parse(payload_json);
-  cJSON *result = NULL;
-
+int sn_resolve_command_json(
+  const cJSON *root, sn_device_instance_t **out_inst, const cJSON **out_params, cJSON **out_result
+) {
   if (!root) {
     if (out_result) *out_result = build_error_fmt("payload is not in a correct json format");
     return -1;
@@ -203,48 +232,106 @@ int dispatch_command(const char *payload_json, cJSON **out_result) {
   int id = 0;
   if (!json_get_int(root, "localId", &id)) {
     if (out_result) *out_result = build_error_fmt("Invalid or missing field \"localId\"");
-    cJSON_Delete(root);
     return -2;
   }
 
-  const sn_device_instance_t *inst = sn_find_instance_by_local_id((uint8_t)id);
+  sn_device_instance_t *inst = sn_find_instance_by_local_id((uint8_t)id);
   if (!inst) {
     if (out_result)
       *out_result =
         build_error_fmt("Cannot found any command associated with localId=%d", (uint8_t)id);
-    cJSON_Delete(root);
     return -2;
   }
 
   const char *action = NULL;
   if (!json_get_string(root, "action", &action)) {
     if (out_result) *out_result = build_error_fmt("Invalid or missing field \"action\"");
-    cJSON_Delete(root);
     return -3;
   }
 
-  const sn_command_desc_t *command_desc = inst->driver->command_desc;
+  const sn_command_desc_t *command_desc = inst->driver ? inst->driver->command_desc : NULL;
   if (!command_desc || strncmp(command_desc->action, action, strlen(command_desc->action)) != 0) {
     if (out_result) *out_result = build_error_fmt("\"action\": \"%s\" unsupported", action);
-    cJSON_Delete(root);
     return -4;
   }
 
   if (!inst->driver->control) {
     if (out_result)
       *out_result = build_error_fmt("\"action\": \"%s\" missing control callback", action);
-    cJSON_Delete(root);
     return -5;
   }
 
-  cJSON *params = cJSON_GetObjectItemCaseSensitive(root, "params");
-  int r = inst->driver->control((void *)&inst->ctx, params, &result);
+  if (!inst->online) {
+    if (out_result) *out_result = build_error_fmt("%s is offline", inst->port->port_name);
+    return -6;
+  }
+
+  if (out_inst) *out_inst = inst;
+  if (out_params) *out_params = cJSON_GetObjectItemCaseSensitive(root, "params");
+  return ESP_OK;
+}
+
+int sn_validate_command_json(
+  const cJSON *root, sn_device_instance_t **out_inst, cJSON **out_result
+) {
+  sn_device_instance_t *inst = NULL;
+  const cJSON *params = NULL;
+  int r = sn_resolve_command_json(root, &inst, &params, out_result);
+  if (r != ESP_OK) return r;
+  if (out_inst) *out_inst = inst;
+
+  const sn_param_desc_t *params_desc = inst->driver->command_desc->params;
+  if (!params_desc || !params_desc->name) return ESP_OK;
+
+  // commands with only optional params may omit the object
+  if (!params) {
+    FOREACH_PARAMS_DESC(pd, params_desc) {
+      if (pd->required) {
+        if (out_result) *out_result = build_error_fmt("missing required param '%s'", pd->name);
+        return -7;
+      }
+    }
+    return ESP_OK;
+  }
+
+  if (!cJSON_IsObject(params)) {
+    if (out_result) *out_result = build_error_fmt("Invalid or missing field \"params\"");
+    return -7;
+  }
+  return validate_params_json(params_desc, params, out_result) ? ESP_OK : -7;
+}
+
+// pseudo: command JSON format from backend:
+// {
+//   "localId": number,
+//   "action": "set_pump_state",
+//   "params": { "actuatorId": 5, "enable": true }
+// }
+int sn_dispatch_command_json(const cJSON *root, cJSON **out_result) {
+  SN_PROF_SCOPE("dispatch");
+  sn_device_instance_t *inst = NULL;
+  const cJSON *params = NULL;
+  int r = sn_resolve_command_json(root, &inst, &params, out_result);
+  if (r != ESP_OK) return r;
+
+  cJSON *result = NULL;
+  r = run_on_actor(inst, params, &result);
 
   if (r != ESP_OK) {
     ESP_LOGE(TAG, "%s Encountered an error (%s)", inst->port->port_name, esp_err_to_name(r));
   }
   if (out_result) *out_result = result;
+  return r;
+}
+
+int dispatch_command(const char *payload_json, cJSON **out_result) {
+  cJSON *root = cJSON_Parse(payload_json);
+  if (!root) {
+    if (out_result) *out_result = build_error_fmt("payload is not in a correct json format");
+    return -1;
+  }
 
+  int r = sn_dispatch_command_json(root, out_result);
   cJSON_Delete(root);
   return r;
 }
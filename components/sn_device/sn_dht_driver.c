@@ -1,8 +1,12 @@
 #include "esp_err.h"
 #include "sn_driver/sensor.h"
 #include "sn_driver_registry.h"
+#include "sn_prof.h"
 
-#include "dht.h"
+#include "driver/gpio.h"
+#include "driver/rmt_rx.h"
+#include "driver/rmt_tx.h"
+#include "esp_attr.h"
 #include "esp_timer.h"
 #include "esp_log.h"
 #include "sn_json.h"
@@ -16,6 +20,51 @@ static const char *TAG = "SN_DHT_DRIVER";
 static const char *dht_types[] = {"dht11",  "dht21",  "dht22",   "dht",
                                   "AM2301", "AM2302", "SiI7021", NULL};
 
+/* The exchange on the single wire, driven and captured by the RMT (1 tick = 1 us):
+ *
+ *   host:   start pulse low (20 ms dht11, 1 ms am2301, 500 us si7021), then released
+ *   sensor: 80 us low, 80 us high, then 40 bits of 50 us low + 26 us (0) or 70 us (1)
+ *           high, humidity, temperature and a checksum byte
+ *
+ * The receiver is armed before the start pulse and ends once the line stays high for
+ * DHT_IDLE_US. The frame is decoded in the receive callback
+ */
+#define DHT_RMT_RESOLUTION_HZ 1000000
+#define DHT_RMT_SYMBOLS       64 // 43 symbols for a full frame
+#define DHT_MAX_DEVICES       4  // two rmt channels each, the esp32 has eight
+#define DHT_IDLE_US           25000
+#define DHT_GLITCH_NS         1000
+#define DHT_BIT_ONE_US        48 // high time splitting 0 and 1
+#define DHT_MIN_INTERVAL_MS   2000
+#define DHT_TIMEOUT_MS        200
+
+typedef enum {
+  DHT_TYPE_DHT11 = 0,
+  DHT_TYPE_AM2301,
+  DHT_TYPE_SI7021,
+} dht_sensor_type_t;
+
+typedef enum {
+  DHT_IDLE = 0,
+  DHT_BUSY, // frame in flight
+  DHT_DONE, // decoded by the receive callback, result is set
+} dht_state_e;
+
+// The rmt side of a sensor, too big for the inline ctx
+typedef struct {
+  bool used;
+  dht_sensor_type_t type;
+  rmt_channel_handle_t rx;
+  rmt_channel_handle_t tx;
+  rmt_encoder_handle_t encoder;
+  rmt_symbol_word_t symbols[DHT_RMT_SYMBOLS];
+  uint32_t state; // dht_state_e
+  esp_err_t result;
+  int16_t temperature; // x10
+  int16_t humidity;    // x10
+  uint64_t started_ms;
+} dht_rmt_t;
+
 struct dht_ctx_s {
   gpio_num_t pin;
   int last_read_ms;
@@ -25,8 +74,170 @@ struct dht_ctx_s {
   local_id_t temperature_id;
   local_id_t humidity_id;
   bool cached;
+  dht_rmt_t *rmt;
 };
 
+static dht_rmt_t s_rmt[DHT_MAX_DEVICES];
+
+// --------------------------------------------------------------------------------
+// Frame
+// --------------------------------------------------------------------------------
+
+static uint32_t start_pulse_us(dht_sensor_type_t type) {
+  switch (type) {
+    case DHT_TYPE_DHT11:
+      return 20000;
+    case DHT_TYPE_SI7021:
+      return 500;
+    default:
+      return 1000;
+  }
+}
+
+// Duration of level i (two per symbol) if the line was high, else 0
+static inline uint32_t IRAM_ATTR high_us(const rmt_symbol_word_t *symbols, size_t i) {
+  const rmt_symbol_word_t *s = &symbols[i / 2];
+  if (i % 2) return s->level1 ? s->duration1 : 0;
+  return s->level0 ? s->duration0 : 0;
+}
+
+// The bits are the last 40 high levels, what comes before them (the end of the start
+// pulse, the 80 us response) is skipped. The final high level is the idle one, its
+// duration is 0
+static esp_err_t IRAM_ATTR decode_frame(
+  dht_sensor_type_t type, const rmt_symbol_word_t *symbols, size_t len, int16_t *hum,
+  int16_t *temp
+) {
+  size_t highs = 0;
+  for (size_t i = 0; i < len * 2; i++) {
+    if (high_us(symbols, i)) highs++;
+  }
+  if (highs < 40) return ESP_ERR_TIMEOUT;
+
+  uint8_t data[5] = {0};
+  size_t b = 0;
+  for (size_t i = 0; i < len * 2; i++) {
+    uint32_t us = high_us(symbols, i);
+    if (!us || highs-- > 40) continue;
+    if (us > DHT_BIT_ONE_US) data[b / 8] |= 0x80 >> (b % 8);
+    b++;
+  }
+  if (data[4] != (uint8_t)(data[0] + data[1] + data[2] + data[3])) return ESP_ERR_INVALID_CRC;
+
+  if (type == DHT_TYPE_DHT11) {
+    *hum = data[0] * 10 + data[1];
+    *temp = data[2] * 10 + (data[3] & 0x7f);
+    if (data[3] & 0x80) *temp = -*temp;
+  } else {
+    *hum = (int16_t)(data[0] << 8 | data[1]);
+    *temp = (int16_t)((data[2] & 0x7f) << 8 | data[3]);
+    if (data[2] & 0x80) *temp = -*temp;
+  }
+  return ESP_OK;
+}
+
+static bool IRAM_ATTR dht_rx_done(
+  rmt_channel_handle_t channel, const rmt_rx_done_event_data_t *edata, void *user_ctx
+) {
+  dht_rmt_t *d = (dht_rmt_t *)user_ctx;
+  d->result = decode_frame(
+    d->type, edata->received_symbols, edata->num_symbols, &d->humidity, &d->temperature
+  );
+  __atomic_store_n(&d->state, DHT_DONE, __ATOMIC_RELEASE);
+  return false;
+}
+
+// --------------------------------------------------------------------------------
+// RMT
+// --------------------------------------------------------------------------------
+
+static void dht_rmt_free(dht_rmt_t *d) {
+  if (d->tx) {
+    rmt_disable(d->tx);
+    rmt_del_channel(d->tx);
+  }
+  if (d->rx) {
+    rmt_disable(d->rx);
+    rmt_del_channel(d->rx);
+  }
+  if (d->encoder) rmt_del_encoder(d->encoder);
+  memset(d, 0, sizeof(*d));
+}
+
+// rx first, the tx channel then shares the pin as an open drain output looped back
+static esp_err_t dht_rmt_alloc(gpio_num_t pin, dht_sensor_type_t type, dht_rmt_t **out) {
+  dht_rmt_t *d = NULL;
+  for (int i = 0; i < DHT_MAX_DEVICES && !d; i++) {
+    if (!s_rmt[i].used) d = &s_rmt[i];
+  }
+  if (!d) return ESP_ERR_NO_MEM;
+  *d = (dht_rmt_t){.used = true, .type = type};
+
+  rmt_rx_channel_config_t rx_cfg = {
+    .gpio_num = pin,
+    .clk_src = RMT_CLK_SRC_DEFAULT,
+    .resolution_hz = DHT_RMT_RESOLUTION_HZ,
+    .mem_block_symbols = DHT_RMT_SYMBOLS,
+  };
+  rmt_tx_channel_config_t tx_cfg = {
+    .gpio_num = pin,
+    .clk_src = RMT_CLK_SRC_DEFAULT,
+    .resolution_hz = DHT_RMT_RESOLUTION_HZ,
+    .mem_block_symbols = DHT_RMT_SYMBOLS,
+    .trans_queue_depth = 1,
+    .flags = {.io_loop_back = true, .io_od_mode = true},
+  };
+  rmt_copy_encoder_config_t enc_cfg = {};
+  rmt_rx_event_callbacks_t cbs = {.on_recv_done = dht_rx_done};
+
+  esp_err_t err = rmt_new_rx_channel(&rx_cfg, &d->rx);
+  if (err == ESP_OK) err = rmt_new_tx_channel(&tx_cfg, &d->tx);
+  if (err == ESP_OK) err = rmt_new_copy_encoder(&enc_cfg, &d->encoder);
+  if (err == ESP_OK) err = rmt_rx_register_event_callbacks(d->rx, &cbs, d);
+  if (err == ESP_OK) err = rmt_enable(d->rx);
+  if (err == ESP_OK) err = rmt_enable(d->tx);
+  // modules carry a pull-up, bare sensors get the internal one
+  if (err == ESP_OK) err = gpio_pullup_en(pin);
+  if (err != ESP_OK) {
+    dht_rmt_free(d);
+    return err;
+  }
+  *out = d;
+  return ESP_OK;
+}
+
+static esp_err_t dht_rmt_start(dht_rmt_t *d) {
+  static const rmt_receive_config_t rx_cfg = {
+    .signal_range_min_ns = DHT_GLITCH_NS,
+    .signal_range_max_ns = DHT_IDLE_US * 1000,
+  };
+  static const rmt_transmit_config_t tx_cfg = {.loop_count = 0, .flags = {.eot_level = 1}};
+  // the pulse lasts until the transmit ends, the copy encoder keeps a pointer to it
+  static rmt_symbol_word_t start[DHT_MAX_DEVICES];
+  rmt_symbol_word_t *pulse = &start[d - s_rmt];
+  *pulse = (rmt_symbol_word_t){
+    .level0 = 0, .duration0 = start_pulse_us(d->type), .level1 = 1, .duration1 = 10
+  };
+
+  __atomic_store_n(&d->state, DHT_BUSY, __ATOMIC_RELAXED);
+  d->started_ms = esp_timer_get_time() / 1000ULL;
+  esp_err_t err = rmt_receive(d->rx, d->symbols, sizeof(d->symbols), &rx_cfg);
+  if (err == ESP_OK) err = rmt_transmit(d->tx, d->encoder, pulse, sizeof(*pulse), &tx_cfg);
+  if (err != ESP_OK) __atomic_store_n(&d->state, DHT_IDLE, __ATOMIC_RELAXED);
+  return err;
+}
+
+// Disabling the channel drops the receive in flight
+static void dht_rmt_cancel(dht_rmt_t *d) {
+  rmt_disable(d->rx);
+  rmt_enable(d->rx);
+  __atomic_store_n(&d->state, DHT_IDLE, __ATOMIC_RELAXED);
+}
+
+// --------------------------------------------------------------------------------
+// Driver
+// --------------------------------------------------------------------------------
+
 static esp_err_t dht_init(const sn_device_port_desc_t *port, void *ctx_out, size_t ctx_size) {
   if (!port || !ctx_out || ctx_size < sizeof(dht_ctx_t) || port->desc.s.usage_type != PUT_GPIO) {
     return ESP_ERR_INVALID_ARG;
@@ -42,7 +253,8 @@ static esp_err_t dht_init(const sn_device_port_desc_t *port, void *ctx_out, size
     .temperature_id = 0,
     .humidity_id = 0,
     .dht_type = DHT_TYPE_AM2301,
-    .cached = 0
+    .cached = 0,
+    .rmt = NULL
   };
   // clang-format on
 
@@ -57,13 +269,23 @@ static esp_err_t dht_init(const sn_device_port_desc_t *port, void *ctx_out, size
   tmp.humidity_id = pm_get_local_id(port->desc.s.measurements, ST_HUMIDITY);
 
   if (tmp.temperature_id == 0 || tmp.humidity_id == 0) return ESP_ERR_INVALID_ARG;
+
+  esp_err_t err = dht_rmt_alloc(_pin, tmp.dht_type, &tmp.rmt);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "No rmt channels for port=%s: %s", port->port_name, esp_err_to_name(err));
+    return err;
+  }
   memcpy(ctx_out, &tmp, sizeof(tmp));
 
   ESP_LOGI(TAG, "DHT init port=%s pin=%d", port->port_name, _pin);
   return ESP_OK;
 }
 
-static void dht_deinit(void *ctx) { (void)ctx; }
+static void dht_deinit(void *ctx) {
+  dht_ctx_t *c = (dht_ctx_t *)ctx;
+  if (c && c->rmt) dht_rmt_free(c->rmt);
+  if (c) c->rmt = NULL;
+}
 
 static bool dht_probe(const sn_device_port_desc_t *port) {
   if (!port) return false;
@@ -71,25 +293,42 @@ static bool dht_probe(const sn_device_port_desc_t *port) {
   return (port->desc.s.usage.gpio.pin >= 0);
 }
 
+// Never waits on the wire: a read that needs a new frame starts it and returns
+// ESP_ERR_NOT_FINISHED, the next read returns the decoded values
 static esp_err_t dht_read_multi(
   void *ctxv, sn_sensor_reading_t *out_buf, int max_out, int *out_count
 ) {
+  SN_PROF_SCOPE("read.dht");
   if (!ctxv || !out_buf || max_out < 2 || !out_count) return ESP_ERR_INVALID_ARG;
   dht_ctx_t *ctx = (dht_ctx_t *)ctxv;
+  dht_rmt_t *d = ctx->rmt;
+  if (!d) return ESP_ERR_INVALID_STATE;
   uint64_t now_ms = esp_timer_get_time() / 1000ULL;
 
-  // use cache to serve multiple measurements without re-reading hardware often
-  if (!ctx->cached || (now_ms - ctx->last_read_ms) > 3000) {
-    float t = 0.0f, h = 0.0f;
-    esp_err_t r = dht_read_float_data(ctx->dht_type, ctx->pin, &h, &t);
-    if (r != ESP_OK) {
+  switch (__atomic_load_n(&d->state, __ATOMIC_ACQUIRE)) {
+    case DHT_DONE:
+      __atomic_store_n(&d->state, DHT_IDLE, __ATOMIC_RELAXED);
+      if (d->result != ESP_OK) {
+        ctx->cached = false;
+        return d->result;
+      }
+      ctx->last_temp = d->temperature / 10.0f;
+      ctx->last_hum = d->humidity / 10.0f;
+      ctx->last_read_ms = (int)d->started_ms;
+      ctx->cached = true;
+      break;
+    case DHT_BUSY:
+      if (now_ms - d->started_ms < DHT_TIMEOUT_MS) return ESP_ERR_NOT_FINISHED;
+      dht_rmt_cancel(d);
       ctx->cached = false;
-      return r;
-    }
-    ctx->last_temp = t;
-    ctx->last_hum = h;
-    ctx->last_read_ms = (int)now_ms;
-    ctx->cached = true;
+      return ESP_ERR_TIMEOUT;
+    default:
+      // the sensors need a rest between two frames, reads in between get the last one
+      if (!ctx->cached || (now_ms - ctx->last_read_ms) >= DHT_MIN_INTERVAL_MS) {
+        esp_err_t err = dht_rmt_start(d);
+        return err == ESP_OK ? ESP_ERR_NOT_FINISHED : err;
+      }
+      break;
   }
 
   unsigned long long now = sn_get_unix_timestamp_ms();
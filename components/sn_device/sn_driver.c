@@ -1,9 +1,16 @@
 #include "sn_driver.h"
 #include "esp_log.h"
+#include "sn_actor.h"
 #include "sn_adc_helper.h"
+#include "sn_bus.h"
 #include "sn_driver/driver_inst.h"
+#include "sn_recovery.h"
 
+#ifdef CONFIG_SN_MAX_DRIVERS
+#define MAX_DRIVERS CONFIG_SN_MAX_DRIVERS
+#else
 #define MAX_DRIVERS 16
+#endif
 
 static const char *TAG = "SN_DRIVER";
 static const sn_driver_desc_t *driver_registry[MAX_DRIVERS];
@@ -11,10 +18,6 @@ static int driver_registry_len = 0;
 sn_device_instance_t gDeviceInstances[MAX_INSTANCES];
 size_t gDeviceInstancesLen = 0;
 
-/* bus mutexes (for i2c/spi shared protection if needed) */
-// static SemaphoreHandle_t i2c_mutex = NULL;
-// static SemaphoreHandle_t spi_mutex = NULL;
-
 /* Helper: find driver by supported_driver_name */
 static bool supports_driver(const sn_driver_desc_t *d, const char *name) {
   if (!d || !name || !d->supported_types) return false;
@@ -48,6 +51,7 @@ esp_err_t sn_driver_register(const sn_driver_desc_t *desc) {
 
 void sn_driver_bind_all_ports(const sn_device_port_desc_t *ports, size_t ports_len) {
   adc_helper_init();
+  ESP_ERROR_CHECK_WITHOUT_ABORT(sn_bus_init());
   gDeviceInstancesLen = 0;
 
   for (size_t i = 0; i < ports_len && gDeviceInstancesLen < MAX_INSTANCES; ++i) {
@@ -58,7 +62,6 @@ void sn_driver_bind_all_ports(const sn_device_port_desc_t *ports, size_t ports_l
     for (int j = 0; j < driver_registry_len; ++j) {
       const sn_driver_desc_t *d = driver_registry[j];
       if (!supports_driver(d, p->drv_name)) continue;
-      // protective locking for i2c/spi if needed would occur here
       bool ok = d->probe ? d->probe(p) : true;
       if (ok && d->priority > best_prio) {
         best_drv = d;
@@ -74,7 +77,7 @@ void sn_driver_bind_all_ports(const sn_device_port_desc_t *ports, size_t ports_l
     inst->interval_ms = 2000;
     inst->last_read_ms = 0;
     inst->consecutive_failures = 0;
-    inst->bus_lock = NULL;
+    inst->bus = NULL;
 
     const char *tstr = get_driver_type_str(p->drv_type);
 
@@ -82,9 +85,13 @@ void sn_driver_bind_all_ports(const sn_device_port_desc_t *ports, size_t ports_l
       inst->online = false;
       ESP_LOGE(TAG, "No driver for %s '%s' drv_name='%s'", tstr, p->port_name, p->drv_name);
     } else {
-      esp_err_t err = best_drv->init ? best_drv->init(p, &inst->ctx, sizeof(inst->ctx)) : ESP_OK;
+      // i2c/spi ports share their bus, the driver finds it in its instance
+      esp_err_t err = sn_bus_acquire(p, &inst->bus);
+      if (err == ESP_OK && best_drv->init) err = best_drv->init(p, &inst->ctx, sizeof(inst->ctx));
+      if (err == ESP_OK) err = sn_actor_mailbox_init(inst);
       if (err == ESP_OK) {
         inst->online = true;
+        inst->health = 100;
         // optional printing for driver type
         switch (inst->port->drv_type) {
           case DRIVER_TYPE_SENSOR: {
@@ -109,17 +116,19 @@ void sn_driver_bind_all_ports(const sn_device_port_desc_t *ports, size_t ports_l
           } break;
         }
       } else {
-        inst->online = false;
         ESP_LOGW(
           TAG, "Driver '%s' init failed for %s '%s' err=%d", best_drv->name, tstr, p->port_name, err
         );
         if (best_drv->deinit) best_drv->deinit(&inst->ctx);
+        // the recovery retries the init on the instance's actor
+        if (sn_actor_mailbox_init(inst) == ESP_OK) sn_recovery_mark_offline(inst);
       }
     }
     gDeviceInstancesLen++;
   }
 
   ESP_LOGW(TAG, "Bound %d devices", gDeviceInstancesLen);
+  ESP_ERROR_CHECK_WITHOUT_ABORT(sn_actor_pool_start());
 }
 
 sn_device_instance_t *sn_driver_get_device_instances() { return gDeviceInstances; }
@@ -0,0 +1,15 @@
+#include "sn_driver/driver_inst.h"
+#include "sn_actor.h"
+
+esp_err_t sn_device_instance_set_interval(sn_device_instance_t *inst, uint32_t new_interval) {
+  if (!inst) return ESP_ERR_INVALID_ARG;
+  if (!inst->online) return ESP_FAIL;
+  if (new_interval == 0) return ESP_ERR_INVALID_ARG;
+
+  sn_actor_msg_t msg = {.type = SN_ACTOR_MSG_SET_INTERVAL, .interval_ms = new_interval};
+  return sn_actor_post(inst, &msg, 0);
+}
+
+uint32_t sn_device_instance_get_interval(const sn_device_instance_t *inst) {
+  return __atomic_load_n(&inst->interval_ms, __ATOMIC_RELAXED);
+}
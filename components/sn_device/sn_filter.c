@@ -0,0 +1,82 @@
+#include "sn_driver/filter.h"
+#include <string.h>
+
+static float median(const sn_filter_stage_t *stage, sn_filter_state_t *st, float x) {
+  uint8_t n = stage->median.n;
+  if (n < 1) n = 1;
+  if (n > SN_FILTER_MEDIAN_MAX) n = SN_FILTER_MEDIAN_MAX;
+
+  st->median.window[st->median.head] = x;
+  st->median.head = (st->median.head + 1) % n;
+  if (st->median.len < n) st->median.len++;
+
+  // insertion sort of a copy, the window is a handful of samples
+  float sorted[SN_FILTER_MEDIAN_MAX];
+  uint8_t len = st->median.len;
+  for (uint8_t i = 0; i < len; i++) {
+    float v = st->median.window[i];
+    uint8_t j = i;
+    for (; j > 0 && sorted[j - 1] > v; j--) sorted[j] = sorted[j - 1];
+    sorted[j] = v;
+  }
+  // a window not yet full gives the median of what it has
+  return len % 2 ? sorted[len / 2] : (sorted[len / 2 - 1] + sorted[len / 2]) / 2;
+}
+
+static float ema(const sn_filter_stage_t *stage, sn_filter_state_t *st, float x) {
+  if (!st->primed) {
+    st->ema.y = x;
+  } else {
+    st->ema.y += stage->ema.alpha * (x - st->ema.y);
+  }
+  return st->ema.y;
+}
+
+// Random walk model: the value holds between samples up to a drift of variance q
+static float kalman(const sn_filter_stage_t *stage, sn_filter_state_t *st, float x) {
+  if (!st->primed) {
+    st->kalman.x = x;
+    st->kalman.p = stage->kalman.r;
+    return x;
+  }
+  float p = st->kalman.p + stage->kalman.q;
+  float k = p / (p + stage->kalman.r);
+  st->kalman.x += k * (x - st->kalman.x);
+  st->kalman.p = (1.0f - k) * p;
+  return st->kalman.x;
+}
+
+static float clamp(const sn_filter_stage_t *stage, float x) {
+  if (x < stage->clamp.min) return stage->clamp.min;
+  if (x > stage->clamp.max) return stage->clamp.max;
+  return x;
+}
+
+float sn_filter_chain_apply(sn_filter_chain_t *chain, float value) {
+  if (!chain) return value;
+  for (uint8_t i = 0; i < chain->len; i++) {
+    const sn_filter_stage_t *stage = &chain->stages[i];
+    sn_filter_state_t *st = &chain->state[i];
+    switch (stage->kind) {
+      case SN_FILTER_MEDIAN:
+        value = median(stage, st, value);
+        break;
+      case SN_FILTER_EMA:
+        value = ema(stage, st, value);
+        break;
+      case SN_FILTER_KALMAN:
+        value = kalman(stage, st, value);
+        break;
+      case SN_FILTER_CLAMP:
+        value = clamp(stage, value);
+        break;
+    }
+    st->primed = true;
+  }
+  return value;
+}
+
+void sn_filter_chain_reset(sn_filter_chain_t *chain) {
+  if (!chain) return;
+  memset(chain->state, 0, chain->len * sizeof(*chain->state));
+}
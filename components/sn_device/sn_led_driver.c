@@ -189,6 +189,15 @@ static esp_err_t led_controller(void *ctxv, const cJSON *paramsJson, cJSON **out
   return ESP_OK;
 }
 
+static cJSON *led_report_state(void *ctxv) {
+  led_ctx_t *ctx = (led_ctx_t *)ctxv;
+  cJSON *state = cJSON_CreateObject();
+  if (!state) return NULL;
+  cJSON_AddBoolToObject(state, "enable", ctx->on);
+  cJSON_AddNumberToObject(state, "brightness", ctx->brightness);
+  return state;
+}
+
 // --------------------------------------------------------------------------------
 // Export driver desc
 // --------------------------------------------------------------------------------
@@ -201,5 +210,6 @@ const sn_driver_desc_t led_driver = {
   .deinit = led_deinit,
   .read_multi = NULL,
   .control = led_controller,
+  .report_state = led_report_state,
   .command_desc = &schema
 };
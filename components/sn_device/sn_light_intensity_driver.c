@@ -3,29 +3,202 @@
 #include "sn_adc_helper.h"
 #include "sn_driver/sensor.h"
 #include "sn_driver_registry.h"
+#include "sn_prof.h"
 
 #include "esp_timer.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "nvs.h"
+#include "sn_json.h"
 #include "sn_sntp.h"
+#include "sn_storage.h"
 #include "soc/gpio_num.h"
 #include <math.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 #include <time.h>
-#include "esp_adc/adc_oneshot.h"
 
 static const char *TAG = "SN_LIGHT_INTENSITY_DRIVER";
 static const char *light_intensity_sensor_types[] = {"lm393", NULL};
 
+// Default calibration of the lm393 module: lux = A * exp(B * D), D the percentage of the
+// way from bright_mv to dark_mv (the ldr pulls the output down in the light). Sampled
+// into the table at init, 32 segments keep the chords within 5% of the curve
+#define LIGHT_MODEL_A     8038.29f // max lux in bright conditions
+#define LIGHT_MODEL_B     -0.1893f // exponential decay rate
+#define LIGHT_BRIGHT_MV   100      // defaults until the module is calibrated
+#define LIGHT_DARK_MV     3000
+#define LIGHT_MV_MAX      3300
+#define LIGHT_LUT_POINTS  33
+#define LIGHT_LUX_MAX     200000 // keeps the Q12 values and slopes in 32 bits
+#define LIGHT_MAX_DEVICES 2
+#define LIGHT_Q           12
+
+// Piecewise-linear mv -> lux, sorted by mv. The slope runs to the next point
+typedef struct {
+  uint16_t mv;
+  int32_t lux;   // Q12
+  int32_t slope; // Q12 lux per mV
+} light_lut_point_t;
+
+typedef struct {
+  bool used;
+  bool custom; // an uploaded curve, the model endpoints do not apply
+  uint8_t len;
+  light_lut_point_t points[LIGHT_LUT_POINTS];
+} light_lut_t;
+
+// An uploaded curve as stored in NVS as lux_<local id>
+typedef struct {
+  uint16_t mv;
+  float lux;
+} light_curve_point_t;
+
+// Endpoints of the model, stored in NVS as cal_<local id>
+typedef struct {
+  uint32_t bright_mv;
+  uint32_t dark_mv;
+} light_cal_t;
+
 struct light_intensity_ctx_s {
   adc1_channel_t channel;
   local_id_t sensor_id;
-  float A; // calibration: # max lux in bright conditions
-  float B; // calibration: # exponential decay rate
-  uint32_t dark_mv;
-  uint32_t bright_mv;
+  light_lut_t *lut; // read and replaced on the instance's actor only
+  uint16_t bright_mv;
+  uint16_t dark_mv;
+};
+
+static light_lut_t s_luts[LIGHT_MAX_DEVICES];
+// taking and releasing a table of the pool, binds and recoveries run on different actors
+static portMUX_TYPE s_lut_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *light_points[] = {"bright", "dark", NULL};
+
+static const sn_param_desc_t params_desc[] = {
+  // back to the default calibration, before the other params apply
+  {.name = "reset", .type = PTYPE_BOOL, .required = false},
+  // model endpoints: the current reading as the point, the explicit values below win
+  {.name = "capture", .type = PTYPE_STRING, .enum_values = light_points, .required = false},
+  {.name = "bright_mv", .type = PTYPE_INT, .min = 0, .max = LIGHT_MV_MAX, .required = false},
+  {.name = "dark_mv", .type = PTYPE_INT, .min = 0, .max = LIGHT_MV_MAX, .required = false},
+  // [[mv, lux], ...] by increasing mv, replaces the model
+  {.name = "curve", .type = PTYPE_ARRAY, .required = false, .min = 2, .max = LIGHT_LUT_POINTS},
+  {.name = NULL}
+};
+
+static const sn_command_desc_t schema = {
+  .action = "calibrate",
+  .params = params_desc,
 };
 
+// --------------------------------------------------------------------------------
+// Table
+// --------------------------------------------------------------------------------
+
+static void lut_key(local_id_t id, char key[16]) { snprintf(key, 16, "lux_%02x", id); }
+
+static void cal_key(local_id_t id, char key[16]) { snprintf(key, 16, "cal_%02x", id); }
+
+static inline bool cal_valid(const light_cal_t *cal) {
+  return cal->bright_mv <= LIGHT_MV_MAX && cal->dark_mv <= LIGHT_MV_MAX
+         && cal->bright_mv != cal->dark_mv;
+}
+
+// false if the mv are not strictly increasing or a value is out of range
+static bool lut_build(light_lut_point_t *out, const light_curve_point_t *curve, uint8_t len) {
+  for (uint8_t i = 0; i < len; i++) {
+    if (!(curve[i].lux >= 0.0f && curve[i].lux <= LIGHT_LUX_MAX)) return false;
+    if (i > 0 && curve[i].mv <= curve[i - 1].mv) return false;
+    out[i].mv = curve[i].mv;
+    out[i].lux = (int32_t)lroundf(curve[i].lux * (1 << LIGHT_Q));
+  }
+  for (uint8_t i = 0; i + 1 < len; i++) {
+    out[i].slope = (out[i + 1].lux - out[i].lux) / (out[i + 1].mv - out[i].mv);
+  }
+  out[len - 1].slope = 0;
+  return true;
+}
+
+// A module wired the other way round reads higher in the light, its table is built
+// backwards so the mv still increase
+static void lut_build_model(light_lut_point_t *out, uint32_t bright_mv, uint32_t dark_mv) {
+  light_curve_point_t curve[LIGHT_LUT_POINTS];
+  bool inverted = bright_mv > dark_mv;
+  int32_t span = (int32_t)dark_mv - (int32_t)bright_mv;
+  for (int i = 0; i < LIGHT_LUT_POINTS; i++) {
+    float d = 100.0f * i / (LIGHT_LUT_POINTS - 1);
+    light_curve_point_t *p = &curve[inverted ? LIGHT_LUT_POINTS - 1 - i : i];
+    p->mv = (uint16_t)((int32_t)bright_mv + span * i / (LIGHT_LUT_POINTS - 1));
+    p->lux = LIGHT_MODEL_A * expf(LIGHT_MODEL_B * d);
+  }
+  lut_build(out, curve, LIGHT_LUT_POINTS);
+}
+
+// Interpolation of the segment holding mv, flat past both ends
+static float lut_lookup(const light_lut_t *lut, uint32_t mv) {
+  const light_lut_point_t *p = lut->points;
+  if (mv <= p[0].mv) return (float)p[0].lux / (1 << LIGHT_Q);
+  if (mv >= p[lut->len - 1].mv) return (float)p[lut->len - 1].lux / (1 << LIGHT_Q);
+
+  uint8_t lo = 0, hi = lut->len - 1;
+  while (hi - lo > 1) {
+    uint8_t mid = (lo + hi) / 2;
+    if (p[mid].mv <= mv) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  int64_t lux = p[lo].lux + (int64_t)p[lo].slope * (int32_t)(mv - p[lo].mv);
+  return lux > 0 ? (float)lux / (1 << LIGHT_Q) : 0.0f;
+}
+
+// Replace the table of a port, on its actor like the reads of it
+static void lut_install(
+  light_lut_t *lut, const light_lut_point_t *points, uint8_t len, bool custom
+) {
+  memcpy(lut->points, points, len * sizeof(*points));
+  lut->len = len;
+  lut->custom = custom;
+}
+
+static void install_model(light_intensity_ctx_t *c) {
+  light_lut_point_t points[LIGHT_LUT_POINTS];
+  lut_build_model(points, c->bright_mv, c->dark_mv);
+  lut_install(c->lut, points, LIGHT_LUT_POINTS, false);
+}
+
+// Endpoints first, a stored curve then takes over from the model they describe
+static void calibration_load(light_intensity_ctx_t *c) {
+  char key[16];
+  light_cal_t cal;
+  size_t len = sizeof(cal);
+  cal_key(c->sensor_id, key);
+  if (sn_storage_get_blob(key, &cal, &len) == ESP_OK && len == sizeof(cal) && cal_valid(&cal)) {
+    c->bright_mv = cal.bright_mv;
+    c->dark_mv = cal.dark_mv;
+  }
+
+  light_lut_point_t points[LIGHT_LUT_POINTS];
+  light_curve_point_t curve[LIGHT_LUT_POINTS];
+  len = sizeof(curve);
+  lut_key(c->sensor_id, key);
+  if (sn_storage_get_blob(key, curve, &len) == ESP_OK
+      && len % sizeof(curve[0]) == 0
+      && len / sizeof(curve[0]) >= 2
+      && lut_build(points, curve, len / sizeof(curve[0]))) {
+    lut_install(c->lut, points, len / sizeof(curve[0]), true);
+    ESP_LOGI(TAG, "Loaded calibration curve of %d points for 0x%02x", c->lut->len, c->sensor_id);
+    return;
+  }
+  install_model(c);
+}
+
+// --------------------------------------------------------------------------------
+// Driver
+// --------------------------------------------------------------------------------
+
 static esp_err_t light_intensity_sensor_init(
   const sn_device_port_desc_t *port, void *ctx_out, size_t ctx_size
 ) {
@@ -41,10 +214,9 @@ static esp_err_t light_intensity_sensor_init(
   light_intensity_ctx_t ctx = {
     .channel = adc_helper_pin_to_channel(pin),
     .sensor_id = pm_get_local_id(port->desc.s.measurements, ST_LIGHT_INTENSITY),
-    .A = 8038.29f,
-    .B = -0.1893f,
-    .dark_mv = 100,
-    .bright_mv = 3000
+    .lut = NULL,
+    .bright_mv = LIGHT_BRIGHT_MV,
+    .dark_mv = LIGHT_DARK_MV,
   };
 
   if (ctx.sensor_id == 0) {
@@ -59,14 +231,33 @@ static esp_err_t light_intensity_sensor_init(
     return ESP_ERR_NOT_SUPPORTED;
   }
 
-  adc_helper_config_channel_atten(ctx.channel, ADC_ATTEN_DB_12);
+  esp_err_t err = adc_helper_config_channel_atten(ctx.channel, ADC_ATTEN_DB_12);
+  if (err != ESP_OK) return err;
+
+  taskENTER_CRITICAL(&s_lut_lock);
+  for (int i = 0; i < LIGHT_MAX_DEVICES && !ctx.lut; i++) {
+    if (!s_luts[i].used) {
+      ctx.lut = &s_luts[i];
+      ctx.lut->used = true;
+    }
+  }
+  taskEXIT_CRITICAL(&s_lut_lock);
+  if (!ctx.lut) return ESP_ERR_NO_MEM;
+  calibration_load(&ctx);
 
   memcpy(ctx_out, &ctx, sizeof(ctx));
 
   return ESP_OK;
 }
 
-static void light_intensity_sensor_deinit(void *ctx) { (void)ctx; }
+static void light_intensity_sensor_deinit(void *ctx) {
+  light_intensity_ctx_t *c = (light_intensity_ctx_t *)ctx;
+  if (!c || !c->lut) return;
+  taskENTER_CRITICAL(&s_lut_lock);
+  c->lut->used = false;
+  taskEXIT_CRITICAL(&s_lut_lock);
+  c->lut = NULL;
+}
 
 static bool light_intensity_sensor_probe(const sn_device_port_desc_t *port) {
   if (!port) return false;
@@ -76,34 +267,186 @@ static bool light_intensity_sensor_probe(const sn_device_port_desc_t *port) {
 static esp_err_t light_intensity_sensor_read_multi(
   void *ctxv, sn_sensor_reading_t *out_buf, int max_out, int *out_count
 ) {
+  SN_PROF_SCOPE("read.light");
   if (!ctxv || !out_buf) return ESP_ERR_INVALID_ARG;
   light_intensity_ctx_t *c = (light_intensity_ctx_t *)ctxv;
-  int raw = adc_helper_read_raw_avg(c->channel, 4);
-  if (raw < 0) return ESP_FAIL;
-  uint32_t mv = adc_helper_raw_to_mv(c->channel, raw);
-
-  uint32_t dark = c->dark_mv;
-  uint32_t bright = c->bright_mv;
-  if (bright == dark) return ESP_ERR_INVALID_STATE;
+  if (!c->lut) return ESP_ERR_INVALID_STATE;
+  // filtered in the background by the adc helper
+  uint32_t mv = 0;
+  esp_err_t err = adc_helper_read_mv(c->channel, &mv);
+  if (err != ESP_OK) return err;
 
-  float D = 0.0f;
-  if (mv <= dark) {
-    D = 0.0f;
-  } else if (mv >= bright) {
-    D = 100.0f;
-  } else {
-    D = ((float)(mv - dark) / (float)(bright - dark)) * 100.0f;
-    if (D < 0.0f) D = 0.0f;
-    if (D > 100.0f) D = 100.0f;
-  }
+  float lux = lut_lookup(c->lut, mv);
 
   out_buf[0].local_id = c->sensor_id;
-  out_buf[0].value = c->A * exp(c->B * D);
+  out_buf[0].value = lux;
   out_buf[0].ts = sn_get_unix_timestamp_ms();
   *out_count = 1;
   return ESP_OK;
 }
 
+// A calibrate command, parsed and checked as a whole before any of it is applied
+typedef struct {
+  bool reset;
+  bool endpoints;
+  light_cal_t cal;   // endpoints after the command
+  uint8_t curve_len; // 0 without a curve
+  light_curve_point_t curve[LIGHT_LUT_POINTS];
+  light_lut_point_t points[LIGHT_LUT_POINTS];
+} light_calibrate_t;
+
+// The endpoints start from the defaults on a reset, from the current ones otherwise
+static esp_err_t parse_endpoints(
+  const light_intensity_ctx_t *c, const cJSON *params, light_calibrate_t *req, cJSON **out_result
+) {
+  req->cal = req->reset ? (light_cal_t){.bright_mv = LIGHT_BRIGHT_MV, .dark_mv = LIGHT_DARK_MV}
+                        : (light_cal_t){.bright_mv = c->bright_mv, .dark_mv = c->dark_mv};
+  if (!req->endpoints) return ESP_OK;
+
+  const char *capture = NULL;
+  if (json_get_string(params, "capture", &capture)) {
+    uint32_t mv = 0;
+    esp_err_t err = adc_helper_read_mv(c->channel, &mv);
+    if (err != ESP_OK) {
+      if (out_result) *out_result = build_error_fmt("no reading to capture");
+      return err;
+    }
+    if (strcmp(capture, "bright") == 0) {
+      req->cal.bright_mv = mv;
+    } else {
+      req->cal.dark_mv = mv;
+    }
+  }
+  int v = 0;
+  if (json_get_int(params, "bright_mv", &v)) req->cal.bright_mv = (uint32_t)v;
+  if (json_get_int(params, "dark_mv", &v)) req->cal.dark_mv = (uint32_t)v;
+  if (!cal_valid(&req->cal)) {
+    if (out_result) *out_result = build_error_fmt("bright_mv and dark_mv must differ");
+    return ESP_ERR_INVALID_ARG;
+  }
+  return ESP_OK;
+}
+
+static esp_err_t parse_curve(const cJSON *arr, light_calibrate_t *req, cJSON **out_result) {
+  uint8_t len = 0;
+  const cJSON *item = NULL;
+  cJSON_ArrayForEach(item, arr) {
+    const cJSON *mv = cJSON_GetArrayItem(item, 0);
+    const cJSON *lux = cJSON_GetArrayItem(item, 1);
+    if (!cJSON_IsArray(item) || cJSON_GetArraySize(item) != 2 || !cJSON_IsNumber(mv)
+        || !cJSON_IsNumber(lux) || mv->valuedouble < 0 || mv->valuedouble > UINT16_MAX
+        || lux->valuedouble < 0) {
+      if (out_result) *out_result = build_error_fmt("curve point %d is not [mv, lux]", len);
+      return ESP_ERR_INVALID_ARG;
+    }
+    req->curve[len++] = (light_curve_point_t){
+      .mv = (uint16_t)mv->valuedouble, .lux = (float)lux->valuedouble
+    };
+  }
+  if (!lut_build(req->points, req->curve, len)) {
+    if (out_result)
+      *out_result =
+        build_error_fmt("curve mv must increase and lux stay below %d", LIGHT_LUX_MAX);
+    return ESP_ERR_INVALID_ARG;
+  }
+  req->curve_len = len;
+  return ESP_OK;
+}
+
+// Store first, the ctx and the table only change once NVS holds the new calibration
+static esp_err_t calibration_apply(
+  light_intensity_ctx_t *c, const light_calibrate_t *req, cJSON **out_result
+) {
+  char key[16];
+  esp_err_t err = ESP_OK;
+  if (req->curve_len) {
+    lut_key(c->sensor_id, key);
+    err = sn_storage_set_blob(key, req->curve, req->curve_len * sizeof(req->curve[0]));
+  } else if (req->reset) {
+    lut_key(c->sensor_id, key);
+    err = sn_storage_erase_key(key);
+  }
+  if (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND) {
+    cal_key(c->sensor_id, key);
+    err = ESP_OK;
+    if (req->endpoints) {
+      err = sn_storage_set_blob(key, &req->cal, sizeof(req->cal));
+    } else if (req->reset) {
+      err = sn_storage_erase_key(key);
+    }
+  }
+  if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+    if (out_result) {
+      *out_result = build_error_fmt("failed to store calibration: %s", esp_err_to_name(err));
+    }
+    return err;
+  }
+
+  c->bright_mv = (uint16_t)req->cal.bright_mv;
+  c->dark_mv = (uint16_t)req->cal.dark_mv;
+  if (req->curve_len) {
+    lut_install(c->lut, req->points, req->curve_len, true);
+  } else if (req->reset || !c->lut->custom) {
+    install_model(c);
+  }
+  return ESP_OK;
+}
+
+// {"reset": true} goes back to the defaults, {"capture": "bright"|"dark"} takes the
+// current reading as that endpoint of the model and {"bright_mv", "dark_mv"} set them,
+// {"curve": [[mv, lux], ...]} replaces the model with a measured curve. A command with
+// any invalid part changes nothing, a valid one is stored and applied from the next
+// reading
+static esp_err_t light_intensity_sensor_control(
+  void *ctxv, const cJSON *paramsJson, cJSON **out_result
+) {
+  if (!ctxv || !paramsJson) return ESP_ERR_INVALID_ARG;
+  light_intensity_ctx_t *c = (light_intensity_ctx_t *)ctxv;
+  if (!c->lut) return ESP_ERR_INVALID_STATE;
+  if (!validate_params_json(params_desc, paramsJson, out_result)) return ESP_ERR_INVALID_ARG;
+
+  light_calibrate_t req = {
+    .endpoints = cJSON_HasObjectItem(paramsJson, "capture")
+                 || cJSON_HasObjectItem(paramsJson, "bright_mv")
+                 || cJSON_HasObjectItem(paramsJson, "dark_mv"),
+  };
+  const cJSON *curve = cJSON_GetObjectItemCaseSensitive(paramsJson, "curve");
+  json_get_bool(paramsJson, "reset", &req.reset);
+  if (!req.reset && !req.endpoints && !curve) {
+    if (out_result) *out_result = build_error_fmt("nothing to calibrate");
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  esp_err_t err = parse_endpoints(c, paramsJson, &req, out_result);
+  if (err == ESP_OK && curve) err = parse_curve(curve, &req, out_result);
+  if (err == ESP_OK) err = calibration_apply(c, &req, out_result);
+  if (err != ESP_OK) {
+    if (out_result && !*out_result) {
+      *out_result = build_error_fmt("calibration failed: %s", esp_err_to_name(err));
+    }
+    return err;
+  }
+  if (out_result) {
+    *out_result = build_success_fmt(
+      "bright_mv=%u dark_mv=%u curve=%d", c->bright_mv, c->dark_mv,
+      c->lut->custom ? c->lut->len : 0
+    );
+  }
+  return ESP_OK;
+}
+
+static cJSON *light_intensity_sensor_report_calibration(void *ctxv) {
+  const light_intensity_ctx_t *c = (const light_intensity_ctx_t *)ctxv;
+  if (!c->lut) return NULL;
+  cJSON *cal = cJSON_CreateObject();
+  if (!cal) return NULL;
+  cJSON_AddNumberToObject(cal, "bright_mv", c->bright_mv);
+  cJSON_AddNumberToObject(cal, "dark_mv", c->dark_mv);
+  // points of the uploaded curve in use, 0 for the model
+  cJSON_AddNumberToObject(cal, "curve", c->lut->custom ? c->lut->len : 0);
+  return cal;
+}
+
 const sn_driver_desc_t light_intensity_driver = {
   .name = "light_intensity_sensor_drv",
   .supported_types = light_intensity_sensor_types,
@@ -111,7 +454,8 @@ const sn_driver_desc_t light_intensity_driver = {
   .probe = light_intensity_sensor_probe,
   .init = light_intensity_sensor_init,
   .read_multi = light_intensity_sensor_read_multi,
-  .control = NULL,
+  .control = light_intensity_sensor_control,
   .deinit = light_intensity_sensor_deinit,
-  .command_desc = NULL
+  .report_calibration = light_intensity_sensor_report_calibration,
+  .command_desc = &schema
 };
@@ -0,0 +1,54 @@
+#include "forward.h"
+#include "sn_driver.h"
+#include "sn_driver_registry.h"
+#include "sn_json.h"
+#include "sn_metrics.h"
+
+static const char *metrics_types[] = {"metrics", ((void *)0)};
+static const sn_param_desc_t params_desc[] = {
+  {.name = "reset", .type = PTYPE_BOOL, .required = false},
+  {.name = ((void *)0)}
+};
+
+static const sn_command_desc_t schema = {
+  .action = "get_metrics",
+  .params = params_desc,
+};
+
+static esp_err_t metrics_init(const sn_device_port_desc_t *desc, void *ctx_out, size_t ctx_size) {
+  return ESP_OK;
+}
+
+static void metrics_deinit(void *ctx) { (void)ctx; }
+
+static esp_err_t metrics_controller(void *ctxv, const cJSON *paramsJson, cJSON **out_result) {
+  if (paramsJson && !validate_params_json(params_desc, paramsJson, out_result)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  cJSON *result = build_success_fmt(NULL);
+  cJSON_AddItemToObject(result, "metrics", sn_metrics_to_json());
+
+  // snapshot first so the values cleared are the ones returned
+  bool reset = false;
+  if (json_get_bool(paramsJson, "reset", &reset) && reset) sn_metrics_reset();
+
+  if (out_result) {
+    *out_result = result;
+  } else {
+    cJSON_Delete(result);
+  }
+  return ESP_OK;
+}
+
+const sn_driver_desc_t metrics_driver = {
+  .name = "metrics_drv",
+  .supported_types = metrics_types,
+  .priority = 50,
+  .probe = NULL,
+  .init = metrics_init,
+  .deinit = metrics_deinit,
+  .read_multi = NULL,
+  .control = metrics_controller,
+  .command_desc = &schema
+};
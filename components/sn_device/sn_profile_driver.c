@@ -0,0 +1,59 @@
+#include "forward.h"
+#include "sn_driver.h"
+#include "sn_driver_registry.h"
+#include "sn_json.h"
+#include "sn_prof.h"
+
+static const char *profile_types[] = {"profile", ((void *)0)};
+static const sn_param_desc_t params_desc[] = {
+  {.name = "reset", .type = PTYPE_BOOL, .required = false},
+  {.name = ((void *)0)}
+};
+
+static const sn_command_desc_t schema = {
+  .action = "get_profile",
+  .params = params_desc,
+};
+
+static esp_err_t profile_init(const sn_device_port_desc_t *desc, void *ctx_out, size_t ctx_size) {
+  return ESP_OK;
+}
+
+static void profile_deinit(void *ctx) { (void)ctx; }
+
+static esp_err_t profile_controller(void *ctxv, const cJSON *paramsJson, cJSON **out_result) {
+  if (paramsJson && !validate_params_json(params_desc, paramsJson, out_result)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  cJSON *profile = sn_prof_to_json();
+  if (!profile) {
+    if (out_result) *out_result = build_error_fmt("profiling is not enabled in this build");
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  cJSON *result = build_success_fmt(NULL);
+  cJSON_AddItemToObject(result, "profile", profile);
+
+  // snapshot first so the values cleared are the ones returned
+  bool reset = false;
+  if (json_get_bool(paramsJson, "reset", &reset) && reset) sn_prof_reset();
+
+  if (out_result) {
+    *out_result = result;
+  } else {
+    cJSON_Delete(result);
+  }
+  return ESP_OK;
+}
+
+const sn_driver_desc_t profile_driver = {
+  .name = "profile_drv",
+  .supported_types = profile_types,
+  .priority = 50,
+  .probe = NULL,
+  .init = profile_init,
+  .deinit = profile_deinit,
+  .read_multi = NULL,
+  .control = profile_controller,
+  .command_desc = &schema
+};
@@ -0,0 +1,128 @@
+#include "sn_recovery.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sn_actor.h"
+#include "sn_bus.h"
+#include "sn_driver.h"
+#include "sn_sntp.h"
+
+static const char *TAG = "SN_RECOVERY";
+static sn_recovery_event_cb_t s_event_cb = NULL;
+
+static inline uint64_t now_ms(void) { return esp_timer_get_time() / 1000ULL; }
+
+static uint32_t backoff_ms(uint16_t attempts) {
+  uint32_t ms = SN_RECOVERY_BACKOFF_MIN_MS;
+  for (uint16_t i = 0; i < attempts && ms < SN_RECOVERY_BACKOFF_MAX_MS; i++) ms *= 2;
+  return ms < SN_RECOVERY_BACKOFF_MAX_MS ? ms : SN_RECOVERY_BACKOFF_MAX_MS;
+}
+
+static void emit_event(
+  sn_device_event_e type, const sn_device_instance_t *inst, double value, double threshold
+) {
+  if (!s_event_cb) return;
+  sn_device_event_t event = {
+    .event_type = type,
+    .source = inst->port->port_name,
+    .value = value,
+    .threshold = threshold,
+    .ts = sn_get_unix_timestamp_ms(),
+  };
+  s_event_cb(&event);
+}
+
+// Runs on the instance's actor, the poll task leaves an offline instance alone so the
+// driver ctx is ours until online is set again
+static void attempt(sn_device_instance_t *inst, void *arg) {
+  const sn_driver_desc_t *d = inst->driver;
+  const sn_device_port_desc_t *p = inst->port;
+
+  // the dead binding still holds its pool slot and channels
+  if (d->deinit) d->deinit(&inst->ctx);
+  esp_err_t err = ESP_ERR_NOT_FOUND;
+  if (!d->probe || d->probe(p)) {
+    // the bus may have failed to open at bind, init would never find it
+    err = inst->bus ? ESP_OK : sn_bus_acquire(p, &inst->bus);
+    if (err == ESP_OK && d->init) err = d->init(p, &inst->ctx, sizeof(inst->ctx));
+  }
+
+  if (err != ESP_OK) {
+    if (d->deinit) d->deinit(&inst->ctx);
+    inst->recovery_attempts++;
+    uint32_t delay = backoff_ms(inst->recovery_attempts);
+    inst->next_recovery_ms = now_ms() + delay;
+    ESP_LOGW(
+      TAG, "Port %s still offline err=%d attempt=%d, next in %lu ms", p->port_name, err,
+      inst->recovery_attempts, (unsigned long)delay
+    );
+  } else {
+    ESP_LOGW(
+      TAG, "Port %s back online after %d attempts", p->port_name, inst->recovery_attempts + 1
+    );
+    emit_event(DEVICE_EVENT_PORT_ONLINE, inst, inst->recovery_attempts + 1, 0);
+    // readings from before the outage say nothing about the new ones
+    if (p->drv_type == DRIVER_TYPE_SENSOR) {
+      FOR_EACH_MEASUREMENT(m, p->desc.s.measurements) sn_filter_chain_reset(m->filter);
+    }
+    inst->recovery_attempts = 0;
+    inst->consecutive_failures = 0;
+    inst->last_read_ms = 0;
+    __atomic_store_n(&inst->online, true, __ATOMIC_RELEASE);
+  }
+  __atomic_store_n(&inst->recovery_pending, 0, __ATOMIC_RELEASE);
+}
+
+// --------------------------------------------------------------------------------
+// API
+// --------------------------------------------------------------------------------
+
+void sn_recovery_set_event_handler(sn_recovery_event_cb_t cb) { s_event_cb = cb; }
+
+// The score moves an eighth of the way up on a good read and a quarter down on a
+// failed one, a port failing one read in four settles around 60
+void sn_recovery_record_read(sn_device_instance_t *inst, bool ok) {
+  if (!inst) return;
+  uint8_t h = inst->health;
+  if (ok) {
+    inst->health = h + (100 - h + 7) / 8;
+    inst->consecutive_failures = 0;
+    return;
+  }
+  inst->health = h - (h + 3) / 4;
+  if (++inst->consecutive_failures >= SN_RECOVERY_FAIL_THRESHOLD) sn_recovery_mark_offline(inst);
+}
+
+void sn_recovery_mark_offline(sn_device_instance_t *inst) {
+  if (!inst) return;
+  __atomic_store_n(&inst->online, false, __ATOMIC_RELEASE);
+  if (!inst->driver) return;
+  inst->recovery_attempts = 0;
+  inst->next_recovery_ms = now_ms() + backoff_ms(0);
+  ESP_LOGW(
+    TAG, "Port %s offline, retry in %d ms", inst->port->port_name, SN_RECOVERY_BACKOFF_MIN_MS
+  );
+  emit_event(
+    DEVICE_EVENT_PORT_OFFLINE, inst, inst->consecutive_failures, SN_RECOVERY_FAIL_THRESHOLD
+  );
+}
+
+void sn_recovery_poll(uint64_t now_ms) {
+  FOR_EACH_INSTANCE(it, gDeviceInstances, gDeviceInstancesLen) {
+    if (!it->driver || !it->mailbox || __atomic_load_n(&it->online, __ATOMIC_ACQUIRE)) continue;
+    if (__atomic_load_n(&it->recovery_pending, __ATOMIC_ACQUIRE)) continue;
+    if (now_ms < it->next_recovery_ms) continue;
+
+    it->recovery_pending = 1;
+    sn_actor_msg_t msg = {.type = SN_ACTOR_MSG_CALL, .call = {.fn = attempt, .arg = NULL}};
+    if (sn_actor_post(it, &msg, 0) != ESP_OK) it->recovery_pending = 0;
+  }
+}
+
+cJSON *sn_recovery_health_to_json(void) {
+  cJSON *json = cJSON_CreateObject();
+  if (!json) return NULL;
+  FOR_EACH_INSTANCE(it, gDeviceInstances, gDeviceInstancesLen) {
+    if (it->driver) cJSON_AddNumberToObject(json, it->port->port_name, it->health);
+  }
+  return json;
+}
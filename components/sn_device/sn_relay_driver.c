@@ -1,56 +1,43 @@
 #include "sn_driver_registry.h"
+#include "sn_actor.h"
 #include "sn_json.h"
 #include "driver/gpio.h"
+#include "esp_timer.h"
 #include <stdint.h>
 
 static const char *TAG = "SN_RELAY_DRIVER";
 static const char *relay_types[] = {"relay", NULL};
 
+// Every access happens on the instance's actor, including the end of a pulse which is
+// posted back from the esp_timer task
 struct relay_ctx_s {
   gpio_num_t pin;
-  TaskHandle_t task;
-  QueueHandle_t queue;
+  esp_timer_handle_t pulse_timer;
   int on_level; // some relay required 0v to turn on
   int off_level;
+  // bumped on the actor by every control changing the output, a queued pulse end from
+  // an older generation must not switch off what came after it
+  uint32_t pulse_gen;
   bool on;
 };
 
-typedef enum { RELAY_CMD_ON, RELAY_CMD_OFF, RELAY_CMD_TOGGLE, RELAY_CMD_PULSE } relay_cmd_t;
-
-typedef struct {
-  relay_cmd_t cmd;
-  uint32_t duration_ms;
-} relay_msg_t;
-
-static void relay_task(void *pvParams) {
-  if (!pvParams) vTaskDelete(NULL);
-  relay_ctx_t *ctx = (relay_ctx_t *)pvParams;
-  relay_msg_t msg;
-  for (;;) {
-    while (xQueueReceive(ctx->queue, &msg, portMAX_DELAY) == pdTRUE) {
-      switch (msg.cmd) {
-        case RELAY_CMD_ON:
-          gpio_set_level(ctx->pin, ctx->on_level);
-          break;
-        case RELAY_CMD_OFF:
-          gpio_set_level(ctx->pin, ctx->off_level);
-          break;
-        case RELAY_CMD_TOGGLE:
-          gpio_set_level(ctx->pin, !gpio_get_level(ctx->pin));
-          break;
-        case RELAY_CMD_PULSE:
-          gpio_set_level(ctx->pin, ctx->on_level);
-          vTaskDelay(pdMS_TO_TICKS(msg.duration_ms));
-          gpio_set_level(ctx->pin, ctx->off_level);
-          break;
-      }
-    }
-  }
+static inline void relay_set(relay_ctx_t *ctx, bool on) {
+  gpio_set_level(ctx->pin, on ? ctx->on_level : ctx->off_level);
+  ctx->on = on;
+}
+
+static void relay_pulse_end(sn_device_instance_t *inst, void *arg) {
+  relay_ctx_t *ctx = (relay_ctx_t *)&inst->ctx;
+  if ((uint32_t)(uintptr_t)arg != ctx->pulse_gen) return;
+  relay_set(ctx, false);
 }
 
-int relay_send(QueueHandle_t relayQueue, relay_cmd_t cmd, uint32_t duration_ms) {
-  relay_msg_t msg = {.cmd = cmd, .duration_ms = duration_ms};
-  return xQueueSend(relayQueue, &msg, 0);
+static void relay_pulse_timer_cb(void *arg) {
+  sn_device_instance_t *inst = (sn_device_instance_t *)arg;
+  uint32_t gen = __atomic_load_n(&((relay_ctx_t *)&inst->ctx)->pulse_gen, __ATOMIC_ACQUIRE);
+  if (sn_actor_call(inst, relay_pulse_end, (void *)(uintptr_t)gen) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to end pulse on %s", inst->port->port_name);
+  }
 }
 
 static const sn_param_desc_t params_desc[] = {
@@ -86,21 +73,37 @@ static esp_err_t relay_init(const sn_device_port_desc_t *port, void *ctx_out, si
   // Initially set to 1
   // TODO: on, off level detection for cross relay model
   relay_ctx_t ctx = {
-    .queue = xQueueCreate(2, sizeof(relay_msg_t)),
-    .task = NULL, // set task handle to null
+    .pulse_timer = NULL,
     .pin = pin,
     .on_level = 0,
     .off_level = 1,
+    .pulse_gen = 0,
     .on = false
   };
   gpio_set_level(pin, ctx.off_level);
 
+  // ctx_out is the ctx stored inline in the instance, the timer posts to that instance
+  const esp_timer_create_args_t timer_args = {
+    .callback = relay_pulse_timer_cb,
+    .arg = sn_device_instance_from_ctx(ctx_out),
+    .name = "relay_pulse",
+  };
+  esp_err_t err = esp_timer_create(&timer_args, &ctx.pulse_timer);
+  if (err != ESP_OK) return err;
+
   memcpy(ctx_out, &ctx, sizeof(ctx));
   ESP_LOGI(TAG, "Relay init port=%s pin=%d", port->port_name, pin);
   return ESP_OK;
 }
 
-static void relay_deinit(void *ctx) { (void)ctx; }
+static void relay_deinit(void *ctxv) {
+  relay_ctx_t *ctx = (relay_ctx_t *)ctxv;
+  if (ctx && ctx->pulse_timer) {
+    esp_timer_stop(ctx->pulse_timer);
+    esp_timer_delete(ctx->pulse_timer);
+    ctx->pulse_timer = NULL;
+  }
+}
 
 static esp_err_t relay_controller(void *ctxv, const cJSON *paramsJson, cJSON **out_result) {
   if (!paramsJson) return ESP_ERR_INVALID_ARG;
@@ -110,12 +113,8 @@ static esp_err_t relay_controller(void *ctxv, const cJSON *paramsJson, cJSON **o
   }
 
   relay_ctx_t *ctx = (relay_ctx_t *)ctxv;
-  if (!ctx->task) {
-    xTaskCreate(relay_task, "relay_task", 2048, ctx, 5, &ctx->task);
-  }
 
   cJSON *out = NULL;
-  if (!paramsJson) return ESP_ERR_INVALID_ARG;
   if (!validate_params_json(params_desc, paramsJson, &out)) {
     if (out && out_result) *out_result = out;
     return ESP_ERR_INVALID_ARG;
@@ -124,24 +123,28 @@ static esp_err_t relay_controller(void *ctxv, const cJSON *paramsJson, cJSON **o
   bool on = ctx->on;
   if (json_get_bool(paramsJson, "enable", &on)) {
     if (ctx->on != on) {
-      if (out_result && relay_send(ctx->queue, on ? RELAY_CMD_ON : RELAY_CMD_OFF, 0) == pdTRUE) {
-        ctx->on = on;
-        *out_result = build_success_fmt("turned %s relay", on ? "on" : "off");
-      } else {
-        *out_result = build_error_fmt("relay is busy");
-      }
+      // an explicit state change cancels a running pulse, even one whose end is queued
+      __atomic_add_fetch(&ctx->pulse_gen, 1, __ATOMIC_RELEASE);
+      esp_timer_stop(ctx->pulse_timer);
+      relay_set(ctx, on);
+      if (out_result) *out_result = build_success_fmt("turned %s relay", on ? "on" : "off");
       return ESP_OK;
     }
   }
 
   double duration_sec = 0;
   if (json_get_number(paramsJson, "duration_sec", &duration_sec)) {
-    uint32_t duration_ms = (uint32_t)duration_sec * 1000;
-    if (out_result && relay_send(ctx->queue, RELAY_CMD_PULSE, duration_ms) == pdTRUE) {
-      *out_result = build_success_fmt("activated relay for %.2lfs", duration_sec);
-    } else {
-      *out_result = build_error_fmt("relay is busy");
+    uint64_t duration_us = (uint64_t)(duration_sec * 1000000.0);
+    __atomic_add_fetch(&ctx->pulse_gen, 1, __ATOMIC_RELEASE);
+    esp_timer_stop(ctx->pulse_timer);
+    relay_set(ctx, true);
+    esp_err_t err = esp_timer_start_once(ctx->pulse_timer, duration_us);
+    if (err != ESP_OK) {
+      relay_set(ctx, false);
+      if (out_result) *out_result = build_error_fmt("cannot start pulse timer");
+      return err;
     }
+    if (out_result) *out_result = build_success_fmt("activated relay for %.2lfs", duration_sec);
     return ESP_OK;
   }
 
@@ -149,6 +152,13 @@ static esp_err_t relay_controller(void *ctxv, const cJSON *paramsJson, cJSON **o
   return ESP_OK;
 }
 
+static cJSON *relay_report_state(void *ctxv) {
+  relay_ctx_t *ctx = (relay_ctx_t *)ctxv;
+  cJSON *state = cJSON_CreateObject();
+  if (state) cJSON_AddBoolToObject(state, "enable", ctx->on);
+  return state;
+}
+
 const sn_driver_desc_t relay_driver = {
   .name = "relay"
           "_drv",
@@ -159,5 +169,6 @@ const sn_driver_desc_t relay_driver = {
   .deinit = relay_deinit,
   .read_multi = NULL,
   .control = relay_controller,
+  .report_state = relay_report_state,
   .command_desc = &schema
 };
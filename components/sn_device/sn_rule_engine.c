@@ -2,27 +2,28 @@
 #include "cJSON.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/idf_additions.h"
 #include "freertos/projdefs.h"
 #include "portmacro.h"
 #include "sn_capability.h"
 #include "sn_driver/sensor.h"
 #include "sn_json.h"
+#include "sn_metrics.h"
+#include "sn_recorder.h"
+#include "sn_trace.h"
 #include "sn_rules/sn_rule_desc.h"
 #include "sn_telemetry_queue.h"
 
 #define MAX_RULE 126
 static const char *TAG = "SN_RULE_ENGINE";
 
-typedef enum {
-  RS_NORMAL,
-  RS_HIGH,
-  RS_LOW,
-} sn_rule_state_e;
-
 typedef struct {
   sn_rule_state_e state;
   const sn_rule_desc_t *desc;
+  // band in use, the desc's unless retuned with sn_rule_engine_set_band
+  double low;
+  double high;
 } sn_rule_instance_t;
 
 static sn_rule_instance_t rule_instances[MAX_RULE];
@@ -31,7 +32,8 @@ static size_t rule_instance_len = 0;
 void dispatch_command_and_print_result(const sn_command_t *commands) {
   cJSON *out = NULL;
   FOREACH_COMMAND(it, commands) {
-    sn_dispatch_command_struct(it, &out);
+    int r = sn_dispatch_command_struct(it, &out);
+    SN_REC_DISPATCH(it, r);
     if (out) {
       char *response_str = cJSON_PrintUnformatted(out);
       ESP_LOGW(TAG, "%s", response_str);
@@ -41,12 +43,6 @@ void dispatch_command_and_print_result(const sn_command_t *commands) {
   }
 }
 
-static inline sn_rule_state_e sn_rule_eval_state(const sn_rule_desc_t *d, double value) {
-  if (value < d->low) return RS_LOW;
-  if (value > d->high) return RS_HIGH;
-  return RS_NORMAL;
-}
-
 static inline void sn_run_exit(const sn_rule_desc_t *d, sn_rule_state_e old_state) {
   switch (old_state) {
     case RS_LOW:
@@ -101,14 +97,63 @@ esp_err_t parse_rules() {
       inst = &rule_instances[rule_instance_len];
       inst->state = RS_NORMAL;
       inst->desc = &gRules[i];
+      inst->low = gRules[i].low;
+      inst->high = gRules[i].high;
       rule_instance_len++;
     }
   }
   return ESP_OK;
 }
 
+esp_err_t sn_rule_engine_init(void) { return parse_rules(); }
+
+static sn_rule_instance_t *find_instance(local_id_t rule_id) {
+  for (int i = 0; i < rule_instance_len; i++) {
+    if (rule_instances[i].desc->id == rule_id) return &rule_instances[i];
+  }
+  return NULL;
+}
+
+esp_err_t sn_rule_engine_set_band(local_id_t rule_id, double low, double high) {
+  if (low > high) return ESP_ERR_INVALID_ARG;
+  sn_rule_instance_t *rule = find_instance(rule_id);
+  if (!rule) return ESP_ERR_NOT_FOUND;
+  rule->low = low;
+  rule->high = high;
+  return ESP_OK;
+}
+
+esp_err_t sn_rule_engine_set_state(local_id_t rule_id, sn_rule_state_e state) {
+  sn_rule_instance_t *rule = find_instance(rule_id);
+  if (!rule) return ESP_ERR_NOT_FOUND;
+  rule->state = state;
+  return ESP_OK;
+}
+
+void sn_rule_engine_process(const sn_sensor_reading_t *reading) {
+  int64_t start = esp_timer_get_time();
+  SN_TRACE_BEGIN("rule.eval", reading->local_id);
+  // INFO: Use priority tree for scaling
+  for (int i = 0; i < rule_instance_len; i++) {
+    sn_rule_instance_t *rule = &rule_instances[i];
+    if (rule->desc->src_id == reading->local_id) {
+      sn_rule_state_e old_state = rule->state;
+      sn_rule_state_e new_state = sn_rule_eval_band(rule->low, rule->high, reading->value);
+      sn_metric_inc(SN_MC_rule_eval);
+      if (old_state == new_state) continue; // no transition, no commands
+      sn_metric_inc(SN_MC_rule_transition);
+      SN_REC_TRANSITION(rule->desc->id, reading, old_state, new_state);
+      sn_run_exit(rule->desc, old_state);
+      sn_run_entry(rule->desc, new_state);
+      rule->state = new_state;
+    }
+  }
+  SN_TRACE_END("rule.eval", reading->local_id);
+  sn_metric_observe(SN_MH_rule_time, (uint32_t)(esp_timer_get_time() - start));
+}
+
 void rule_engine_task(void *pvParams) {
-  esp_err_t status = parse_rules();
+  esp_err_t status = sn_rule_engine_init();
   ESP_ERROR_CHECK_WITHOUT_ABORT(status);
   if (status != ESP_OK) {
     vTaskDelete(NULL);
@@ -118,18 +163,9 @@ void rule_engine_task(void *pvParams) {
   sn_sensor_reading_t reading;
   for (;;) {
     if (xQueueReceive(queue, &reading, portMAX_DELAY)) {
-      // INFO: Use priority tree for scaling
-      for (int i = 0; i < rule_instance_len; i++) {
-        sn_rule_instance_t *rule = &rule_instances[i];
-        if (rule->desc->src_id == reading.local_id) {
-          sn_rule_state_e old_state = rule->state;
-          sn_rule_state_e new_state = sn_rule_eval_state(rule->desc, reading.value);
-          if (old_state == new_state) continue; // no transition, no commands
-          sn_run_exit(rule->desc, old_state);
-          sn_run_entry(rule->desc, new_state);
-          rule->state = new_state;
-        }
-      }
+      // +1 for the reading just received
+      sn_metric_gauge_max(SN_MG_rule_queue_hwm, uxQueueMessagesWaiting(queue) + 1);
+      sn_rule_engine_process(&reading);
     }
   }
 }
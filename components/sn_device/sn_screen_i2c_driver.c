@@ -1,13 +1,15 @@
 #include "display/lv_display.h"
 #include "esp_heap_caps.h"
 #include "esp_timer.h"
+#include "sn_bus.h"
 #include "sn_common.h"
+#include "sn_driver/driver_inst.h"
 #include "sn_driver/port_desc.h"
 #include "sn_json.h"
 #include "sn_driver_registry.h"
+#include "sn_trace.h"
 
 #include "lvgl.h"
-#include "driver/i2c_master.h"
 #include "freertos/idf_additions.h"
 #include "esp_lcd_panel_io.h"
 #include "esp_lcd_panel_ops.h"
@@ -20,19 +22,39 @@
 #include <sys/lock.h>
 #include <unistd.h>
 
+#define SCREEN_MSG_MAX_LEN      32
+#define SCREEN_DEFAULT_I2C_ADDR 0x3C // ssd1306 with sa0 low
+
+// Everything init creates is released by deinit, the recovery runs them again
 struct screen_i2c_ctx_s {
   uint8_t *fb;
   uint8_t *internal_fb;
   lv_display_t *display;
+  esp_lcd_panel_io_handle_t io_handle;
   esp_lcd_panel_handle_t panel_handle;
+  esp_timer_handle_t tick_timer;
   TaskHandle_t lvgl_port_task;
-  _lock_t lvgl_api_lock;
+  _lock_t lvgl_api_lock; // kept across a deinit, the next init reuses it
+  char msg[SCREEN_MSG_MAX_LEN]; // last message shown, reported to the shadow
 };
 
+// lvgl has at most one flush in flight, it waits for flush_ready before the next one
+typedef struct {
+  screen_i2c_ctx_t *ctx;
+  int x1, y1, x2, y2;
+} screen_flush_t;
+
+static screen_flush_t s_flush;
+
 static const char *TAG = "SCREEN_I2C_DRIVER";
 static const char *screen_i2c_types[] = {"ssd1306", ((void *)0)};
 
-static inline void lvgl_lock(screen_i2c_ctx_t *ctx) { _lock_acquire(&ctx->lvgl_api_lock); }
+// the trace span is the time spent waiting for the lock
+static inline void lvgl_lock(screen_i2c_ctx_t *ctx) {
+  SN_TRACE_BEGIN("lvgl.lock", 0);
+  _lock_acquire(&ctx->lvgl_api_lock);
+  SN_TRACE_END("lvgl.lock", 0);
+}
 static inline void lvgl_unlock(screen_i2c_ctx_t *ctx) { _lock_release(&ctx->lvgl_api_lock); }
 
 static const sn_param_desc_t params_desc[] = {
@@ -52,6 +74,31 @@ static bool notify_lvgl_flush_ready(
   return false;
 }
 
+static esp_err_t flush_txn(sn_bus_t *bus, void *arg) {
+  const screen_flush_t *f = (const screen_flush_t *)arg;
+  return esp_lcd_panel_draw_bitmap(
+    f->ctx->panel_handle, f->x1, f->y1, f->x2 + 1, f->y2 + 1, f->ctx->fb
+  );
+}
+
+// a failed transfer never reaches the panel io callback, the frame is dropped
+static void on_flush_done(esp_err_t rc, void *arg) {
+  const screen_flush_t *f = (const screen_flush_t *)arg;
+  if (rc != ESP_OK) lv_display_flush_ready(f->ctx->display);
+}
+
+static esp_err_t panel_setup_txn(sn_bus_t *bus, void *arg) {
+  esp_lcd_panel_handle_t panel = (esp_lcd_panel_handle_t)arg;
+  esp_err_t err = esp_lcd_panel_reset(panel);
+  if (err == ESP_OK) err = esp_lcd_panel_init(panel);
+  if (err == ESP_OK) err = esp_lcd_panel_disp_on_off(panel, true);
+  return err;
+}
+
+static inline uint16_t screen_addr(const sn_actuator_port_t *port) {
+  return port->usage.i2c.addr ? port->usage.i2c.addr : SCREEN_DEFAULT_I2C_ADDR;
+}
+
 static void lvgl_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map) {
   screen_i2c_ctx_t *ctx = lv_display_get_user_data(disp);
 
@@ -88,8 +135,13 @@ static void lvgl_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px
     }
   }
 
-  // pass the draw buffer to the driver
-  esp_lcd_panel_draw_bitmap(ctx->panel_handle, x1, y1, x2 + 1, y2 + 1, ctx->fb);
+  // pass the draw buffer to the bus, the panel io signals flush_ready once it is sent
+  s_flush = (screen_flush_t){.ctx = ctx, .x1 = x1, .y1 = y1, .x2 = x2, .y2 = y2};
+  sn_bus_t *bus = sn_device_instance_from_ctx(ctx)->bus;
+  if (sn_bus_submit_async(bus, SN_BUS_PRIO_LOW, flush_txn, &s_flush, on_flush_done, &s_flush)
+      != ESP_OK) {
+    lv_display_flush_ready(disp);
+  }
 }
 
 static void increase_lvgl_tick(void *arg) {
@@ -113,9 +165,9 @@ static void lvgl_port_task(void *pvParams) {
   }
 }
 
+// The bus is only opened by the bind, whether the panel acks is checked by the init
 static bool screen_i2c_probe(const sn_device_port_desc_t *port) {
-  // TODO: implement probing
-  return true;
+  return port && port->desc.a.usage_type == PUT_I2C;
 }
 
 static esp_err_t screen_i2c_init(
@@ -132,118 +184,143 @@ static esp_err_t screen_i2c_init(
     return ESP_ERR_INVALID_ARG;
   }
 
-  // WARN: This should be placed in the registration code
-  // I only placed it here for quick demo
-  ESP_LOGI(TAG, "Initialize I2C bus");
-  i2c_master_bus_handle_t i2c_bus = NULL;
-  i2c_master_bus_config_t bus_config = {
-    .clk_source = I2C_CLK_SRC_DEFAULT,
-    .glitch_ignore_cnt = 7,
-    .i2c_port = I2C_NUM_0,
-    .sda_io_num = port->usage.i2c.sda,
-    .scl_io_num = port->usage.i2c.scl,
-    .flags.enable_internal_pullup = true,
-  };
-  ESP_ERROR_CHECK(i2c_new_master_bus(&bus_config, &i2c_bus));
+  // opened by the bind from the port usage, shared with the other devices on it
+  sn_bus_t *bus = sn_device_instance_from_ctx(ctx_out)->bus;
+  if (!bus) return ESP_ERR_INVALID_STATE;
+  // a missing panel leaves the port to the recovery
+  if (sn_bus_i2c_probe(bus, screen_addr(port)) != ESP_OK) {
+    ESP_LOGW(TAG, "No panel at 0x%02x on %s", screen_addr(port), desc->port_name);
+    return ESP_ERR_NOT_FOUND;
+  }
 
   screen_i2c_ctx_t *ctx = ctx_out;
+  _lock_t lock = ctx->lvgl_api_lock;
   memset(ctx, 0, sizeof(screen_i2c_ctx_t));
-  if (strncmp("ssd1306", desc->drv_name, 7) == 0) {
-    const int ssd1306_h_res = 128;
-    const int ssd1306_v_res = 64;
-    const int buffer_size = ssd1306_v_res * ssd1306_h_res / 8;
-
-    ctx->fb = malloc(buffer_size);
-
-    esp_lcd_panel_io_handle_t io_handle = NULL;
-    esp_lcd_panel_io_i2c_config_t io_config = {
-      .dev_addr = 0x3C, // default for ssd1306
-      .scl_speed_hz = 400 * 1000,
-      .control_phase_bytes = 1, // According to SSD1306 datasheet
-      .lcd_cmd_bits = 8,        // According to SSD1306 datasheet
-      .lcd_param_bits = 8,      // According to SSD1306 datasheet
-      .dc_bit_offset = 6,       // According to SSD1306 datasheet
-    };
-    ESP_ERROR_CHECK(esp_lcd_new_panel_io_i2c(i2c_bus, &io_config, &io_handle));
-
-    // ----------------------------------------
-    // Install panel driver
-    // ----------------------------------------
-    ESP_LOGI(TAG, "Install SSD1306 panel driver");
-    esp_lcd_panel_dev_config_t panel_config = {
-      .bits_per_pixel = 1,
-      .reset_gpio_num = -1,
-    };
-    esp_lcd_panel_ssd1306_config_t ssd1306_config = {
-      .height = 64,
-    };
-    panel_config.vendor_config = &ssd1306_config;
-    ESP_ERROR_CHECK(esp_lcd_new_panel_ssd1306(io_handle, &panel_config, &ctx->panel_handle));
-    ESP_ERROR_CHECK(esp_lcd_panel_reset(ctx->panel_handle));
-    ESP_ERROR_CHECK(esp_lcd_panel_init(ctx->panel_handle));
-    ESP_ERROR_CHECK(esp_lcd_panel_disp_on_off(ctx->panel_handle, true));
-
-    // ----------------------------------------
-    // Init LVGL
-    // ----------------------------------------
-    ESP_LOGI(TAG, "Initialize LVGL");
-    lv_init();
-    // create a lvgl display
-
-    ctx->display = lv_display_create(ssd1306_h_res, ssd1306_v_res);
-    // associate the i2c panel handle to the display
-    lv_display_set_user_data(ctx->display, ctx);
-    /* allocate LVGL draw buffer and setup display */
-    size_t draw_buffer_sz = buffer_size + 8;
-    ctx->internal_fb = heap_caps_calloc(1, draw_buffer_sz, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-    assert(ctx->internal_fb);
-
-    // LVGL9 suooprt new monochromatic format.
-    lv_display_set_color_format(ctx->display, LV_COLOR_FORMAT_I1);
-    // initialize LVGL draw buffers
-    lv_display_set_buffers(
-      ctx->display, ctx->internal_fb, NULL, draw_buffer_sz, LV_DISPLAY_RENDER_MODE_FULL
-    );
-    // set the callback which can copy the rendered image to an area of the display
-    lv_display_set_flush_cb(ctx->display, lvgl_flush_cb);
-
-    ESP_LOGI(TAG, "Register io panel event callback for LVGL flush ready notification");
-    const esp_lcd_panel_io_callbacks_t cbs = {
-      .on_color_trans_done = notify_lvgl_flush_ready,
-    };
-
-    /* Register done callback */
-    esp_lcd_panel_io_register_event_callbacks(io_handle, &cbs, ctx->display);
-
-    ESP_LOGI(TAG, "Use esp_timer as LVGL tick timer");
-    const esp_timer_create_args_t lvgl_tick_timer_args = {
-      .callback = &increase_lvgl_tick,
-      .name = "lvgl_tick"
-    };
-    esp_timer_handle_t lvgl_tick_timer = NULL;
-    ESP_ERROR_CHECK(esp_timer_create(&lvgl_tick_timer_args, &lvgl_tick_timer));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(lvgl_tick_timer, 5 * 1000));
-
-    ESP_LOGI(TAG, "Create LVGL task");
-    xTaskCreate(lvgl_port_task, "LVGL", 4096, ctx, 5, &ctx->lvgl_port_task);
+  ctx->lvgl_api_lock = lock;
+  if (strncmp("ssd1306", desc->drv_name, 7) != 0) return ESP_ERR_NOT_SUPPORTED;
+
+  // a failure returns right away, the caller deinits what was created so far
+  const int ssd1306_h_res = 128;
+  const int ssd1306_v_res = 64;
+  const int buffer_size = ssd1306_v_res * ssd1306_h_res / 8;
+
+  ctx->fb = malloc(buffer_size);
+  if (!ctx->fb) return ESP_ERR_NO_MEM;
+
+  esp_lcd_panel_io_i2c_config_t io_config = {
+    .dev_addr = screen_addr(port),
+    .scl_speed_hz = 400 * 1000,
+    .control_phase_bytes = 1, // According to SSD1306 datasheet
+    .lcd_cmd_bits = 8,        // According to SSD1306 datasheet
+    .lcd_param_bits = 8,      // According to SSD1306 datasheet
+    .dc_bit_offset = 6,       // According to SSD1306 datasheet
+  };
+  esp_err_t err = esp_lcd_new_panel_io_i2c(sn_bus_i2c_handle(bus), &io_config, &ctx->io_handle);
+  if (err != ESP_OK) return err;
+
+  // ----------------------------------------
+  // Install panel driver
+  // ----------------------------------------
+  ESP_LOGI(TAG, "Install SSD1306 panel driver");
+  esp_lcd_panel_dev_config_t panel_config = {
+    .bits_per_pixel = 1,
+    .reset_gpio_num = -1,
+  };
+  esp_lcd_panel_ssd1306_config_t ssd1306_config = {
+    .height = 64,
+  };
+  panel_config.vendor_config = &ssd1306_config;
+  err = esp_lcd_new_panel_ssd1306(ctx->io_handle, &panel_config, &ctx->panel_handle);
+  if (err != ESP_OK) return err;
+  err = sn_bus_submit(bus, SN_BUS_PRIO_NORMAL, panel_setup_txn, ctx->panel_handle);
+  if (err != ESP_OK) return err;
+
+  // ----------------------------------------
+  // Init LVGL
+  // ----------------------------------------
+  ESP_LOGI(TAG, "Initialize LVGL");
+  // once for the firmware, a re-init only creates a new display
+  if (!lv_is_initialized()) lv_init();
+  // create a lvgl display
+  ctx->display = lv_display_create(ssd1306_h_res, ssd1306_v_res);
+  if (!ctx->display) return ESP_ERR_NO_MEM;
+  // associate the i2c panel handle to the display
+  lv_display_set_user_data(ctx->display, ctx);
+  /* allocate LVGL draw buffer and setup display */
+  size_t draw_buffer_sz = buffer_size + 8;
+  ctx->internal_fb = heap_caps_calloc(1, draw_buffer_sz, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (!ctx->internal_fb) return ESP_ERR_NO_MEM;
+
+  // LVGL9 suooprt new monochromatic format.
+  lv_display_set_color_format(ctx->display, LV_COLOR_FORMAT_I1);
+  // initialize LVGL draw buffers
+  lv_display_set_buffers(
+    ctx->display, ctx->internal_fb, NULL, draw_buffer_sz, LV_DISPLAY_RENDER_MODE_FULL
+  );
+  // set the callback which can copy the rendered image to an area of the display
+  lv_display_set_flush_cb(ctx->display, lvgl_flush_cb);
+
+  ESP_LOGI(TAG, "Register io panel event callback for LVGL flush ready notification");
+  const esp_lcd_panel_io_callbacks_t cbs = {
+    .on_color_trans_done = notify_lvgl_flush_ready,
+  };
 
-    lvgl_lock(ctx);
-    lv_obj_t *label = lv_label_create(lv_screen_active());
-    lv_label_set_text(label, "hello world");
-    lv_obj_set_pos(label, 0, 0);
-    lvgl_unlock(ctx);
+  /* Register done callback */
+  esp_lcd_panel_io_register_event_callbacks(ctx->io_handle, &cbs, ctx->display);
 
-    ESP_LOGI(TAG, "screen i2c init port=%s", desc->port_name);
-  } else {
-    return ESP_ERR_NOT_SUPPORTED;
+  ESP_LOGI(TAG, "Use esp_timer as LVGL tick timer");
+  const esp_timer_create_args_t lvgl_tick_timer_args = {
+    .callback = &increase_lvgl_tick,
+    .name = "lvgl_tick"
+  };
+  err = esp_timer_create(&lvgl_tick_timer_args, &ctx->tick_timer);
+  if (err == ESP_OK) err = esp_timer_start_periodic(ctx->tick_timer, 5 * 1000);
+  if (err != ESP_OK) return err;
+
+  ESP_LOGI(TAG, "Create LVGL task");
+  if (xTaskCreate(lvgl_port_task, "LVGL", 4096, ctx, 5, &ctx->lvgl_port_task) != pdPASS) {
+    ctx->lvgl_port_task = NULL;
+    return ESP_ERR_NO_MEM;
   }
 
+  lvgl_lock(ctx);
+  lv_obj_t *label = lv_label_create(lv_screen_active());
+  lv_label_set_text(label, "hello world");
+  lv_obj_set_pos(label, 0, 0);
+  lvgl_unlock(ctx);
+
+  ESP_LOGI(TAG, "screen i2c init port=%s", desc->port_name);
   return ESP_OK;
 }
 
+static esp_err_t noop_txn(sn_bus_t *bus, void *arg) { return ESP_OK; }
+
+// Safe on a ctx init left half built, and on one already released
 static void screen_i2c_deinit(void *ctxv) {
-  // screen_i2c_ctx_t *ctx = (screen_i2c_ctx_t *)ctxv;
-  // heap_caps_free(ctx->fb);
+  screen_i2c_ctx_t *ctx = (screen_i2c_ctx_t *)ctxv;
+  if (!ctx) return;
+  if (ctx->tick_timer) {
+    esp_timer_stop(ctx->tick_timer);
+    esp_timer_delete(ctx->tick_timer);
+  }
+  if (ctx->lvgl_port_task) {
+    // not while it is inside lvgl
+    lvgl_lock(ctx);
+    vTaskDelete(ctx->lvgl_port_task);
+    lvgl_unlock(ctx);
+  }
+  // flushes are queued at low priority, once this ran none uses the panel any more
+  sn_bus_t *bus = sn_device_instance_from_ctx(ctx)->bus;
+  if (bus && ctx->panel_handle) sn_bus_submit(bus, SN_BUS_PRIO_LOW, noop_txn, NULL);
+  if (ctx->display) lv_display_delete(ctx->display);
+  if (ctx->panel_handle) esp_lcd_panel_del(ctx->panel_handle);
+  if (ctx->io_handle) esp_lcd_panel_io_del(ctx->io_handle);
+  heap_caps_free(ctx->internal_fb);
+  free(ctx->fb);
+
+  _lock_t lock = ctx->lvgl_api_lock;
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->lvgl_api_lock = lock;
 }
 
 static esp_err_t screen_i2c_controller(void *ctxv, const cJSON *paramsJson, cJSON **out_result) {
@@ -262,11 +339,20 @@ static esp_err_t screen_i2c_controller(void *ctxv, const cJSON *paramsJson, cJSO
     lv_label_set_text(label, msg);
     lv_obj_set_pos(label, 0, 0);
     lvgl_unlock(ctx);
+    strncpy(ctx->msg, msg, sizeof(ctx->msg) - 1);
+    ctx->msg[sizeof(ctx->msg) - 1] = '\0';
   }
 
   return ESP_OK;
 }
 
+static cJSON *screen_i2c_report_state(void *ctxv) {
+  screen_i2c_ctx_t *ctx = ctxv;
+  cJSON *state = cJSON_CreateObject();
+  if (state) cJSON_AddStringToObject(state, "msg", ctx->msg);
+  return state;
+}
+
 const sn_driver_desc_t screen_i2c_driver = {
   .name = "screen_i2c_drv",
   .supported_types = screen_i2c_types,
@@ -276,5 +362,6 @@ const sn_driver_desc_t screen_i2c_driver = {
   .deinit = screen_i2c_deinit,
   .read_multi = NULL,
   .control = screen_i2c_controller,
+  .report_state = screen_i2c_report_state,
   .command_desc = &schema
 };
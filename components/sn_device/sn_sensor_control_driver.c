@@ -55,10 +55,16 @@ static esp_err_t sensor_control_controller(
     return ESP_FAIL;
   }
 
-  sn_device_instance_set_interval(inst, sample_rate);
+  // runs on an actor worker: the target instance applies the new rate on its own actor
+  esp_err_t err = sn_device_instance_set_interval(inst, (uint32_t)sample_rate);
+  if (err != ESP_OK) {
+    if (out_result)
+      *out_result = build_error_fmt("%s rejected sample_rate change", inst->port->port_name);
+    return err;
+  }
 
   if (out_result)
-    *out_result = build_success_fmt("%s sample_rate=%d", inst->port->port_name, inst->interval_ms);
+    *out_result = build_success_fmt("%s sample_rate=%d", inst->port->port_name, (int)sample_rate);
   return ESP_OK;
 }
 
@@ -3,24 +3,68 @@
 #include "sn_adc_helper.h"
 #include "sn_driver/sensor.h"
 #include "sn_driver_registry.h"
+#include "sn_prof.h"
 
 #include "esp_log.h"
+#include "nvs.h"
+#include "sn_json.h"
 #include "sn_sntp.h"
+#include "sn_storage.h"
 #include "soc/gpio_num.h"
+#include <math.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 #include <time.h>
 
 static const char *TAG = "SN_SOIL_MOISTURE_DRIVER";
 static const char *soil_moisture_types[] = {"soil_adc", NULL};
 
+#define SOIL_DRY_MV 3300 // defaults until the probe is calibrated
+#define SOIL_WET_MV 1000
+#define SOIL_MV_MAX 3300
+
+// bounds of the adc correction fitted against a reference meter
+#define SOIL_FIT_OFFSET_MAX 500   // mV
+#define SOIL_FIT_GAIN_MAX   4.0
+#define SOIL_FIT_CURVE_MAX  0.001 // per mV
+
+// Two points of the linear mapping, stored in NVS as cal_<local id>
+typedef struct {
+  uint32_t dry_mv;
+  uint32_t wet_mv;
+} soil_cal_t;
+
 struct soil_moisture_ctx_s {
   adc1_channel_t channel;
   local_id_t sensor_id;
-  uint32_t dry_mv;
-  uint32_t wet_mv;
+  soil_cal_t cal; // read and written on the instance's actor only
+};
+
+static const char *soil_points[] = {"dry", "wet", NULL};
+
+static const sn_param_desc_t params_desc[] = {
+  // take the current reading as the point, the explicit values below win
+  {.name = "capture", .type = PTYPE_STRING, .enum_values = soil_points, .required = false},
+  {.name = "dry_mv", .type = PTYPE_INT, .min = 0, .max = SOIL_MV_MAX, .required = false},
+  {.name = "wet_mv", .type = PTYPE_INT, .min = 0, .max = SOIL_MV_MAX, .required = false},
+  // adc correction of the channel: [offset_mv, gain] or [offset_mv, gain, curve], [] drops it
+  {.name = "fit", .type = PTYPE_ARRAY, .min = 0, .max = 3, .required = false},
+  {.name = NULL}
 };
 
+static const sn_command_desc_t schema = {
+  .action = "calibrate",
+  .params = params_desc,
+};
+
+static void cal_key(local_id_t id, char key[16]) { snprintf(key, 16, "cal_%02x", id); }
+
+// the probe reads a higher voltage when dry
+static inline bool cal_valid(const soil_cal_t *cal) {
+  return cal->dry_mv <= SOIL_MV_MAX && cal->wet_mv < cal->dry_mv;
+}
+
 static esp_err_t soil_moisture_init(
   const sn_device_port_desc_t *port, void *ctx_out, size_t ctx_size
 ) {
@@ -37,8 +81,7 @@ static esp_err_t soil_moisture_init(
   soil_moisture_ctx_t ctx = {
     .channel = adc_helper_pin_to_channel(pin),
     .sensor_id = pm_get_local_id(port->desc.s.measurements, ST_MOISTURE),
-    .dry_mv = 3300,
-    .wet_mv = 1000 // Default calibration
+    .cal = {.dry_mv = SOIL_DRY_MV, .wet_mv = SOIL_WET_MV}
   };
 
   if (ctx.sensor_id == INVALID_LOCAL_ID) {
@@ -51,7 +94,20 @@ static esp_err_t soil_moisture_init(
   }
 
   // configure attenuation (we choose 12dB for wider range)
-  adc_helper_config_channel_atten(ctx.channel, ADC_ATTEN_DB_12);
+  esp_err_t err = adc_helper_config_channel_atten(ctx.channel, ADC_ATTEN_DB_12);
+  if (err != ESP_OK) return err;
+
+  char key[16];
+  soil_cal_t cal;
+  size_t len = sizeof(cal);
+  cal_key(ctx.sensor_id, key);
+  if (sn_storage_get_blob(key, &cal, &len) == ESP_OK && len == sizeof(cal) && cal_valid(&cal)) {
+    ctx.cal = cal;
+    ESP_LOGI(
+      TAG, "Calibration of %s: dry=%lumV wet=%lumV", port->port_name, (unsigned long)cal.dry_mv,
+      (unsigned long)cal.wet_mv
+    );
+  }
 
   memcpy(ctx_out, &ctx, sizeof(ctx));
 
@@ -68,16 +124,18 @@ static bool soil_moisture_probe(const sn_device_port_desc_t *port) {
 static esp_err_t soil_moisture_read_multi(
   void *ctxv, sn_sensor_reading_t *out_buf, int max_out, int *out_count
 ) {
+  SN_PROF_SCOPE("read.soil");
   if (!ctxv || !out_buf) return ESP_ERR_INVALID_ARG;
 
   soil_moisture_ctx_t *c = (soil_moisture_ctx_t *)ctxv;
-  int raw = adc_helper_read_raw_avg(c->channel, 4);
-  if (raw < 0) return ESP_FAIL;
-  uint32_t mv = adc_helper_raw_to_mv(c->channel, raw);
+  // filtered in the background by the adc helper
+  uint32_t mv = 0;
+  esp_err_t err = adc_helper_read_mv(c->channel, &mv);
+  if (err != ESP_OK) return err;
 
   // clamp and map
-  uint32_t dry = c->dry_mv;
-  uint32_t wet = c->wet_mv;
+  uint32_t dry = c->cal.dry_mv;
+  uint32_t wet = c->cal.wet_mv;
   if (dry == wet) return ESP_ERR_INVALID_STATE;
 
   out_buf[0].local_id = c->sensor_id;
@@ -98,6 +156,131 @@ static esp_err_t soil_moisture_read_multi(
   return ESP_OK;
 }
 
+// mv' = offset_mv + gain * mv + curve * mv^2 in the Q16/Q32 of adc_helper_fit_t. An
+// empty array leaves *out NULL
+static bool parse_fit(
+  const cJSON *arr, adc_helper_fit_t *fit, const adc_helper_fit_t **out, cJSON **out_result
+) {
+  double v[3] = {0.0, 1.0, 0.0};
+  int len = cJSON_GetArraySize(arr);
+  *out = NULL;
+  if (len == 0) return true;
+  if (len < 2) {
+    if (out_result) *out_result = build_error_fmt("fit needs at least [offset_mv, gain]");
+    return false;
+  }
+  for (int i = 0; i < len; i++) {
+    const cJSON *it = cJSON_GetArrayItem(arr, i);
+    if (!cJSON_IsNumber(it)) {
+      if (out_result) *out_result = build_error_fmt("fit[%d] must be a number", i);
+      return false;
+    }
+    v[i] = it->valuedouble;
+  }
+  if (fabs(v[0]) > SOIL_FIT_OFFSET_MAX || v[1] <= 0.0 || v[1] > SOIL_FIT_GAIN_MAX
+      || fabs(v[2]) > SOIL_FIT_CURVE_MAX) {
+    if (out_result) {
+      *out_result = build_error_fmt(
+        "fit out of range: |offset_mv| <= %d, 0 < gain <= %.1f, |curve| <= %g",
+        SOIL_FIT_OFFSET_MAX, SOIL_FIT_GAIN_MAX, SOIL_FIT_CURVE_MAX
+      );
+    }
+    return false;
+  }
+  fit->offset = (int32_t)lround(v[0] * 65536.0);
+  fit->gain = (int32_t)lround(v[1] * 65536.0);
+  fit->curve = (int32_t)lround(v[2] * 4294967296.0);
+  *out = fit;
+  return true;
+}
+
+// {"capture": "dry"|"wet"} takes the current reading as that point, {"dry_mv", "wet_mv"}
+// set them and {"fit": [...]} corrects the adc channel. Everything is validated before
+// anything is stored, the result applies from the next reading
+static esp_err_t soil_moisture_control(void *ctxv, const cJSON *paramsJson, cJSON **out_result) {
+  if (!ctxv || !paramsJson) return ESP_ERR_INVALID_ARG;
+  soil_moisture_ctx_t *c = (soil_moisture_ctx_t *)ctxv;
+  if (!validate_params_json(params_desc, paramsJson, out_result)) return ESP_ERR_INVALID_ARG;
+
+  adc_helper_fit_t fit_buf;
+  const adc_helper_fit_t *fit = NULL;
+  const cJSON *fit_json = cJSON_GetObjectItemCaseSensitive(paramsJson, "fit");
+  if (fit_json && !parse_fit(fit_json, &fit_buf, &fit, out_result)) return ESP_ERR_INVALID_ARG;
+
+  soil_cal_t cal = c->cal;
+  const char *capture = NULL;
+  if (json_get_string(paramsJson, "capture", &capture)) {
+    uint32_t mv = 0;
+    esp_err_t err = adc_helper_read_mv(c->channel, &mv);
+    if (err != ESP_OK) {
+      if (out_result) *out_result = build_error_fmt("no reading to capture");
+      return err;
+    }
+    if (strcmp(capture, "dry") == 0) {
+      cal.dry_mv = mv;
+    } else {
+      cal.wet_mv = mv;
+    }
+  }
+  int v = 0;
+  if (json_get_int(paramsJson, "dry_mv", &v)) cal.dry_mv = (uint32_t)v;
+  if (json_get_int(paramsJson, "wet_mv", &v)) cal.wet_mv = (uint32_t)v;
+
+  if (!cal_valid(&cal)) {
+    if (out_result) {
+      *out_result = build_error_fmt(
+        "dry_mv=%lu must be above wet_mv=%lu", (unsigned long)cal.dry_mv,
+        (unsigned long)cal.wet_mv
+      );
+    }
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  if (cal.dry_mv != c->cal.dry_mv || cal.wet_mv != c->cal.wet_mv) {
+    char key[16];
+    cal_key(c->sensor_id, key);
+    esp_err_t err = sn_storage_set_blob(key, &cal, sizeof(cal));
+    if (err != ESP_OK) {
+      if (out_result) {
+        *out_result = build_error_fmt("failed to store calibration: %s", esp_err_to_name(err));
+      }
+      return err;
+    }
+    c->cal = cal;
+  }
+  if (fit_json) {
+    esp_err_t err = adc_helper_set_fit(c->channel, fit);
+    if (err != ESP_OK) {
+      if (out_result) {
+        *out_result = build_error_fmt("failed to store fit: %s", esp_err_to_name(err));
+      }
+      return err;
+    }
+  }
+  if (out_result) {
+    *out_result = build_success_fmt(
+      "dry_mv=%lu wet_mv=%lu", (unsigned long)cal.dry_mv, (unsigned long)cal.wet_mv
+    );
+  }
+  return ESP_OK;
+}
+
+static cJSON *soil_moisture_report_calibration(void *ctxv) {
+  const soil_moisture_ctx_t *c = (const soil_moisture_ctx_t *)ctxv;
+  cJSON *cal = cJSON_CreateObject();
+  if (!cal) return NULL;
+  cJSON_AddNumberToObject(cal, "dry_mv", c->cal.dry_mv);
+  cJSON_AddNumberToObject(cal, "wet_mv", c->cal.wet_mv);
+  adc_helper_fit_t fit;
+  if (adc_helper_get_fit(c->channel, &fit)) {
+    cJSON *arr = cJSON_AddArrayToObject(cal, "fit");
+    cJSON_AddItemToArray(arr, cJSON_CreateNumber(fit.offset / 65536.0));
+    cJSON_AddItemToArray(arr, cJSON_CreateNumber(fit.gain / 65536.0));
+    cJSON_AddItemToArray(arr, cJSON_CreateNumber(fit.curve / 4294967296.0));
+  }
+  return cal;
+}
+
 const sn_driver_desc_t soil_moisture_driver = {
   .name = "soil_moisture_drv",
   .supported_types = soil_moisture_types,
@@ -105,7 +288,8 @@ const sn_driver_desc_t soil_moisture_driver = {
   .probe = soil_moisture_probe,
   .init = soil_moisture_init,
   .read_multi = soil_moisture_read_multi,
-  .control = NULL,
+  .control = soil_moisture_control,
   .deinit = soil_moisture_deinit,
-  .command_desc = NULL
+  .report_calibration = soil_moisture_report_calibration,
+  .command_desc = &schema
 };
@@ -0,0 +1,79 @@
+#include "forward.h"
+#include "sn_driver.h"
+#include "sn_driver_registry.h"
+#include "sn_json.h"
+#include "sn_state_table.h"
+
+static const char *state_types[] = {"state", ((void *)0)};
+static const sn_param_desc_t params_desc[] = {
+  {.name = "local_id",
+   .type = PTYPE_INT,
+   .required = false,
+   .min = LOCAL_ID_MIN,
+   .max = SN_STATE_TABLE_LEN - 1},
+  // the whole table is paged: first local_id of the page and rows per page
+  {.name = "offset", .type = PTYPE_INT, .required = false, .min = 0, .max = SN_STATE_TABLE_LEN},
+  {.name = "limit",
+   .type = PTYPE_INT,
+   .required = false,
+   .min = 1,
+   .max = SN_STATE_TABLE_PAGE_MAX},
+  {.name = ((void *)0)}
+};
+
+static const sn_command_desc_t schema = {
+  .action = "get_state",
+  .params = params_desc,
+};
+
+static esp_err_t state_init(const sn_device_port_desc_t *desc, void *ctx_out, size_t ctx_size) {
+  return ESP_OK;
+}
+
+static void state_deinit(void *ctx) { (void)ctx; }
+
+// Served from the state table only, never touches the sensors. Without a local_id the
+// table comes a page at a time, {"offset": next} asks for the following one
+static esp_err_t state_controller(void *ctxv, const cJSON *paramsJson, cJSON **out_result) {
+  if (paramsJson && !validate_params_json(params_desc, paramsJson, out_result)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  int id = INVALID_LOCAL_ID;
+  if (!json_get_int(paramsJson, "local_id", &id)) {
+    int offset = 0, limit = SN_STATE_TABLE_PAGE_MAX;
+    json_get_int(paramsJson, "offset", &offset);
+    json_get_int(paramsJson, "limit", &limit);
+    cJSON *result = build_success_fmt(NULL);
+    cJSON_AddItemToObject(result, "state", sn_state_table_to_json((local_id_t)offset, limit));
+    if (out_result) *out_result = result;
+    return ESP_OK;
+  }
+
+  sn_state_snapshot_t snap;
+  if (!sn_state_table_read((local_id_t)id, &snap)) {
+    if (out_result) *out_result = build_error_fmt("no state for localId=%d", id);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  cJSON *result = build_success_fmt(NULL);
+  cJSON_AddNumberToObject(result, "localId", id);
+  cJSON_AddNumberToObject(result, "value", snap.value);
+  cJSON_AddNumberToObject(result, "ts", (double)snap.ts);
+  cJSON_AddStringToObject(result, "quality", sn_state_quality_str(snap.quality));
+  cJSON_AddNumberToObject(result, "seq", snap.seq);
+  if (out_result) *out_result = result;
+  return ESP_OK;
+}
+
+const sn_driver_desc_t state_driver = {
+  .name = "state_drv",
+  .supported_types = state_types,
+  .priority = 50,
+  .probe = NULL,
+  .init = state_init,
+  .deinit = state_deinit,
+  .read_multi = NULL,
+  .control = state_controller,
+  .command_desc = &schema
+};
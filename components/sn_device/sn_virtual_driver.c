@@ -0,0 +1,156 @@
+#include "sn_driver_registry.h"
+#include "sn_driver.h"
+#include "sn_json.h"
+#include "sn_prof.h"
+#include "sn_sntp.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <math.h>
+#include <string.h>
+
+static const char *TAG = "SN_VIRTUAL_DRIVER";
+static const char *virtual_types[] = {"virtual", NULL};
+
+// Synthetic ports for load and scale tests. A sensor port returns one reading per
+// measurement of its map, an actuator port keeps the last value it was set to
+struct virtual_ctx_s {
+  const sn_port_measurement_map_t *measurements;
+  float base;
+  float amplitude;
+  float noise;
+  uint32_t period_ms;
+  uint32_t phase_ms; // spreads the ports over the period
+  uint32_t rng;
+  uint16_t fail_permille;
+  float value; // actuator
+  uint32_t writes;
+};
+
+static const sn_param_desc_t params_desc[] = {
+  {.name = "value", .required = true, .type = PTYPE_NUMBER},
+  {.name = NULL}
+};
+
+static const sn_command_desc_t schema = {
+  .action = "set_value",
+  .params = params_desc,
+};
+
+// xorshift32, deterministic per port
+static inline uint32_t next_rand(virtual_ctx_t *ctx) {
+  uint32_t x = ctx->rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return ctx->rng = x;
+}
+
+static inline uint32_t hash_name(const char *s) {
+  uint32_t h = 2166136261u;
+  while (*s) h = (h ^ (uint8_t)*s++) * 16777619u;
+  return h ? h : 1;
+}
+
+static bool virtual_probe(const sn_device_port_desc_t *port) {
+  if (!port) return false;
+  if (port->drv_type == DRIVER_TYPE_SENSOR) return port->desc.s.usage_type == PUT_VIRTUAL;
+  return port->drv_type == DRIVER_TYPE_ACTUATOR;
+}
+
+static esp_err_t virtual_init(const sn_device_port_desc_t *port, void *ctx_out, size_t ctx_size) {
+  if (!port || !ctx_out || ctx_size < sizeof(virtual_ctx_t)) return ESP_ERR_INVALID_ARG;
+
+  uint32_t h = hash_name(port->port_name);
+  virtual_ctx_t ctx = {.rng = h};
+
+  if (port->drv_type == DRIVER_TYPE_SENSOR) {
+    const sn_sensor_port_t *s = &port->desc.s;
+    if (s->usage_type != PUT_VIRTUAL || pm_count(s->measurements) == 0) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    ctx.measurements = s->measurements;
+    ctx.base = s->usage.virt.base;
+    ctx.amplitude = s->usage.virt.amplitude;
+    ctx.noise = s->usage.virt.noise;
+    ctx.period_ms = s->usage.virt.period_ms;
+    ctx.phase_ms = ctx.period_ms ? h % ctx.period_ms : 0;
+    ctx.fail_permille = s->usage.virt.fail_permille;
+  } else if (port->drv_type != DRIVER_TYPE_ACTUATOR) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+
+  memcpy(ctx_out, &ctx, sizeof(ctx));
+  ESP_LOGD(TAG, "Virtual init port=%s", port->port_name);
+  return ESP_OK;
+}
+
+static void virtual_deinit(void *ctx) { (void)ctx; }
+
+static esp_err_t virtual_read_multi(
+  void *ctxv, sn_sensor_reading_t *out_buf, int max_out, int *out_count
+) {
+  SN_PROF_SCOPE("read.virtual");
+  if (!ctxv || !out_buf || max_out < 1 || !out_count) return ESP_ERR_INVALID_ARG;
+  virtual_ctx_t *ctx = (virtual_ctx_t *)ctxv;
+  if (!ctx->measurements) return ESP_ERR_INVALID_STATE;
+
+  if (ctx->fail_permille && next_rand(ctx) % 1000 < ctx->fail_permille) return ESP_FAIL;
+
+  uint64_t now_ms = esp_timer_get_time() / 1000ULL;
+  unsigned long long ts = sn_get_unix_timestamp_ms();
+  int n = 0;
+  FOR_EACH_MEASUREMENT(m, ctx->measurements) {
+    if (n >= max_out) break;
+    float v = ctx->base;
+    if (ctx->period_ms) {
+      // a quarter period apart between the measurements of a port
+      uint32_t t = (uint32_t)((now_ms + ctx->phase_ms + n * ctx->period_ms / 4) % ctx->period_ms);
+      v += ctx->amplitude * sinf(2.0f * (float)M_PI * t / ctx->period_ms);
+    }
+    if (ctx->noise > 0.0f) v += ctx->noise * ((next_rand(ctx) % 2001) / 1000.0f - 1.0f);
+    out_buf[n++] = (sn_sensor_reading_t){.local_id = m->local_id, .value = v, .ts = ts};
+  }
+  *out_count = n;
+  return ESP_OK;
+}
+
+static esp_err_t virtual_controller(void *ctxv, const cJSON *paramsJson, cJSON **out_result) {
+  if (!ctxv || !paramsJson) return ESP_ERR_INVALID_ARG;
+  virtual_ctx_t *ctx = (virtual_ctx_t *)ctxv;
+
+  if (!validate_params_json(params_desc, paramsJson, out_result)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  double value = 0;
+  json_get_number(paramsJson, "value", &value);
+  ctx->value = (float)value;
+  ctx->writes++;
+  if (out_result) *out_result = build_success_fmt("value set to %.2f", value);
+  return ESP_OK;
+}
+
+static cJSON *virtual_report_state(void *ctxv) {
+  virtual_ctx_t *ctx = (virtual_ctx_t *)ctxv;
+  if (ctx->measurements) return NULL; // sensors have no state to converge
+  cJSON *state = cJSON_CreateObject();
+  if (!state) return NULL;
+  cJSON_AddNumberToObject(state, "value", ctx->value);
+  cJSON_AddNumberToObject(state, "writes", ctx->writes);
+  return state;
+}
+
+const sn_driver_desc_t virtual_driver = {
+  .name = "virtual_drv",
+  .supported_types = virtual_types,
+  .priority = 10,
+  .probe = virtual_probe,
+  .init = virtual_init,
+  .deinit = virtual_deinit,
+  .read_multi = virtual_read_multi,
+  .control = virtual_controller,
+  .report_state = virtual_report_state,
+  .command_desc = &schema
+};
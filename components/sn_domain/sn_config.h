@@ -3,11 +3,8 @@
 
 #include "sdkconfig.h"
 
-#define I2C_BUS_PORT 0
-
+// the i2c bus comes from the port usage, see sn_bus.h
 #define LCD_PIXEL_CLOCK_HZ (400 * 1000)
-#define SDA_PIN_NUM        21
-#define SCL_PIN_NUM        22
 #define PIN_NUM_RST        -1
 #define I2C_HW_ADDR        0x3C
 
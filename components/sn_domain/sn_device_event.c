@@ -0,0 +1,20 @@
+#include "sn_device_event.h"
+
+static const char *event_type_str[] = {
+#define TO_ENUM_STR(c) #c,
+  DEVICE_EVENT_TYPE(TO_ENUM_STR)
+#undef TO_ENUM_STR
+};
+
+cJSON *sn_device_event_to_json(const sn_device_event_t *event) {
+  if (!event) return NULL;
+  cJSON *ret = cJSON_CreateObject();
+  if (!ret) return NULL;
+
+  cJSON_AddStringToObject(ret, "type", event_type_str[event->event_type]);
+  if (event->source) cJSON_AddStringToObject(ret, "source", event->source);
+  cJSON_AddNumberToObject(ret, "value", event->value);
+  cJSON_AddNumberToObject(ret, "threshold", event->threshold);
+  cJSON_AddNumberToObject(ret, "ts", event->ts);
+  return ret;
+}
@@ -3,18 +3,34 @@
 
 #include "cJSON.h"
 
+#define DEVICE_EVENT_TYPE(X)                                                                       \
+  X(RULE_TRIGGERED)                                                                                \
+  X(RULE_CREATED)                                                                                  \
+  X(LOW_HEAP)        /* free heap below threshold */                                               \
+  X(HEAP_FRAGMENTED) /* largest free block below threshold */                                      \
+  X(STACK_LOW)       /* task stack high-water mark below threshold */                              \
+  X(ALLOC_FAILED)                                                                                  \
+  X(PORT_OFFLINE)    /* read failures in a row, threshold the limit */                             \
+  X(PORT_ONLINE)     /* recovered, value the attempts it took */
+
 typedef enum {
-  DEVICE_EVENT_RULE_TRIGGERED,
-  DEVICE_EVENT_RULE_CREATED,
+#define TO_ENUM_FIELD(c) DEVICE_EVENT_##c,
+  DEVICE_EVENT_TYPE(TO_ENUM_FIELD)
+#undef TO_ENUM_FIELD
 } sn_device_event_e;
 
 typedef struct {
   sn_device_event_e event_type;
+  const char *source; // optional: task or port the event is about
+  double value;
+  double threshold;
+  unsigned long long ts;
 } sn_device_event_t;
 
-static inline cJSON *sn_device_event_to_json(const sn_device_event_t *event) {
-  cJSON *ret = cJSON_CreateObject();
-  return ret;
-}
+/*
+ * @brief Event payload:
+ * { "type": "STACK_LOW", "source": "mqtt_task", "value": 380, "threshold": 512, "ts": ... }
+ */
+cJSON *sn_device_event_to_json(const sn_device_event_t *event);
 
 #endif // !SN_DEVICE_EVENT_H
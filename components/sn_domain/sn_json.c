@@ -105,6 +105,23 @@ bool validate_params_json(const sn_param_desc_t *desc, const cJSON *params, cJSO
             }
           }
           break;
+        case PTYPE_ARRAY:
+          if (!cJSON_IsArray(it)) {
+            if (err_out)
+              *err_out = build_error_fmt(
+                "param '%s' (%s) must be array", pd->name, cjson_type_to_name(it->type)
+              );
+            return false;
+          }
+          // the items are checked by the handler
+          if (pd->min != pd->max) {
+            int len = cJSON_GetArraySize(it);
+            if (len < (int)pd->min || len > (int)pd->max) {
+              if (err_out) *err_out = build_error_fmt("param '%s' length out of range", pd->name);
+              return false;
+            }
+          }
+          break;
       }
     }
   }
@@ -131,7 +148,7 @@ bool validate_params_json(const sn_param_desc_t *desc, const cJSON *params, cJSO
  * }
  */
 
-static const char *ptype_str[] = {"int", "number", "boolean", "string"};
+static const char *ptype_str[] = {"int", "number", "boolean", "string", "array"};
 
 cJSON *sn_command_to_payload_json(const sn_command_t *command) {
   if (!command) return NULL;
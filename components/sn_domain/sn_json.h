@@ -5,7 +5,7 @@
 #include "sn_driver/sensor.h"
 #include <stdbool.h>
 
-typedef enum { PTYPE_INT = 0, PTYPE_NUMBER, PTYPE_BOOL, PTYPE_STRING } ptype_t;
+typedef enum { PTYPE_INT = 0, PTYPE_NUMBER, PTYPE_BOOL, PTYPE_STRING, PTYPE_ARRAY } ptype_t;
 
 typedef struct {
   const char *name;
@@ -13,7 +13,7 @@ typedef struct {
   // NULL-terminated string enums
   const char **enum_values;
 
-  // use only for numeric types
+  // use only for numeric types, bounds the length of arrays
   double min;
   double max;
 
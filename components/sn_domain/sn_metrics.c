@@ -0,0 +1,73 @@
+#include "sn_metrics.h"
+#include <string.h>
+
+uint32_t gMetricCounters[SN_MC_MAX];
+uint32_t gMetricGauges[SN_MG_MAX];
+sn_metric_histogram_t gMetricHistograms[SN_MH_MAX];
+
+static const char *counter_keys[] = {
+#define GEN_METRIC_KEY(NAME, KEY) KEY,
+  SN_METRIC_COUNTERS(GEN_METRIC_KEY)
+#undef GEN_METRIC_KEY
+};
+
+static const char *gauge_keys[] = {
+#define GEN_METRIC_KEY(NAME, KEY) KEY,
+  SN_METRIC_GAUGES(GEN_METRIC_KEY)
+#undef GEN_METRIC_KEY
+};
+
+static const char *histogram_keys[] = {
+#define GEN_METRIC_KEY(NAME, KEY) KEY,
+  SN_METRIC_HISTOGRAMS(GEN_METRIC_KEY)
+#undef GEN_METRIC_KEY
+};
+
+static inline uint32_t load(const uint32_t *v) { return __atomic_load_n(v, __ATOMIC_RELAXED); }
+
+cJSON *sn_metrics_to_json(void) {
+  cJSON *root = cJSON_CreateObject();
+  if (!root) return NULL;
+
+  cJSON *counters = cJSON_AddObjectToObject(root, "c");
+  for (int i = 0; i < SN_MC_MAX; i++) {
+    cJSON_AddNumberToObject(counters, counter_keys[i], load(&gMetricCounters[i]));
+  }
+
+  cJSON *gauges = cJSON_AddObjectToObject(root, "g");
+  for (int i = 0; i < SN_MG_MAX; i++) {
+    cJSON_AddNumberToObject(gauges, gauge_keys[i], load(&gMetricGauges[i]));
+  }
+
+  cJSON *histograms = cJSON_AddObjectToObject(root, "h");
+  for (int i = 0; i < SN_MH_MAX; i++) {
+    const sn_metric_histogram_t *h = &gMetricHistograms[i];
+    int used = SN_METRIC_HIST_BUCKETS;
+    while (used > 0 && load(&h->buckets[used - 1]) == 0) used--;
+
+    cJSON *entry = cJSON_CreateArray();
+    cJSON_AddItemToArray(entry, cJSON_CreateNumber(load(&h->count)));
+    cJSON_AddItemToArray(entry, cJSON_CreateNumber(load(&h->max)));
+    cJSON *buckets = cJSON_CreateArray();
+    for (int b = 0; b < used; b++) {
+      cJSON_AddItemToArray(buckets, cJSON_CreateNumber(load(&h->buckets[b])));
+    }
+    cJSON_AddItemToArray(entry, buckets);
+    cJSON_AddItemToObject(histograms, histogram_keys[i], entry);
+  }
+  return root;
+}
+
+void sn_metrics_reset(void) {
+  // not atomic as a whole, updates racing with the reset land on either side
+  for (int i = 0; i < SN_MC_MAX; i++) __atomic_store_n(&gMetricCounters[i], 0, __ATOMIC_RELAXED);
+  for (int i = 0; i < SN_MG_MAX; i++) __atomic_store_n(&gMetricGauges[i], 0, __ATOMIC_RELAXED);
+  for (int i = 0; i < SN_MH_MAX; i++) {
+    sn_metric_histogram_t *h = &gMetricHistograms[i];
+    __atomic_store_n(&h->count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->max, 0, __ATOMIC_RELAXED);
+    for (int b = 0; b < SN_METRIC_HIST_BUCKETS; b++) {
+      __atomic_store_n(&h->buckets[b], 0, __ATOMIC_RELAXED);
+    }
+  }
+}
@@ -0,0 +1,126 @@
+// --------------------------------------------------------------------------------
+// sn_metrics.h
+//
+// description: static registry of counters, gauges and log2 histograms. Every update
+// is a single relaxed 32-bit atomic so they are cheap enough for the hot paths and
+// safe from any task. Add a metric by adding a line to the tables below.
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_METRICS_H
+#define SN_METRICS_H
+
+#include "cJSON.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// clang-format off
+#define SN_METRIC_COUNTERS(X)                                 \
+  X(mqtt_pub_ok,        "mqtt.pub.ok")                        \
+  X(mqtt_pub_fail,      "mqtt.pub.fail")                      \
+  X(mqtt_pub_drop,      "mqtt.pub.drop")   /* queue full */   \
+  X(mqtt_pub_oversize,  "mqtt.pub.big")    /* > payload max */\
+  X(mqtt_rx,            "mqtt.rx")                            \
+  X(tq_sent,            "tq.sent")                            \
+  X(tq_drop,            "tq.drop")         /* consumer full */\
+  X(sensor_read_ok,     "read.ok")                            \
+  X(sensor_read_fail,   "read.fail")                          \
+  X(rule_eval,          "rule.eval")                          \
+  X(rule_transition,    "rule.trans")                         \
+  X(cmd_ok,             "cmd.ok")                             \
+  X(cmd_fail,           "cmd.fail")                           \
+  X(heap_alloc_fail,    "heap.fail")                          \
+  X(rec_ok,             "rec.ok")                             \
+  X(rec_drop,           "rec.drop")        /* buffer full */  \
+  X(bus_drop,           "bus.drop")        /* queue full */
+
+#define SN_METRIC_GAUGES(X)                                   \
+  X(mqtt_pubq_depth,    "mqtt.pubq")                          \
+  X(mqtt_pubq_hwm,      "mqtt.pubq.hwm")                      \
+  X(rule_queue_hwm,     "rule.q.hwm")
+
+// values in us
+#define SN_METRIC_HISTOGRAMS(X)                               \
+  X(cmd_latency,        "cmd.us")                             \
+  X(sign_time,          "sign.us")                            \
+  X(sensor_read_time,   "read.us")                            \
+  X(rule_time,          "rule.us")                            \
+  X(bus_wait,           "bus.wait.us")     /* queued to run */\
+  X(bus_txn_time,       "bus.txn.us")
+// clang-format on
+
+// bucket i counts values in [2^i, 2^(i+1)), the last one everything above 2^19us (~0.5s)
+#define SN_METRIC_HIST_BUCKETS 20
+
+typedef enum {
+#define GEN_METRIC_ENUM(NAME, KEY) SN_MC_##NAME,
+  SN_METRIC_COUNTERS(GEN_METRIC_ENUM) SN_MC_MAX
+#undef GEN_METRIC_ENUM
+} sn_metric_counter_e;
+
+typedef enum {
+#define GEN_METRIC_ENUM(NAME, KEY) SN_MG_##NAME,
+  SN_METRIC_GAUGES(GEN_METRIC_ENUM) SN_MG_MAX
+#undef GEN_METRIC_ENUM
+} sn_metric_gauge_e;
+
+typedef enum {
+#define GEN_METRIC_ENUM(NAME, KEY) SN_MH_##NAME,
+  SN_METRIC_HISTOGRAMS(GEN_METRIC_ENUM) SN_MH_MAX
+#undef GEN_METRIC_ENUM
+} sn_metric_histogram_e;
+
+typedef struct {
+  uint32_t count;
+  uint32_t max;
+  uint32_t buckets[SN_METRIC_HIST_BUCKETS];
+} sn_metric_histogram_t;
+
+extern uint32_t gMetricCounters[SN_MC_MAX];
+extern uint32_t gMetricGauges[SN_MG_MAX];
+extern sn_metric_histogram_t gMetricHistograms[SN_MH_MAX];
+
+static inline void sn_metric_add(sn_metric_counter_e id, uint32_t n) {
+  __atomic_fetch_add(&gMetricCounters[id], n, __ATOMIC_RELAXED);
+}
+
+static inline void sn_metric_inc(sn_metric_counter_e id) { sn_metric_add(id, 1); }
+
+static inline void sn_metric_gauge_set(sn_metric_gauge_e id, uint32_t v) {
+  __atomic_store_n(&gMetricGauges[id], v, __ATOMIC_RELAXED);
+}
+
+static inline void sn_metric_store_max(uint32_t *dst, uint32_t v) {
+  uint32_t cur = __atomic_load_n(dst, __ATOMIC_RELAXED);
+  while (v > cur
+         && !__atomic_compare_exchange_n(dst, &cur, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+// keep the highest value seen (high-water marks)
+static inline void sn_metric_gauge_max(sn_metric_gauge_e id, uint32_t v) {
+  sn_metric_store_max(&gMetricGauges[id], v);
+}
+
+static inline void sn_metric_observe(sn_metric_histogram_e id, uint32_t v) {
+  sn_metric_histogram_t *h = &gMetricHistograms[id];
+  int b = v < 2 ? 0 : 31 - __builtin_clz(v);
+  if (b >= SN_METRIC_HIST_BUCKETS) b = SN_METRIC_HIST_BUCKETS - 1;
+  __atomic_fetch_add(&h->buckets[b], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+  sn_metric_store_max(&h->max, v);
+}
+
+/*
+ * @brief Compact dump, histograms are [count, max, [buckets...]] with trailing empty
+ * buckets trimmed:
+ * { "c": {"mqtt.pub.ok": 120, ...}, "g": {...}, "h": {"cmd.us": [4, 2100, [0,0,1,3]]} }
+ */
+cJSON *sn_metrics_to_json(void);
+
+/*
+ * @brief Zero every metric
+ */
+void sn_metrics_reset(void);
+
+#endif // !SN_METRICS_H
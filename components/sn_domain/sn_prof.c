@@ -0,0 +1,90 @@
+#include "sn_prof.h"
+
+#if CONFIG_SN_PROF_ENABLE
+
+#include "esp_cpu.h"
+#include "esp_private/esp_clk.h"
+#include "freertos/FreeRTOS.h"
+
+static sn_prof_probe_t *s_head = NULL;
+
+static void link_probe(sn_prof_probe_t *probe) {
+  if (__atomic_exchange_n(&probe->linked, 1, __ATOMIC_ACQ_REL)) return;
+  sn_prof_probe_t *head = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE);
+  do {
+    probe->next = head;
+  } while (!__atomic_compare_exchange_n(
+    &s_head, &head, probe, true, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE
+  ));
+}
+
+sn_prof_scope_t sn_prof_begin(sn_prof_probe_t *probe) {
+  if (!__atomic_load_n(&probe->linked, __ATOMIC_RELAXED)) link_probe(probe);
+  return (sn_prof_scope_t){
+    .probe = probe, .core = xPortGetCoreID(), .start = esp_cpu_get_cycle_count()
+  };
+}
+
+void sn_prof_end(sn_prof_scope_t *scope) {
+  // the counter wraps every ~18s at 240 MHz, the difference does not
+  uint32_t cycles = esp_cpu_get_cycle_count() - scope->start;
+  if (xPortGetCoreID() != scope->core) return;
+  sn_prof_probe_t *p = scope->probe;
+  __atomic_fetch_add(&p->calls, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&p->total, cycles, __ATOMIC_RELAXED);
+
+  uint32_t cur = __atomic_load_n(&p->min, __ATOMIC_RELAXED);
+  while (cycles < cur &&
+         !__atomic_compare_exchange_n(&p->min, &cur, cycles, true, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED));
+  cur = __atomic_load_n(&p->max, __ATOMIC_RELAXED);
+  while (cycles > cur &&
+         !__atomic_compare_exchange_n(&p->max, &cur, cycles, true, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED));
+}
+
+cJSON *sn_prof_to_json(void) {
+  cJSON *root = cJSON_CreateObject();
+  if (!root) return NULL;
+  cJSON_AddNumberToObject(root, "mhz", esp_clk_cpu_freq() / 1000000);
+
+  cJSON *probes = cJSON_AddObjectToObject(root, "probes");
+  for (sn_prof_probe_t *p = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE); p; p = p->next) {
+    uint32_t calls = __atomic_load_n(&p->calls, __ATOMIC_RELAXED);
+    if (!calls) continue;
+    cJSON *entry = cJSON_CreateArray();
+    cJSON_AddItemToArray(entry, cJSON_CreateNumber(calls));
+    cJSON_AddItemToArray(entry, cJSON_CreateNumber(__atomic_load_n(&p->total, __ATOMIC_RELAXED)));
+    cJSON_AddItemToArray(entry, cJSON_CreateNumber(__atomic_load_n(&p->min, __ATOMIC_RELAXED)));
+    cJSON_AddItemToArray(entry, cJSON_CreateNumber(__atomic_load_n(&p->max, __ATOMIC_RELAXED)));
+    // two sites may share a name, the first one listed keeps it
+    if (cJSON_HasObjectItem(probes, p->name)) {
+      cJSON_Delete(entry);
+      continue;
+    }
+    cJSON_AddItemToObject(probes, p->name, entry);
+  }
+  return root;
+}
+
+void sn_prof_reset(void) {
+  // like sn_metrics_reset, scopes ending during the reset land on either side
+  for (sn_prof_probe_t *p = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE); p; p = p->next) {
+    __atomic_store_n(&p->calls, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&p->total, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&p->min, UINT32_MAX, __ATOMIC_RELAXED);
+    __atomic_store_n(&p->max, 0, __ATOMIC_RELAXED);
+  }
+}
+
+#else
+
+sn_prof_scope_t sn_prof_begin(sn_prof_probe_t *probe) { return (sn_prof_scope_t){0}; }
+
+void sn_prof_end(sn_prof_scope_t *scope) {}
+
+cJSON *sn_prof_to_json(void) { return NULL; }
+
+void sn_prof_reset(void) {}
+
+#endif // CONFIG_SN_PROF_ENABLE
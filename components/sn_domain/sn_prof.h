@@ -0,0 +1,70 @@
+// --------------------------------------------------------------------------------
+// sn_prof.h
+//
+// description: aggregate cpu cycle profile of the hot paths. SN_PROF_SCOPE(name) counts
+// the cycles from the probe to the end of the enclosing block into a per-site entry
+// (calls, total, min, max). The probes compile to nothing unless CONFIG_SN_PROF_ENABLE
+// is set. The table is read and reset with the get_profile command of the profile
+// port.
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_PROF_H
+#define SN_PROF_H
+
+#include "cJSON.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// One per probe site, linked into the table on its first run
+typedef struct sn_prof_probe_s {
+  const char *name; // string literal, only the pointer is stored
+  uint32_t calls;
+  uint32_t min;
+  uint32_t max;
+  uint64_t total;
+  uint32_t linked;
+  struct sn_prof_probe_s *next;
+} sn_prof_probe_t;
+
+#define SN_PROF_PROBE_INIT(label) {.name = (label), .min = UINT32_MAX}
+
+typedef struct {
+  sn_prof_probe_t *probe;
+  uint32_t start;
+  int core;
+} sn_prof_scope_t;
+
+#if CONFIG_SN_PROF_ENABLE
+
+#define SN_PROF_CAT_(a, b) a##b
+#define SN_PROF_CAT(a, b)  SN_PROF_CAT_(a, b)
+
+// The cycle counter is per core, a scope that ends on another core than it began on is
+// not recorded
+#define SN_PROF_SCOPE(name)                                                                        \
+  static sn_prof_probe_t SN_PROF_CAT(sn_prof_probe_, __LINE__) = SN_PROF_PROBE_INIT(name);         \
+  sn_prof_scope_t SN_PROF_CAT(sn_prof_scope_, __LINE__)                                            \
+    __attribute__((cleanup(sn_prof_end), unused)) =                                                \
+      sn_prof_begin(&SN_PROF_CAT(sn_prof_probe_, __LINE__))
+
+#else
+
+#define SN_PROF_SCOPE(name) ((void)0)
+
+#endif // CONFIG_SN_PROF_ENABLE
+
+sn_prof_scope_t sn_prof_begin(sn_prof_probe_t *probe);
+
+void sn_prof_end(sn_prof_scope_t *scope);
+
+/*
+ * @brief { "mhz": 240, "probes": { "sign": [calls, total, min, max], ... } } in cycles,
+ * probes that never ran are left out. NULL when profiling is compiled out
+ */
+cJSON *sn_prof_to_json(void);
+
+void sn_prof_reset(void);
+
+#endif // !SN_PROF_H
@@ -0,0 +1,196 @@
+#include "sn_recorder.h"
+#include "esp_log.h"
+#include "sn_metrics.h"
+
+#if CONFIG_SN_RECORDER_ENABLE
+
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define REC_BUFFER   CONFIG_SN_RECORDER_BUFFER
+#define REC_FLUSH_MS CONFIG_SN_RECORDER_FLUSH_MS
+
+static const char *TAG = "SN_RECORDER";
+
+// Records are staged as the exact bytes of the flash, padding and sector headers
+// included, so a flush is a plain sequential write. Two buffers: the records go to
+// one while the other is written out
+static uint8_t s_stage[2][REC_BUFFER];
+static size_t s_stage_len[2];
+static int s_active = 0;
+
+static const esp_partition_t *s_part = NULL;
+static SemaphoreHandle_t s_lock = NULL;  // the active buffer and the chain below
+static SemaphoreHandle_t s_flush = NULL; // one flush at a time
+static TaskHandle_t s_task = NULL;
+static uint32_t s_tail = 0;    // partition offset the next staged byte lands on
+static uint32_t s_flushed = 0; // partition offset the next flush writes at
+static uint32_t s_seq = 0;     // of the newest sector
+static unsigned long long s_last_ts = 0;
+
+void sn_recorder_record(const sn_rec_t *rec) {
+  if (!s_part || !rec) return;
+
+  uint8_t buf[SN_REC_RECORD_MAX];
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  size_t n = sn_recorder_encode(rec, s_last_ts, buf, sizeof(buf));
+  uint32_t off = s_tail % SN_REC_SECTOR_SIZE;
+  // the first record of a sector chains to base_ms, the time of the record before it,
+  // so it is encoded the same either way
+  bool new_sector = off == 0 || n > SN_REC_SECTOR_SIZE - off;
+  size_t pad = new_sector && off ? SN_REC_SECTOR_SIZE - off : 0;
+  size_t total = pad + (new_sector ? SN_REC_HEADER_SIZE : 0) + n;
+
+  uint8_t *stage = s_stage[s_active];
+  size_t *len = &s_stage_len[s_active];
+  if (!n || *len + total > REC_BUFFER) {
+    xSemaphoreGive(s_lock);
+    sn_metric_inc(SN_MC_rec_drop);
+    return;
+  }
+  memset(stage + *len, 0xff, pad);
+  *len += pad;
+  if (new_sector) {
+    sn_recorder_write_header(stage + *len, ++s_seq, s_last_ts);
+    *len += SN_REC_HEADER_SIZE;
+  }
+  memcpy(stage + *len, buf, n);
+  *len += n;
+  s_tail = (s_tail + total) % s_part->size;
+  s_last_ts = rec->ts;
+  bool kick = *len > REC_BUFFER / 2;
+  xSemaphoreGive(s_lock);
+
+  sn_metric_inc(SN_MC_rec_ok);
+  if (kick && s_task) xTaskNotifyGive(s_task);
+}
+
+static esp_err_t write_out(const uint8_t *data, size_t len) {
+  while (len) {
+    uint32_t off = s_flushed % SN_REC_SECTOR_SIZE;
+    size_t chunk = SN_REC_SECTOR_SIZE - off < len ? SN_REC_SECTOR_SIZE - off : len;
+    if (off == 0) {
+      esp_err_t err = esp_partition_erase_range(s_part, s_flushed, SN_REC_SECTOR_SIZE);
+      if (err != ESP_OK) return err;
+    }
+    esp_err_t err = esp_partition_write(s_part, s_flushed, data, chunk);
+    if (err != ESP_OK) return err;
+    s_flushed = (s_flushed + chunk) % s_part->size;
+    data += chunk;
+    len -= chunk;
+  }
+  return ESP_OK;
+}
+
+esp_err_t sn_recorder_flush(void) {
+  if (!s_part) return ESP_ERR_INVALID_STATE;
+
+  xSemaphoreTake(s_flush, portMAX_DELAY);
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  int idx = s_active;
+  s_active ^= 1;
+  xSemaphoreGive(s_lock);
+
+  esp_err_t err = write_out(s_stage[idx], s_stage_len[idx]);
+  if (err != ESP_OK) ESP_LOGE(TAG, "Flash write failed: %s", esp_err_to_name(err));
+  s_stage_len[idx] = 0;
+  xSemaphoreGive(s_flush);
+  return err;
+}
+
+static void recorder_task(void *pvParams) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(REC_FLUSH_MS));
+    sn_recorder_flush();
+  }
+}
+
+// Resume after the last record of the newest sector. A sector cut short by a torn
+// write is left alone, the log goes on in the next one
+static void resume(void) {
+  uint32_t sectors = s_part->size / SN_REC_SECTOR_SIZE;
+  uint8_t header[SN_REC_HEADER_SIZE];
+  bool found = false;
+  uint32_t newest = 0;
+  for (uint32_t i = 0; i < sectors; i++) {
+    uint32_t seq;
+    if (esp_partition_read(s_part, i * SN_REC_SECTOR_SIZE, header, sizeof(header)) != ESP_OK ||
+        !sn_recorder_read_header(header, &seq, NULL))
+      continue;
+    if (!found || (int32_t)(seq - s_seq) > 0) {
+      newest = i;
+      s_seq = seq;
+      found = true;
+    }
+  }
+  if (!found) {
+    s_tail = s_flushed = 0;
+    return;
+  }
+
+  uint8_t *sector = malloc(SN_REC_SECTOR_SIZE);
+  uint32_t base = newest * SN_REC_SECTOR_SIZE;
+  uint32_t off = SN_REC_SECTOR_SIZE;
+  if (sector && esp_partition_read(s_part, base, sector, SN_REC_SECTOR_SIZE) == ESP_OK) {
+    sn_recorder_read_header(sector, NULL, &s_last_ts);
+    off = SN_REC_HEADER_SIZE;
+    while (off < SN_REC_SECTOR_SIZE && sector[off] != 0xff) {
+      sn_rec_t rec;
+      size_t used = sn_recorder_decode(sector + off, SN_REC_SECTOR_SIZE - off, &s_last_ts, &rec);
+      if (!used) {
+        ESP_LOGW(TAG, "Sector %lu ends in a torn record", (unsigned long)newest);
+        off = SN_REC_SECTOR_SIZE;
+        break;
+      }
+      off += used;
+    }
+  }
+  free(sector);
+  s_tail = s_flushed = (base + off) % s_part->size;
+}
+
+esp_err_t sn_recorder_init(void) {
+  if (s_part) return ESP_OK;
+
+  const esp_partition_t *part = esp_partition_find_first(
+    ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, SN_REC_PARTITION
+  );
+  if (!part || part->size < 2 * SN_REC_SECTOR_SIZE) {
+    ESP_LOGE(TAG, "No \"%s\" partition", SN_REC_PARTITION);
+    return ESP_ERR_NOT_FOUND;
+  }
+  s_lock = xSemaphoreCreateMutex();
+  s_flush = xSemaphoreCreateMutex();
+  if (!s_lock || !s_flush) return ESP_ERR_NO_MEM;
+
+  s_part = part;
+  resume();
+  if (xTaskCreate(recorder_task, "recorder_task", 3072, NULL, 2, &s_task) != pdPASS) {
+    s_part = NULL;
+    return ESP_ERR_NO_MEM;
+  }
+
+  // the clock is not synced yet, the boot takes the time of the last record
+  sn_rec_t boot = {.type = SN_REC_BOOT, .ts = s_last_ts, .boot.reason = esp_reset_reason()};
+  sn_recorder_record(&boot);
+  ESP_LOGI(
+    TAG, "Recording to \"%s\" at 0x%lx (seq %lu)", SN_REC_PARTITION, (unsigned long)s_tail,
+    (unsigned long)s_seq
+  );
+  return ESP_OK;
+}
+
+#else
+
+void sn_recorder_record(const sn_rec_t *rec) {}
+
+esp_err_t sn_recorder_init(void) { return ESP_ERR_NOT_SUPPORTED; }
+
+esp_err_t sn_recorder_flush(void) { return ESP_ERR_NOT_SUPPORTED; }
+
+#endif // CONFIG_SN_RECORDER_ENABLE
@@ -0,0 +1,163 @@
+// --------------------------------------------------------------------------------
+// sn_recorder.h
+//
+// description: compact binary log of the sensor readings, inbound commands, rule
+// transitions and the commands the rules dispatched, appended to the "reclog" flash
+// partition. The log is dumped with parttool.py and replayed on the host against the
+// real rule engine (host_test/replay). The SN_REC_* probes compile to nothing unless
+// CONFIG_SN_RECORDER_ENABLE is set.
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_RECORDER_H
+#define SN_RECORDER_H
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "sn_driver/sensor.h"
+#include "sn_json.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Layout of the partition, a ring of 4 KB sectors written in order:
+ *
+ *   sector: | magic u32 | seq u32 | base_ms u64 | record | record | ... | 0xff ... |
+ *   record: | type u8 | body_len varint | dt_ms zigzag varint | fields of the type |
+ *
+ * dt_ms chains every record to the one before it, the first of a sector to base_ms.
+ * Integers are little endian, strings a varint length, the bytes and a nul. Records
+ * never span two sectors, the rest of a sector stays erased
+ */
+#define SN_REC_MAGIC        0x4C524E53u // "SNRL"
+#define SN_REC_SECTOR_SIZE  4096
+#define SN_REC_HEADER_SIZE  16
+#define SN_REC_COMMAND_MAX  256 // inbound payloads are truncated to this
+#define SN_REC_RECORD_MAX   (SN_REC_COMMAND_MAX + 24)
+#define SN_REC_PARTITION    "reclog"
+
+typedef enum {
+  SN_REC_BOOT = 1,   // the recorder started, reason is esp_reset_reason()
+  SN_REC_READING,    // a reading handed to the consumers, ts is the reading's
+  SN_REC_TRANSITION, // a rule changed state, ts and value are the reading's
+  SN_REC_DISPATCH,   // a command run by the rule of the last transition
+  SN_REC_COMMAND,    // an inbound command payload, as received
+} sn_rec_type_e;
+
+#define SN_REC_COMMAND_GROUP     0x01 // received on an org or cluster topic
+#define SN_REC_COMMAND_TRUNCATED 0x02
+
+// Strings of a decoded record point into the decoded buffer and are nul terminated
+typedef struct {
+  sn_rec_type_e type;
+  unsigned long long ts; // unix ms
+  union {
+    struct {
+      uint8_t reason;
+    } boot;
+    sn_sensor_reading_t reading;
+    struct {
+      local_id_t rule_id;
+      local_id_t src_id;
+      uint8_t from; // sn_rule_state_e
+      uint8_t to;
+      float value;
+    } transition;
+    struct {
+      local_id_t local_id;
+      int32_t result; // esp_err_t of the dispatch
+      const char *action;
+      const char *params_json;
+    } dispatch;
+    struct {
+      uint8_t flags;
+      const char *payload;
+    } command;
+  };
+} sn_rec_t;
+
+typedef void (*sn_rec_visit_t)(const sn_rec_t *rec, void *arg);
+
+typedef struct {
+  uint32_t sectors; // with a valid header
+  uint32_t records;
+  uint32_t corrupt; // sectors cut short by a record that does not decode
+  unsigned long long first_ts;
+  unsigned long long last_ts;
+} sn_rec_log_stats_t;
+
+#if CONFIG_SN_RECORDER_ENABLE
+
+#define SN_REC_READING(reading) sn_recorder_reading(reading)
+#define SN_REC_TRANSITION(rule_id, reading, from, to)                                             \
+  sn_recorder_transition((rule_id), (reading), (from), (to))
+#define SN_REC_DISPATCH(command, result) sn_recorder_dispatch((command), (result))
+#define SN_REC_COMMAND(payload, group)   sn_recorder_command((payload), (group))
+
+#else
+
+#define SN_REC_READING(reading)                       ((void)0)
+#define SN_REC_TRANSITION(rule_id, reading, from, to) ((void)0)
+#define SN_REC_DISPATCH(command, result)              ((void)0)
+#define SN_REC_COMMAND(payload, group)                ((void)0)
+
+#endif // CONFIG_SN_RECORDER_ENABLE
+
+/*
+ * @brief Find the "reclog" partition, resume after the newest record and start the
+ * flush task. Records a SN_REC_BOOT
+ */
+esp_err_t sn_recorder_init(void);
+
+/*
+ * @brief Write what is buffered to flash, blocking. Call before a planned restart
+ */
+esp_err_t sn_recorder_flush(void);
+
+/*
+ * @brief Append a record, safe from any task. Records arriving while the buffer is
+ * full are dropped and counted in rec.drop. Use the macros
+ */
+void sn_recorder_record(const sn_rec_t *rec);
+
+void sn_recorder_reading(const sn_sensor_reading_t *reading);
+void sn_recorder_transition(
+  local_id_t rule_id, const sn_sensor_reading_t *reading, uint8_t from, uint8_t to
+);
+void sn_recorder_dispatch(const sn_command_t *command, int result);
+void sn_recorder_command(const char *payload, bool group);
+
+// --------------------------------------------------------------------------------
+// Codec, shared by the device and the host replayer
+// --------------------------------------------------------------------------------
+
+/*
+ * @brief Encode rec after a record at prev_ts
+ * @return bytes written, 0 if it does not fit in cap
+ */
+size_t sn_recorder_encode(
+  const sn_rec_t *rec, unsigned long long prev_ts, uint8_t *buf, size_t cap
+);
+
+/*
+ * @brief Decode the record at buf, *ts is the time of the previous record on entry and
+ * of this one on return
+ * @return bytes consumed, 0 at the erased end of a sector or on a corrupt record
+ */
+size_t sn_recorder_decode(const uint8_t *buf, size_t len, unsigned long long *ts, sn_rec_t *out);
+
+void sn_recorder_write_header(uint8_t *buf, uint32_t seq, unsigned long long base_ms);
+
+// false if buf does not start with a sector header
+bool sn_recorder_read_header(const uint8_t *buf, uint32_t *seq, unsigned long long *base_ms);
+
+/*
+ * @brief Visit the records of a partition image from the oldest to the newest
+ * @param stats (optional)
+ * @return number of records visited
+ */
+size_t sn_recorder_walk(
+  const uint8_t *image, size_t len, sn_rec_visit_t visit, void *arg, sn_rec_log_stats_t *stats
+);
+
+#endif // !SN_RECORDER_H
@@ -0,0 +1,313 @@
+#include "sn_recorder.h"
+#include "sn_sntp.h"
+#include <string.h>
+
+// --------------------------------------------------------------------------------
+// Builders, the timestamp is taken here so the probes stay one line
+// --------------------------------------------------------------------------------
+
+void sn_recorder_reading(const sn_sensor_reading_t *reading) {
+  if (!reading) return;
+  sn_rec_t rec = {.type = SN_REC_READING, .ts = reading->ts, .reading = *reading};
+  sn_recorder_record(&rec);
+}
+
+void sn_recorder_transition(
+  local_id_t rule_id, const sn_sensor_reading_t *reading, uint8_t from, uint8_t to
+) {
+  if (!reading) return;
+  sn_rec_t rec = {
+    .type = SN_REC_TRANSITION,
+    .ts = reading->ts,
+    .transition =
+      {.rule_id = rule_id,
+       .src_id = reading->local_id,
+       .from = from,
+       .to = to,
+       .value = reading->value},
+  };
+  sn_recorder_record(&rec);
+}
+
+void sn_recorder_dispatch(const sn_command_t *command, int result) {
+  if (!command) return;
+  sn_rec_t rec = {
+    .type = SN_REC_DISPATCH,
+    .ts = sn_get_unix_timestamp_ms(),
+    .dispatch =
+      {.local_id = command->local_id,
+       .result = result,
+       .action = command->action,
+       .params_json = command->params_json},
+  };
+  sn_recorder_record(&rec);
+}
+
+void sn_recorder_command(const char *payload, bool group) {
+  if (!payload) return;
+  sn_rec_t rec = {
+    .type = SN_REC_COMMAND,
+    .ts = sn_get_unix_timestamp_ms(),
+    .command = {.flags = group ? SN_REC_COMMAND_GROUP : 0, .payload = payload},
+  };
+  sn_recorder_record(&rec);
+}
+
+// --------------------------------------------------------------------------------
+// Encoding
+// --------------------------------------------------------------------------------
+
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  size_t cap;
+} rec_writer_t;
+
+static void put_u8(rec_writer_t *w, uint8_t v) {
+  if (w->len < w->cap) w->buf[w->len] = v;
+  w->len++;
+}
+
+static void put_varint(rec_writer_t *w, uint64_t v) {
+  while (v >= 0x80) {
+    put_u8(w, (uint8_t)(v | 0x80));
+    v >>= 7;
+  }
+  put_u8(w, (uint8_t)v);
+}
+
+static void put_zigzag(rec_writer_t *w, int64_t v) {
+  put_varint(w, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static void put_le(rec_writer_t *w, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) put_u8(w, (uint8_t)(v >> (8 * i)));
+}
+
+static void put_f32(rec_writer_t *w, float f) {
+  uint32_t v;
+  memcpy(&v, &f, sizeof(v));
+  put_le(w, v, 4);
+}
+
+static void put_str(rec_writer_t *w, const char *s, size_t max) {
+  size_t n = s ? strnlen(s, max) : 0;
+  put_varint(w, n);
+  for (size_t i = 0; i < n; i++) put_u8(w, (uint8_t)s[i]);
+  put_u8(w, 0);
+}
+
+static void put_body(rec_writer_t *w, const sn_rec_t *rec, unsigned long long prev_ts) {
+  put_zigzag(w, (int64_t)(rec->ts - prev_ts));
+  switch (rec->type) {
+    case SN_REC_BOOT:
+      put_u8(w, rec->boot.reason);
+      break;
+    case SN_REC_READING:
+      put_varint(w, rec->reading.local_id);
+      put_f32(w, rec->reading.value);
+      break;
+    case SN_REC_TRANSITION:
+      put_varint(w, rec->transition.rule_id);
+      put_varint(w, rec->transition.src_id);
+      put_u8(w, rec->transition.from);
+      put_u8(w, rec->transition.to);
+      put_f32(w, rec->transition.value);
+      break;
+    case SN_REC_DISPATCH:
+      put_varint(w, rec->dispatch.local_id);
+      put_zigzag(w, rec->dispatch.result);
+      put_str(w, rec->dispatch.action, 64);
+      put_str(w, rec->dispatch.params_json, SN_REC_COMMAND_MAX);
+      break;
+    case SN_REC_COMMAND: {
+      uint8_t flags = rec->command.flags;
+      if (rec->command.payload && strnlen(rec->command.payload, SN_REC_COMMAND_MAX + 1) >
+                                    SN_REC_COMMAND_MAX) {
+        flags |= SN_REC_COMMAND_TRUNCATED;
+      }
+      put_u8(w, flags);
+      put_str(w, rec->command.payload, SN_REC_COMMAND_MAX);
+      break;
+    }
+  }
+}
+
+size_t sn_recorder_encode(
+  const sn_rec_t *rec, unsigned long long prev_ts, uint8_t *buf, size_t cap
+) {
+  if (!rec || !buf) return 0;
+  // measure the body first, its length goes in front of it
+  rec_writer_t body = {.buf = NULL, .cap = 0};
+  put_body(&body, rec, prev_ts);
+
+  rec_writer_t w = {.buf = buf, .cap = cap};
+  put_u8(&w, (uint8_t)rec->type);
+  put_varint(&w, body.len);
+  if (w.len + body.len > cap) return 0;
+  put_body(&w, rec, prev_ts);
+  return w.len;
+}
+
+void sn_recorder_write_header(uint8_t *buf, uint32_t seq, unsigned long long base_ms) {
+  rec_writer_t w = {.buf = buf, .cap = SN_REC_HEADER_SIZE};
+  put_le(&w, SN_REC_MAGIC, 4);
+  put_le(&w, seq, 4);
+  put_le(&w, base_ms, 8);
+}
+
+// --------------------------------------------------------------------------------
+// Decoding
+// --------------------------------------------------------------------------------
+
+typedef struct {
+  const uint8_t *buf;
+  size_t len;
+  size_t pos;
+  bool bad;
+} rec_reader_t;
+
+static uint8_t get_u8(rec_reader_t *r) {
+  if (r->pos >= r->len) {
+    r->bad = true;
+    return 0;
+  }
+  return r->buf[r->pos++];
+}
+
+static uint64_t get_varint(rec_reader_t *r) {
+  uint64_t v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    uint8_t b = get_u8(r);
+    v |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) return v;
+  }
+  r->bad = true;
+  return 0;
+}
+
+static int64_t get_zigzag(rec_reader_t *r) {
+  uint64_t v = get_varint(r);
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static uint64_t get_le(rec_reader_t *r, int bytes) {
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++) v |= (uint64_t)get_u8(r) << (8 * i);
+  return v;
+}
+
+static float get_f32(rec_reader_t *r) {
+  uint32_t v = (uint32_t)get_le(r, 4);
+  float f;
+  memcpy(&f, &v, sizeof(f));
+  return f;
+}
+
+static const char *get_str(rec_reader_t *r) {
+  uint64_t n = get_varint(r);
+  if (r->bad || n >= r->len - r->pos || r->buf[r->pos + n] != 0) {
+    r->bad = true;
+    return NULL;
+  }
+  const char *s = (const char *)&r->buf[r->pos];
+  r->pos += n + 1;
+  return s;
+}
+
+size_t sn_recorder_decode(const uint8_t *buf, size_t len, unsigned long long *ts, sn_rec_t *out) {
+  if (!buf || !len || !ts || !out || buf[0] == 0xff) return 0;
+
+  rec_reader_t head = {.buf = buf, .len = len};
+  uint8_t type = get_u8(&head);
+  uint64_t body_len = get_varint(&head);
+  if (head.bad || body_len > len - head.pos) return 0;
+
+  rec_reader_t r = {.buf = buf + head.pos, .len = (size_t)body_len};
+  memset(out, 0, sizeof(*out));
+  out->type = (sn_rec_type_e)type;
+  out->ts = *ts + (unsigned long long)get_zigzag(&r);
+  switch (type) {
+    case SN_REC_BOOT:
+      out->boot.reason = get_u8(&r);
+      break;
+    case SN_REC_READING:
+      out->reading.local_id = (local_id_t)get_varint(&r);
+      out->reading.value = get_f32(&r);
+      out->reading.ts = out->ts;
+      break;
+    case SN_REC_TRANSITION:
+      out->transition.rule_id = (local_id_t)get_varint(&r);
+      out->transition.src_id = (local_id_t)get_varint(&r);
+      out->transition.from = get_u8(&r);
+      out->transition.to = get_u8(&r);
+      out->transition.value = get_f32(&r);
+      break;
+    case SN_REC_DISPATCH:
+      out->dispatch.local_id = (local_id_t)get_varint(&r);
+      out->dispatch.result = (int32_t)get_zigzag(&r);
+      out->dispatch.action = get_str(&r);
+      out->dispatch.params_json = get_str(&r);
+      break;
+    case SN_REC_COMMAND:
+      out->command.flags = get_u8(&r);
+      out->command.payload = get_str(&r);
+      break;
+    default:
+      // a type added later, skipped by its length
+      break;
+  }
+  if (r.bad) return 0;
+  *ts = out->ts;
+  return head.pos + (size_t)body_len;
+}
+
+bool sn_recorder_read_header(const uint8_t *buf, uint32_t *seq, unsigned long long *base_ms) {
+  rec_reader_t r = {.buf = buf, .len = SN_REC_HEADER_SIZE};
+  if (!buf || get_le(&r, 4) != SN_REC_MAGIC) return false;
+  uint32_t s = (uint32_t)get_le(&r, 4);
+  unsigned long long base = get_le(&r, 8);
+  if (seq) *seq = s;
+  if (base_ms) *base_ms = base;
+  return true;
+}
+
+size_t sn_recorder_walk(
+  const uint8_t *image, size_t len, sn_rec_visit_t visit, void *arg, sn_rec_log_stats_t *stats
+) {
+  sn_rec_log_stats_t st = {0};
+  size_t sectors = len / SN_REC_SECTOR_SIZE;
+  size_t newest = 0;
+  uint32_t newest_seq = 0;
+  for (size_t i = 0; i < sectors; i++) {
+    uint32_t seq;
+    if (!sn_recorder_read_header(image + i * SN_REC_SECTOR_SIZE, &seq, NULL)) continue;
+    if (!st.sectors++ || (int32_t)(seq - newest_seq) > 0) {
+      newest = i;
+      newest_seq = seq;
+    }
+  }
+
+  // the ring is written in order, the oldest sector follows the newest one
+  for (size_t n = 1; st.sectors && n <= sectors; n++) {
+    const uint8_t *sector = image + ((newest + n) % sectors) * SN_REC_SECTOR_SIZE;
+    unsigned long long ts;
+    if (!sn_recorder_read_header(sector, NULL, &ts)) continue;
+
+    size_t off = SN_REC_HEADER_SIZE;
+    while (off < SN_REC_SECTOR_SIZE && sector[off] != 0xff) {
+      sn_rec_t rec;
+      size_t used = sn_recorder_decode(sector + off, SN_REC_SECTOR_SIZE - off, &ts, &rec);
+      if (!used) {
+        st.corrupt++;
+        break;
+      }
+      if (!st.records++) st.first_ts = rec.ts;
+      st.last_ts = rec.ts;
+      if (visit) visit(&rec, arg);
+      off += used;
+    }
+  }
+  if (stats) *stats = st;
+  return st.records;
+}
@@ -0,0 +1,103 @@
+#include "sn_state_table.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+// Retries before a reader sleeps. Readers (actor workers) outrank the writer (poll task),
+// one preempting it mid-update on the same core would otherwise spin forever
+#define READ_SPINS 8
+
+typedef struct {
+  uint32_t seq; // odd while the writer is updating the entry
+  uint32_t quality;
+  float value;
+  unsigned long long ts;
+} state_entry_t;
+
+static state_entry_t s_table[SN_STATE_TABLE_LEN];
+
+static inline void write_begin(state_entry_t *e) {
+  __atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELAXED);
+  // the odd seq must be visible before any field changes
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void write_end(state_entry_t *e) {
+  __atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELEASE);
+}
+
+void sn_state_table_update(local_id_t local_id, float value, unsigned long long ts) {
+  if (local_id >= SN_STATE_TABLE_LEN) return;
+  state_entry_t *e = &s_table[local_id];
+
+  write_begin(e);
+  e->value = value;
+  e->ts = ts;
+  e->quality = SN_QUALITY_GOOD;
+  write_end(e);
+}
+
+void sn_state_table_mark_bad(local_id_t local_id) {
+  if (local_id >= SN_STATE_TABLE_LEN) return;
+  state_entry_t *e = &s_table[local_id];
+  if (e->quality == SN_QUALITY_BAD) return;
+
+  write_begin(e);
+  e->quality = SN_QUALITY_BAD;
+  write_end(e);
+}
+
+bool sn_state_table_read(local_id_t local_id, sn_state_snapshot_t *out) {
+  if (local_id >= SN_STATE_TABLE_LEN || !out) return false;
+  const state_entry_t *e = &s_table[local_id];
+
+  uint32_t begin, end;
+  state_entry_t copy;
+  for (int tries = 1;; tries++) {
+    begin = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+    if (!(begin & 1)) { // even: no writer in progress
+      memcpy(&copy, e, sizeof(copy));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      end = __atomic_load_n(&e->seq, __ATOMIC_RELAXED);
+      if (begin == end) break;
+    }
+    // a yield would not let a lower priority writer run, sleep a tick instead
+    if (tries % READ_SPINS == 0) vTaskDelay(1);
+  }
+
+  if (copy.quality == SN_QUALITY_NONE) return false;
+  out->ts = copy.ts;
+  out->value = copy.value;
+  out->quality = (sn_state_quality_e)copy.quality;
+  // every update bumps seq twice
+  out->seq = begin >> 1;
+  return true;
+}
+
+cJSON *sn_state_table_to_json(local_id_t from, int limit) {
+  cJSON *root = cJSON_CreateObject();
+  if (!root) return NULL;
+
+  // rows instead of objects keep a page small
+  const char *cols[] = {"localId", "value", "ts", "quality", "seq"};
+  cJSON_AddItemToObject(root, "cols", cJSON_CreateStringArray(cols, 5));
+  cJSON *rows = cJSON_AddArrayToObject(root, "rows");
+
+  sn_state_snapshot_t snap;
+  int len = 0;
+  for (int id = from; id < SN_STATE_TABLE_LEN; id++) {
+    if (!sn_state_table_read(id, &snap)) continue;
+    if (len++ == limit) {
+      cJSON_AddNumberToObject(root, "next", id);
+      break;
+    }
+    cJSON *row = cJSON_CreateArray();
+    cJSON_AddItemToArray(row, cJSON_CreateNumber(id));
+    cJSON_AddItemToArray(row, cJSON_CreateNumber(snap.value));
+    cJSON_AddItemToArray(row, cJSON_CreateNumber((double)snap.ts));
+    cJSON_AddItemToArray(row, cJSON_CreateString(sn_state_quality_str(snap.quality)));
+    cJSON_AddItemToArray(row, cJSON_CreateNumber(snap.seq));
+    cJSON_AddItemToArray(rows, row);
+  }
+  return root;
+}
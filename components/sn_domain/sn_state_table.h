@@ -0,0 +1,68 @@
+// --------------------------------------------------------------------------------
+// sn_state_table.h
+//
+// description: latest value of every sensor local_id. The sensor poll task is the
+// only writer, any task can read an entry lock-free through a per-entry seqlock.
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_STATE_TABLE_H
+#define SN_STATE_TABLE_H
+
+#include "cJSON.h"
+#include "forward.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Ports use local_id 0x01 -> 0x7E, rules (0x7F -> 0xFE) have no state
+#define SN_STATE_TABLE_LEN 0x80
+// rows of a dump, a page of the widest rows stays within one mqtt message
+#define SN_STATE_TABLE_PAGE_MAX 12
+
+typedef enum {
+  SN_QUALITY_NONE = 0, // never read
+  SN_QUALITY_GOOD,
+  SN_QUALITY_BAD, // last read failed, value is the last good one
+} sn_state_quality_e;
+
+typedef struct {
+  unsigned long long ts; // unix ms of the last good read
+  float value;
+  uint32_t seq; // number of updates of this entry
+  sn_state_quality_e quality;
+} sn_state_snapshot_t;
+
+/*
+ * @brief Store a good reading (single writer)
+ */
+void sn_state_table_update(local_id_t local_id, float value, unsigned long long ts);
+
+/*
+ * @brief Flag the entry as bad and keep its last value (single writer)
+ */
+void sn_state_table_mark_bad(local_id_t local_id);
+
+/*
+ * @brief Consistent copy of an entry, safe from any task. Sleeps a tick between bursts
+ * of retries while the writer is mid-update, not callable from an ISR
+ * @return false if the local_id is out of range or was never written
+ */
+bool sn_state_table_read(local_id_t local_id, sn_state_snapshot_t *out);
+
+/*
+ * @brief Compact dump of up to limit written entries from local_id from on. next is the
+ * local_id to ask for the following page, absent on the last one:
+ * { "cols": ["localId","value","ts","quality","seq"], "rows": [[1, 24.5, 1731..., "good", 12]],
+ *   "next": 14 }
+ */
+cJSON *sn_state_table_to_json(local_id_t from, int limit);
+
+static inline const char *sn_state_quality_str(sn_state_quality_e q) {
+  switch (q) {
+    case SN_QUALITY_GOOD: return "good";
+    case SN_QUALITY_BAD:  return "bad";
+    default:              return "none";
+  }
+}
+
+#endif // !SN_STATE_TABLE_H
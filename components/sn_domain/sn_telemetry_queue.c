@@ -1,12 +1,20 @@
 #include "sn_telemetry_queue.h"
 #include "esp_log.h"
+#include "sdkconfig.h"
+#include "sn_metrics.h"
+#include "sn_recorder.h"
 
+#ifdef CONFIG_SN_MAX_CONSUMERS
+#define MAX_CONSUMERS CONFIG_SN_MAX_CONSUMERS
+#else
 #define MAX_CONSUMERS 16
+#endif
+
 static QueueHandle_t consumer_queues[MAX_CONSUMERS];
 static int consumer_count = 0;
 
 esp_err_t register_consumer(QueueHandle_t q) {
-  if (consumer_count > MAX_CONSUMERS) {
+  if (consumer_count >= MAX_CONSUMERS) {
     return ESP_ERR_NO_MEM;
   }
   consumer_queues[consumer_count++] = q;
@@ -16,7 +24,12 @@ esp_err_t register_consumer(QueueHandle_t q) {
 void distribute_reading(sn_sensor_reading_t *reading) {
   sn_sensor_reading_t data;
   memcpy(&data, reading, sizeof(sn_sensor_reading_t));
+  SN_REC_READING(&data);
   for (int i = 0; i < consumer_count; i++) {
-    xQueueSend(consumer_queues[i], &data, 0);
+    if (xQueueSend(consumer_queues[i], &data, 0) == pdTRUE) {
+      sn_metric_inc(SN_MC_tq_sent);
+    } else {
+      sn_metric_inc(SN_MC_tq_drop);
+    }
   }
 }
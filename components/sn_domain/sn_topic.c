@@ -19,11 +19,22 @@ static void rebuild_topics(void) {
   );
   TOPIC_DEVICE_CONFIG(gen_fill_cache)
 #undef gen_fill_cache
+
+  // extra args are ignored by formats that don't use them
+#define gen_fill_group_cache(name, fmt)                                                            \
+  sn_build_device_topic(                                                                           \
+    cache.name##_topic, sizeof(cache.name##_topic), fmt, ctx.orgId, ctx.clusterId                  \
+  );
+  TOPIC_GROUP_CONFIG(gen_fill_group_cache)
+#undef gen_fill_group_cache
+  // a device outside any cluster must not subscribe to "org/<org>/cluster//command"
+  if (ctx.clusterId[0] == '\0') cache.cluster_command_topic[0] = '\0';
 }
 
 void print_topic_cache(void) {
 #define gen_print_cache(name, fmt) ESP_LOGI(TAG, "%s", cache.name##_topic);
   TOPIC_DEVICE_CONFIG(gen_print_cache)
+  TOPIC_GROUP_CONFIG(gen_print_cache)
 #undef gen_print_cache
 }
 
@@ -39,6 +50,7 @@ esp_err_t sn_mqtt_topic_cache_init(const sn_mqtt_topic_context_t *context) {
   ESP_LOGI(TAG, "MQTT topics initialized", ctx.orgId, ctx.deviceId);
   ESP_LOGI(TAG, "orgId=%s", ctx.orgId);
   ESP_LOGI(TAG, "deviceId=%s", ctx.deviceId);
+  ESP_LOGI(TAG, "clusterId=%s", ctx.clusterId);
   return ESP_OK;
 }
 
@@ -50,8 +62,9 @@ esp_err_t sn_mqtt_topic_cache_set_context(const sn_mqtt_topic_context_t *context
     TAG,
     "MQTT topics rebuilt for"
     "\n\torgId     =%s"
-    "\n\tdeviceId  =%s",
-    ctx.orgId, ctx.deviceId
+    "\n\tdeviceId  =%s"
+    "\n\tclusterId =%s",
+    ctx.orgId, ctx.deviceId, ctx.clusterId
   );
   rebuild_topics();
   return ESP_OK;
@@ -19,21 +19,33 @@
 
 // clang-format off
 #define TOPIC_DEVICE_CONFIG(X) \
-  X(telemetry,    TOPIC_DEV_FMT "telemetry")      \
-  X(status,       TOPIC_DEV_FMT "status")         \
-  X(command,      TOPIC_DEV_FMT "command")        \
-  X(command_ack,  TOPIC_DEV_FMT "command-ack")    \
-  X(event,        TOPIC_DEV_FMT "event")
+  X(telemetry,        TOPIC_DEV_FMT "telemetry")        \
+  X(status,           TOPIC_DEV_FMT "status")           \
+  X(command,          TOPIC_DEV_FMT "command")          \
+  X(command_ack,      TOPIC_DEV_FMT "command-ack")      \
+  X(event,            TOPIC_DEV_FMT "event")            \
+  X(shadow_reported,  TOPIC_DEV_FMT "shadow/reported")  \
+  X(shadow_desired,   TOPIC_DEV_FMT "shadow/desired")   \
+  X(shadow_get,       TOPIC_DEV_FMT "shadow/get")       \
+  X(trace,            TOPIC_DEV_FMT "trace")            \
+  X(trace_get,        TOPIC_DEV_FMT "trace/get")
+
+// Topics shared by a group of devices, built from (orgId, clusterId)
+#define TOPIC_GROUP_CONFIG(X) \
+  X(org_command,      TOPIC_BASE_FMT "command")             \
+  X(cluster_command,  TOPIC_BASE_FMT "cluster/%s/command")
 // clang-format on
 
 typedef struct {
   char orgId[64];
   char deviceId[64];
+  char clusterId[64]; // optional, no cluster topics when empty
 } sn_mqtt_topic_context_t;
 
 typedef struct {
 #define GEN_TOPIC_CACHE_FIELD(NAME, fmt, ...) char NAME##_topic[MAX_TOPIC_LEN];
   TOPIC_DEVICE_CONFIG(GEN_TOPIC_CACHE_FIELD)
+  TOPIC_GROUP_CONFIG(GEN_TOPIC_CACHE_FIELD)
 #undef GEN_TOPIC_CACHE_FIELD
 } sn_mqtt_topic_cache_t;
 
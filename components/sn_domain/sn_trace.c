@@ -0,0 +1,98 @@
+#include "sn_trace.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#if CONFIG_SN_TRACE_ENABLE
+
+#define TRACE_LEN CONFIG_SN_TRACE_BUFFER_LEN
+_Static_assert((TRACE_LEN & (TRACE_LEN - 1)) == 0, "SN_TRACE_BUFFER_LEN must be a power of two");
+
+// names of the live tasks, resolved once per dump
+#define TRACE_MAX_TASKS 32
+
+static sn_trace_event_t s_ring[TRACE_LEN];
+static uint32_t s_head = 0; // total events recorded, the slot is head % TRACE_LEN
+static uint32_t s_enabled = 1;
+
+void sn_trace_record(char phase, const char *name, uint16_t arg) {
+  if (!__atomic_load_n(&s_enabled, __ATOMIC_RELAXED)) return;
+  uint32_t idx = __atomic_fetch_add(&s_head, 1, __ATOMIC_RELAXED);
+  sn_trace_event_t *e = &s_ring[idx & (TRACE_LEN - 1)];
+  e->ts_us = (uint32_t)esp_timer_get_time();
+  e->name = name;
+  e->task = xTaskGetCurrentTaskHandle();
+  e->phase = phase;
+  e->core = (uint8_t)xPortGetCoreID();
+  e->arg = arg;
+}
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+static TaskStatus_t s_tasks[TRACE_MAX_TASKS];
+static UBaseType_t s_tasks_len = 0;
+
+static const char *task_name(void *task) {
+  for (UBaseType_t i = 0; i < s_tasks_len; i++) {
+    if (s_tasks[i].xHandle == task) return s_tasks[i].pcTaskName;
+  }
+  return NULL;
+}
+#endif
+
+size_t sn_trace_dump(sn_trace_visit_t visit, void *arg, bool clear) {
+  if (!visit) return 0;
+
+  __atomic_store_n(&s_enabled, 0, __ATOMIC_RELAXED);
+  // let a writer that already passed the check finish its slot
+  vTaskDelay(1);
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+  s_tasks_len = uxTaskGetSystemState(s_tasks, TRACE_MAX_TASKS, NULL);
+#endif
+
+  uint32_t head = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+  uint32_t len = head < TRACE_LEN ? head : TRACE_LEN;
+  for (uint32_t i = head - len; i != head; i++) {
+    const sn_trace_event_t *e = &s_ring[i & (TRACE_LEN - 1)];
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    visit(e, task_name(e->task), arg);
+#else
+    visit(e, NULL, arg);
+#endif
+  }
+
+  if (clear) __atomic_store_n(&s_head, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&s_enabled, 1, __ATOMIC_RELAXED);
+  return len;
+}
+
+static void print_event(const sn_trace_event_t *e, const char *task_name, void *arg) {
+  char task[12];
+  if (!task_name) {
+    snprintf(task, sizeof(task), "%p", e->task);
+    task_name = task;
+  }
+  printf(
+    "SNTRACE,%lu,%c,%u,%s,%s,%u\n", (unsigned long)e->ts_us, e->phase, e->core, task_name,
+    e->name, e->arg
+  );
+}
+
+size_t sn_trace_dump_console(bool clear) {
+  printf("SNTRACE_BEGIN\n");
+  size_t n = sn_trace_dump(print_event, NULL, clear);
+  printf("SNTRACE_END,%u\n", (unsigned)n);
+  return n;
+}
+
+#else
+
+void sn_trace_record(char phase, const char *name, uint16_t arg) {}
+
+size_t sn_trace_dump(sn_trace_visit_t visit, void *arg, bool clear) { return 0; }
+
+size_t sn_trace_dump_console(bool clear) { return 0; }
+
+#endif // CONFIG_SN_TRACE_ENABLE
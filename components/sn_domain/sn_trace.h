@@ -0,0 +1,69 @@
+// --------------------------------------------------------------------------------
+// sn_trace.h
+//
+// description: ring buffer of timestamped begin/end/instant events tagged with the
+// task and core that recorded them. The SN_TRACE_* macros compile to nothing unless
+// CONFIG_SN_TRACE_ENABLE is set, so the probes can stay in the hot paths. Dumps are
+// converted to Chrome trace JSON on the host with tools/trace_to_chrome.py.
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_TRACE_H
+#define SN_TRACE_H
+
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// phases use the chrome trace letters
+#define SN_TRACE_PH_BEGIN   'B'
+#define SN_TRACE_PH_END     'E'
+#define SN_TRACE_PH_INSTANT 'i'
+
+typedef struct {
+  uint32_t ts_us;   // esp_timer low 32 bits, wraps every ~71 min
+  const char *name; // string literal, only the pointer is stored
+  void *task;       // TaskHandle_t of the recording task
+  char phase;
+  uint8_t core;
+  uint16_t arg; // local_id, queue depth, ...
+} sn_trace_event_t;
+
+// task_name is NULL when the task no longer exists
+typedef void (*sn_trace_visit_t)(const sn_trace_event_t *event, const char *task_name, void *arg);
+
+#if CONFIG_SN_TRACE_ENABLE
+
+#define SN_TRACE_BEGIN(name, arg)   sn_trace_record(SN_TRACE_PH_BEGIN, (name), (arg))
+#define SN_TRACE_END(name, arg)     sn_trace_record(SN_TRACE_PH_END, (name), (arg))
+#define SN_TRACE_INSTANT(name, arg) sn_trace_record(SN_TRACE_PH_INSTANT, (name), (arg))
+
+#else
+
+#define SN_TRACE_BEGIN(name, arg)   ((void)0)
+#define SN_TRACE_END(name, arg)     ((void)0)
+#define SN_TRACE_INSTANT(name, arg) ((void)0)
+
+#endif // CONFIG_SN_TRACE_ENABLE
+
+/*
+ * @brief Append an event, lock-free and safe from any task or core. Use the macros
+ */
+void sn_trace_record(char phase, const char *name, uint16_t arg);
+
+/*
+ * @brief Walk the buffer from the oldest to the newest event. Recording is paused
+ * during the walk, which must not block on anything that records
+ * @param clear drop the events once visited
+ * @return number of events visited
+ */
+size_t sn_trace_dump(sn_trace_visit_t visit, void *arg, bool clear);
+
+/*
+ * @brief Print every event as a "SNTRACE,<ts_us>,<ph>,<core>,<task>,<name>,<arg>" line
+ * on the console
+ */
+size_t sn_trace_dump_console(bool clear);
+
+#endif // !SN_TRACE_H
@@ -0,0 +1,495 @@
+#include "sn_command_executor.h"
+#include "cJSON.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "sn_actor.h"
+#include "sn_capability.h"
+#include "sn_driver.h"
+#include "sn_common.h"
+#include "sn_json.h"
+#include "sn_mqtt_manager.h"
+#include "sn_recorder.h"
+#include "sn_sntp.h"
+#include "sn_topic.h"
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/idf_additions.h"
+#include "freertos/projdefs.h"
+
+static const char *TAG = "SN_COMMAND_EXECUTOR";
+
+typedef struct {
+  cJSON *root; // owned by whoever holds the job
+  unsigned long long received_ms;
+  unsigned long long expires_ms; // 0 if the command never expires
+  uint32_t ack_window_ms;        // group commands: acks are spread over this window
+  bool group;                    // received on an org/cluster topic
+  char id[SN_COMMAND_ID_MAX_LEN];
+} command_job_t;
+
+typedef struct {
+  cJSON *result;
+  int64_t due_us;
+  char id[SN_COMMAND_ID_MAX_LEN];
+} deferred_ack_t;
+
+static QueueHandle_t s_cmdq = NULL;
+static TaskHandle_t s_exec_task = NULL;
+
+// Group acks, only touched by the executor task
+static deferred_ack_t s_deferred[SN_GROUP_ACK_MAX_PENDING];
+static int s_deferred_len = 0;
+static int64_t s_bucket_refill_us = 0;
+static uint32_t s_bucket_tokens = SN_GROUP_ACK_BURST;
+
+// Consume the result and publish it to the ack topic with the correlation id
+static void publish_ack(const char *id, cJSON *result) {
+  if (!result) return;
+  if (id && id[0]) cJSON_AddStringToObject(result, "id", id);
+
+  char *payload_str = cJSON_PrintUnformatted(result);
+  cJSON_Delete(result);
+  if (!payload_str) return;
+
+  const char *topic = sn_mqtt_topic_cache_get()->command_ack_topic;
+  esp_err_t err = sn_mqtt_publish_enqueue(topic, payload_str, 1, false);
+  if (err == ESP_ERR_INVALID_SIZE) {
+    // the backend still gets an ack for the id, without the result
+    cJSON *error = build_error_fmt("result too large (%u bytes)", (unsigned)strlen(payload_str));
+    if (id && id[0]) cJSON_AddStringToObject(error, "id", id);
+    char *error_str = cJSON_PrintUnformatted(error);
+    if (error_str) sn_mqtt_publish_enqueue(topic, error_str, 1, false);
+    cJSON_free(error_str);
+    cJSON_Delete(error);
+  }
+  cJSON_free(payload_str);
+}
+
+// --------------------------------------------------------------------------------
+// Batches
+// --------------------------------------------------------------------------------
+
+typedef struct {
+  bool validate_all; // reject the whole batch if any command is invalid
+  bool ordered;      // run one after another, waiting for each result
+} batch_opts_t;
+
+typedef struct batch_s batch_t;
+
+typedef struct {
+  batch_t *batch;
+  esp_err_t rc;
+  cJSON *result;
+} batch_slot_t;
+
+struct batch_s {
+  TaskHandle_t waiter;
+  uint32_t pending;
+  batch_slot_t slots[SN_COMMAND_BATCH_MAX];
+};
+
+static void on_batch_slot_done(esp_err_t rc, cJSON *result, void *arg) {
+  batch_slot_t *slot = (batch_slot_t *)arg;
+  slot->rc = rc;
+  slot->result = result;
+  if (__atomic_sub_fetch(&slot->batch->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+    xTaskNotifyGive(slot->batch->waiter);
+  }
+}
+
+// Post every resolved command without waiting in between and block until all of them
+// completed. Used for unordered batches. The commands land in their mailboxes back to
+// back but the workers may already run the first ones while the rest are posted, this
+// only narrows the window between them
+static void run_batch_async(const cJSON *commands, batch_t *batch, sn_device_instance_t **insts) {
+  int n = cJSON_GetArraySize(commands);
+
+  batch->waiter = xTaskGetCurrentTaskHandle();
+  // +1 guard so a fast worker can't reach 0 before every command is posted
+  batch->pending = 1;
+
+  for (int i = 0; i < n; i++) {
+    if (!insts[i]) continue;
+    cJSON *params = cJSON_Duplicate(
+      cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(commands, i), "params"), true
+    );
+    __atomic_add_fetch(&batch->pending, 1, __ATOMIC_ACQ_REL);
+    esp_err_t err = sn_actor_control_async(insts[i], params, on_batch_slot_done, &batch->slots[i]);
+    if (err != ESP_OK) {
+      __atomic_sub_fetch(&batch->pending, 1, __ATOMIC_ACQ_REL);
+      batch->slots[i].rc = err;
+      batch->slots[i].result = build_error_fmt("%s is busy", insts[i]->port->port_name);
+    }
+  }
+
+  if (__atomic_sub_fetch(&batch->pending, 1, __ATOMIC_ACQ_REL) != 0) {
+    // the workers write into the slots so wait for every posted command
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
+
+/* Batch payload:
+ * {
+ *   "id": "b6c1...",
+ *   "commands": [ {"localId": 13, "action": "control_relay", "params": {...}}, ... ],
+ *   "validateAll": true, // (default true)  nothing runs if any command is invalid
+ *   "ordered": true      // (default true)  run sequentially in array order, otherwise
+ *                        // post them all at once without waiting (best effort, no
+ *                        // rollback and no guarantee they apply on the same tick)
+ * }
+ *
+ * Ack:
+ * { "id": "...", "status": "success|error", "applied": 2, "failed": 0,
+ *   "results": [ {"localId": 13, "status": "success", "message": "..."}, ... ] }
+ */
+static cJSON *execute_batch(const cJSON *root, const cJSON *commands) {
+  int n = cJSON_GetArraySize(commands);
+  if (n <= 0) return build_error_fmt("\"commands\" is empty");
+  if (n > SN_COMMAND_BATCH_MAX) {
+    return build_error_fmt("too many commands: %d (max: %d)", n, SN_COMMAND_BATCH_MAX);
+  }
+
+  batch_opts_t opts = {.validate_all = true, .ordered = true};
+  json_get_bool(root, "validateAll", &opts.validate_all);
+  json_get_bool(root, "ordered", &opts.ordered);
+
+  batch_t *batch = calloc(1, sizeof(batch_t));
+  if (!batch) return build_error_fmt("out of memory");
+  sn_device_instance_t *insts[SN_COMMAND_BATCH_MAX] = {0};
+
+  int invalid = 0;
+  for (int i = 0; i < n; i++) {
+    const cJSON *cmd = cJSON_GetArrayItem(commands, i);
+    batch->slots[i].batch = batch;
+    batch->slots[i].rc = sn_validate_command_json(cmd, &insts[i], &batch->slots[i].result);
+    if (batch->slots[i].rc != ESP_OK) {
+      insts[i] = NULL;
+      invalid++;
+    }
+  }
+
+  if (invalid == 0 || !opts.validate_all) {
+    if (!opts.ordered) {
+      run_batch_async(commands, batch, insts);
+    } else {
+      for (int i = 0; i < n; i++) {
+        if (!insts[i]) continue;
+        const cJSON *params =
+          cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(commands, i), "params");
+        batch->slots[i].rc = sn_actor_control(insts[i], params, &batch->slots[i].result);
+      }
+    }
+  } else {
+    ESP_LOGW(TAG, "Rejecting batch: %d/%d commands invalid", invalid, n);
+  }
+
+  bool rejected = invalid > 0 && opts.validate_all;
+  int applied = 0, failed = 0;
+  cJSON *results = cJSON_CreateArray();
+  for (int i = 0; i < n; i++) {
+    batch_slot_t *slot = &batch->slots[i];
+    cJSON *result = slot->result;
+    if (!result) {
+      result = rejected || slot->rc != ESP_OK
+               ? build_error_fmt("%s", rejected ? "not executed" : esp_err_to_name(slot->rc))
+               : build_success_fmt(NULL);
+    }
+    if (slot->rc == ESP_OK && !rejected) {
+      applied++;
+    } else {
+      failed++;
+    }
+
+    int local_id = 0;
+    if (json_get_int(cJSON_GetArrayItem(commands, i), "localId", &local_id)) {
+      cJSON_AddNumberToObject(result, "localId", local_id);
+    }
+    cJSON_AddItemToArray(results, result);
+  }
+  free(batch);
+
+  cJSON *ack = failed == 0 ? build_success_fmt(NULL)
+               : rejected  ? build_error_fmt("batch rejected, %d invalid command(s)", invalid)
+                           : build_error_fmt("%d command(s) failed", failed);
+  cJSON_AddNumberToObject(ack, "applied", applied);
+  cJSON_AddNumberToObject(ack, "failed", failed);
+  cJSON_AddItemToObject(ack, "results", results);
+  return ack;
+}
+
+// Error ack of a job past its expiresAt/ttlMs, NULL if it can still run
+static cJSON *check_expired(const command_job_t *job) {
+  unsigned long long now = sn_get_unix_timestamp_ms();
+  if (!job->expires_ms || now <= job->expires_ms) return NULL;
+  unsigned long long late_ms = now - job->expires_ms;
+  ESP_LOGW(TAG, "Dropping stale command id=%s (expired %llums ago)", job->id, late_ms);
+  return build_error_fmt("command expired %llums ago", late_ms);
+}
+
+// --------------------------------------------------------------------------------
+// Group commands
+// --------------------------------------------------------------------------------
+
+// true if the (optional) string array is missing or contains value
+static bool json_array_has_string(const cJSON *root, const char *key, const char *value) {
+  const cJSON *arr = cJSON_GetObjectItemCaseSensitive(root, key);
+  if (!arr) return true;
+  if (!value || !cJSON_IsArray(arr)) return false;
+
+  const cJSON *it = NULL;
+  cJSON_ArrayForEach(it, arr) {
+    if (cJSON_IsString(it) && strcmp(it->valuestring, value) == 0) return true;
+  }
+  return false;
+}
+
+// An instance of a targeted type whose driver handles the action
+static bool group_instance_matches(
+  const sn_device_instance_t *it, const char *action, const cJSON *target
+) {
+  // ports without a matching driver are bound too
+  if (!it->driver) return false;
+  const sn_command_desc_t *desc = it->driver->command_desc;
+  if (!desc || !it->driver->control || strcmp(desc->action, action) != 0) return false;
+  return !target || json_array_has_string(target, "types", it->port->drv_name);
+}
+
+/* Group payload (org or cluster topic):
+ * {
+ *   "id": "b6c1...",
+ *   "target": {                  // (optional) every field is optional
+ *     "clusterIds": ["c1", ...], // org topic only: restrict to clusters
+ *     "deviceIds": ["d1", ...],
+ *     "types": ["relay", ...]    // driver names
+ *   },
+ *   "action": "control_relay",
+ *   "params": { "enable": false },
+ *   "ackWindowMs": 5000          // (optional) acks are spread randomly over this window
+ * }
+ *
+ * The command runs on every online instance of a matching type supporting the action.
+ * Returns NULL if the device is not targeted, devices outside the group stay silent,
+ * even when the command expired
+ */
+static cJSON *execute_group(const command_job_t *job) {
+  const sn_mqtt_topic_context_t *topic_ctx = sn_mqtt_topic_cache_get_context();
+  const cJSON *target = cJSON_GetObjectItemCaseSensitive(job->root, "target");
+
+  if (target) {
+    const char *cluster = topic_ctx->clusterId[0] ? topic_ctx->clusterId : NULL;
+    if (!json_array_has_string(target, "clusterIds", cluster)
+        || !json_array_has_string(target, "deviceIds", topic_ctx->deviceId))
+      return NULL;
+  }
+
+  const char *action = NULL;
+  if (!json_get_string(job->root, "action", &action)) return NULL;
+  const cJSON *params = cJSON_GetObjectItemCaseSensitive(job->root, "params");
+
+  bool targeted = false;
+  FOR_EACH_INSTANCE(it, gDeviceInstances, gDeviceInstancesLen) {
+    if (group_instance_matches(it, action, target)) {
+      targeted = true;
+      break;
+    }
+  }
+  if (!targeted) return NULL;
+  cJSON *expired = check_expired(job);
+  if (expired) return expired;
+
+  cJSON *results = NULL;
+  int applied = 0, failed = 0;
+  FOR_EACH_INSTANCE(it, gDeviceInstances, gDeviceInstancesLen) {
+    if (!group_instance_matches(it, action, target)) continue;
+
+    if (!results) results = cJSON_CreateArray();
+    cJSON *result = NULL;
+    esp_err_t rc = it->online ? sn_actor_control((sn_device_instance_t *)it, params, &result)
+                              : ESP_ERR_INVALID_STATE;
+    if (!result) {
+      result = rc == ESP_OK ? build_success_fmt(NULL) : build_error_fmt("%s", esp_err_to_name(rc));
+    }
+    if (rc == ESP_OK) {
+      applied++;
+    } else {
+      failed++;
+    }
+    cJSON_AddStringToObject(result, "name", it->port->port_name);
+    cJSON_AddItemToArray(results, result);
+  }
+  if (!results) return NULL;
+
+  cJSON *ack = failed == 0 ? build_success_fmt(NULL) : build_error_fmt("%d failed", failed);
+  cJSON_AddNumberToObject(ack, "applied", applied);
+  cJSON_AddNumberToObject(ack, "failed", failed);
+  cJSON_AddItemToObject(ack, "results", results);
+  return ack;
+}
+
+static void defer_ack(const command_job_t *job, cJSON *result) {
+  if (!result) return;
+  if (s_deferred_len >= SN_GROUP_ACK_MAX_PENDING) {
+    ESP_LOGW(TAG, "Too many pending group acks, dropping id=%s", job->id);
+    cJSON_Delete(result);
+    return;
+  }
+
+  deferred_ack_t *d = &s_deferred[s_deferred_len++];
+  uint32_t jitter_ms = job->ack_window_ms ? esp_random() % job->ack_window_ms : 0;
+  d->result = result;
+  d->due_us = esp_timer_get_time() + (int64_t)jitter_ms * 1000;
+  memcpy(d->id, job->id, sizeof(d->id));
+}
+
+static bool take_ack_token(int64_t now_us) {
+  int64_t period_us = 1000000 / SN_GROUP_ACK_RATE_PER_SEC;
+  if (s_bucket_tokens < SN_GROUP_ACK_BURST) {
+    uint32_t refill = (uint32_t)((now_us - s_bucket_refill_us) / period_us);
+    if (refill > 0) {
+      s_bucket_tokens = MIN(s_bucket_tokens + refill, SN_GROUP_ACK_BURST);
+      s_bucket_refill_us += (int64_t)refill * period_us;
+    }
+  } else {
+    s_bucket_refill_us = now_us;
+  }
+
+  if (s_bucket_tokens == 0) return false;
+  s_bucket_tokens--;
+  return true;
+}
+
+// Publish the due acks the bucket allows and return how long until the next one
+static TickType_t flush_deferred_acks(void) {
+  int64_t now = esp_timer_get_time();
+  int64_t next_due = INT64_MAX;
+
+  for (int i = 0; i < s_deferred_len;) {
+    deferred_ack_t *d = &s_deferred[i];
+    if (d->due_us <= now) {
+      if (!take_ack_token(now)) {
+        // out of tokens, retry when the next one is refilled
+        next_due = now + 1000000 / SN_GROUP_ACK_RATE_PER_SEC;
+        break;
+      }
+      publish_ack(d->id, d->result);
+      s_deferred[i] = s_deferred[--s_deferred_len];
+      continue;
+    }
+    next_due = MIN(next_due, d->due_us);
+    i++;
+  }
+
+  if (next_due == INT64_MAX) return portMAX_DELAY;
+  return pdMS_TO_TICKS((next_due - now) / 1000) + 1;
+}
+
+static cJSON *execute_job(const command_job_t *job) {
+  cJSON *result = NULL;
+  // a group job checks its targets first
+  if (job->group) return execute_group(job);
+  cJSON *expired = check_expired(job);
+  if (expired) return expired;
+
+  const cJSON *commands = cJSON_GetObjectItemCaseSensitive(job->root, "commands");
+  if (cJSON_IsArray(commands)) return execute_batch(job->root, commands);
+
+  int r = sn_dispatch_command_json(job->root, &result);
+  // some drivers don't fill a result, the backend still expects an ack per id
+  if (!result) {
+    result = r == ESP_OK ? build_success_fmt(NULL) : build_error_fmt("%s", esp_err_to_name(r));
+  }
+  return result;
+}
+
+static void executor_task(void *pvParams) {
+  command_job_t job;
+  TickType_t wait = portMAX_DELAY;
+
+  for (;;) {
+    if (xQueueReceive(s_cmdq, &job, wait) == pdTRUE) {
+      if (job.group) {
+        defer_ack(&job, execute_job(&job));
+      } else {
+        publish_ack(job.id, execute_job(&job));
+      }
+      cJSON_Delete(job.root);
+    }
+    wait = flush_deferred_acks();
+  }
+}
+
+esp_err_t sn_command_executor_start(void) {
+  if (s_exec_task) return ESP_OK;
+
+  s_cmdq = xQueueCreate(SN_COMMAND_QUEUE_LEN, sizeof(command_job_t));
+  if (!s_cmdq) return ESP_ERR_NO_MEM;
+
+  BaseType_t ok = xTaskCreatePinnedToCore(
+    executor_task, "cmd_exec_task", SN_COMMAND_EXEC_STACK_SIZE, NULL, SN_COMMAND_EXEC_PRIORITY,
+    &s_exec_task, 1
+  );
+  if (ok != pdPASS) {
+    vQueueDelete(s_cmdq);
+    s_cmdq = NULL;
+    return ESP_ERR_NO_MEM;
+  }
+
+  ESP_LOGI(TAG, "Command executor started (queue=%d)", SN_COMMAND_QUEUE_LEN);
+  return ESP_OK;
+}
+
+static esp_err_t submit(const char *payload, bool group) {
+  if (!payload) return ESP_ERR_INVALID_ARG;
+  if (!s_cmdq) return ESP_ERR_INVALID_STATE;
+  SN_REC_COMMAND(payload, group);
+
+  command_job_t job = {.received_ms = sn_get_unix_timestamp_ms(), .group = group};
+  job.root = cJSON_Parse(payload);
+  if (!job.root) {
+    // a broken broadcast would get an error from every device
+    if (!group) publish_ack(NULL, build_error_fmt("payload is not in a correct json format"));
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  const char *id = NULL;
+  if (json_get_string(job.root, "id", &id)) {
+    // a truncated id would not match the command on the backend, the error echoes it whole
+    if (strlen(id) >= sizeof(job.id)) {
+      ESP_LOGW(TAG, "Rejecting command, id of %u chars", (unsigned)strlen(id));
+      if (!group) {
+        publish_ack(id, build_error_fmt("id longer than %d chars", SN_COMMAND_ID_MAX_LEN - 1));
+      }
+      cJSON_Delete(job.root);
+      return ESP_ERR_INVALID_ARG;
+    }
+    strcpy(job.id, id);
+  }
+
+  double v = 0;
+  if (json_get_number(job.root, "expiresAt", &v) && v > 0) {
+    job.expires_ms = (unsigned long long)v;
+  } else if (json_get_number(job.root, "ttlMs", &v) && v > 0) {
+    job.expires_ms = job.received_ms + (unsigned long long)v;
+  }
+
+  if (group) {
+    job.ack_window_ms = SN_GROUP_ACK_WINDOW_MS;
+    if (json_get_number(job.root, "ackWindowMs", &v) && v >= 0) {
+      job.ack_window_ms = (uint32_t)(MIN(v, SN_GROUP_ACK_WINDOW_MAX_MS));
+    }
+  }
+
+  if (xQueueSend(s_cmdq, &job, 0) != pdTRUE) {
+    ESP_LOGW(TAG, "Command queue full, rejecting id=%s", job.id);
+    if (!group) publish_ack(job.id, build_error_fmt("command queue full"));
+    cJSON_Delete(job.root);
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+esp_err_t sn_command_executor_submit(const char *payload) { return submit(payload, false); }
+
+esp_err_t sn_command_executor_submit_group(const char *payload) { return submit(payload, true); }
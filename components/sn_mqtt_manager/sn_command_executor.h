@@ -0,0 +1,69 @@
+// --------------------------------------------------------------------------------
+// sn_command_executor.h
+//
+// description: run inbound commands off the mqtt event task. Commands are parsed
+// on receive, queued and executed by a worker which publishes an ack carrying the
+// command's correlation id.
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_COMMAND_EXECUTOR_H
+#define SN_COMMAND_EXECUTOR_H
+
+#include "esp_err.h"
+
+#define SN_COMMAND_QUEUE_LEN       8
+#define SN_COMMAND_ID_MAX_LEN      40
+#define SN_COMMAND_EXEC_STACK_SIZE 4096
+#define SN_COMMAND_EXEC_PRIORITY   5
+#define SN_COMMAND_BATCH_MAX       16
+
+// Group commands reach many devices at once, their acks are delayed by a random amount
+// within the window and rate limited by a token bucket to avoid stampeding the broker
+#define SN_GROUP_ACK_WINDOW_MS     3000
+#define SN_GROUP_ACK_WINDOW_MAX_MS 60000
+#define SN_GROUP_ACK_RATE_PER_SEC  2
+#define SN_GROUP_ACK_BURST         4
+#define SN_GROUP_ACK_MAX_PENDING   8
+
+/*
+ * Command payload accepted by the executor:
+ * {
+ *   "id": "b6c1...",          // (optional) correlation id echoed in the ack, at most
+ *                             // SN_COMMAND_ID_MAX_LEN - 1 chars
+ *   "expiresAt": 1731000000,  // (optional) unix timestamp in ms
+ *   "ttlMs": 5000,            // (optional) relative to the time of receipt
+ *   "localId": 13,
+ *   "action": "control_relay",
+ *   "params": { "enable": true }
+ * }
+ *
+ * or a batch acked once with the results of every command:
+ * {
+ *   "id": "b6c1...",
+ *   "commands": [ { "localId": 13, "action": "control_relay", "params": {...} }, ... ],
+ *   "validateAll": true, // (default true) nothing runs if any command is invalid
+ *   "ordered": true      // (default true) run sequentially in array order, otherwise
+ *                        // post them all at once (best effort, not atomic)
+ * }
+ */
+
+/*
+ * @brief Create the command queue and the worker task
+ */
+esp_err_t sn_command_executor_start(void);
+
+/*
+ * @brief Parse and enqueue a raw command payload without blocking.
+ * Rejected payloads (malformed, queue full) are acked immediately.
+ */
+esp_err_t sn_command_executor_submit(const char *payload);
+
+/*
+ * @brief Same as sn_command_executor_submit for commands received on an org or cluster
+ * topic. Devices outside the target stay silent and acks are jittered and rate limited.
+ * Invalid payloads are dropped without an ack
+ */
+esp_err_t sn_command_executor_submit_group(const char *payload);
+
+#endif // !SN_COMMAND_EXECUTOR_H
@@ -2,12 +2,17 @@
 #include "cJSON.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "mqtt_client.h"
+#include "sn_common.h"
 #include "sn_device_event.h"
+#include "sn_metrics.h"
 #include "sn_mqtt_router.h"
+#include "sn_prof.h"
 #include "sn_security.h"
 #include "sn_storage.h"
 #include "sn_topic.h"
+#include "sn_trace.h"
 #include <string.h>
 #include "freertos/idf_additions.h"
 #include "freertos/projdefs.h"
@@ -17,6 +22,8 @@ static const char *TAG = "SN_MQTT_MANAGER";
 static esp_mqtt_client_handle_t client = NULL;
 static sn_mqtt_msg_cb_t msg_callback = NULL;
 static void *msg_arg = NULL;
+static sn_mqtt_connect_cb_t connect_callback = NULL;
+static void *connect_arg = NULL;
 static QueueHandle_t s_mqtt_pubq = NULL;
 static TaskHandle_t s_pub_task = NULL;
 
@@ -26,7 +33,7 @@ static EventGroupHandle_t s_mqtt_event_group;
 
 typedef struct {
   char topic[256];
-  char payload[1024];
+  char payload[SN_MQTT_PAYLOAD_MAX];
   int qos;
   bool retain;
 } mqtt_publish_msg_t;
@@ -37,12 +44,21 @@ static void pub_task(void *arg) {
 
   while (1) {
     if (xQueueReceive(s_mqtt_pubq, &msg, portMAX_DELAY) == pdTRUE) {
-      int msg_id = esp_mqtt_client_publish(client, msg.topic, msg.payload, 0, msg.qos, msg.retain);
+      SN_TRACE_BEGIN("mqtt.publish", msg.qos);
+      int msg_id;
+      {
+        SN_PROF_SCOPE("mqtt.publish");
+        msg_id = esp_mqtt_client_publish(client, msg.topic, msg.payload, 0, msg.qos, msg.retain);
+      }
+      SN_TRACE_END("mqtt.publish", msg_id >= 0);
       if (msg_id >= 0) {
+        sn_metric_inc(SN_MC_mqtt_pub_ok);
         ESP_LOGI(TAG, "Tx [%d]: %s ", msg_id, msg.payload);
       } else {
+        sn_metric_inc(SN_MC_mqtt_pub_fail);
         ESP_LOGE(TAG, "Failed to publish topic %s", msg.topic);
       }
+      sn_metric_gauge_set(SN_MG_mqtt_pubq_depth, uxQueueMessagesWaiting(s_mqtt_pubq));
     }
   }
 }
@@ -56,6 +72,7 @@ static void mqtt_event_handler(
   switch ((esp_mqtt_event_id_t)event_id) {
     case MQTT_EVENT_CONNECTED:
       xEventGroupSetBits(s_mqtt_event_group, MQTT_CONNECTED_BIT);
+      if (connect_callback) connect_callback(connect_arg);
       break;
 
     case MQTT_EVENT_DISCONNECTED:
@@ -64,13 +81,17 @@ static void mqtt_event_handler(
       break;
 
     case MQTT_EVENT_DATA: {
-      char topic[MAX_TOPIC_LEN], payload[1024];
+      // static: 1.5 KB of buffers on the mqtt task stack left little headroom for the
+      // handlers, only the mqtt task runs this
+      static char topic[MAX_TOPIC_LEN], payload[1024];
       memset(topic, 0, sizeof(topic));
       memset(payload, 0, sizeof(payload));
-      strncpy(topic, event->topic, event->topic_len);
-      strncpy(payload, event->data, event->data_len);
+      strncpy(topic, event->topic, MIN(event->topic_len, sizeof(topic) - 1));
+      strncpy(payload, event->data, MIN(event->data_len, sizeof(payload) - 1));
 
       ESP_LOGI(TAG, "RX [%s]:\n%s", topic, payload);
+      sn_metric_inc(SN_MC_mqtt_rx);
+      SN_TRACE_INSTANT("mqtt.rx", event->data_len);
 
       if (msg_callback) msg_callback(topic, payload, msg_arg);
     } break;
@@ -170,21 +191,43 @@ esp_err_t sn_mqtt_stop() { return esp_mqtt_client_stop(client); }
 
 esp_err_t sn_mqtt_destroy() { return esp_mqtt_client_destroy(client); }
 
+// Copy topic and payload into the message, a truncated payload would go out as broken
+// json so it is refused instead
+static esp_err_t msg_fill(mqtt_publish_msg_t *msg, const char *topic, const char *payload) {
+  if (!topic || !payload) return ESP_ERR_INVALID_ARG;
+  size_t topic_len = strlen(topic);
+  size_t payload_len = strlen(payload);
+  if (topic_len >= sizeof(msg->topic) || payload_len >= sizeof(msg->payload)) {
+    sn_metric_inc(SN_MC_mqtt_pub_oversize);
+    ESP_LOGE(TAG, "Payload of %u bytes too large for %s", (unsigned)payload_len, topic);
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(msg->topic, topic, topic_len + 1);
+  memcpy(msg->payload, payload, payload_len + 1);
+  return ESP_OK;
+}
+
 // Enqueue message safely
 static esp_err_t publisher_enqueue(mqtt_publish_msg_t *msg) {
   if (!s_mqtt_pubq) return ESP_ERR_INVALID_STATE;
+  SN_TRACE_BEGIN("mqtt.enqueue", 0);
   if (xQueueSend(s_mqtt_pubq, msg, pdMS_TO_TICKS(100)) != pdTRUE) {
+    SN_TRACE_END("mqtt.enqueue", 0);
+    sn_metric_inc(SN_MC_mqtt_pub_drop);
     ESP_LOGW(TAG, "Publish queue full, message dropped");
     return ESP_FAIL;
   }
+  UBaseType_t depth = uxQueueMessagesWaiting(s_mqtt_pubq);
+  SN_TRACE_END("mqtt.enqueue", depth);
+  sn_metric_gauge_set(SN_MG_mqtt_pubq_depth, depth);
+  sn_metric_gauge_max(SN_MG_mqtt_pubq_hwm, depth);
   return ESP_OK;
 }
 
 esp_err_t sn_mqtt_publish_enqueue(const char *topic, const char *payload, int qos, bool retain) {
   mqtt_publish_msg_t msg = {.qos = qos, .retain = retain};
-  strncpy(msg.topic, topic, sizeof(msg.topic));
-  strncpy(msg.payload, payload, sizeof(msg.payload) - 1);
-  return publisher_enqueue(&msg);
+  esp_err_t err = msg_fill(&msg, topic, payload);
+  return err == ESP_OK ? publisher_enqueue(&msg) : err;
 }
 
 esp_err_t sn_mqtt_publish_json_payload(cJSON *payload, const char *topic, int qos, bool retain) {
@@ -192,12 +235,11 @@ esp_err_t sn_mqtt_publish_json_payload(cJSON *payload, const char *topic, int qo
   mqtt_publish_msg_t msg = {.qos = qos, .retain = retain};
 
   char *json_str = cJSON_PrintUnformatted(payload);
-  strncpy(msg.topic, topic, sizeof(msg.topic));
-  strncpy(msg.payload, json_str, sizeof(msg.payload) - 1);
-
-  cJSON_free(json_str);
   cJSON_Delete(payload);
-  return publisher_enqueue(&msg);
+  if (!json_str) return ESP_ERR_NO_MEM;
+  esp_err_t err = msg_fill(&msg, topic, json_str);
+  cJSON_free(json_str);
+  return err == ESP_OK ? publisher_enqueue(&msg) : err;
 }
 
 esp_err_t sn_mqtt_publish_json_payload_signed(
@@ -206,16 +248,18 @@ esp_err_t sn_mqtt_publish_json_payload_signed(
   if (!payload || !topic) return ESP_ERR_INVALID_ARG;
   mqtt_publish_msg_t msg = {.qos = qos, .retain = retain};
 
+  int64_t sign_start = esp_timer_get_time();
+  SN_TRACE_BEGIN("mqtt.sign", 0);
   cJSON *json = sn_security_sign_and_wrap_payload(payload);
+  SN_TRACE_END("mqtt.sign", 0);
+  sn_metric_observe(SN_MH_sign_time, (uint32_t)(esp_timer_get_time() - sign_start));
   if (!json) return ESP_ERR_NO_MEM;
   char *json_str = cJSON_PrintUnformatted(json);
-
-  strncpy(msg.topic, topic, sizeof(msg.topic));
-  strncpy(msg.payload, json_str, sizeof(msg.payload) - 1);
-
-  cJSON_free(json_str);
   cJSON_Delete(json);
-  return publisher_enqueue(&msg);
+  if (!json_str) return ESP_ERR_NO_MEM;
+  esp_err_t err = msg_fill(&msg, topic, json_str);
+  cJSON_free(json_str);
+  return err == ESP_OK ? publisher_enqueue(&msg) : err;
 }
 
 esp_err_t publish_device_event(const sn_device_event_t *event) {
@@ -242,6 +286,12 @@ esp_err_t sn_mqtt_register_handler(sn_mqtt_msg_cb_t cb, void *arg) {
   return ESP_OK;
 }
 
+esp_err_t sn_mqtt_register_connect_handler(sn_mqtt_connect_cb_t cb, void *arg) {
+  connect_callback = cb;
+  connect_arg = arg;
+  return ESP_OK;
+}
+
 void mqtt_debug_print_rx(const void *event) {
   esp_mqtt_event_handle_t e = (esp_mqtt_event_handle_t)event;
   char topic[MAX_TOPIC_LEN];
@@ -3,11 +3,17 @@
 
 #include "cJSON.h"
 #include "esp_err.h"
+#include "sn_device_event.h"
 #include "sn_driver/sensor.h"
 #include <stdbool.h>
 
+// Largest payload a publish can carry, including the terminator. Longer payloads are
+// rejected rather than truncated into invalid json
+#define SN_MQTT_PAYLOAD_MAX 1024
+
 // Callback type
 typedef void (*sn_mqtt_msg_cb_t)(const char *topic, const char *payload, void *arg);
+typedef void (*sn_mqtt_connect_cb_t)(void *arg);
 
 // Config struct (optional external)
 typedef struct {
@@ -28,6 +34,7 @@ esp_err_t sn_mqtt_start(void);
 
 /*
  * @brief enqueue publish payload to mqtt topic
+ * @return ESP_ERR_INVALID_SIZE if the payload does not fit SN_MQTT_PAYLOAD_MAX
  */
 esp_err_t sn_mqtt_publish_enqueue(const char *topic, const char *payload, int qos, bool retain);
 
@@ -37,12 +44,18 @@ esp_err_t sn_mqtt_publish_enqueue(const char *topic, const char *payload, int qo
 esp_err_t sn_mqtt_publish_payload_json(cJSON *payload, const char *topic);
 
 /*
- * @brief general publish payload method with signature
+ * @brief general publish payload method with signature, consumes payload
+ * @return ESP_ERR_INVALID_SIZE if the signed payload does not fit SN_MQTT_PAYLOAD_MAX
  */
 esp_err_t sn_mqtt_publish_json_payload_signed(
   cJSON *payload, const char *topic, int qos, bool retain
 );
 
+/*
+ * @brief publish a signed device event on the event topic
+ */
+esp_err_t publish_device_event(const sn_device_event_t *event);
+
 /*
  * @brief Subscribe to mqtt topic
  */
@@ -53,6 +66,11 @@ esp_err_t sn_mqtt_subscribe(const char *topic, int qos);
  */
 esp_err_t sn_mqtt_register_handler(sn_mqtt_msg_cb_t cb, void *arg);
 
+/*
+ * @brief Register a callback run on every (re)connection, on the mqtt event task
+ */
+esp_err_t sn_mqtt_register_connect_handler(sn_mqtt_connect_cb_t cb, void *arg);
+
 /*
  * @brief stop the client
  */
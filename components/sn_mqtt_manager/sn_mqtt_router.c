@@ -2,6 +2,7 @@
 #include "sn_mqtt_manager.h"
 #include "esp_log.h"
 #include "sn_topic.h"
+#include "sn_trace.h"
 #include <stdio.h>
 #include <string.h>
 
@@ -24,7 +25,9 @@ static void on_mqtt_message(const char *topic, const char *payload, void *args)
   for (size_t i = 0; i < registry_count; i++) {
     if (strncmp(topic, registry[i].topic, sizeof(registry[i].topic)) == 0) {
       if (registry[i].handler) {
+        SN_TRACE_BEGIN("mqtt.route", i);
         registry[i].handler(topic, payload);
+        SN_TRACE_END("mqtt.route", i);
         return;
       }
     }
@@ -0,0 +1,179 @@
+#include "sn_shadow.h"
+#include "cJSON.h"
+#include "esp_log.h"
+#include "sn_actor.h"
+#include "sn_driver.h"
+#include "sn_json.h"
+#include "sn_mqtt_manager.h"
+#include "sn_mqtt_router.h"
+#include "sn_sntp.h"
+#include "sn_topic.h"
+#include <stdlib.h>
+#include "freertos/idf_additions.h"
+
+static const char *TAG = "SN_SHADOW";
+
+// Last reported document per instance, indexed like gDeviceInstances
+static cJSON *s_reported[MAX_INSTANCES];
+static uint32_t s_version = 0;
+static SemaphoreHandle_t s_lock = NULL;
+
+static inline int instance_index(const sn_device_instance_t *inst) {
+  return (int)(inst - gDeviceInstances);
+}
+
+static inline int instance_local_id(const sn_device_instance_t *inst) {
+  return inst->port->drv_type == DRIVER_TYPE_COMMAND_API ? inst->port->desc.c.local_id
+                                                          : inst->port->desc.a.local_id;
+}
+
+// Keys of next missing from or different in prev (NULL if nothing changed)
+static cJSON *diff_state(const cJSON *prev, const cJSON *next) {
+  cJSON *delta = NULL;
+  const cJSON *it = NULL;
+  cJSON_ArrayForEach(it, next) {
+    const cJSON *old = prev ? cJSON_GetObjectItemCaseSensitive(prev, it->string) : NULL;
+    if (old && cJSON_Compare(old, it, true)) continue;
+    if (!delta) delta = cJSON_CreateObject();
+    cJSON_AddItemToObject(delta, it->string, cJSON_Duplicate(it, true));
+  }
+  return delta;
+}
+
+static void publish_reported(cJSON *reported, uint32_t version, bool full) {
+  cJSON *root = cJSON_CreateObject();
+  if (!root) {
+    cJSON_Delete(reported);
+    return;
+  }
+  if (full) cJSON_AddBoolToObject(root, "full", true);
+  cJSON_AddItemToObject(root, "reported", reported);
+  cJSON_AddNumberToObject(root, "version", version);
+  cJSON_AddNumberToObject(root, "ts", sn_get_unix_timestamp_ms());
+
+  const char *topic = sn_mqtt_topic_cache_get()->shadow_reported_topic;
+  sn_mqtt_publish_json_payload_signed(root, topic, 1, false);
+}
+
+// Actor observer: runs on the instance's worker, so the ctx can be read directly
+static void on_state_changed(sn_device_instance_t *inst) {
+  cJSON *state = inst->driver->report_state((void *)&inst->ctx);
+  if (!state) return;
+
+  int idx = instance_index(inst);
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  cJSON *delta = diff_state(s_reported[idx], state);
+  cJSON_Delete(s_reported[idx]);
+  s_reported[idx] = state;
+  uint32_t version = delta ? ++s_version : s_version;
+  xSemaphoreGive(s_lock);
+
+  if (!delta) return;
+
+  char key[8];
+  snprintf(key, sizeof(key), "%d", instance_local_id(inst));
+  cJSON *reported = cJSON_CreateObject();
+  cJSON_AddItemToObject(reported, key, delta);
+  publish_reported(reported, version, false);
+}
+
+// the observer does the work, this only gets the actor to run it
+static void refresh_state(sn_device_instance_t *inst, void *arg) {}
+
+static void on_desired_done(esp_err_t rc, cJSON *result, void *arg) {
+  if (rc != ESP_OK) ESP_LOGW(TAG, "Desired state rejected (%s)", esp_err_to_name(rc));
+  cJSON_Delete(result);
+}
+
+static void on_desired_msg(const char *topic, const char *payload) {
+  cJSON *root = cJSON_Parse(payload);
+  cJSON *desired = NULL;
+  if (!json_get_object(root, "desired", &desired)) {
+    ESP_LOGW(TAG, "Ignoring malformed desired state");
+    cJSON_Delete(root);
+    return;
+  }
+
+  const cJSON *it = NULL;
+  cJSON_ArrayForEach(it, desired) {
+    sn_device_instance_t *inst = sn_find_instance_by_local_id((uint8_t)atoi(it->string));
+    if (!inst || !inst->online || !inst->driver->report_state || !cJSON_IsObject(it)) {
+      ESP_LOGW(TAG, "No shadow for localId=%s", it->string);
+      continue;
+    }
+
+    // the control params are the reported state with the desired keys on top, so
+    // required params the backend left out keep their current value
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const cJSON *reported = s_reported[instance_index(inst)];
+    cJSON *delta = diff_state(reported, it);
+    cJSON *params = delta ? cJSON_Duplicate(reported, true) : NULL;
+    xSemaphoreGive(s_lock);
+
+    if (!delta) continue;
+    if (!params) params = cJSON_CreateObject();
+    const cJSON *d = NULL;
+    cJSON_ArrayForEach(d, delta) {
+      cJSON_DeleteItemFromObjectCaseSensitive(params, d->string);
+      cJSON_AddItemToObject(params, d->string, cJSON_Duplicate(d, true));
+    }
+    cJSON_Delete(delta);
+
+    // the reported delta follows through the observer once applied
+    sn_actor_control_async(inst, params, on_desired_done, NULL);
+  }
+  cJSON_Delete(root);
+}
+
+static void on_get_msg(const char *topic, const char *payload) { sn_shadow_publish_snapshot(); }
+
+static void on_connected(void *arg) { sn_shadow_publish_snapshot(); }
+
+// --------------------------------------------------------------------------------
+// API
+// --------------------------------------------------------------------------------
+
+esp_err_t sn_shadow_publish_snapshot(void) {
+  if (!s_lock) return ESP_ERR_INVALID_STATE;
+
+  cJSON *reported = cJSON_CreateObject();
+  if (!reported) return ESP_ERR_NO_MEM;
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  FOR_EACH_INSTANCE(it, gDeviceInstances, gDeviceInstancesLen) {
+    const cJSON *state = s_reported[instance_index(it)];
+    if (!state) continue;
+    char key[8];
+    snprintf(key, sizeof(key), "%d", instance_local_id(it));
+    cJSON_AddItemToObject(reported, key, cJSON_Duplicate(state, true));
+  }
+  uint32_t version = s_version;
+  xSemaphoreGive(s_lock);
+
+  publish_reported(reported, version, true);
+  return ESP_OK;
+}
+
+esp_err_t sn_shadow_start(void) {
+  if (s_lock) return ESP_OK;
+  s_lock = xSemaphoreCreateMutex();
+  if (!s_lock) return ESP_ERR_NO_MEM;
+
+  sn_actor_set_state_observer(on_state_changed);
+
+  const sn_mqtt_topic_cache_t *cache = sn_mqtt_topic_cache_get();
+  sn_mqtt_router_subscriber_add(cache->shadow_desired_topic, on_desired_msg, 1);
+  sn_mqtt_router_subscriber_add(cache->shadow_get_topic, on_get_msg, 1);
+  sn_mqtt_register_connect_handler(on_connected, NULL);
+
+  // first report of every instance is published in full as its initial delta
+  FOR_EACH_INSTANCE(it, gDeviceInstances, gDeviceInstancesLen) {
+    if (!it->online || !it->driver->report_state) continue;
+    if (sn_actor_call(it, refresh_state, NULL) != ESP_OK) {
+      ESP_LOGW(TAG, "Cannot refresh state of %s", it->port->port_name);
+    }
+  }
+
+  ESP_LOGI(TAG, "Shadow started");
+  return ESP_OK;
+}
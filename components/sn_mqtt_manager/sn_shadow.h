@@ -0,0 +1,39 @@
+// --------------------------------------------------------------------------------
+// sn_shadow.h
+//
+// description: device shadow of the actuator states. The reported document of each
+// local_id is refreshed by the actors after every control and only the changed keys
+// are published. A desired document is diffed locally against the reported one and
+// converged through the regular control path.
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_SHADOW_H
+#define SN_SHADOW_H
+
+#include "esp_err.h"
+
+/*
+ * Reported delta (shadow/reported), keys are local ids:
+ * { "reported": { "13": { "enable": true } }, "version": 12, "ts": 1731000000000 }
+ *
+ * Full snapshot, published on (re)connect and on any message to shadow/get:
+ * { "full": true, "reported": { "10": {...}, "13": {...} }, "version": 12, "ts": ... }
+ *
+ * Desired (shadow/desired), only the keys that differ from the reported state trigger
+ * a control call:
+ * { "desired": { "13": { "enable": false }, "14": { "msg": "hello" } } }
+ */
+
+/*
+ * @brief Hook the actors, subscribe the shadow topics and publish the initial state.
+ * Call once mqtt is started and the drivers are bound
+ */
+esp_err_t sn_shadow_start(void);
+
+/*
+ * @brief Publish the full reported document
+ */
+esp_err_t sn_shadow_publish_snapshot(void);
+
+#endif // !SN_SHADOW_H
@@ -0,0 +1,112 @@
+#include "sn_trace_mqtt.h"
+#include "cJSON.h"
+#include "esp_log.h"
+#include "sn_json.h"
+#include "sn_mqtt_manager.h"
+#include "sn_mqtt_router.h"
+#include "sn_sntp.h"
+#include "sn_topic.h"
+#include "sn_trace.h"
+#include <stdlib.h>
+#include "freertos/idf_additions.h"
+
+static const char *TAG = "SN_TRACE_MQTT";
+
+// ~60 bytes per escaped row, keeps a signed chunk under the 1 KB publish buffer
+#define TRACE_CHUNK_EVENTS 12
+
+typedef struct {
+  bool clear;
+  bool console;
+} dump_request_t;
+
+typedef struct {
+  unsigned long long id;
+  uint32_t seq;
+  cJSON *events;
+  int len;
+  int dropped;
+} dump_state_t;
+
+static uint32_t s_dumping = 0;
+
+static void publish_chunk(dump_state_t *st, bool last) {
+  cJSON *root = cJSON_CreateObject();
+  cJSON_AddNumberToObject(root, "dump", st->id);
+  cJSON_AddNumberToObject(root, "seq", st->seq++);
+  cJSON_AddItemToObject(root, "events", st->events ? st->events : cJSON_CreateArray());
+  cJSON_AddBoolToObject(root, "last", last);
+  st->events = NULL;
+  st->len = 0;
+
+  const char *topic = sn_mqtt_topic_cache_get()->trace_topic;
+  // the enqueue blocks while the publisher queue is full, which paces the dump
+  if (sn_mqtt_publish_json_payload_signed(root, topic, 0, false) != ESP_OK) st->dropped++;
+}
+
+static void add_event(const sn_trace_event_t *e, const char *task_name, void *arg) {
+  dump_state_t *st = arg;
+  if (!st->events) st->events = cJSON_CreateArray();
+
+  char phase[2] = {e->phase, '\0'};
+  cJSON *row = cJSON_CreateArray();
+  cJSON_AddItemToArray(row, cJSON_CreateNumber(e->ts_us));
+  cJSON_AddItemToArray(row, cJSON_CreateString(phase));
+  cJSON_AddItemToArray(row, cJSON_CreateNumber(e->core));
+  cJSON_AddItemToArray(row, task_name ? cJSON_CreateString(task_name) : cJSON_CreateNull());
+  cJSON_AddItemToArray(row, cJSON_CreateString(e->name));
+  cJSON_AddItemToArray(row, cJSON_CreateNumber(e->arg));
+  cJSON_AddItemToArray(st->events, row);
+
+  if (++st->len >= TRACE_CHUNK_EVENTS) publish_chunk(st, false);
+}
+
+// the dump blocks on the publisher queue, it can't run on the mqtt task
+static void dump_task(void *pvParams) {
+  dump_request_t req = *(dump_request_t *)pvParams;
+  free(pvParams);
+
+  size_t n = 0;
+  if (req.console) {
+    n = sn_trace_dump_console(req.clear);
+  } else {
+    dump_state_t st = {.id = sn_get_unix_timestamp_ms()};
+    n = sn_trace_dump(add_event, &st, req.clear);
+    publish_chunk(&st, true);
+    if (st.dropped) ESP_LOGW(TAG, "%d trace chunks dropped", st.dropped);
+  }
+  ESP_LOGI(TAG, "Dumped %u trace events", (unsigned)n);
+
+  __atomic_store_n(&s_dumping, 0, __ATOMIC_RELEASE);
+  vTaskDelete(NULL);
+}
+
+static void on_get_msg(const char *topic, const char *payload) {
+  if (__atomic_exchange_n(&s_dumping, 1, __ATOMIC_ACQUIRE)) {
+    ESP_LOGW(TAG, "Trace dump already running");
+    return;
+  }
+
+  dump_request_t *req = calloc(1, sizeof(dump_request_t));
+  cJSON *root = cJSON_Parse(payload);
+  if (req) {
+    json_get_bool(root, "clear", &req->clear);
+    json_get_bool(root, "console", &req->console);
+  }
+  cJSON_Delete(root);
+
+  if (!req || xTaskCreate(dump_task, "trace_dump", 4096, req, 2, NULL) != pdPASS) {
+    ESP_LOGE(TAG, "Cannot start trace dump");
+    free(req);
+    __atomic_store_n(&s_dumping, 0, __ATOMIC_RELEASE);
+  }
+}
+
+esp_err_t sn_trace_mqtt_start(void) {
+#if CONFIG_SN_TRACE_ENABLE
+  return sn_mqtt_router_subscriber_add(sn_mqtt_topic_cache_get()->trace_get_topic, on_get_msg, 1);
+#else
+  (void)on_get_msg;
+  return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
@@ -0,0 +1,29 @@
+// --------------------------------------------------------------------------------
+// sn_trace_mqtt.h
+//
+// description: dump of the trace buffer over mqtt. Any message on trace/get starts a
+// dump, published on the trace topic in chunks small enough for one mqtt message.
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_TRACE_MQTT_H
+#define SN_TRACE_MQTT_H
+
+#include "esp_err.h"
+
+/*
+ * Request (trace/get), both flags optional:
+ * { "clear": true, "console": false }
+ *
+ * Chunks (trace), events are [ts_us, phase, core, task, name, arg]:
+ * { "dump": 1731000000000, "seq": 0, "events": [[81234567, "B", 0, "sensor_poll_task",
+ *   "sensor.read", 3], ...], "last": false }
+ */
+
+/*
+ * @brief Subscribe trace/get. Call once mqtt is started
+ * @return ESP_ERR_NOT_SUPPORTED when tracing is compiled out
+ */
+esp_err_t sn_trace_mqtt_start(void);
+
+#endif // !SN_TRACE_MQTT_H
@@ -3,6 +3,7 @@
 #include "esp_err.h"
 #include "mbedtls/md.h"
 #include "sn_storage.h"
+#include "sn_prof.h"
 #include "sn_sntp.h"
 #include <stdbool.h>
 #include <stdio.h>
@@ -11,40 +12,50 @@
 // utilities function for wrapping the payload
 cJSON *sn_security_sign_and_wrap_payload(cJSON *payload) {
   static unsigned char s_device_secret[65] = {0};
-  static size_t s_secret_len = 0;
   static bool s_has_secret = false;
 
   if (!payload) return NULL;
 
+  if (!s_has_secret) {
+    // try fetching secret from nvs, if device doesn't have secret then skipping signature
+    esp_err_t ok = sn_storage_get_device_secret((char *)s_device_secret, sizeof(s_device_secret));
+    s_has_secret = ok == ESP_OK;
+  }
+
+  return sn_security_sign_and_wrap_payload_with_secret(
+    payload, s_has_secret ? (const char *)s_device_secret : NULL
+  );
+}
+
+cJSON *sn_security_sign_and_wrap_payload_with_secret(cJSON *payload, const char *secret) {
+  if (!payload) return NULL;
+  SN_PROF_SCOPE("sign");
+
   // create wrapper
   cJSON *wrapper = cJSON_CreateObject();
   char *payload_str = cJSON_PrintUnformatted(payload);
+  cJSON_Delete(payload);
+  if (!wrapper || !payload_str) {
+    cJSON_Delete(wrapper);
+    cJSON_free(payload_str);
+    return NULL;
+  }
   cJSON_AddItemToObject(wrapper, "raw_payload", cJSON_CreateString(payload_str));
   cJSON_AddNumberToObject(wrapper, "ts", sn_get_unix_timestamp_ms());
 
-  if (!s_has_secret) {
-    // try fetching secret from nvs
-    esp_err_t ok = sn_storage_get_device_secret((char *)s_device_secret, sizeof(s_device_secret));
-    if (ok != ESP_OK) {
-      // if device doesn't have secret then skipping signature
-      return wrapper;
-    } else {
-      s_secret_len = strlen((char *)s_device_secret);
-      s_has_secret = true;
-    }
+  if (secret && secret[0]) {
+    unsigned char hmac_result[32] = {0};
+    char hmac_hex[65];
+    sn_security_calculate_hmac(
+      (const unsigned char *)secret, strlen(secret), (unsigned char *)payload_str,
+      strlen(payload_str), hmac_result
+    );
+    sn_security_byte_to_hex_string(hmac_result, sizeof(hmac_result), hmac_hex);
+    cJSON_AddItemToObject(wrapper, "sig", cJSON_CreateString(hmac_hex));
   }
 
-  unsigned char hmac_result[32] = {0};
-  char hmac_hex[65];
-  sn_security_calculate_hmac(
-    s_device_secret, s_secret_len, (unsigned char *)payload_str, strlen(payload_str), hmac_result
-  );
-  sn_security_byte_to_hex_string(hmac_result, sizeof(hmac_result), hmac_hex);
-  cJSON_AddItemToObject(wrapper, "sig", cJSON_CreateString(hmac_hex));
-
   // free dangle resource
   cJSON_free(payload_str);
-  cJSON_Delete(payload);
 
   return wrapper;
 }
@@ -53,6 +64,7 @@ void sn_security_calculate_hmac(
   const unsigned char *key, size_t key_len, const unsigned char *message, size_t msg_len,
   unsigned char *hmac_result
 ) {
+  SN_PROF_SCOPE("hmac");
   mbedtls_md_context_t ctx;
   mbedtls_md_type_t md_type = MBEDTLS_MD_SHA256; // Using SHA-256
 
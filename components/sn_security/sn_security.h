@@ -4,8 +4,18 @@
 #include <stddef.h>
 #include "cJSON.h"
 
+/*
+ * @brief wraps the payload as {raw_payload, ts, sig}, signed with the device secret from
+ * storage. Takes ownership of payload
+ */
 cJSON *sn_security_sign_and_wrap_payload(cJSON *payload);
 
+/*
+ * @brief same as sn_security_sign_and_wrap_payload with the given secret, the wrapper is
+ * left unsigned when secret is NULL or empty. Takes ownership of payload
+ */
+cJSON *sn_security_sign_and_wrap_payload_with_secret(cJSON *payload, const char *secret);
+
 // clang-format off
 void sn_security_calculate_hmac(
   const unsigned char *key, size_t key_len,
@@ -70,6 +70,27 @@ esp_err_t sn_storage_erase_key(const char *key) {
   return err;
 }
 
+esp_err_t sn_storage_set_blob(const char *key, const void *value, size_t len) {
+  nvs_handle_t nvs;
+  esp_err_t err = nvs_open(STORAGE_NAMESPACE, NVS_READWRITE, &nvs);
+  if (err != ESP_OK) return err;
+
+  err = nvs_set_blob(nvs, key, value, len);
+  if (err == ESP_OK) err = nvs_commit(nvs);
+  nvs_close(nvs);
+  return err;
+}
+
+esp_err_t sn_storage_get_blob(const char *key, void *out, size_t *len) {
+  nvs_handle_t nvs;
+  esp_err_t err = nvs_open(STORAGE_NAMESPACE, NVS_READONLY, &nvs);
+  if (err != ESP_OK) return err;
+
+  err = nvs_get_blob(nvs, key, out, len);
+  nvs_close(nvs);
+  return err;
+}
+
 // --------------------------------------------------------------------------------
 // Device Info
 // --------------------------------------------------------------------------------
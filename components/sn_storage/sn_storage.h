@@ -2,6 +2,7 @@
 #define SN_STORAGE_H
 
 #include "esp_err.h"
+#include <stddef.h>
 #define STORAGE_NAMESPACE "sn_storage"
 
 #define DECLARE_GETTER_SETTER_DELETE(KEY)                                                          \
@@ -42,6 +43,17 @@ esp_err_t sn_storage_get_string(const char *key, char *out, size_t len);
  */
 esp_err_t sn_storage_erase_key(const char *key);
 
+/*
+ * @brief Store a binary value, keys are at most 15 characters
+ */
+esp_err_t sn_storage_set_blob(const char *key, const void *value, size_t len);
+
+/*
+ * @brief Read a binary value
+ * @param len size of out on entry, length of the stored value on return
+ */
+esp_err_t sn_storage_get_blob(const char *key, void *out, size_t *len);
+
 // --------------------------------------------------------------------------------
 // Debug utilities
 // --------------------------------------------------------------------------------
@@ -1,8 +1,8 @@
 #include "sn_ui.h"
 #include "misc/lv_async.h"
 #include "sn_config.h"
-#include "systems/sn_device_mgr.h"
 #include "sn_error.h"
+#include "sn_prof.h"
 
 #include <esp_lcd_panel_io.h>
 #include <esp_lcd_panel_ops.h>
@@ -32,6 +32,15 @@ static lv_display_t *g_display = NULL;
 // static SemaphoreHandle_t lvgl_api_lock = NULL;
 static esp_lcd_panel_handle_t g_panelHandle = NULL;
 static esp_lcd_panel_io_handle_t g_ioHandle = NULL;
+// shared with the other devices on the i2c bus, transfers go through its queue
+static sn_bus_t *g_bus = NULL;
+
+typedef struct {
+  int x1, y1, x2, y2;
+} ui_flush_t;
+
+// lvgl waits for flush_ready before the next flush, one is enough
+static ui_flush_t g_flush;
 
 static void increase_lvgl_tick(void *arg) {
   /* Tell LVGL how many milliseconds has elapsed */
@@ -46,8 +55,24 @@ static bool notify_lvgl_flush_ready(
   return false;
 }
 
+static esp_err_t flush_txn(sn_bus_t *bus, void *arg) {
+  const ui_flush_t *f = (const ui_flush_t *)arg;
+  return esp_lcd_panel_draw_bitmap(g_panelHandle, f->x1, f->y1, f->x2 + 1, f->y2 + 1, oled_buffer);
+}
+
+// a failed transfer never reaches the panel io callback
+static void on_flush_done(esp_err_t rc, void *arg) {
+  if (rc != ESP_OK) lv_display_flush_ready(g_display);
+}
+
+static esp_err_t panel_setup_txn(sn_bus_t *bus, void *arg) {
+  TRY(esp_lcd_panel_reset(g_panelHandle));
+  TRY(esp_lcd_panel_init(g_panelHandle));
+  return esp_lcd_panel_disp_on_off(g_panelHandle, true);
+}
+
 static void lvgl_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map) {
-  esp_lcd_panel_handle_t panel_handle = lv_display_get_user_data(disp);
+  SN_PROF_SCOPE("ui.flush");
 
   // This is necessary because LVGL reserves 2 x 4 bytes in the buffer, as these
   // are assumed to be used as a palette. Skip the palette here More information
@@ -81,14 +106,12 @@ static void lvgl_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px
       }
     }
   }
-  // pass the draw buffer to the driver
-  SemaphoreHandle_t i2c_mutex = sn_devmgr_get_i2c_master_bus_mutex();
-  if (xSemaphoreTake(i2c_mutex, pdMS_TO_TICKS(2000)) == pdTRUE) {
-    esp_lcd_panel_draw_bitmap(panel_handle, x1, y1, x2 + 1, y2 + 1, oled_buffer);
-    xSemaphoreGive(i2c_mutex);
-  } else {
-    // timeout: schedule a retry or drop the frame (log)
-    ESP_LOGW(TAG, "i2c mutex timeout in lvgl_flush_cb");
+  // pass the draw buffer to the bus, bulk transfers give way to the sensors on it
+  g_flush = (ui_flush_t){.x1 = x1, .y1 = y1, .x2 = x2, .y2 = y2};
+  if (sn_bus_submit_async(g_bus, SN_BUS_PRIO_LOW, flush_txn, &g_flush, on_flush_done, NULL)
+      != ESP_OK) {
+    ESP_LOGW(TAG, "i2c queue full in lvgl_flush_cb, frame dropped");
+    lv_display_flush_ready(disp);
   }
 }
 
@@ -103,7 +126,7 @@ static esp_err_t init_ssd1306_panel() {
     .dc_bit_offset = 6,             // According to SSD1306 datasheet
   };
 
-  TRY(esp_lcd_new_panel_io_i2c(sn_devmgr_get_i2c_master_bus_handle(), &io_config, &g_ioHandle));
+  TRY(esp_lcd_new_panel_io_i2c(sn_bus_i2c_handle(g_bus), &io_config, &g_ioHandle));
 
   ESP_LOGI(TAG, "Install SSD1306 panel driver");
   esp_lcd_panel_dev_config_t panel_config = {
@@ -116,9 +139,7 @@ static esp_err_t init_ssd1306_panel() {
   panel_config.vendor_config = &ssd1306_config;
 
   TRY(esp_lcd_new_panel_ssd1306(g_ioHandle, &panel_config, &g_panelHandle));
-  TRY(esp_lcd_panel_reset(g_panelHandle));
-  TRY(esp_lcd_panel_init(g_panelHandle));
-  return esp_lcd_panel_disp_on_off(g_panelHandle, true);
+  return sn_bus_submit(g_bus, SN_BUS_PRIO_NORMAL, panel_setup_txn, NULL);
 }
 
 static esp_err_t init_lgvl() {
@@ -150,12 +171,14 @@ static esp_err_t init_lgvl() {
   return esp_lcd_panel_io_register_event_callbacks(g_ioHandle, &cbs, g_display);
 }
 
-esp_err_t sn_ui_init(void *pvParams) {
+esp_err_t sn_ui_init(sn_bus_t *bus) {
   // lvgl_api_lock = xSemaphoreCreateMutex();
   // RETURN_IF_FALSE(TAG, !lvgl_api_lock, ESP_FAIL, "Cannot create semaphore");
+  RETURN_IF_FALSE(TAG, bus, ESP_ERR_INVALID_ARG, "no i2c bus for the display");
+  g_bus = bus;
   RETURN_IF_FALSE(
-    TAG, sn_devmgr_i2c_scan_address(0x3c) == ESP_OK, ESP_FAIL,
-    "cannot find slave address %.2x. quitting task", 0x3c
+    TAG, sn_bus_i2c_probe(g_bus, I2C_HW_ADDR) == ESP_OK, ESP_FAIL,
+    "cannot find slave address %.2x. quitting task", I2C_HW_ADDR
   );
 
   TRY(init_ssd1306_panel());
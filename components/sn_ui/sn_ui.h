@@ -3,5 +3,15 @@
 
 #include "esp_err.h"
 #include "lvgl.h"
+#include "sn_bus.h"
+
+/*
+ * @brief Bring up the ssd1306 and lvgl on a shared i2c bus (see sn_bus.h)
+ */
+esp_err_t sn_ui_init(sn_bus_t *bus);
+
+lv_display_t *sn_ui_get_display();
+
+void ui_task();
 
 #endif
@@ -0,0 +1,125 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_MAX_RESULTS 32
+#define BENCH_DEFAULT_MS  300
+
+static sn_bench_result_t s_results[BENCH_MAX_RESULTS];
+static int s_results_len = 0;
+
+// --------------------------------------------------------------------------------
+// Allocation counters (-Wl,--wrap)
+// --------------------------------------------------------------------------------
+
+static uint64_t s_allocs = 0;
+static uint64_t s_alloc_bytes = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static inline void count_alloc(size_t size) {
+  __atomic_fetch_add(&s_allocs, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&s_alloc_bytes, size, __ATOMIC_RELAXED);
+}
+
+void *__wrap_malloc(size_t size) {
+  count_alloc(size);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+  count_alloc(n * size);
+  return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  if (size) count_alloc(size);
+  return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void *ptr) { __real_free(ptr); }
+
+// --------------------------------------------------------------------------------
+// Runner
+// --------------------------------------------------------------------------------
+
+static inline uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t time_loop(sn_bench_fn_t fn, void *arg, uint64_t n) {
+  uint64_t start = now_ns();
+  for (uint64_t i = 0; i < n; i++) fn(arg);
+  return now_ns() - start;
+}
+
+bool sn_bench_run(const char *name, sn_bench_fn_t fn, void *arg) {
+  const char *filter = getenv("SN_BENCH_FILTER");
+  if (filter && !strstr(name, filter)) return false;
+  if (s_results_len >= BENCH_MAX_RESULTS) return false;
+
+  const char *min_ms_env = getenv("SN_BENCH_MIN_MS");
+  uint64_t min_ns = (min_ms_env ? strtoull(min_ms_env, NULL, 10) : BENCH_DEFAULT_MS) * 1000000ULL;
+
+  // warm up and grow n until a run lasts a tenth of the budget
+  uint64_t n = 1;
+  uint64_t elapsed = time_loop(fn, arg, n);
+  while (elapsed < min_ns / 10 && n < (1ULL << 32)) {
+    n *= 2;
+    elapsed = time_loop(fn, arg, n);
+  }
+  n = elapsed ? n * min_ns / elapsed : n;
+  if (n == 0) n = 1;
+
+  uint64_t allocs = __atomic_load_n(&s_allocs, __ATOMIC_RELAXED);
+  uint64_t bytes = __atomic_load_n(&s_alloc_bytes, __ATOMIC_RELAXED);
+  elapsed = time_loop(fn, arg, n);
+  allocs = __atomic_load_n(&s_allocs, __ATOMIC_RELAXED) - allocs;
+  bytes = __atomic_load_n(&s_alloc_bytes, __ATOMIC_RELAXED) - bytes;
+
+  sn_bench_result_t *r = &s_results[s_results_len++];
+  r->name = name;
+  r->iterations = n;
+  r->ns_per_op = (double)elapsed / n;
+  r->allocs_per_op = (double)allocs / n;
+  r->bytes_per_op = (double)bytes / n;
+
+  fprintf(
+    stderr, "%-28s %12llu %12.1f ns/op %8.2f allocs/op %10.1f B/op\n", name,
+    (unsigned long long)n, r->ns_per_op, r->allocs_per_op, r->bytes_per_op
+  );
+  return true;
+}
+
+int sn_bench_write_results(void) {
+  const char *path = getenv("SN_BENCH_OUT");
+  const char *rev = getenv("SN_BENCH_REV");
+  FILE *f = path ? fopen(path, "w") : stdout;
+  if (!f) {
+    perror(path);
+    return -1;
+  }
+
+  fprintf(f, "{\"rev\":\"%s\",\"results\":[", rev ? rev : "");
+  for (int i = 0; i < s_results_len; i++) {
+    const sn_bench_result_t *r = &s_results[i];
+    fprintf(
+      f,
+      "%s{\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f,"
+      "\"bytes_per_op\":%.1f}",
+      i ? "," : "", r->name, (unsigned long long)r->iterations, r->ns_per_op, r->allocs_per_op,
+      r->bytes_per_op
+    );
+  }
+  fprintf(f, "]}\n");
+
+  if (f != stdout) fclose(f);
+  return 0;
+}
@@ -0,0 +1,41 @@
+// --------------------------------------------------------------------------------
+// bench.h
+//
+// description: minimal benchmark runner. Each case is timed over enough iterations to
+// last SN_BENCH_MIN_MS and reports ns/op, allocations/op and allocated bytes/op. The
+// results are written as json for the ci to compare two commits
+// (tools/bench_compare.py).
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_BENCH_H
+#define SN_BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// one operation of the benchmarked path
+typedef void (*sn_bench_fn_t)(void *arg);
+
+typedef struct {
+  const char *name;
+  uint64_t iterations;
+  double ns_per_op;
+  double allocs_per_op;
+  double bytes_per_op;
+} sn_bench_result_t;
+
+/*
+ * @brief Time fn unless the name is filtered out by SN_BENCH_FILTER (substring)
+ * @return false if the case was skipped
+ */
+bool sn_bench_run(const char *name, sn_bench_fn_t fn, void *arg);
+
+/*
+ * @brief Write every result to SN_BENCH_OUT (default: stdout):
+ * { "rev": "<SN_BENCH_REV>", "results": [ { "name": "dispatch_command",
+ *   "iterations": 65536, "ns_per_op": 5120.4, "allocs_per_op": 14, "bytes_per_op": 911 } ] }
+ */
+int sn_bench_write_results(void);
+
+#endif // !SN_BENCH_H
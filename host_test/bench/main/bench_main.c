@@ -0,0 +1,193 @@
+#include "bench.h"
+#include "cJSON.h"
+#include "esp_log.h"
+#include "sn_capability.h"
+#include "sn_driver.h"
+#include "sn_driver_registry.h"
+#include "sn_json.h"
+#include "sn_rules/sn_rule_engine.h"
+#include "sn_security.h"
+#include "sn_storage.h"
+#include "sn_string.h"
+#include "sn_topic.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// clang-format off
+#define BENCHES(X)             \
+  X(sensor_reading_to_json)    \
+  X(sign_and_wrap_payload)     \
+  X(validate_params_json)      \
+  X(dispatch_command)          \
+  X(rule_process)              \
+  X(rule_process_transition)   \
+  X(sid_intern)                \
+  X(topic_build)               \
+  X(topic_cache_rebuild)
+// clang-format on
+
+#define BENCH_LOCAL_ID     0x10
+#define BENCH_RULE_SOURCES 4
+#define BENCH_SIDS         64
+
+// --------------------------------------------------------------------------------
+// Device model: a no-op command port measures the dispatch path alone
+// --------------------------------------------------------------------------------
+
+static const char *noop_types[] = {"bench_noop", NULL};
+static const sn_param_desc_t noop_params[] = {
+  {.name = "enable", .type = PTYPE_BOOL,   .required = true },
+  {.name = "level",  .type = PTYPE_NUMBER, .required = false},
+  {.name = NULL}
+};
+static const sn_command_desc_t noop_schema = {.action = "noop", .params = noop_params};
+
+static esp_err_t noop_controller(void *ctxv, const cJSON *paramsJson, cJSON **out_result) {
+  if (out_result) *out_result = build_success_fmt(NULL);
+  return ESP_OK;
+}
+
+static const sn_driver_desc_t noop_driver = {
+  .name = "bench_noop_drv",
+  .supported_types = noop_types,
+  .priority = 50,
+  .control = noop_controller,
+  .command_desc = &noop_schema,
+};
+
+const sn_device_port_desc_t gDevicePorts[] = {
+  COMMAND_PORT_LITERAL("noop", "bench_noop", ((sn_command_api_port_t){.local_id = BENCH_LOCAL_ID})),
+  COMMAND_PORT_LITERAL("state", "state", ((sn_command_api_port_t){.local_id = 0x7D})),
+  COMMAND_PORT_LITERAL("metrics", "metrics", ((sn_command_api_port_t){.local_id = 0x7C})),
+};
+const size_t gDevicePortsLen = sizeof(gDevicePorts) / sizeof(sn_device_port_desc_t);
+
+// every band change writes to the noop port
+static const sn_command_t noop_commands[] = {
+  {.local_id = BENCH_LOCAL_ID, .action = "noop", .params_json = "{\"enable\":true}"},
+  COMMAND_NULL_ENTRY
+};
+
+// 16 rules over 4 sources, each source is matched by 4 of them. The bands of a source
+// all contain 40, 0 is below and 100 above every one of them
+// clang-format off
+#define BENCH_RULE_IDS(X) \
+  X(0)  X(1)  X(2)  X(3)  X(4)  X(5)  X(6)  X(7) \
+  X(8)  X(9)  X(10) X(11) X(12) X(13) X(14) X(15)
+// clang-format on
+#define GEN_BENCH_RULE(N)                                                                          \
+  {.id = 0x7F + (N), .src_id = 0x01 + (N) % BENCH_RULE_SOURCES, .name = "bench",                   \
+   .on_low = noop_commands, .on_normal = noop_commands, .on_high = noop_commands,                  \
+   .low = 20 + (N), .high = 60 + (N)},
+const sn_rule_desc_t gRules[] = {BENCH_RULE_IDS(GEN_BENCH_RULE)};
+#undef GEN_BENCH_RULE
+const size_t gRulesLen = sizeof(gRules) / sizeof(sn_rule_desc_t);
+
+// --------------------------------------------------------------------------------
+// Cases
+// --------------------------------------------------------------------------------
+
+static volatile int s_sink;
+static const cJSON *s_params = NULL;
+static char s_sids[BENCH_SIDS][24];
+static const sn_mqtt_topic_context_t s_topic_ctx = {
+  .orgId = "6650c0ffee0000000000beef",
+  .deviceId = "6650c0ffee0000000000d00d",
+  .clusterId = "greenhouse-1",
+};
+
+static void bench_sensor_reading_to_json(void *arg) {
+  sn_sensor_reading_t reading = {.local_id = 0x01, .value = 24.5f, .ts = 1731000000000ULL};
+  cJSON *json = sensor_reading_to_json_obj(&reading);
+  cJSON_Delete(json);
+}
+
+// what a signed publish does before the enqueue
+static void bench_sign_and_wrap_payload(void *arg) {
+  sn_sensor_reading_t reading = {.local_id = 0x01, .value = 24.5f, .ts = 1731000000000ULL};
+  cJSON *json = sn_security_sign_and_wrap_payload(sensor_reading_to_json_obj(&reading));
+  char *str = cJSON_PrintUnformatted(json);
+  cJSON_free(str);
+  cJSON_Delete(json);
+}
+
+static void bench_validate_params_json(void *arg) {
+  s_sink = validate_params_json(noop_params, s_params, NULL);
+}
+
+static void bench_dispatch_command(void *arg) {
+  cJSON *result = NULL;
+  s_sink = dispatch_command(
+    "{\"localId\":16,\"action\":\"noop\",\"params\":{\"enable\":true,\"level\":0.5}}", &result
+  );
+  cJSON_Delete(result);
+}
+
+// a reading inside every band: the table scan and the evaluation of the matching rules
+static void bench_rule_process(void *arg) {
+  static uint32_t i = 0;
+  sn_sensor_reading_t reading = {
+    .local_id = 0x01 + i++ % BENCH_RULE_SOURCES, .value = 40.0f, .ts = 1731000000000ULL
+  };
+  sn_rule_engine_process(&reading);
+}
+
+// the source swings below and above every band, each reading moves its 4 rules and
+// dispatches their commands
+static void bench_rule_process_transition(void *arg) {
+  static uint32_t i = 0;
+  sn_sensor_reading_t reading = {
+    .local_id = 0x01, .value = i++ % 2 ? 100.0f : 0.0f, .ts = 1731000000000ULL
+  };
+  sn_rule_engine_process(&reading);
+}
+
+// hits only, the table is filled during setup
+static void bench_sid_intern(void *arg) {
+  static uint32_t i = 0;
+  s_sink = (int)sid_intern(s_sids[i++ % BENCH_SIDS]).hash;
+}
+
+static void bench_topic_build(void *arg) {
+  char topic[MAX_TOPIC_LEN];
+  sn_build_device_topic(
+    topic, sizeof(topic), TOPIC_DEV_FMT "telemetry", s_topic_ctx.orgId, s_topic_ctx.deviceId
+  );
+  s_sink = topic[0];
+}
+
+static void bench_topic_cache_rebuild(void *arg) { sn_mqtt_topic_cache_set_context(&s_topic_ctx); }
+
+// --------------------------------------------------------------------------------
+// Setup
+// --------------------------------------------------------------------------------
+
+static void setup(void) {
+  ESP_ERROR_CHECK(sn_storage_init(NULL));
+  ESP_ERROR_CHECK(sn_storage_set_device_secret("bench-secret-0123456789abcdef"));
+
+  sn_driver_register(&noop_driver);
+  sn_driver_register(&state_driver);
+  sn_driver_register(&metrics_driver);
+  sn_driver_bind_all_ports(gDevicePorts, gDevicePortsLen);
+
+  s_params = cJSON_Parse("{\"enable\":true,\"level\":0.5}");
+
+  ESP_ERROR_CHECK(sn_rule_engine_init());
+  for (int i = 0; i < BENCH_SIDS; i++) {
+    snprintf(s_sids[i], sizeof(s_sids[i]), "sensor.%02d.value", i);
+    sid_intern(s_sids[i]);
+  }
+  sn_mqtt_topic_cache_init(&s_topic_ctx);
+}
+
+void app_main(void) {
+  setup();
+  esp_log_level_set("*", ESP_LOG_ERROR);
+
+#define RUN_BENCH(NAME) sn_bench_run(#NAME, bench_##NAME, NULL);
+  BENCHES(RUN_BENCH)
+#undef RUN_BENCH
+
+  exit(sn_bench_write_results() == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,32 @@
+// --------------------------------------------------------------------------------
+// driver/adc_types_legacy.h
+//
+// description: host stand-in for the legacy adc driver types
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_DRIVER_ADC_TYPES_LEGACY_H
+#define SN_HOST_DRIVER_ADC_TYPES_LEGACY_H
+
+#include "hal/adc_types.h"
+
+typedef enum {
+  ADC1_CHANNEL_0 = 0,
+  ADC1_CHANNEL_1,
+  ADC1_CHANNEL_2,
+  ADC1_CHANNEL_3,
+  ADC1_CHANNEL_4,
+  ADC1_CHANNEL_5,
+  ADC1_CHANNEL_6,
+  ADC1_CHANNEL_7,
+  ADC1_CHANNEL_MAX,
+} adc1_channel_t;
+
+typedef enum {
+  ADC_WIDTH_BIT_9 = 0,
+  ADC_WIDTH_BIT_10,
+  ADC_WIDTH_BIT_11,
+  ADC_WIDTH_BIT_12,
+} adc_bits_width_t;
+
+#endif // !SN_HOST_DRIVER_ADC_TYPES_LEGACY_H
@@ -0,0 +1,48 @@
+// --------------------------------------------------------------------------------
+// driver/gpio.h
+//
+// description: host stand-in for the gpio driver, backed by the fake gpio
+// (sn_fake_hal.h)
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_DRIVER_GPIO_H
+#define SN_HOST_DRIVER_GPIO_H
+
+#include "esp_bit_defs.h"
+#include "esp_err.h"
+#include "soc/gpio_num.h"
+#include <stdint.h>
+
+typedef enum {
+  GPIO_MODE_DISABLE = 0,
+  GPIO_MODE_INPUT,
+  GPIO_MODE_OUTPUT,
+  GPIO_MODE_INPUT_OUTPUT,
+  GPIO_MODE_OUTPUT_OD,
+  GPIO_MODE_INPUT_OUTPUT_OD,
+} gpio_mode_t;
+
+typedef enum { GPIO_PULLUP_DISABLE = 0, GPIO_PULLUP_ENABLE } gpio_pullup_t;
+typedef enum { GPIO_PULLDOWN_DISABLE = 0, GPIO_PULLDOWN_ENABLE } gpio_pulldown_t;
+typedef enum { GPIO_INTR_DISABLE = 0, GPIO_INTR_POSEDGE, GPIO_INTR_NEGEDGE } gpio_int_type_t;
+
+typedef struct {
+  uint64_t pin_bit_mask;
+  gpio_mode_t mode;
+  gpio_pullup_t pull_up_en;
+  gpio_pulldown_t pull_down_en;
+  gpio_int_type_t intr_type;
+} gpio_config_t;
+
+esp_err_t gpio_config(const gpio_config_t *cfg);
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+
+int gpio_get_level(gpio_num_t gpio_num);
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode);
+
+esp_err_t gpio_pullup_en(gpio_num_t gpio_num);
+
+#endif // !SN_HOST_DRIVER_GPIO_H
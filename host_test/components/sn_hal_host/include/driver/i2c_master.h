@@ -0,0 +1,45 @@
+// --------------------------------------------------------------------------------
+// driver/i2c_master.h
+//
+// description: host stand-in for the i2c master bus, only what the bus manager and the
+// panel io need
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_DRIVER_I2C_MASTER_H
+#define SN_HOST_DRIVER_I2C_MASTER_H
+
+#include "esp_err.h"
+#include "soc/gpio_num.h"
+#include <stdint.h>
+
+typedef enum { I2C_NUM_0 = 0, I2C_NUM_1, I2C_NUM_MAX } i2c_port_num_t;
+typedef enum { I2C_CLK_SRC_DEFAULT = 0 } i2c_clock_source_t;
+
+typedef struct {
+  i2c_port_num_t i2c_port;
+  gpio_num_t sda_io_num;
+  gpio_num_t scl_io_num;
+  i2c_clock_source_t clk_source;
+  uint8_t glitch_ignore_cnt;
+  int intr_priority;
+  size_t trans_queue_depth;
+  struct {
+    uint32_t enable_internal_pullup : 1;
+  } flags;
+} i2c_master_bus_config_t;
+
+typedef struct sn_fake_i2c_bus_s *i2c_master_bus_handle_t;
+
+esp_err_t i2c_new_master_bus(
+  const i2c_master_bus_config_t *bus_config, i2c_master_bus_handle_t *ret_bus_handle
+);
+
+esp_err_t i2c_del_master_bus(i2c_master_bus_handle_t bus_handle);
+
+// every address acks, the fake bus has the panel on it
+esp_err_t i2c_master_probe(
+  i2c_master_bus_handle_t bus_handle, uint16_t address, int xfer_timeout_ms
+);
+
+#endif // !SN_HOST_DRIVER_I2C_MASTER_H
@@ -0,0 +1,20 @@
+// --------------------------------------------------------------------------------
+// driver/rmt_common.h
+//
+// description: host stand-in for the rmt channel life cycle
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_RMT_COMMON_H
+#define SN_HOST_RMT_COMMON_H
+
+#include "driver/rmt_types.h"
+#include "esp_err.h"
+
+esp_err_t rmt_del_channel(rmt_channel_handle_t channel);
+
+esp_err_t rmt_enable(rmt_channel_handle_t channel);
+
+esp_err_t rmt_disable(rmt_channel_handle_t channel);
+
+#endif // !SN_HOST_RMT_COMMON_H
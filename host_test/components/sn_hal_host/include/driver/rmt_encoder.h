@@ -0,0 +1,23 @@
+// --------------------------------------------------------------------------------
+// driver/rmt_encoder.h
+//
+// description: host stand-in for the rmt encoders, only the copy encoder is provided
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_RMT_ENCODER_H
+#define SN_HOST_RMT_ENCODER_H
+
+#include "driver/rmt_types.h"
+#include "esp_err.h"
+
+typedef struct {
+} rmt_copy_encoder_config_t;
+
+esp_err_t rmt_new_copy_encoder(
+  const rmt_copy_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder
+);
+
+esp_err_t rmt_del_encoder(rmt_encoder_handle_t encoder);
+
+#endif // !SN_HOST_RMT_ENCODER_H
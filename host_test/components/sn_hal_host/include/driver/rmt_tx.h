@@ -0,0 +1,48 @@
+// --------------------------------------------------------------------------------
+// driver/rmt_tx.h
+//
+// description: host stand-in for the rmt transmitter. A transmit on the pin of a fake
+// dht answers on the receiver armed on the same pin (sn_fake_hal.h)
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_RMT_TX_H
+#define SN_HOST_RMT_TX_H
+
+#include "driver/rmt_common.h"
+#include "driver/rmt_encoder.h"
+#include "soc/gpio_num.h"
+
+typedef struct {
+  gpio_num_t gpio_num;
+  rmt_clock_source_t clk_src;
+  uint32_t resolution_hz;
+  size_t mem_block_symbols;
+  size_t trans_queue_depth;
+  int intr_priority;
+  struct {
+    uint32_t invert_out : 1;
+    uint32_t with_dma : 1;
+    uint32_t io_loop_back : 1;
+    uint32_t io_od_mode : 1;
+  } flags;
+} rmt_tx_channel_config_t;
+
+typedef struct {
+  int loop_count;
+  struct {
+    uint32_t eot_level : 1;
+    uint32_t queue_nonblocking : 1;
+  } flags;
+} rmt_transmit_config_t;
+
+esp_err_t rmt_new_tx_channel(
+  const rmt_tx_channel_config_t *config, rmt_channel_handle_t *ret_chan
+);
+
+esp_err_t rmt_transmit(
+  rmt_channel_handle_t tx_channel, rmt_encoder_handle_t encoder, const void *payload,
+  size_t payload_bytes, const rmt_transmit_config_t *config
+);
+
+#endif // !SN_HOST_RMT_TX_H
@@ -0,0 +1,43 @@
+// --------------------------------------------------------------------------------
+// driver/rmt_types.h
+//
+// description: host stand-in for the rmt driver types, the channels are backed by the
+// fake dht (sn_fake_hal.h)
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_RMT_TYPES_H
+#define SN_HOST_RMT_TYPES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum { RMT_CLK_SRC_DEFAULT = 0 } rmt_clock_source_t;
+
+typedef union {
+  struct {
+    uint16_t duration0 : 15;
+    uint16_t level0 : 1;
+    uint16_t duration1 : 15;
+    uint16_t level1 : 1;
+  };
+  uint32_t val;
+} rmt_symbol_word_t;
+
+typedef struct rmt_channel_t *rmt_channel_handle_t;
+typedef struct rmt_encoder_t *rmt_encoder_handle_t;
+
+typedef struct {
+  rmt_symbol_word_t *received_symbols;
+  size_t num_symbols;
+  struct {
+    uint32_t is_last : 1;
+  } flags;
+} rmt_rx_done_event_data_t;
+
+typedef bool (*rmt_rx_done_callback_t)(
+  rmt_channel_handle_t rx_chan, const rmt_rx_done_event_data_t *edata, void *user_ctx
+);
+
+#endif // !SN_HOST_RMT_TYPES_H
@@ -0,0 +1,33 @@
+// --------------------------------------------------------------------------------
+// driver/spi_master.h
+//
+// description: host stand-in for the spi master bus, only what the bus manager needs
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_DRIVER_SPI_MASTER_H
+#define SN_HOST_DRIVER_SPI_MASTER_H
+
+#include "esp_err.h"
+#include <stdint.h>
+
+typedef enum { SPI1_HOST = 0, SPI2_HOST, SPI3_HOST, SPI_HOST_MAX } spi_host_device_t;
+typedef enum { SPI_DMA_DISABLED = 0, SPI_DMA_CH_AUTO = 3 } spi_dma_chan_t;
+
+typedef struct {
+  int mosi_io_num;
+  int miso_io_num;
+  int sclk_io_num;
+  int quadwp_io_num;
+  int quadhd_io_num;
+  int max_transfer_sz;
+  uint32_t flags;
+} spi_bus_config_t;
+
+esp_err_t spi_bus_initialize(
+  spi_host_device_t host_id, const spi_bus_config_t *bus_config, spi_dma_chan_t dma_chan
+);
+
+esp_err_t spi_bus_free(spi_host_device_t host_id);
+
+#endif // !SN_HOST_DRIVER_SPI_MASTER_H
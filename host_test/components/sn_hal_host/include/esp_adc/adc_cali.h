@@ -0,0 +1,19 @@
+// --------------------------------------------------------------------------------
+// esp_adc/adc_cali.h
+//
+// description: host stand-in for the adc calibration driver, backed by the fake adc
+// (sn_fake_hal.h)
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_ADC_CALI_H
+#define SN_HOST_ADC_CALI_H
+
+#include "esp_err.h"
+#include "hal/adc_types.h"
+
+typedef struct adc_cali_scheme_t *adc_cali_handle_t;
+
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t handle, int raw, int *voltage);
+
+#endif // !SN_HOST_ADC_CALI_H
@@ -0,0 +1,13 @@
+// --------------------------------------------------------------------------------
+// esp_adc/adc_oneshot.h
+//
+// description: host stand-in, the drivers read through sn_adc_helper only
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_ADC_ONESHOT_H
+#define SN_HOST_ADC_ONESHOT_H
+
+#include "hal/adc_types.h"
+
+#endif // !SN_HOST_ADC_ONESHOT_H
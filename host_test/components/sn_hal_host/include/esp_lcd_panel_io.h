@@ -0,0 +1,51 @@
+// --------------------------------------------------------------------------------
+// esp_lcd_panel_io.h
+//
+// description: host stand-in for the lcd panel io over i2c
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_ESP_LCD_PANEL_IO_H
+#define SN_HOST_ESP_LCD_PANEL_IO_H
+
+#include "driver/i2c_master.h"
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct sn_fake_lcd_io_s *esp_lcd_panel_io_handle_t;
+
+typedef struct {
+} esp_lcd_panel_io_event_data_t;
+
+typedef bool (*esp_lcd_panel_io_color_trans_done_cb_t)(
+  esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_io_event_data_t *edata, void *user_ctx
+);
+
+typedef struct {
+  esp_lcd_panel_io_color_trans_done_cb_t on_color_trans_done;
+} esp_lcd_panel_io_callbacks_t;
+
+typedef struct {
+  uint32_t dev_addr;
+  esp_lcd_panel_io_color_trans_done_cb_t on_color_trans_done;
+  void *user_ctx;
+  size_t control_phase_bytes;
+  unsigned int dc_bit_offset;
+  int lcd_cmd_bits;
+  int lcd_param_bits;
+  uint32_t scl_speed_hz;
+} esp_lcd_panel_io_i2c_config_t;
+
+esp_err_t esp_lcd_new_panel_io_i2c(
+  i2c_master_bus_handle_t bus, const esp_lcd_panel_io_i2c_config_t *io_config,
+  esp_lcd_panel_io_handle_t *ret_io
+);
+
+esp_err_t esp_lcd_panel_io_register_event_callbacks(
+  esp_lcd_panel_io_handle_t io, const esp_lcd_panel_io_callbacks_t *cbs, void *user_ctx
+);
+
+esp_err_t esp_lcd_panel_io_del(esp_lcd_panel_io_handle_t io);
+
+#endif // !SN_HOST_ESP_LCD_PANEL_IO_H
@@ -0,0 +1,29 @@
+// --------------------------------------------------------------------------------
+// esp_lcd_panel_ops.h
+//
+// description: host stand-in for the lcd panel operations
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_ESP_LCD_PANEL_OPS_H
+#define SN_HOST_ESP_LCD_PANEL_OPS_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+
+typedef struct sn_fake_lcd_panel_s *esp_lcd_panel_handle_t;
+
+esp_err_t esp_lcd_panel_reset(esp_lcd_panel_handle_t panel);
+
+esp_err_t esp_lcd_panel_init(esp_lcd_panel_handle_t panel);
+
+esp_err_t esp_lcd_panel_disp_on_off(esp_lcd_panel_handle_t panel, bool on_off);
+
+esp_err_t esp_lcd_panel_draw_bitmap(
+  esp_lcd_panel_handle_t panel, int x_start, int y_start, int x_end, int y_end,
+  const void *color_data
+);
+
+esp_err_t esp_lcd_panel_del(esp_lcd_panel_handle_t panel);
+
+#endif // !SN_HOST_ESP_LCD_PANEL_OPS_H
@@ -0,0 +1,31 @@
+// --------------------------------------------------------------------------------
+// esp_lcd_panel_vendor.h
+//
+// description: host stand-in for the ssd1306 panel, drawn into the fake framebuffer
+// (sn_fake_hal.h)
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_ESP_LCD_PANEL_VENDOR_H
+#define SN_HOST_ESP_LCD_PANEL_VENDOR_H
+
+#include "esp_lcd_panel_io.h"
+#include "esp_lcd_panel_ops.h"
+#include <stdint.h>
+
+typedef struct {
+  int reset_gpio_num;
+  uint32_t bits_per_pixel;
+  void *vendor_config;
+} esp_lcd_panel_dev_config_t;
+
+typedef struct {
+  uint8_t height;
+} esp_lcd_panel_ssd1306_config_t;
+
+esp_err_t esp_lcd_new_panel_ssd1306(
+  esp_lcd_panel_io_handle_t io, const esp_lcd_panel_dev_config_t *panel_dev_config,
+  esp_lcd_panel_handle_t *ret_panel
+);
+
+#endif // !SN_HOST_ESP_LCD_PANEL_VENDOR_H
@@ -0,0 +1,66 @@
+// --------------------------------------------------------------------------------
+// hal/adc_types.h
+//
+// description: host stand-in for the adc hal types
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_HAL_ADC_TYPES_H
+#define SN_HOST_HAL_ADC_TYPES_H
+
+#include <stdint.h>
+
+typedef enum {
+  ADC_UNIT_1 = 0,
+  ADC_UNIT_2,
+} adc_unit_t;
+
+typedef enum {
+  ADC_ATTEN_DB_0 = 0,
+  ADC_ATTEN_DB_2_5,
+  ADC_ATTEN_DB_6,
+  ADC_ATTEN_DB_12,
+} adc_atten_t;
+
+typedef enum {
+  ADC_BITWIDTH_DEFAULT = 0,
+  ADC_BITWIDTH_9 = 9,
+  ADC_BITWIDTH_10 = 10,
+  ADC_BITWIDTH_11 = 11,
+  ADC_BITWIDTH_12 = 12,
+} adc_bitwidth_t;
+
+// as on the esp32, where the continuous driver packs a conversion in 16 bits
+#define SOC_ADC_DIGI_MAX_BITWIDTH 12
+#define SOC_ADC_DIGI_RESULT_BYTES 2
+
+typedef enum {
+  ADC_CONV_SINGLE_UNIT_1 = 1,
+  ADC_CONV_SINGLE_UNIT_2,
+  ADC_CONV_BOTH_UNIT,
+  ADC_CONV_ALTER_UNIT,
+} adc_digi_convert_mode_t;
+
+typedef enum {
+  ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+  ADC_DIGI_OUTPUT_FORMAT_TYPE2,
+} adc_digi_output_format_t;
+
+typedef struct {
+  uint8_t atten;
+  uint8_t channel;
+  uint8_t unit;
+  uint8_t bit_width;
+} adc_digi_pattern_config_t;
+
+typedef struct {
+  union {
+    struct {
+      uint16_t data : 12;
+      uint16_t channel : 4;
+    } type1;
+    uint16_t val;
+  };
+} adc_digi_output_data_t;
+
+#endif // !SN_HOST_HAL_ADC_TYPES_H
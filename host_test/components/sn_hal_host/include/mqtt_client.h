@@ -0,0 +1,102 @@
+// --------------------------------------------------------------------------------
+// mqtt_client.h
+//
+// description: host stand-in for the esp-mqtt client, connected to the in-process
+// broker of sn_fake_mqtt.c. Only the part of the api the firmware uses; events are
+// delivered on the broker task like the real client delivers them on its mqtt task
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_MQTT_CLIENT_H
+#define SN_HOST_MQTT_CLIENT_H
+
+#include "esp_err.h"
+#include "esp_event.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+ESP_EVENT_DECLARE_BASE(MQTT_EVENTS);
+
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+typedef enum esp_mqtt_event_id_t {
+  MQTT_EVENT_ANY = -1,
+  MQTT_EVENT_ERROR = 0,
+  MQTT_EVENT_CONNECTED,
+  MQTT_EVENT_DISCONNECTED,
+  MQTT_EVENT_SUBSCRIBED,
+  MQTT_EVENT_UNSUBSCRIBED,
+  MQTT_EVENT_PUBLISHED,
+  MQTT_EVENT_DATA,
+  MQTT_EVENT_BEFORE_CONNECT,
+  MQTT_EVENT_DELETED,
+} esp_mqtt_event_id_t;
+
+typedef struct esp_mqtt_event_t {
+  esp_mqtt_event_id_t event_id;
+  esp_mqtt_client_handle_t client;
+  char *data;
+  int data_len;
+  int total_data_len;
+  int current_data_offset;
+  char *topic;
+  int topic_len;
+  int msg_id;
+  int session_present;
+  bool retain;
+  int qos;
+  bool dup;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+typedef struct esp_mqtt_client_config_t {
+  struct {
+    struct {
+      const char *uri;
+    } address;
+  } broker;
+  struct {
+    const char *username;
+    const char *client_id;
+    struct {
+      const char *password;
+    } authentication;
+  } credentials;
+  struct {
+    struct {
+      const char *topic;
+      const char *msg;
+      int msg_len;
+      int qos;
+      int retain;
+    } last_will;
+    bool disable_clean_session;
+    int keepalive;
+  } session;
+} esp_mqtt_client_config_t;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config);
+
+esp_err_t esp_mqtt_client_register_event(
+  esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event, esp_event_handler_t event_handler,
+  void *event_handler_arg
+);
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client);
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client);
+
+// msg_id, 0 for qos 0, -1 when not connected
+int esp_mqtt_client_publish(
+  esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+  int retain
+);
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos);
+
+int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *topic);
+
+#endif // !SN_HOST_MQTT_CLIENT_H
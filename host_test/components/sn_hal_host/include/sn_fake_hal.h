@@ -0,0 +1,224 @@
+// --------------------------------------------------------------------------------
+// sn_fake_hal.h
+//
+// description: scripting side of the host peripherals. The gpio, adc, ledc, dht,
+// ssd1306 and mqtt broker stand-ins keep their state here so a harness can feed inputs
+// to the real drivers and check what they drove. Every peripheral call is counted and
+// timed.
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_FAKE_HAL_H
+#define SN_FAKE_HAL_H
+
+#include "cJSON.h"
+#include "driver/adc_types_legacy.h"
+#include "driver/ledc.h"
+#include "esp_err.h"
+#include "mqtt_client.h"
+#include "sn_recorder.h"
+#include "soc/gpio_num.h"
+#include <stdint.h>
+
+// clang-format off
+#define SN_FAKE_HAL_CALLS(X)  \
+  X(gpio_config)              \
+  X(gpio_set_level)           \
+  X(gpio_get_level)           \
+  X(adc_continuous_read)      \
+  X(ledc_channel_config)      \
+  X(ledc_set_duty)            \
+  X(ledc_update_duty)         \
+  X(rmt_transmit)             \
+  X(panel_draw_bitmap)        \
+  X(mqtt_publish)
+// clang-format on
+
+typedef enum {
+#define GEN_FAKE_CALL_ENUM(NAME) SN_FAKE_CALL_##NAME,
+  SN_FAKE_HAL_CALLS(GEN_FAKE_CALL_ENUM) SN_FAKE_CALL_MAX
+#undef GEN_FAKE_CALL_ENUM
+} sn_fake_hal_call_e;
+
+typedef struct {
+  uint64_t count;
+  uint64_t total_ns;
+  uint64_t max_ns;
+} sn_fake_hal_call_stats_t;
+
+extern sn_fake_hal_call_stats_t gFakeHalStats[SN_FAKE_CALL_MAX];
+
+// monotonic clock of the per-call timing
+uint64_t sn_fake_hal_now_ns(void);
+
+// account a call that started at start_ns, safe from any task
+void sn_fake_hal_record(sn_fake_hal_call_e call, uint64_t start_ns);
+
+/*
+ * @brief Per-call stats, calls never made are left out:
+ * { "gpio_set_level": [12, 840, 210], ... } as [count, total_ns, max_ns]
+ */
+cJSON *sn_fake_hal_stats_to_json(void);
+
+void sn_fake_hal_stats_reset(void);
+
+// --------------------------------------------------------------------------------
+// Clock and recorder
+// --------------------------------------------------------------------------------
+
+/*
+ * @brief Pin sn_get_unix_timestamp_ms to ms, 0 goes back to the host clock. esp_timer
+ * and the FreeRTOS ticks keep running in real time
+ */
+void sn_fake_clock_set_ms(unsigned long long ms);
+
+/*
+ * @brief Receive every record of the SN_REC_* probes, on the task that records it.
+ * Nothing is written to flash on the host
+ */
+void sn_fake_recorder_set_tap(sn_rec_visit_t tap, void *arg);
+
+// --------------------------------------------------------------------------------
+// GPIO
+// --------------------------------------------------------------------------------
+
+/*
+ * @brief Level read back by gpio_get_level on an input pin
+ */
+void sn_fake_gpio_set_input(gpio_num_t pin, int level);
+
+/*
+ * @brief Last level driven on the pin, -1 if the pin was never configured as output
+ */
+int sn_fake_gpio_get_output(gpio_num_t pin);
+
+/*
+ * @brief Number of level changes driven on the pin
+ */
+uint32_t sn_fake_gpio_get_edges(gpio_num_t pin);
+
+// --------------------------------------------------------------------------------
+// ADC
+// --------------------------------------------------------------------------------
+
+/*
+ * @brief Constant raw reading of a channel (0..4095), drops a loaded waveform
+ */
+void sn_fake_adc_set_raw(adc1_channel_t ch, int raw);
+
+/*
+ * @brief Play a waveform on a channel, looped. The file has one raw reading per line,
+ * blank lines and lines starting with '#' are skipped
+ * @param step_ms time between two samples of the file, 0 to step once per conversion
+ */
+esp_err_t sn_fake_adc_load_waveform(adc1_channel_t ch, const char *path, uint32_t step_ms);
+
+// --------------------------------------------------------------------------------
+// LEDC
+// --------------------------------------------------------------------------------
+
+/*
+ * @brief Duty applied by the last ledc_update_duty, as a fraction of the resolution
+ */
+float sn_fake_ledc_get_level(ledc_channel_t channel);
+
+// --------------------------------------------------------------------------------
+// DHT
+// --------------------------------------------------------------------------------
+
+typedef enum {
+  SN_FAKE_DHT_OK = 0,
+  SN_FAKE_DHT_TIMEOUT,      // no response to the start signal
+  SN_FAKE_DHT_BAD_CHECKSUM, // one bit of the frame flipped
+} sn_fake_dht_fault_e;
+
+/*
+ * @brief Attach a sensor to the pin, it answers the start pulses the rmt sends on the
+ * pin. A start pulse of 18 ms or more gets a dht11 frame, a shorter one a 16-bit frame.
+ * Reads time out on pins without one
+ */
+void sn_fake_dht_set(gpio_num_t pin, float temperature, float humidity);
+
+/*
+ * @brief Fail the next count reads of the pin
+ */
+void sn_fake_dht_inject_fault(gpio_num_t pin, sn_fake_dht_fault_e fault, int count);
+
+/*
+ * @brief Delay from the start pulse to the end of the rmt receive, about 50000 on the
+ * real sensor (start pulse, frame and the idle time that ends the receive). 0 by default
+ * so the harnesses run as fast as the host allows
+ */
+void sn_fake_dht_set_latency_us(uint32_t us);
+
+// --------------------------------------------------------------------------------
+// SSD1306
+// --------------------------------------------------------------------------------
+
+#define SN_FAKE_SSD1306_WIDTH  128
+#define SN_FAKE_SSD1306_HEIGHT 64
+
+/*
+ * @brief Display ram in the panel layout: 8 pages of 128 columns, bit n of a column
+ * byte is row page * 8 + n. NULL until a panel is created
+ */
+const uint8_t *sn_fake_ssd1306_get_framebuffer(void);
+
+/*
+ * @brief Number of draw_bitmap calls
+ */
+uint32_t sn_fake_ssd1306_get_flushes(void);
+
+/*
+ * @brief Write the display ram as a plain pbm image (lit pixels are black)
+ */
+esp_err_t sn_fake_ssd1306_write_pbm(const char *path);
+
+// --------------------------------------------------------------------------------
+// MQTT broker
+// --------------------------------------------------------------------------------
+
+// Link between a client and the broker, applied to each direction. Delivery stays in
+// order like over tcp: a lost segment is sent again after rto_ms (doubled on every
+// loss of the same segment) and holds back what follows it
+typedef struct {
+  uint32_t delay_ms;      // one way
+  uint32_t jitter_ms;     // uniform extra delay in [0, jitter_ms]
+  uint16_t loss_permille; // lost segments per 1000
+  uint32_t rto_ms;        // first retransmission timeout
+} sn_fake_mqtt_link_t;
+
+// called on the broker task, data is not nul terminated
+typedef void (*sn_fake_mqtt_sink_t)(const char *topic, const char *data, int len, void *arg);
+
+/*
+ * @brief Link of every client, a perfect link (no delay, no loss) by default
+ */
+void sn_fake_mqtt_set_link(const sn_fake_mqtt_link_t *link);
+
+/*
+ * @brief Subscribe the backend side, colocated with the broker. Filters take the mqtt
+ * '+' and '#' wildcards
+ */
+esp_err_t sn_fake_mqtt_subscribe(const char *filter, sn_fake_mqtt_sink_t sink, void *arg);
+
+/*
+ * @brief Publish from the backend side, the clients receive it over their link
+ * @param len 0 to take strlen(data)
+ */
+esp_err_t sn_fake_mqtt_publish(const char *topic, const char *data, int len);
+
+/*
+ * @brief Break the connection of a client without a disconnect packet: the broker
+ * publishes its last will, drops its subscriptions and what was in flight, and the
+ * client gets MQTT_EVENT_DISCONNECTED. esp_mqtt_client_start() connects it again
+ */
+esp_err_t sn_fake_mqtt_drop(esp_mqtt_client_handle_t client);
+
+/*
+ * @brief { "up": 812, "down": 40, "retransmits": 3, "unrouted": 0, "pending_max": 9,
+ * "connects": 2, "wills": 0, "clients": 1, "clients_max": 2, "subs": 4 }
+ */
+cJSON *sn_fake_mqtt_stats_to_json(void);
+
+#endif // !SN_FAKE_HAL_H
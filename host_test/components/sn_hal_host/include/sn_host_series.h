@@ -0,0 +1,42 @@
+// --------------------------------------------------------------------------------
+// sn_host_series.h
+//
+// description: raw latency samples of the host harnesses, kept whole so the
+// percentiles are exact (the sn_metrics histograms are log2 buckets)
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_SERIES_H
+#define SN_HOST_SERIES_H
+
+#include "cJSON.h"
+#include <stdint.h>
+
+// samples kept per series, later ones are counted but not stored
+#define SN_HOST_SERIES_CAP (1 << 18)
+
+typedef struct {
+  const char *key;
+  uint32_t *samples; // allocated on the first sample
+  uint32_t len;      // samples recorded, may exceed SN_HOST_SERIES_CAP
+} sn_host_series_t;
+
+#define SN_HOST_SERIES_INIT(KEY) {.key = (KEY), .samples = NULL, .len = 0}
+
+/*
+ * @brief Record a sample, safe from any task
+ */
+void sn_host_series_add(sn_host_series_t *s, uint32_t value);
+
+/*
+ * @brief { "n": 7680, "p50": 12, "p90": 40, "p99": 880, "p999": 1900, "max": 2300 },
+ * only "n" when nothing was recorded
+ */
+cJSON *sn_host_series_to_json(const sn_host_series_t *s);
+
+/*
+ * @brief Drop the samples, not safe against a concurrent sn_host_series_add
+ */
+void sn_host_series_reset(sn_host_series_t *s);
+
+#endif // !SN_HOST_SERIES_H
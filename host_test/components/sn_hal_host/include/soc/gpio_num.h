@@ -0,0 +1,51 @@
+// --------------------------------------------------------------------------------
+// soc/gpio_num.h
+//
+// description: host stand-in for the chip gpio numbers used by the port descriptors
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_GPIO_NUM_H
+#define SN_HOST_GPIO_NUM_H
+
+typedef enum {
+  GPIO_NUM_NC = -1,
+  GPIO_NUM_0 = 0,
+  GPIO_NUM_1,
+  GPIO_NUM_2,
+  GPIO_NUM_3,
+  GPIO_NUM_4,
+  GPIO_NUM_5,
+  GPIO_NUM_6,
+  GPIO_NUM_7,
+  GPIO_NUM_8,
+  GPIO_NUM_9,
+  GPIO_NUM_10,
+  GPIO_NUM_11,
+  GPIO_NUM_12,
+  GPIO_NUM_13,
+  GPIO_NUM_14,
+  GPIO_NUM_15,
+  GPIO_NUM_16,
+  GPIO_NUM_17,
+  GPIO_NUM_18,
+  GPIO_NUM_19,
+  GPIO_NUM_20,
+  GPIO_NUM_21,
+  GPIO_NUM_22,
+  GPIO_NUM_23,
+  GPIO_NUM_25 = 25,
+  GPIO_NUM_26,
+  GPIO_NUM_27,
+  GPIO_NUM_32 = 32,
+  GPIO_NUM_33,
+  GPIO_NUM_34,
+  GPIO_NUM_35,
+  GPIO_NUM_36,
+  GPIO_NUM_37,
+  GPIO_NUM_38,
+  GPIO_NUM_39,
+  GPIO_NUM_MAX,
+} gpio_num_t;
+
+#endif // !SN_HOST_GPIO_NUM_H
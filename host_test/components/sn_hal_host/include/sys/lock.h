@@ -0,0 +1,28 @@
+// --------------------------------------------------------------------------------
+// sys/lock.h
+//
+// description: host stand-in for the newlib locks, glibc has none. Zero initialized
+// like the newlib ones, the mutex is created on first use
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_HOST_SYS_LOCK_H
+#define SN_HOST_SYS_LOCK_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+typedef SemaphoreHandle_t _lock_t;
+
+static inline void _lock_acquire(_lock_t *lock) {
+  if (!*lock) {
+    vTaskSuspendAll();
+    if (!*lock) *lock = xSemaphoreCreateMutex();
+    xTaskResumeAll();
+  }
+  xSemaphoreTake(*lock, portMAX_DELAY);
+}
+
+static inline void _lock_release(_lock_t *lock) { xSemaphoreGive(*lock); }
+
+#endif // !SN_HOST_SYS_LOCK_H
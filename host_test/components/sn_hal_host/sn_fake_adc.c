@@ -0,0 +1,293 @@
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sn_fake_hal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "FAKE_ADC";
+
+#define WAVEFORM_LINE_MAX 32
+
+typedef struct {
+  int raw;          // constant reading when there is no waveform
+  int *wave;        // looped samples, owned
+  size_t wave_len;
+  uint32_t step_ms; // 0: one sample per conversion
+  uint32_t cursor;  // conversions done, for step_ms == 0
+} fake_adc_channel_t;
+
+struct adc_continuous_ctx_t {
+  uint32_t frame_bytes;
+  uint32_t pool_bytes;
+  adc_digi_pattern_config_t pattern[ADC1_CHANNEL_MAX];
+  uint32_t pattern_len;
+  uint32_t pattern_pos;
+  uint32_t freq_hz;
+  adc_continuous_evt_cbs_t cbs;
+  void *user_data;
+  bool started;
+  int64_t start_us;
+  uint64_t done; // conversions handed out since the start
+};
+
+static fake_adc_channel_t s_adc[ADC1_CHANNEL_MAX];
+static struct adc_continuous_ctx_t s_ctx;
+static bool s_ctx_used = false;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// full scale of each attenuation in mV, as on the esp32
+static const uint32_t s_full_scale_mv[] = {950, 1250, 1750, 3100};
+
+static inline int max_raw(adc_bits_width_t width) { return (1 << (9 + width)) - 1; }
+
+// caller holds s_lock
+static int sample(uint8_t channel, uint8_t bit_width, int64_t now_us) {
+  fake_adc_channel_t *c = &s_adc[channel];
+  int raw = c->raw;
+  if (c->wave_len) {
+    uint64_t idx = c->step_ms ? (uint64_t)(now_us / 1000) / c->step_ms : c->cursor++;
+    raw = c->wave[idx % c->wave_len];
+  }
+  // the samples are 12 bit, narrower widths drop the low bits like the sar does
+  adc_bits_width_t width = bit_width >= 9 && bit_width <= 12 ? bit_width - 9 : ADC_WIDTH_BIT_12;
+  raw >>= ADC_WIDTH_BIT_12 - width;
+  if (raw > max_raw(width)) raw = max_raw(width);
+  if (raw < 0) raw = 0;
+  return raw;
+}
+
+// Stands in for the dma interrupt, one per frame of conversions
+static void frame_task(void *arg) {
+  struct adc_continuous_ctx_t *h = arg;
+  while (1) {
+    taskENTER_CRITICAL(&s_lock);
+    bool started = h->started;
+    uint32_t freq = h->freq_hz;
+    taskEXIT_CRITICAL(&s_lock);
+
+    uint32_t period_ms = 1;
+    if (started && freq) {
+      period_ms = (uint32_t)((uint64_t)h->frame_bytes / SOC_ADC_DIGI_RESULT_BYTES * 1000 / freq);
+    }
+    vTaskDelay(pdMS_TO_TICKS(period_ms) ? pdMS_TO_TICKS(period_ms) : 1);
+    if (started && h->cbs.on_conv_done) {
+      adc_continuous_evt_data_t evt = {.conv_frame_buffer = NULL, .size = h->frame_bytes};
+      h->cbs.on_conv_done(h, &evt, h->user_data);
+    }
+  }
+}
+
+esp_err_t adc_continuous_new_handle(
+  const adc_continuous_handle_cfg_t *hdl_config, adc_continuous_handle_t *ret_handle
+) {
+  if (!hdl_config || !ret_handle || !hdl_config->conv_frame_size) return ESP_ERR_INVALID_ARG;
+  // one dma controller
+  if (s_ctx_used) return ESP_ERR_INVALID_STATE;
+  s_ctx = (struct adc_continuous_ctx_t){
+    .frame_bytes = hdl_config->conv_frame_size,
+    .pool_bytes = hdl_config->max_store_buf_size,
+  };
+  if (xTaskCreate(frame_task, "fake_adc_dma", 2048, &s_ctx, 10, NULL) != pdPASS) {
+    return ESP_ERR_NO_MEM;
+  }
+  s_ctx_used = true;
+  *ret_handle = &s_ctx;
+  return ESP_OK;
+}
+
+esp_err_t adc_continuous_config(
+  adc_continuous_handle_t handle, const adc_continuous_config_t *config
+) {
+  if (!handle || !config || !config->pattern_num || config->pattern_num > ADC1_CHANNEL_MAX)
+    return ESP_ERR_INVALID_ARG;
+  if (config->conv_mode != ADC_CONV_SINGLE_UNIT_1) return ESP_ERR_NOT_SUPPORTED;
+  for (uint32_t i = 0; i < config->pattern_num; i++) {
+    const adc_digi_pattern_config_t *p = &config->adc_pattern[i];
+    if (p->channel >= ADC1_CHANNEL_MAX || p->atten > ADC_ATTEN_DB_12) return ESP_ERR_INVALID_ARG;
+  }
+
+  taskENTER_CRITICAL(&s_lock);
+  bool started = handle->started;
+  if (!started) {
+    // the attenuation is not modeled, the helper converts with its calibration
+    for (uint32_t i = 0; i < config->pattern_num; i++) {
+      handle->pattern[i] = config->adc_pattern[i];
+    }
+    handle->pattern_len = config->pattern_num;
+    handle->freq_hz = config->sample_freq_hz;
+  }
+  taskEXIT_CRITICAL(&s_lock);
+  return started ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+esp_err_t adc_continuous_register_event_callbacks(
+  adc_continuous_handle_t handle, const adc_continuous_evt_cbs_t *cbs, void *user_data
+) {
+  if (!handle || !cbs) return ESP_ERR_INVALID_ARG;
+  if (handle->started) return ESP_ERR_INVALID_STATE;
+  handle->cbs = *cbs;
+  handle->user_data = user_data;
+  return ESP_OK;
+}
+
+esp_err_t adc_continuous_start(adc_continuous_handle_t handle) {
+  if (!handle) return ESP_ERR_INVALID_ARG;
+  if (!handle->pattern_len || !handle->freq_hz) return ESP_ERR_INVALID_STATE;
+  taskENTER_CRITICAL(&s_lock);
+  handle->start_us = esp_timer_get_time();
+  handle->done = 0;
+  handle->pattern_pos = 0;
+  handle->started = true;
+  taskEXIT_CRITICAL(&s_lock);
+  return ESP_OK;
+}
+
+esp_err_t adc_continuous_read(
+  adc_continuous_handle_t handle, uint8_t *buf, uint32_t length_max, uint32_t *out_length,
+  uint32_t timeout_ms
+) {
+  uint64_t t0 = sn_fake_hal_now_ns();
+  if (!handle || !buf || !out_length) return ESP_ERR_INVALID_ARG;
+  *out_length = 0;
+
+  // the conversions are made when read, as many as the rate gave since the last read
+  int64_t now = esp_timer_get_time();
+  taskENTER_CRITICAL(&s_lock);
+  if (!handle->started) {
+    taskEXIT_CRITICAL(&s_lock);
+    return ESP_ERR_INVALID_STATE;
+  }
+  uint64_t due = (uint64_t)(now - handle->start_us) * handle->freq_hz / 1000000;
+  uint64_t pool = handle->pool_bytes / SOC_ADC_DIGI_RESULT_BYTES;
+  // a full pool drops the oldest conversions
+  if (due - handle->done > pool) handle->done = due - pool;
+  uint64_t n = due - handle->done;
+  if (n > length_max / SOC_ADC_DIGI_RESULT_BYTES) n = length_max / SOC_ADC_DIGI_RESULT_BYTES;
+  for (uint64_t i = 0; i < n; i++) {
+    const adc_digi_pattern_config_t *p =
+      &handle->pattern[handle->pattern_pos++ % handle->pattern_len];
+    adc_digi_output_data_t d = {
+      .type1 = {.data = sample(p->channel, p->bit_width, now), .channel = p->channel}
+    };
+    memcpy(&buf[i * SOC_ADC_DIGI_RESULT_BYTES], &d, SOC_ADC_DIGI_RESULT_BYTES);
+  }
+  handle->done += n;
+  taskEXIT_CRITICAL(&s_lock);
+
+  // no waiting, the helper drains with timeout 0
+  (void)timeout_ms;
+  if (!n) return ESP_ERR_TIMEOUT;
+  *out_length = (uint32_t)n * SOC_ADC_DIGI_RESULT_BYTES;
+  sn_fake_hal_record(SN_FAKE_CALL_adc_continuous_read, t0);
+  return ESP_OK;
+}
+
+esp_err_t adc_continuous_stop(adc_continuous_handle_t handle) {
+  if (!handle) return ESP_ERR_INVALID_ARG;
+  taskENTER_CRITICAL(&s_lock);
+  bool started = handle->started;
+  handle->started = false;
+  taskEXIT_CRITICAL(&s_lock);
+  return started ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t adc_continuous_deinit(adc_continuous_handle_t handle) {
+  if (!handle) return ESP_ERR_INVALID_ARG;
+  // the frame task stays, a new handle reuses it
+  return handle->started ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+struct adc_cali_scheme_t {
+  adc_atten_t atten;
+  adc_bitwidth_t bitwidth;
+};
+
+esp_err_t adc_cali_create_scheme_line_fitting(
+  const adc_cali_line_fitting_config_t *config, adc_cali_handle_t *ret_handle
+) {
+  if (!config || !ret_handle || config->atten > ADC_ATTEN_DB_12) return ESP_ERR_INVALID_ARG;
+  struct adc_cali_scheme_t *scheme = malloc(sizeof(*scheme));
+  if (!scheme) return ESP_ERR_NO_MEM;
+  scheme->atten = config->atten;
+  scheme->bitwidth = config->bitwidth ? config->bitwidth : ADC_BITWIDTH_12;
+  *ret_handle = scheme;
+  return ESP_OK;
+}
+
+esp_err_t adc_cali_delete_scheme_line_fitting(adc_cali_handle_t handle) {
+  if (!handle) return ESP_ERR_INVALID_ARG;
+  free(handle);
+  return ESP_OK;
+}
+
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t handle, int raw, int *voltage) {
+  if (!handle || !voltage || raw < 0) return ESP_ERR_INVALID_ARG;
+  *voltage = (int)((uint32_t)raw * s_full_scale_mv[handle->atten] / ((1u << handle->bitwidth) - 1));
+  return ESP_OK;
+}
+
+// --------------------------------------------------------------------------------
+// Scripting
+// --------------------------------------------------------------------------------
+
+static void set_waveform(adc1_channel_t ch, int raw, int *wave, size_t len, uint32_t step_ms) {
+  taskENTER_CRITICAL(&s_lock);
+  int *old = s_adc[ch].wave;
+  s_adc[ch].raw = raw;
+  s_adc[ch].wave = wave;
+  s_adc[ch].wave_len = len;
+  s_adc[ch].step_ms = step_ms;
+  s_adc[ch].cursor = 0;
+  taskEXIT_CRITICAL(&s_lock);
+  free(old);
+}
+
+void sn_fake_adc_set_raw(adc1_channel_t ch, int raw) {
+  if (ch < ADC1_CHANNEL_0 || ch >= ADC1_CHANNEL_MAX) return;
+  set_waveform(ch, raw, NULL, 0, 0);
+}
+
+esp_err_t sn_fake_adc_load_waveform(adc1_channel_t ch, const char *path, uint32_t step_ms) {
+  if (ch < ADC1_CHANNEL_0 || ch >= ADC1_CHANNEL_MAX || !path) return ESP_ERR_INVALID_ARG;
+
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    ESP_LOGE(TAG, "Cannot open waveform %s", path);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  int *wave = NULL;
+  size_t len = 0, cap = 0;
+  char line[WAVEFORM_LINE_MAX];
+  while (fgets(line, sizeof(line), f)) {
+    char *end = NULL;
+    long v = strtol(line, &end, 10);
+    if (line[0] == '#' || end == line) continue;
+    if (len == cap) {
+      cap = cap ? cap * 2 : 64;
+      int *grown = realloc(wave, cap * sizeof(int));
+      if (!grown) {
+        free(wave);
+        fclose(f);
+        return ESP_ERR_NO_MEM;
+      }
+      wave = grown;
+    }
+    wave[len++] = (int)v;
+  }
+  fclose(f);
+
+  if (!len) {
+    ESP_LOGE(TAG, "Waveform %s has no sample", path);
+    free(wave);
+    return ESP_ERR_INVALID_SIZE;
+  }
+  set_waveform(ch, wave[0], wave, len, step_ms);
+  ESP_LOGI(TAG, "ch%d plays %s (%u samples)", ch, path, (unsigned)len);
+  return ESP_OK;
+}
@@ -0,0 +1,289 @@
+#include "driver/rmt_rx.h"
+#include "driver/rmt_tx.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sn_fake_hal.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define FAKE_DHT_MAX_PIN     40
+#define FAKE_RMT_CHANNELS    8
+#define FAKE_DHT11_START_US  18000 // the dht11 wants at least 18 ms, the others about 1
+#define FAKE_DHT_WAIT_US     30    // released line before the sensor answers
+#define FAKE_DHT_RESPONSE_US 80
+#define FAKE_DHT_BIT_LOW_US  50
+#define FAKE_DHT_BIT_ZERO_US 26
+#define FAKE_DHT_BIT_ONE_US  70
+
+typedef struct {
+  bool attached;
+  int16_t temperature; // x10
+  int16_t humidity;    // x10
+  sn_fake_dht_fault_e fault;
+  int fault_count;
+} fake_dht_t;
+
+struct rmt_channel_t {
+  bool used;
+  bool tx;
+  bool enabled;
+  gpio_num_t gpio;
+  uint32_t resolution_hz;
+  // rx only
+  rmt_rx_done_callback_t on_recv_done;
+  void *user_ctx;
+  rmt_symbol_word_t *buf;
+  size_t buf_symbols;
+  bool armed;
+  size_t received; // symbols of the frame written into buf
+  uint64_t due_ns; // when the receive completes
+};
+
+// the copy encoder has no state, every handle is the same one
+struct rmt_encoder_t {
+  int unused;
+};
+
+static fake_dht_t s_dht[FAKE_DHT_MAX_PIN];
+static struct rmt_channel_t s_chan[FAKE_RMT_CHANNELS];
+static struct rmt_encoder_t s_copy_encoder;
+static TaskHandle_t s_task;
+static uint32_t s_latency_us = 0;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// --------------------------------------------------------------------------------
+// Wire
+// --------------------------------------------------------------------------------
+
+// 40-bit frame as sent on the wire: humidity, temperature, checksum
+static void encode_frame(bool dht11, int16_t hum, int16_t temp, uint8_t data[5]) {
+  if (dht11) {
+    // integral and decimal bytes, the sign is bit 7 of the temperature decimal byte
+    uint16_t t = (uint16_t)abs(temp);
+    data[0] = hum / 10;
+    data[1] = hum % 10;
+    data[2] = t / 10;
+    data[3] = (t % 10) | (temp < 0 ? 0x80 : 0);
+  } else {
+    // 16-bit big endian x10 values, sign and magnitude temperature
+    uint16_t t = (uint16_t)abs(temp) | (temp < 0 ? 0x8000 : 0);
+    data[0] = (uint16_t)hum >> 8;
+    data[1] = (uint16_t)hum & 0xff;
+    data[2] = t >> 8;
+    data[3] = t & 0xff;
+  }
+  data[4] = data[0] + data[1] + data[2] + data[3];
+}
+
+static inline uint16_t ticks(const struct rmt_channel_t *c, uint32_t us) {
+  return (uint16_t)((uint64_t)us * c->resolution_hz / 1000000);
+}
+
+static size_t put(const struct rmt_channel_t *rx, size_t n, uint32_t low_us, uint32_t high_us) {
+  if (n >= rx->buf_symbols) return n;
+  rx->buf[n] = (rmt_symbol_word_t){
+    .level0 = 0, .duration0 = ticks(rx, low_us), .level1 = 1, .duration1 = ticks(rx, high_us)
+  };
+  return n + 1;
+}
+
+// What the receiver captures: the start pulse looped back from the transmitter, then
+// the answer of the sensor if one is attached. The line idles high at the end, which
+// the receiver reports as a 0 duration
+static size_t capture(const struct rmt_channel_t *rx, uint32_t start_us, fake_dht_t *dev) {
+  bool answers = dev->attached && !(dev->fault_count > 0 && dev->fault == SN_FAKE_DHT_TIMEOUT);
+  size_t n = put(rx, 0, start_us, answers ? FAKE_DHT_WAIT_US : 0);
+  if (!answers) return n;
+
+  uint8_t data[5];
+  encode_frame(start_us >= FAKE_DHT11_START_US, dev->humidity, dev->temperature, data);
+  if (dev->fault_count > 0 && dev->fault == SN_FAKE_DHT_BAD_CHECKSUM) data[1] ^= 0x04;
+
+  n = put(rx, n, FAKE_DHT_RESPONSE_US, FAKE_DHT_RESPONSE_US);
+  for (int b = 0; b < 40; b++) {
+    bool one = data[b / 8] & (0x80 >> (b % 8));
+    n = put(rx, n, FAKE_DHT_BIT_LOW_US, one ? FAKE_DHT_BIT_ONE_US : FAKE_DHT_BIT_ZERO_US);
+  }
+  return put(rx, n, FAKE_DHT_BIT_LOW_US, 0);
+}
+
+// Stands in for the rmt interrupt, completes the receives that are due
+static void rmt_task(void *arg) {
+  while (1) {
+    vTaskDelay(1);
+    for (int i = 0; i < FAKE_RMT_CHANNELS; i++) {
+      struct rmt_channel_t *c = &s_chan[i];
+      rmt_rx_done_event_data_t evt = {.flags = {.is_last = 1}};
+      taskENTER_CRITICAL(&s_lock);
+      bool done = c->used && !c->tx && c->armed && c->received
+                  && sn_fake_hal_now_ns() >= c->due_ns;
+      if (done) {
+        c->armed = false;
+        evt.received_symbols = c->buf;
+        evt.num_symbols = c->received;
+      }
+      taskEXIT_CRITICAL(&s_lock);
+      if (done && c->on_recv_done) c->on_recv_done(c, &evt, c->user_ctx);
+    }
+  }
+}
+
+// --------------------------------------------------------------------------------
+// RMT
+// --------------------------------------------------------------------------------
+
+static esp_err_t new_channel(
+  bool tx, gpio_num_t gpio, uint32_t resolution_hz, rmt_channel_handle_t *ret_chan
+) {
+  if (gpio < 0 || gpio >= FAKE_DHT_MAX_PIN || !resolution_hz || !ret_chan) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!s_task && xTaskCreate(rmt_task, "fake_rmt", 2048, NULL, 10, &s_task) != pdPASS) {
+    return ESP_ERR_NO_MEM;
+  }
+  taskENTER_CRITICAL(&s_lock);
+  struct rmt_channel_t *c = NULL;
+  for (int i = 0; i < FAKE_RMT_CHANNELS && !c; i++) {
+    if (!s_chan[i].used) c = &s_chan[i];
+  }
+  if (c) {
+    *c = (struct rmt_channel_t){
+      .used = true, .tx = tx, .gpio = gpio, .resolution_hz = resolution_hz
+    };
+  }
+  taskEXIT_CRITICAL(&s_lock);
+  if (!c) return ESP_ERR_NOT_FOUND;
+  *ret_chan = c;
+  return ESP_OK;
+}
+
+esp_err_t rmt_new_tx_channel(
+  const rmt_tx_channel_config_t *config, rmt_channel_handle_t *ret_chan
+) {
+  if (!config) return ESP_ERR_INVALID_ARG;
+  return new_channel(true, config->gpio_num, config->resolution_hz, ret_chan);
+}
+
+esp_err_t rmt_new_rx_channel(
+  const rmt_rx_channel_config_t *config, rmt_channel_handle_t *ret_chan
+) {
+  if (!config) return ESP_ERR_INVALID_ARG;
+  return new_channel(false, config->gpio_num, config->resolution_hz, ret_chan);
+}
+
+esp_err_t rmt_del_channel(rmt_channel_handle_t channel) {
+  if (!channel || !channel->used) return ESP_ERR_INVALID_ARG;
+  if (channel->enabled) return ESP_ERR_INVALID_STATE;
+  taskENTER_CRITICAL(&s_lock);
+  *channel = (struct rmt_channel_t){0};
+  taskEXIT_CRITICAL(&s_lock);
+  return ESP_OK;
+}
+
+esp_err_t rmt_enable(rmt_channel_handle_t channel) {
+  if (!channel || !channel->used) return ESP_ERR_INVALID_ARG;
+  if (channel->enabled) return ESP_ERR_INVALID_STATE;
+  channel->enabled = true;
+  return ESP_OK;
+}
+
+// a receive in flight is dropped
+esp_err_t rmt_disable(rmt_channel_handle_t channel) {
+  if (!channel || !channel->used) return ESP_ERR_INVALID_ARG;
+  if (!channel->enabled) return ESP_ERR_INVALID_STATE;
+  taskENTER_CRITICAL(&s_lock);
+  channel->enabled = false;
+  channel->armed = false;
+  taskEXIT_CRITICAL(&s_lock);
+  return ESP_OK;
+}
+
+esp_err_t rmt_new_copy_encoder(
+  const rmt_copy_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder
+) {
+  if (!config || !ret_encoder) return ESP_ERR_INVALID_ARG;
+  *ret_encoder = &s_copy_encoder;
+  return ESP_OK;
+}
+
+esp_err_t rmt_del_encoder(rmt_encoder_handle_t encoder) {
+  return encoder ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t rmt_rx_register_event_callbacks(
+  rmt_channel_handle_t rx_channel, const rmt_rx_event_callbacks_t *cbs, void *user_data
+) {
+  if (!rx_channel || rx_channel->tx || !cbs) return ESP_ERR_INVALID_ARG;
+  if (rx_channel->enabled) return ESP_ERR_INVALID_STATE;
+  rx_channel->on_recv_done = cbs->on_recv_done;
+  rx_channel->user_ctx = user_data;
+  return ESP_OK;
+}
+
+esp_err_t rmt_receive(
+  rmt_channel_handle_t rx_channel, void *buffer, size_t buffer_size,
+  const rmt_receive_config_t *config
+) {
+  if (!rx_channel || rx_channel->tx || !buffer || !config) return ESP_ERR_INVALID_ARG;
+  if (!rx_channel->enabled || rx_channel->armed) return ESP_ERR_INVALID_STATE;
+  taskENTER_CRITICAL(&s_lock);
+  rx_channel->buf = buffer;
+  rx_channel->buf_symbols = buffer_size / sizeof(rmt_symbol_word_t);
+  rx_channel->received = 0;
+  rx_channel->armed = true;
+  taskEXIT_CRITICAL(&s_lock);
+  return ESP_OK;
+}
+
+// Only a leading low pulse is understood, as the start signal of a dht
+esp_err_t rmt_transmit(
+  rmt_channel_handle_t tx_channel, rmt_encoder_handle_t encoder, const void *payload,
+  size_t payload_bytes, const rmt_transmit_config_t *config
+) {
+  uint64_t t0 = sn_fake_hal_now_ns();
+  if (!tx_channel || !tx_channel->tx || !encoder || !payload || !config
+      || payload_bytes < sizeof(rmt_symbol_word_t)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!tx_channel->enabled) return ESP_ERR_INVALID_STATE;
+  const rmt_symbol_word_t *sym = payload;
+  uint32_t start_us =
+    sym->level0 ? 0 : (uint32_t)((uint64_t)sym->duration0 * 1000000 / tx_channel->resolution_hz);
+
+  taskENTER_CRITICAL(&s_lock);
+  fake_dht_t *dev = &s_dht[tx_channel->gpio];
+  for (int i = 0; i < FAKE_RMT_CHANNELS; i++) {
+    struct rmt_channel_t *rx = &s_chan[i];
+    if (!rx->used || rx->tx || !rx->armed || rx->gpio != tx_channel->gpio) continue;
+    rx->received = capture(rx, start_us, dev);
+    rx->due_ns = t0 + (uint64_t)s_latency_us * 1000;
+  }
+  if (dev->fault_count > 0) dev->fault_count--;
+  taskEXIT_CRITICAL(&s_lock);
+
+  sn_fake_hal_record(SN_FAKE_CALL_rmt_transmit, t0);
+  return ESP_OK;
+}
+
+// --------------------------------------------------------------------------------
+// Scripting
+// --------------------------------------------------------------------------------
+
+void sn_fake_dht_set(gpio_num_t pin, float temperature, float humidity) {
+  if (pin < 0 || pin >= FAKE_DHT_MAX_PIN) return;
+  taskENTER_CRITICAL(&s_lock);
+  s_dht[pin].attached = true;
+  s_dht[pin].temperature = (int16_t)lroundf(temperature * 10);
+  s_dht[pin].humidity = (int16_t)lroundf(humidity * 10);
+  taskEXIT_CRITICAL(&s_lock);
+}
+
+void sn_fake_dht_inject_fault(gpio_num_t pin, sn_fake_dht_fault_e fault, int count) {
+  if (pin < 0 || pin >= FAKE_DHT_MAX_PIN) return;
+  taskENTER_CRITICAL(&s_lock);
+  s_dht[pin].fault = fault;
+  s_dht[pin].fault_count = fault == SN_FAKE_DHT_OK ? 0 : count;
+  taskEXIT_CRITICAL(&s_lock);
+}
+
+void sn_fake_dht_set_latency_us(uint32_t us) { s_latency_us = us; }
@@ -0,0 +1,243 @@
+#include "sn_fake_hal.h"
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "driver/spi_master.h"
+#include "esp_log.h"
+#include <stdbool.h>
+#include <time.h>
+
+static const char *TAG = "FAKE_HAL";
+
+#define FAKE_GPIO_MAX 40
+
+sn_fake_hal_call_stats_t gFakeHalStats[SN_FAKE_CALL_MAX];
+
+static const char *s_call_names[SN_FAKE_CALL_MAX] = {
+#define GEN_FAKE_CALL_NAME(NAME) #NAME,
+  SN_FAKE_HAL_CALLS(GEN_FAKE_CALL_NAME)
+#undef GEN_FAKE_CALL_NAME
+};
+
+uint64_t sn_fake_hal_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void sn_fake_hal_record(sn_fake_hal_call_e call, uint64_t start_ns) {
+  uint64_t ns = sn_fake_hal_now_ns() - start_ns;
+  sn_fake_hal_call_stats_t *s = &gFakeHalStats[call];
+  __atomic_fetch_add(&s->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&s->total_ns, ns, __ATOMIC_RELAXED);
+  uint64_t cur = __atomic_load_n(&s->max_ns, __ATOMIC_RELAXED);
+  while (ns > cur
+         && !__atomic_compare_exchange_n(
+           &s->max_ns, &cur, ns, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED
+         )) {
+  }
+}
+
+cJSON *sn_fake_hal_stats_to_json(void) {
+  cJSON *root = cJSON_CreateObject();
+  if (!root) return NULL;
+  for (int i = 0; i < SN_FAKE_CALL_MAX; i++) {
+    const sn_fake_hal_call_stats_t *s = &gFakeHalStats[i];
+    if (!s->count) continue;
+    const double v[3] = {(double)s->count, (double)s->total_ns, (double)s->max_ns};
+    cJSON_AddItemToObject(root, s_call_names[i], cJSON_CreateDoubleArray(v, 3));
+  }
+  return root;
+}
+
+void sn_fake_hal_stats_reset(void) {
+  for (int i = 0; i < SN_FAKE_CALL_MAX; i++) {
+    __atomic_store_n(&gFakeHalStats[i].count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&gFakeHalStats[i].total_ns, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&gFakeHalStats[i].max_ns, 0, __ATOMIC_RELAXED);
+  }
+}
+
+// --------------------------------------------------------------------------------
+// GPIO
+// --------------------------------------------------------------------------------
+
+typedef struct {
+  gpio_mode_t mode;
+  int input;
+  int output; // -1 until driven
+  uint32_t edges;
+} fake_gpio_t;
+
+static fake_gpio_t s_gpio[FAKE_GPIO_MAX];
+
+static inline bool gpio_valid(gpio_num_t pin) { return pin >= 0 && pin < FAKE_GPIO_MAX; }
+
+static inline bool gpio_is_output(gpio_mode_t mode) {
+  return mode != GPIO_MODE_DISABLE && mode != GPIO_MODE_INPUT;
+}
+
+esp_err_t gpio_config(const gpio_config_t *cfg) {
+  uint64_t t0 = sn_fake_hal_now_ns();
+  if (!cfg || !cfg->pin_bit_mask || cfg->pin_bit_mask >> FAKE_GPIO_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  for (int pin = 0; pin < FAKE_GPIO_MAX; pin++) {
+    if (!(cfg->pin_bit_mask & (1ULL << pin))) continue;
+    s_gpio[pin].mode = cfg->mode;
+    s_gpio[pin].output = gpio_is_output(cfg->mode) ? 0 : -1;
+    s_gpio[pin].input = cfg->pull_up_en == GPIO_PULLUP_ENABLE;
+  }
+  sn_fake_hal_record(SN_FAKE_CALL_gpio_config, t0);
+  return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode) {
+  if (!gpio_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+  s_gpio[gpio_num].mode = mode;
+  if (gpio_is_output(mode) && s_gpio[gpio_num].output < 0) s_gpio[gpio_num].output = 0;
+  return ESP_OK;
+}
+
+// the pin reads high until something drives it
+esp_err_t gpio_pullup_en(gpio_num_t gpio_num) {
+  if (!gpio_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+  s_gpio[gpio_num].input = 1;
+  return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+  uint64_t t0 = sn_fake_hal_now_ns();
+  if (!gpio_valid(gpio_num)) return ESP_ERR_INVALID_ARG;
+  fake_gpio_t *g = &s_gpio[gpio_num];
+  // like the chip, the level is latched even before the pin is an output
+  int next = level ? 1 : 0;
+  if (g->output >= 0 && g->output != next) __atomic_fetch_add(&g->edges, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&g->output, next, __ATOMIC_RELAXED);
+  sn_fake_hal_record(SN_FAKE_CALL_gpio_set_level, t0);
+  return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+  uint64_t t0 = sn_fake_hal_now_ns();
+  if (!gpio_valid(gpio_num)) return 0;
+  const fake_gpio_t *g = &s_gpio[gpio_num];
+  int level = gpio_is_output(g->mode) && g->mode != GPIO_MODE_OUTPUT_OD
+                ? __atomic_load_n(&g->output, __ATOMIC_RELAXED)
+                : __atomic_load_n(&g->input, __ATOMIC_RELAXED);
+  sn_fake_hal_record(SN_FAKE_CALL_gpio_get_level, t0);
+  return level;
+}
+
+void sn_fake_gpio_set_input(gpio_num_t pin, int level) {
+  if (gpio_valid(pin)) __atomic_store_n(&s_gpio[pin].input, level ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+int sn_fake_gpio_get_output(gpio_num_t pin) {
+  return gpio_valid(pin) ? __atomic_load_n(&s_gpio[pin].output, __ATOMIC_RELAXED) : -1;
+}
+
+uint32_t sn_fake_gpio_get_edges(gpio_num_t pin) {
+  return gpio_valid(pin) ? __atomic_load_n(&s_gpio[pin].edges, __ATOMIC_RELAXED) : 0;
+}
+
+// --------------------------------------------------------------------------------
+// LEDC
+// --------------------------------------------------------------------------------
+
+typedef struct {
+  int gpio_num;
+  ledc_timer_t timer;
+  uint32_t duty;    // pending, set_duty
+  uint32_t applied; // latched by update_duty
+} fake_ledc_channel_t;
+
+static ledc_timer_bit_t s_timer_bits[LEDC_TIMER_3 + 1];
+static fake_ledc_channel_t s_ledc[LEDC_CHANNEL_MAX];
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf) {
+  if (!timer_conf || timer_conf->timer_num > LEDC_TIMER_3) return ESP_ERR_INVALID_ARG;
+  if (timer_conf->duty_resolution < 1 || timer_conf->duty_resolution >= LEDC_TIMER_BIT_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  s_timer_bits[timer_conf->timer_num] = timer_conf->duty_resolution;
+  return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *ledc_conf) {
+  uint64_t t0 = sn_fake_hal_now_ns();
+  if (!ledc_conf || ledc_conf->channel >= LEDC_CHANNEL_MAX) return ESP_ERR_INVALID_ARG;
+  if (ledc_conf->timer_sel > LEDC_TIMER_3) return ESP_ERR_INVALID_ARG;
+  if (!s_timer_bits[ledc_conf->timer_sel]) {
+    ESP_LOGE(TAG, "ledc timer %d is not configured", ledc_conf->timer_sel);
+    return ESP_ERR_INVALID_STATE;
+  }
+  s_ledc[ledc_conf->channel] = (fake_ledc_channel_t){
+    .gpio_num = ledc_conf->gpio_num,
+    .timer = ledc_conf->timer_sel,
+    .duty = ledc_conf->duty,
+    .applied = ledc_conf->duty,
+  };
+  sn_fake_hal_record(SN_FAKE_CALL_ledc_channel_config, t0);
+  return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty) {
+  uint64_t t0 = sn_fake_hal_now_ns();
+  if (speed_mode >= LEDC_SPEED_MODE_MAX || channel >= LEDC_CHANNEL_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  uint32_t max = 1U << s_timer_bits[s_ledc[channel].timer];
+  if (duty > max) {
+    ESP_LOGW(TAG, "ledc duty %u above %u on channel %d", (unsigned)duty, (unsigned)max, channel);
+    return ESP_ERR_INVALID_ARG;
+  }
+  __atomic_store_n(&s_ledc[channel].duty, duty, __ATOMIC_RELAXED);
+  sn_fake_hal_record(SN_FAKE_CALL_ledc_set_duty, t0);
+  return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+  uint64_t t0 = sn_fake_hal_now_ns();
+  if (speed_mode >= LEDC_SPEED_MODE_MAX || channel >= LEDC_CHANNEL_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  uint32_t duty = __atomic_load_n(&s_ledc[channel].duty, __ATOMIC_RELAXED);
+  __atomic_store_n(&s_ledc[channel].applied, duty, __ATOMIC_RELAXED);
+  sn_fake_hal_record(SN_FAKE_CALL_ledc_update_duty, t0);
+  return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+  if (channel >= LEDC_CHANNEL_MAX) return 0;
+  return __atomic_load_n(&s_ledc[channel].applied, __ATOMIC_RELAXED);
+}
+
+float sn_fake_ledc_get_level(ledc_channel_t channel) {
+  if (channel >= LEDC_CHANNEL_MAX || !s_timer_bits[s_ledc[channel].timer]) return 0.0f;
+  uint32_t max = 1U << s_timer_bits[s_ledc[channel].timer];
+  return (float)ledc_get_duty(LEDC_LOW_SPEED_MODE, channel) / (float)max;
+}
+
+// --------------------------------------------------------------------------------
+// SPI
+// --------------------------------------------------------------------------------
+
+// no device answers on the fake hosts, only the ownership is checked
+static bool s_spi_used[SPI_HOST_MAX];
+
+esp_err_t spi_bus_initialize(
+  spi_host_device_t host_id, const spi_bus_config_t *bus_config, spi_dma_chan_t dma_chan
+) {
+  if (host_id < 0 || host_id >= SPI_HOST_MAX || !bus_config) return ESP_ERR_INVALID_ARG;
+  if (s_spi_used[host_id]) return ESP_ERR_INVALID_STATE;
+  s_spi_used[host_id] = true;
+  return ESP_OK;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t host_id) {
+  if (host_id < 0 || host_id >= SPI_HOST_MAX || !s_spi_used[host_id]) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  s_spi_used[host_id] = false;
+  return ESP_OK;
+}
@@ -0,0 +1,655 @@
+#include "mqtt_client.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sn_fake_hal.h"
+#include "sys/lock.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "FAKE_MQTT";
+
+ESP_EVENT_DEFINE_BASE(MQTT_EVENTS);
+
+#define FAKE_MQTT_FILTER_LEN  128
+#define FAKE_MQTT_BUCKETS     4096 // exact topic filters, power of two
+#define FAKE_MQTT_DEFAULT_RTO 200
+// the client event handlers run on the broker task, same budget as the esp-mqtt task
+#define FAKE_MQTT_TASK_STACK  6144
+#define FAKE_MQTT_TASK_PRIO   5
+
+typedef enum {
+  HOP_UP = 0, // client to broker
+  HOP_DOWN,   // broker to client
+  HOP_MAX
+} fake_hop_e;
+
+// A filter without wildcards sits in the bucket of its hash, the others in one list
+// that every publish walks
+typedef struct fake_sub_s {
+  struct fake_sub_s *next;         // bucket or wildcard list
+  struct fake_sub_s *client_next;  // subscriptions of the same client
+  esp_mqtt_client_handle_t client; // NULL for the backend
+  sn_fake_mqtt_sink_t sink;        // backend subscriptions only
+  void *arg;
+  uint32_t hash;
+  bool wildcard;
+  char filter[];
+} fake_sub_t;
+
+// Clients are never freed, a destroyed one goes to the free list with its gen bumped
+// so the messages still in flight for it are dropped
+struct esp_mqtt_client {
+  bool used;
+  bool connected;
+  uint32_t gen;
+  esp_event_handler_t handler;
+  void *handler_arg;
+  esp_mqtt_event_id_t handler_event;
+  fake_sub_t *subs;
+  int next_msg_id;
+  int64_t last_due_us[HOP_MAX]; // keeps each direction in order
+  uint32_t route_mark;          // last route that picked this client
+  char *will_topic;
+  char *will_msg;
+  int will_len;
+  int will_qos;
+  struct esp_mqtt_client *next_free;
+};
+
+// topic and data are stored after the struct
+typedef struct {
+  int64_t due_us;
+  uint32_t seq; // ties broken in scheduling order
+  fake_hop_e hop;
+  esp_mqtt_client_handle_t client; // NULL for backend publishes
+  uint32_t gen;
+  esp_mqtt_event_id_t event;
+  int msg_id;
+  int qos;
+  char *topic;
+  char *data;
+  int len;
+} fake_msg_t;
+
+typedef struct {
+  sn_fake_mqtt_sink_t sink;
+  void *arg;
+} fake_sink_t;
+
+static fake_sub_t *s_exact[FAKE_MQTT_BUCKETS];
+static fake_sub_t *s_wild = NULL;
+static fake_sub_t *s_backend = NULL; // client_next list of the backend subscriptions
+static struct esp_mqtt_client *s_free = NULL;
+static sn_fake_mqtt_link_t s_link = {.rto_ms = FAKE_MQTT_DEFAULT_RTO};
+static uint32_t s_rng = 0x2545f491;
+
+// min-heap of the messages in flight, ordered by due time
+static fake_msg_t **s_heap = NULL;
+static size_t s_heap_len = 0;
+static size_t s_heap_cap = 0;
+static uint32_t s_seq = 0;
+
+// match results of a route, only the broker task routes
+static uint32_t s_route_mark = 0;
+static esp_mqtt_client_handle_t *s_targets = NULL;
+static size_t s_targets_cap = 0;
+static fake_sink_t *s_sinks = NULL;
+static size_t s_sinks_cap = 0;
+
+static _lock_t s_lock;
+static SemaphoreHandle_t s_wake = NULL;
+
+static struct {
+  uint32_t up;
+  uint32_t down;
+  uint32_t retransmits;
+  uint32_t unrouted;
+  uint32_t pending_max;
+  uint32_t connects;
+  uint32_t wills;
+  uint32_t clients;
+  uint32_t clients_max;
+  uint32_t subs;
+} s_stats;
+
+// --------------------------------------------------------------------------------
+// Delivery queue, under s_lock
+// --------------------------------------------------------------------------------
+
+static inline uint32_t next_rand(void) {
+  s_rng ^= s_rng << 13;
+  s_rng ^= s_rng >> 17;
+  s_rng ^= s_rng << 5;
+  return s_rng;
+}
+
+static inline bool msg_before(const fake_msg_t *a, const fake_msg_t *b) {
+  return a->due_us != b->due_us ? a->due_us < b->due_us : (int32_t)(a->seq - b->seq) < 0;
+}
+
+static bool heap_push(fake_msg_t *m) {
+  if (s_heap_len == s_heap_cap) {
+    size_t cap = s_heap_cap ? s_heap_cap * 2 : 64;
+    fake_msg_t **heap = realloc(s_heap, cap * sizeof(*heap));
+    if (!heap) return false;
+    s_heap = heap;
+    s_heap_cap = cap;
+  }
+  size_t i = s_heap_len++;
+  while (i && msg_before(m, s_heap[(i - 1) / 2])) {
+    s_heap[i] = s_heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  s_heap[i] = m;
+  return true;
+}
+
+static fake_msg_t *heap_pop(void) {
+  fake_msg_t *top = s_heap[0];
+  fake_msg_t *last = s_heap[--s_heap_len];
+  size_t i = 0;
+  for (;;) {
+    size_t c = 2 * i + 1;
+    if (c >= s_heap_len) break;
+    if (c + 1 < s_heap_len && msg_before(s_heap[c + 1], s_heap[c])) c++;
+    if (!msg_before(s_heap[c], last)) break;
+    s_heap[i] = s_heap[c];
+    i = c;
+  }
+  if (s_heap_len) s_heap[i] = last;
+  return top;
+}
+
+// arrival time at the other end of the client's link
+static int64_t link_due(esp_mqtt_client_handle_t c, fake_hop_e hop) {
+  int64_t due = esp_timer_get_time() + s_link.delay_ms * 1000LL;
+  if (s_link.jitter_ms) due += next_rand() % (s_link.jitter_ms * 1000 + 1);
+  uint32_t rto_ms = s_link.rto_ms;
+  while (s_link.loss_permille && next_rand() % 1000 < s_link.loss_permille) {
+    due += rto_ms * 1000LL;
+    rto_ms *= 2;
+    s_stats.retransmits++;
+  }
+  if (due < c->last_due_us[hop]) due = c->last_due_us[hop];
+  c->last_due_us[hop] = due;
+  return due;
+}
+
+// --------------------------------------------------------------------------------
+// Subscriptions, under s_lock
+// --------------------------------------------------------------------------------
+
+static inline uint32_t hash_topic(const char *s) {
+  uint32_t h = 2166136261u;
+  while (*s) h = (h ^ (uint8_t)*s++) * 16777619u;
+  return h;
+}
+
+static inline fake_sub_t **sub_list(const fake_sub_t *sub) {
+  return sub->wildcard ? &s_wild : &s_exact[sub->hash & (FAKE_MQTT_BUCKETS - 1)];
+}
+
+static fake_sub_t *sub_add(
+  esp_mqtt_client_handle_t c, const char *filter, sn_fake_mqtt_sink_t sink, void *arg
+) {
+  size_t len = strlen(filter);
+  fake_sub_t *sub = calloc(1, sizeof(fake_sub_t) + len + 1);
+  if (!sub) return NULL;
+  memcpy(sub->filter, filter, len);
+  sub->client = c;
+  sub->sink = sink;
+  sub->arg = arg;
+  sub->hash = hash_topic(filter);
+  sub->wildcard = strpbrk(filter, "+#") != NULL;
+
+  fake_sub_t **list = sub_list(sub);
+  sub->next = *list;
+  *list = sub;
+  fake_sub_t **owner = c ? &c->subs : &s_backend;
+  sub->client_next = *owner;
+  *owner = sub;
+  s_stats.subs++;
+  return sub;
+}
+
+static void sub_unlink(fake_sub_t *sub) {
+  for (fake_sub_t **p = sub_list(sub); *p; p = &(*p)->next) {
+    if (*p != sub) continue;
+    *p = sub->next;
+    break;
+  }
+  s_stats.subs--;
+}
+
+// clean session, a client that goes away loses its subscriptions
+static void client_clear_subs(esp_mqtt_client_handle_t c) {
+  while (c->subs) {
+    fake_sub_t *sub = c->subs;
+    c->subs = sub->client_next;
+    sub_unlink(sub);
+    free(sub);
+  }
+}
+
+static void client_clear_will(esp_mqtt_client_handle_t c) {
+  free(c->will_topic);
+  free(c->will_msg);
+  c->will_topic = NULL;
+  c->will_msg = NULL;
+  c->will_len = 0;
+}
+
+// --------------------------------------------------------------------------------
+// Broker
+// --------------------------------------------------------------------------------
+
+// '+' matches one level, '#' the remaining ones
+static bool topic_matches(const char *filter, const char *topic) {
+  while (*filter) {
+    if (*filter == '#') return true;
+    if (*filter == '+') {
+      while (*topic && *topic != '/') topic++;
+      filter++;
+      continue;
+    }
+    if (*filter++ != *topic++) return false;
+  }
+  return *topic == '\0';
+}
+
+static fake_msg_t *msg_new(
+  fake_hop_e hop, esp_mqtt_client_handle_t c, esp_mqtt_event_id_t event, const char *topic,
+  const char *data, int len
+) {
+  size_t topic_len = topic ? strlen(topic) : 0;
+  fake_msg_t *m = calloc(1, sizeof(fake_msg_t) + topic_len + 1 + len + 1);
+  if (!m) return NULL;
+  m->hop = hop;
+  m->client = c;
+  m->gen = c ? c->gen : 0;
+  m->event = event;
+  m->topic = (char *)(m + 1);
+  m->data = m->topic + topic_len + 1;
+  m->len = len;
+  if (topic_len) memcpy(m->topic, topic, topic_len);
+  if (len) memcpy(m->data, data, len);
+  return m;
+}
+
+static void schedule(fake_msg_t *m) {
+  _lock_acquire(&s_lock);
+  m->due_us = m->client ? link_due(m->client, m->hop) : esp_timer_get_time();
+  m->seq = s_seq++;
+  bool ok = heap_push(m);
+  if (s_heap_len > s_stats.pending_max) s_stats.pending_max = s_heap_len;
+  _lock_release(&s_lock);
+
+  if (!ok) {
+    ESP_LOGE(TAG, "Delivery queue full, dropping %s", m->topic);
+    free(m);
+    return;
+  }
+  xSemaphoreGive(s_wake);
+}
+
+static bool grow(void **buf, size_t *cap, size_t len, size_t elem) {
+  if (len < *cap) return true;
+  size_t new_cap = *cap ? *cap * 2 : 64;
+  void *p = realloc(*buf, new_cap * elem);
+  if (!p) return false;
+  *buf = p;
+  *cap = new_cap;
+  return true;
+}
+
+// a client with several matching filters gets the message once
+static void collect(const fake_sub_t *sub, size_t *sinks_len, size_t *targets_len) {
+  esp_mqtt_client_handle_t c = sub->client;
+  if (!c) {
+    if (!grow((void **)&s_sinks, &s_sinks_cap, *sinks_len, sizeof(*s_sinks))) return;
+    s_sinks[(*sinks_len)++] = (fake_sink_t){.sink = sub->sink, .arg = sub->arg};
+    return;
+  }
+  if (!c->connected || c->route_mark == s_route_mark) return;
+  if (!grow((void **)&s_targets, &s_targets_cap, *targets_len, sizeof(*s_targets))) return;
+  c->route_mark = s_route_mark;
+  s_targets[(*targets_len)++] = c;
+}
+
+static void route(const fake_msg_t *m) {
+  size_t sinks_len = 0, targets_len = 0;
+  uint32_t h = hash_topic(m->topic);
+
+  _lock_acquire(&s_lock);
+  if (m->client) s_stats.up++;
+  // 0 is the mark of a client that was never picked
+  if (++s_route_mark == 0) s_route_mark = 1;
+  for (fake_sub_t *sub = s_exact[h & (FAKE_MQTT_BUCKETS - 1)]; sub; sub = sub->next) {
+    if (sub->hash == h && strcmp(sub->filter, m->topic) == 0) {
+      collect(sub, &sinks_len, &targets_len);
+    }
+  }
+  for (fake_sub_t *sub = s_wild; sub; sub = sub->next) {
+    if (topic_matches(sub->filter, m->topic)) collect(sub, &sinks_len, &targets_len);
+  }
+  if (!sinks_len && !targets_len) s_stats.unrouted++;
+  _lock_release(&s_lock);
+
+  for (size_t i = 0; i < sinks_len; i++) s_sinks[i].sink(m->topic, m->data, m->len, s_sinks[i].arg);
+  for (size_t i = 0; i < targets_len; i++) {
+    fake_msg_t *out = msg_new(HOP_DOWN, s_targets[i], MQTT_EVENT_DATA, m->topic, m->data, m->len);
+    if (!out) continue;
+    out->qos = m->qos;
+    schedule(out);
+  }
+}
+
+static void deliver(const fake_msg_t *m) {
+  esp_mqtt_client_handle_t c = m->client;
+
+  _lock_acquire(&s_lock);
+  bool live = c->used && c->gen == m->gen;
+  if (live && m->event == MQTT_EVENT_CONNECTED && !c->connected) {
+    c->connected = true;
+    s_stats.connects++;
+  }
+  // the disconnect of a dropped client is the only event it still gets
+  if (m->event != MQTT_EVENT_DISCONNECTED) live = live && c->connected;
+  if (live && m->event == MQTT_EVENT_DATA) s_stats.down++;
+  esp_event_handler_t handler = c->handler;
+  void *handler_arg = c->handler_arg;
+  bool wanted = c->handler_event == MQTT_EVENT_ANY || c->handler_event == m->event;
+  _lock_release(&s_lock);
+
+  if (!live || !handler || !wanted) return;
+  esp_mqtt_event_t event = {
+    .event_id = m->event,
+    .client = c,
+    .data = m->data,
+    .data_len = m->len,
+    .total_data_len = m->len,
+    .topic = m->topic,
+    .topic_len = strlen(m->topic),
+    .msg_id = m->msg_id,
+    .qos = m->qos,
+  };
+  handler(handler_arg, MQTT_EVENTS, event.event_id, &event);
+}
+
+static void broker_task(void *arg) {
+  for (;;) {
+    fake_msg_t *m = NULL;
+    TickType_t wait = portMAX_DELAY;
+
+    _lock_acquire(&s_lock);
+    if (s_heap_len) {
+      int64_t left_us = s_heap[0]->due_us - esp_timer_get_time();
+      if (left_us <= 0) {
+        m = heap_pop();
+      } else {
+        wait = pdMS_TO_TICKS((left_us + 999) / 1000);
+        if (!wait) wait = 1;
+      }
+    }
+    _lock_release(&s_lock);
+
+    if (!m) {
+      xSemaphoreTake(s_wake, wait);
+      continue;
+    }
+    if (m->hop == HOP_UP) {
+      route(m);
+    } else {
+      deliver(m);
+    }
+    free(m);
+  }
+}
+
+static void broker_start(void) {
+  bool first = false;
+  vTaskSuspendAll();
+  if (!s_wake) {
+    s_wake = xSemaphoreCreateBinary();
+    first = true;
+  }
+  xTaskResumeAll();
+  if (first) {
+    xTaskCreate(broker_task, "mqtt_task", FAKE_MQTT_TASK_STACK, NULL, FAKE_MQTT_TASK_PRIO, NULL);
+  }
+}
+
+// --------------------------------------------------------------------------------
+// esp-mqtt client api
+// --------------------------------------------------------------------------------
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config) {
+  if (!config) return NULL;
+  broker_start();
+
+  const char *will_topic = config->session.last_will.topic;
+  const char *will_msg = config->session.last_will.msg ? config->session.last_will.msg : "";
+  int will_len = config->session.last_will.msg_len;
+  if (will_len <= 0) will_len = strlen(will_msg);
+  char *topic_copy = will_topic ? strdup(will_topic) : NULL;
+  char *msg_copy = will_topic ? malloc(will_len) : NULL;
+  if (will_topic && (!topic_copy || !msg_copy)) {
+    free(topic_copy);
+    free(msg_copy);
+    return NULL;
+  }
+  if (msg_copy) memcpy(msg_copy, will_msg, will_len);
+
+  _lock_acquire(&s_lock);
+  esp_mqtt_client_handle_t c = s_free;
+  if (c) s_free = c->next_free;
+  _lock_release(&s_lock);
+  if (!c) c = calloc(1, sizeof(*c));
+  if (!c) {
+    ESP_LOGE(TAG, "No memory for a client");
+    free(topic_copy);
+    free(msg_copy);
+    return NULL;
+  }
+
+  _lock_acquire(&s_lock);
+  uint32_t gen = c->gen;
+  memset(c, 0, sizeof(*c));
+  c->gen = gen;
+  c->used = true;
+  c->will_topic = topic_copy;
+  c->will_msg = msg_copy;
+  c->will_len = will_len;
+  c->will_qos = config->session.last_will.qos;
+  if (++s_stats.clients > s_stats.clients_max) s_stats.clients_max = s_stats.clients;
+  _lock_release(&s_lock);
+
+  ESP_LOGD(TAG, "Client for %s", config->broker.address.uri ? config->broker.address.uri : "-");
+  return c;
+}
+
+esp_err_t esp_mqtt_client_register_event(
+  esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event, esp_event_handler_t event_handler,
+  void *event_handler_arg
+) {
+  if (!client || !event_handler) return ESP_ERR_INVALID_ARG;
+  _lock_acquire(&s_lock);
+  client->handler = event_handler;
+  client->handler_arg = event_handler_arg;
+  client->handler_event = event;
+  _lock_release(&s_lock);
+  return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) {
+  if (!client || !client->used) return ESP_ERR_INVALID_ARG;
+  // the connack comes back over the link
+  fake_msg_t *m = msg_new(HOP_DOWN, client, MQTT_EVENT_CONNECTED, NULL, NULL, 0);
+  if (!m) return ESP_ERR_NO_MEM;
+  schedule(m);
+  return ESP_OK;
+}
+
+// a clean disconnect, the will is discarded
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client) {
+  if (!client || !client->used) return ESP_ERR_INVALID_ARG;
+  _lock_acquire(&s_lock);
+  client->connected = false;
+  client_clear_subs(client);
+  _lock_release(&s_lock);
+  return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client) {
+  if (!client) return ESP_ERR_INVALID_ARG;
+  _lock_acquire(&s_lock);
+  if (!client->used) {
+    _lock_release(&s_lock);
+    return ESP_ERR_INVALID_STATE;
+  }
+  client->used = false;
+  client->connected = false;
+  client->gen++;
+  client_clear_subs(client);
+  client_clear_will(client);
+  client->next_free = s_free;
+  s_free = client;
+  s_stats.clients--;
+  _lock_release(&s_lock);
+  return ESP_OK;
+}
+
+int esp_mqtt_client_publish(
+  esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+  int retain
+) {
+  uint64_t t0 = sn_fake_hal_now_ns();
+  if (!client || !topic) return -1;
+  if (!data) data = "";
+  if (len <= 0) len = strlen(data);
+
+  _lock_acquire(&s_lock);
+  bool connected = client->connected;
+  int msg_id = connected && qos > 0 ? ++client->next_msg_id : 0;
+  _lock_release(&s_lock);
+  if (!connected) return -1;
+
+  // retain is not kept, the harnesses subscribe before anything is published
+  fake_msg_t *m = msg_new(HOP_UP, client, MQTT_EVENT_DATA, topic, data, len);
+  if (!m) return -1;
+  m->msg_id = msg_id;
+  m->qos = qos;
+  schedule(m);
+  sn_fake_hal_record(SN_FAKE_CALL_mqtt_publish, t0);
+  return msg_id;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos) {
+  if (!client || !topic || strlen(topic) >= FAKE_MQTT_FILTER_LEN) return -1;
+  int msg_id = -1;
+  _lock_acquire(&s_lock);
+  if (client->connected && sub_add(client, topic, NULL, NULL)) msg_id = ++client->next_msg_id;
+  _lock_release(&s_lock);
+  return msg_id;
+}
+
+int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *topic) {
+  if (!client || !topic) return -1;
+  int msg_id = -1;
+  _lock_acquire(&s_lock);
+  for (fake_sub_t **p = &client->subs; *p; p = &(*p)->client_next) {
+    fake_sub_t *sub = *p;
+    if (strcmp(sub->filter, topic) != 0) continue;
+    *p = sub->client_next;
+    sub_unlink(sub);
+    free(sub);
+    msg_id = ++client->next_msg_id;
+    break;
+  }
+  _lock_release(&s_lock);
+  return msg_id;
+}
+
+// --------------------------------------------------------------------------------
+// Scripting
+// --------------------------------------------------------------------------------
+
+void sn_fake_mqtt_set_link(const sn_fake_mqtt_link_t *link) {
+  if (!link) return;
+  _lock_acquire(&s_lock);
+  s_link = *link;
+  // a certain loss would never deliver
+  if (s_link.loss_permille > 999) s_link.loss_permille = 999;
+  if (!s_link.rto_ms) s_link.rto_ms = FAKE_MQTT_DEFAULT_RTO;
+  _lock_release(&s_lock);
+}
+
+esp_err_t sn_fake_mqtt_subscribe(const char *filter, sn_fake_mqtt_sink_t sink, void *arg) {
+  if (!filter || !sink || strlen(filter) >= FAKE_MQTT_FILTER_LEN) return ESP_ERR_INVALID_ARG;
+  broker_start();
+  _lock_acquire(&s_lock);
+  fake_sub_t *sub = sub_add(NULL, filter, sink, arg);
+  _lock_release(&s_lock);
+  return sub ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t sn_fake_mqtt_publish(const char *topic, const char *data, int len) {
+  if (!topic || !data) return ESP_ERR_INVALID_ARG;
+  broker_start();
+  if (len <= 0) len = strlen(data);
+  fake_msg_t *m = msg_new(HOP_UP, NULL, MQTT_EVENT_DATA, topic, data, len);
+  if (!m) return ESP_ERR_NO_MEM;
+  m->qos = 1;
+  schedule(m);
+  return ESP_OK;
+}
+
+esp_err_t sn_fake_mqtt_drop(esp_mqtt_client_handle_t client) {
+  if (!client) return ESP_ERR_INVALID_ARG;
+  fake_msg_t *will = NULL;
+
+  _lock_acquire(&s_lock);
+  if (!client->used || !client->connected) {
+    _lock_release(&s_lock);
+    return ESP_ERR_INVALID_STATE;
+  }
+  client->connected = false;
+  client->gen++; // what was in flight on the connection is lost
+  client_clear_subs(client);
+  if (client->will_topic) {
+    will = msg_new(
+      HOP_UP, NULL, MQTT_EVENT_DATA, client->will_topic, client->will_msg, client->will_len
+    );
+    if (will) will->qos = client->will_qos;
+    s_stats.wills++;
+  }
+  _lock_release(&s_lock);
+
+  // the broker publishes the will, the client sees its connection go down
+  if (will) schedule(will);
+  fake_msg_t *m = msg_new(HOP_DOWN, client, MQTT_EVENT_DISCONNECTED, NULL, NULL, 0);
+  if (!m) return ESP_ERR_NO_MEM;
+  schedule(m);
+  return ESP_OK;
+}
+
+cJSON *sn_fake_mqtt_stats_to_json(void) {
+  cJSON *root = cJSON_CreateObject();
+  if (!root) return NULL;
+  _lock_acquire(&s_lock);
+  cJSON_AddNumberToObject(root, "up", s_stats.up);
+  cJSON_AddNumberToObject(root, "down", s_stats.down);
+  cJSON_AddNumberToObject(root, "retransmits", s_stats.retransmits);
+  cJSON_AddNumberToObject(root, "unrouted", s_stats.unrouted);
+  cJSON_AddNumberToObject(root, "pending_max", s_stats.pending_max);
+  cJSON_AddNumberToObject(root, "connects", s_stats.connects);
+  cJSON_AddNumberToObject(root, "wills", s_stats.wills);
+  cJSON_AddNumberToObject(root, "clients", s_stats.clients);
+  cJSON_AddNumberToObject(root, "clients_max", s_stats.clients_max);
+  cJSON_AddNumberToObject(root, "subs", s_stats.subs);
+  _lock_release(&s_lock);
+  return root;
+}
@@ -0,0 +1,191 @@
+#include "driver/i2c_master.h"
+#include "esp_lcd_panel_io.h"
+#include "esp_lcd_panel_ops.h"
+#include "esp_lcd_panel_vendor.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "sn_fake_hal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "FAKE_SSD1306";
+
+#define FB_PAGES (SN_FAKE_SSD1306_HEIGHT / 8)
+#define FB_SIZE  (SN_FAKE_SSD1306_WIDTH * FB_PAGES)
+
+struct sn_fake_i2c_bus_s {
+  i2c_master_bus_config_t config;
+};
+
+struct sn_fake_lcd_io_s {
+  uint32_t dev_addr;
+  esp_lcd_panel_io_color_trans_done_cb_t on_color_trans_done;
+  void *user_ctx;
+};
+
+struct sn_fake_lcd_panel_s {
+  esp_lcd_panel_io_handle_t io;
+  int height;
+  bool on;
+};
+
+// a single panel, the device has one screen
+static uint8_t *s_gram = NULL;
+static uint32_t s_flushes = 0;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t i2c_new_master_bus(
+  const i2c_master_bus_config_t *bus_config, i2c_master_bus_handle_t *ret_bus_handle
+) {
+  if (!bus_config || !ret_bus_handle) return ESP_ERR_INVALID_ARG;
+  i2c_master_bus_handle_t bus = calloc(1, sizeof(*bus));
+  if (!bus) return ESP_ERR_NO_MEM;
+  bus->config = *bus_config;
+  *ret_bus_handle = bus;
+  return ESP_OK;
+}
+
+esp_err_t i2c_del_master_bus(i2c_master_bus_handle_t bus_handle) {
+  free(bus_handle);
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_probe(
+  i2c_master_bus_handle_t bus_handle, uint16_t address, int xfer_timeout_ms
+) {
+  return bus_handle ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_lcd_new_panel_io_i2c(
+  i2c_master_bus_handle_t bus, const esp_lcd_panel_io_i2c_config_t *io_config,
+  esp_lcd_panel_io_handle_t *ret_io
+) {
+  if (!bus || !io_config || !ret_io) return ESP_ERR_INVALID_ARG;
+  esp_lcd_panel_io_handle_t io = calloc(1, sizeof(*io));
+  if (!io) return ESP_ERR_NO_MEM;
+  io->dev_addr = io_config->dev_addr;
+  io->on_color_trans_done = io_config->on_color_trans_done;
+  io->user_ctx = io_config->user_ctx;
+  *ret_io = io;
+  return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_io_register_event_callbacks(
+  esp_lcd_panel_io_handle_t io, const esp_lcd_panel_io_callbacks_t *cbs, void *user_ctx
+) {
+  if (!io || !cbs) return ESP_ERR_INVALID_ARG;
+  io->on_color_trans_done = cbs->on_color_trans_done;
+  io->user_ctx = user_ctx;
+  return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_io_del(esp_lcd_panel_io_handle_t io) {
+  free(io);
+  return ESP_OK;
+}
+
+esp_err_t esp_lcd_new_panel_ssd1306(
+  esp_lcd_panel_io_handle_t io, const esp_lcd_panel_dev_config_t *panel_dev_config,
+  esp_lcd_panel_handle_t *ret_panel
+) {
+  if (!io || !panel_dev_config || !ret_panel) return ESP_ERR_INVALID_ARG;
+  if (panel_dev_config->bits_per_pixel != 1) return ESP_ERR_NOT_SUPPORTED;
+
+  const esp_lcd_panel_ssd1306_config_t *vendor = panel_dev_config->vendor_config;
+  int height = vendor ? vendor->height : SN_FAKE_SSD1306_HEIGHT;
+  if (height != 32 && height != SN_FAKE_SSD1306_HEIGHT) return ESP_ERR_NOT_SUPPORTED;
+
+  esp_lcd_panel_handle_t panel = calloc(1, sizeof(*panel));
+  if (!panel) return ESP_ERR_NO_MEM;
+  if (!s_gram) s_gram = calloc(1, FB_SIZE);
+  if (!s_gram) {
+    free(panel);
+    return ESP_ERR_NO_MEM;
+  }
+  panel->io = io;
+  panel->height = height;
+  *ret_panel = panel;
+  return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_reset(esp_lcd_panel_handle_t panel) {
+  if (!panel) return ESP_ERR_INVALID_ARG;
+  taskENTER_CRITICAL(&s_lock);
+  memset(s_gram, 0, FB_SIZE);
+  taskEXIT_CRITICAL(&s_lock);
+  return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_init(esp_lcd_panel_handle_t panel) {
+  return panel ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_lcd_panel_disp_on_off(esp_lcd_panel_handle_t panel, bool on_off) {
+  if (!panel) return ESP_ERR_INVALID_ARG;
+  panel->on = on_off;
+  return ESP_OK;
+}
+
+// the color data is laid out like the display ram, the window is copied page by page
+esp_err_t esp_lcd_panel_draw_bitmap(
+  esp_lcd_panel_handle_t panel, int x_start, int y_start, int x_end, int y_end,
+  const void *color_data
+) {
+  uint64_t t0 = sn_fake_hal_now_ns();
+  if (!panel || !color_data || x_start >= x_end || y_start >= y_end) return ESP_ERR_INVALID_ARG;
+  if (x_start < 0 || x_end > SN_FAKE_SSD1306_WIDTH || y_start < 0 || y_end > panel->height) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  const uint8_t *src = color_data;
+  int width = x_end - x_start;
+  taskENTER_CRITICAL(&s_lock);
+  for (int page = y_start / 8; page <= (y_end - 1) / 8; page++) {
+    memcpy(&s_gram[page * SN_FAKE_SSD1306_WIDTH + x_start], src, width);
+    src += width;
+  }
+  s_flushes++;
+  taskEXIT_CRITICAL(&s_lock);
+
+  // the i2c transfer is synchronous here, completion is signaled right away
+  esp_lcd_panel_io_handle_t io = panel->io;
+  if (io->on_color_trans_done) io->on_color_trans_done(io, NULL, io->user_ctx);
+
+  sn_fake_hal_record(SN_FAKE_CALL_panel_draw_bitmap, t0);
+  return ESP_OK;
+}
+
+esp_err_t esp_lcd_panel_del(esp_lcd_panel_handle_t panel) {
+  free(panel);
+  return ESP_OK;
+}
+
+// --------------------------------------------------------------------------------
+// Scripting
+// --------------------------------------------------------------------------------
+
+const uint8_t *sn_fake_ssd1306_get_framebuffer(void) { return s_gram; }
+
+uint32_t sn_fake_ssd1306_get_flushes(void) { return s_flushes; }
+
+esp_err_t sn_fake_ssd1306_write_pbm(const char *path) {
+  if (!path) return ESP_ERR_INVALID_ARG;
+  if (!s_gram) return ESP_ERR_INVALID_STATE;
+
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    ESP_LOGE(TAG, "Cannot write %s", path);
+    return ESP_FAIL;
+  }
+  fprintf(f, "P1\n%d %d\n", SN_FAKE_SSD1306_WIDTH, SN_FAKE_SSD1306_HEIGHT);
+  for (int y = 0; y < SN_FAKE_SSD1306_HEIGHT; y++) {
+    for (int x = 0; x < SN_FAKE_SSD1306_WIDTH; x++) {
+      bool lit = s_gram[(y / 8) * SN_FAKE_SSD1306_WIDTH + x] & (1 << (y % 8));
+      fputc(lit ? '1' : '0', f);
+    }
+    fputc('\n', f);
+  }
+  fclose(f);
+  return ESP_OK;
+}
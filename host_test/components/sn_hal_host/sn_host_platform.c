@@ -0,0 +1,53 @@
+#include "esp_err.h"
+#include "esp_mac.h"
+#include "sn_fake_hal.h"
+#include "sn_sntp.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// --------------------------------------------------------------------------------
+// Time, the host clock is always considered synced
+// --------------------------------------------------------------------------------
+
+static unsigned long long s_virtual_ms = 0; // 0 follows the host clock
+
+void sn_fake_clock_set_ms(unsigned long long ms) {
+  __atomic_store_n(&s_virtual_ms, ms, __ATOMIC_RELAXED);
+}
+
+esp_err_t sn_init_sntp(void) { return ESP_OK; }
+
+esp_err_t sn_wait_for_timesync() { return ESP_OK; }
+
+void sn_sync_time() {}
+
+bool sn_is_time_synced(time_t timestamp) { return true; }
+
+unsigned long long sn_get_unix_timestamp_ms() {
+  unsigned long long virtual_ms = __atomic_load_n(&s_virtual_ms, __ATOMIC_RELAXED);
+  if (virtual_ms) return virtual_ms;
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (unsigned long long)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000ULL;
+}
+
+void sn_timestamp_to_iso8601(time_t timestamp, char *buffer, size_t buffer_size) {
+  struct tm tm;
+  gmtime_r(&timestamp, &tm);
+  strftime(buffer, buffer_size, "%Y-%m-%dT%H:%M:%SZ", &tm);
+}
+
+void sn_get_iso8601_timestamp(char *buffer, size_t buffer_size) {
+  sn_timestamp_to_iso8601(time(NULL), buffer, buffer_size);
+}
+
+// --------------------------------------------------------------------------------
+// Efuse, fixed mac unless the idf linux port provides one
+// --------------------------------------------------------------------------------
+
+__attribute__((weak)) esp_err_t esp_efuse_mac_get_default(uint8_t *mac) {
+  static const uint8_t host_mac[6] = {0x02, 0x00, 0x00, 0x5e, 0x00, 0x01};
+  memcpy(mac, host_mac, sizeof(host_mac));
+  return ESP_OK;
+}
@@ -0,0 +1,56 @@
+#include "sn_host_series.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+void sn_host_series_add(sn_host_series_t *s, uint32_t value) {
+  if (!s->samples) {
+    uint32_t *buf = calloc(SN_HOST_SERIES_CAP, sizeof(uint32_t));
+    uint32_t *expected = NULL;
+    if (!buf) return;
+    if (!__atomic_compare_exchange_n(
+          &s->samples, &expected, buf, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE
+        )) {
+      free(buf);
+    }
+  }
+  uint32_t idx = __atomic_fetch_add(&s->len, 1, __ATOMIC_RELAXED);
+  if (idx < SN_HOST_SERIES_CAP) s->samples[idx] = value;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static uint32_t percentile(const uint32_t *sorted, uint32_t n, double p) {
+  uint32_t idx = (uint32_t)(p * (n - 1) + 0.5);
+  return sorted[idx];
+}
+
+cJSON *sn_host_series_to_json(const sn_host_series_t *s) {
+  cJSON *item = cJSON_CreateObject();
+  if (!item) return NULL;
+  uint32_t len = __atomic_load_n(&s->len, __ATOMIC_RELAXED);
+  uint32_t n = len < SN_HOST_SERIES_CAP ? len : SN_HOST_SERIES_CAP;
+  cJSON_AddNumberToObject(item, "n", len);
+  if (!n) return item;
+
+  uint32_t *sorted = malloc(n * sizeof(uint32_t));
+  if (!sorted) return item;
+  memcpy(sorted, s->samples, n * sizeof(uint32_t));
+  qsort(sorted, n, sizeof(uint32_t), cmp_u32);
+  cJSON_AddNumberToObject(item, "p50", percentile(sorted, n, 0.50));
+  cJSON_AddNumberToObject(item, "p90", percentile(sorted, n, 0.90));
+  cJSON_AddNumberToObject(item, "p99", percentile(sorted, n, 0.99));
+  cJSON_AddNumberToObject(item, "p999", percentile(sorted, n, 0.999));
+  cJSON_AddNumberToObject(item, "max", sorted[n - 1]);
+  free(sorted);
+  return item;
+}
+
+void sn_host_series_reset(sn_host_series_t *s) {
+  free(s->samples);
+  s->samples = NULL;
+  s->len = 0;
+}
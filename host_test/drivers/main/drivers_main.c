@@ -0,0 +1,203 @@
+#include "cJSON.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mqtt_sink.h"
+#include "sn_actor.h"
+#include "sn_adc_helper.h"
+#include "sn_capability.h"
+#include "sn_driver.h"
+#include "sn_driver_registry.h"
+#include "sn_fake_hal.h"
+#include "sn_metrics.h"
+#include "sn_recovery.h"
+#include "sn_rules/sn_rule_engine.h"
+#include "sn_storage.h"
+#include "sn_topic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "SN_DRIVERS";
+
+extern void sensor_poll_task(void *pvParam);
+
+// pins of main/src/device_port_specs.c
+#define SIM_DHT_PIN   GPIO_NUM_23
+#define SIM_SOIL_PIN  GPIO_NUM_35
+#define SIM_LIGHT_PIN GPIO_NUM_34
+#define SIM_PUMP_PIN  GPIO_NUM_5
+#define SIM_OLED_ID   0x0E
+
+#define SIM_SOIL_STEP_MS 2500
+
+static const sn_mqtt_topic_context_t s_topic_ctx = {
+  .orgId = "6650c0ffee0000000000beef",
+  .deviceId = "6650c0ffee0000000000d00d",
+};
+
+static const char *env_or(const char *name, const char *fallback) {
+  const char *v = getenv(name);
+  return v && v[0] ? v : fallback;
+}
+
+// --------------------------------------------------------------------------------
+// Peripherals
+// --------------------------------------------------------------------------------
+
+static esp_err_t script_peripherals(void) {
+  char path[256];
+  snprintf(path, sizeof(path), "%s/soil_dry_wet.txt", env_or("SN_SIM_WAVEFORMS", "waveforms"));
+  esp_err_t err = sn_fake_adc_load_waveform(
+    adc_helper_pin_to_channel(SIM_SOIL_PIN), path, SIM_SOIL_STEP_MS
+  );
+  if (err != ESP_OK) return err;
+
+  // overcast daylight on the lm393
+  sn_fake_adc_set_raw(adc_helper_pin_to_channel(SIM_LIGHT_PIN), 1800);
+  sn_fake_dht_set(SIM_DHT_PIN, 24.6f, 58.0f);
+  sn_fake_dht_set_latency_us(atoi(env_or("SN_SIM_DHT_LATENCY_US", "0")));
+  return ESP_OK;
+}
+
+// --------------------------------------------------------------------------------
+// Recovery
+// --------------------------------------------------------------------------------
+
+static const char *s_dht_port = NULL;
+static uint32_t s_dht_offline = 0;
+static uint32_t s_dht_online = 0;
+
+// Emitted on the poll task and the actors
+static esp_err_t on_device_event(const sn_device_event_t *event) {
+  if (!s_dht_port || strcmp(event->source, s_dht_port) != 0) return ESP_OK;
+  if (event->event_type == DEVICE_EVENT_PORT_OFFLINE) {
+    __atomic_add_fetch(&s_dht_offline, 1, __ATOMIC_RELAXED);
+  } else if (event->event_type == DEVICE_EVENT_PORT_ONLINE) {
+    __atomic_add_fetch(&s_dht_online, 1, __ATOMIC_RELAXED);
+  }
+  return ESP_OK;
+}
+
+static const char *find_dht_port(void) {
+  FOR_EACH_SENSOR_INSTANCE(it, gDeviceInstances, gDeviceInstancesLen) {
+    const sn_sensor_port_t *s = &it->port->desc.s;
+    if (s->usage_type == PUT_GPIO && s->usage.gpio.pin == SIM_DHT_PIN) return it->port->port_name;
+  }
+  return NULL;
+}
+
+// --------------------------------------------------------------------------------
+// Report
+// --------------------------------------------------------------------------------
+
+static void collect_state(sn_device_instance_t *inst, void *arg) {
+  *(cJSON **)arg = inst->driver->report_state((void *)&inst->ctx);
+}
+
+static cJSON *instances_to_json(bool *all_online) {
+  cJSON *arr = cJSON_CreateArray();
+  FOR_EACH_INSTANCE(it, gDeviceInstances, gDeviceInstancesLen) {
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "port", it->port->port_name);
+    cJSON_AddStringToObject(item, "driver", it->driver ? it->driver->name : "(none)");
+    cJSON_AddBoolToObject(item, "online", it->online);
+    cJSON_AddNumberToObject(item, "failures", it->consecutive_failures);
+    cJSON_AddNumberToObject(item, "health", it->health);
+
+    cJSON *state = NULL;
+    // waits for collect_state, state lives on this stack
+    if (it->online && it->driver->report_state) sn_actor_call_sync(it, collect_state, &state);
+    if (state) cJSON_AddItemToObject(item, "state", state);
+
+    if (!it->online) *all_online = false;
+    cJSON_AddItemToArray(arr, item);
+  }
+  return arr;
+}
+
+static cJSON *outputs_to_json(void) {
+  cJSON *outputs = cJSON_CreateObject();
+  cJSON_AddNumberToObject(outputs, "pump", sn_fake_gpio_get_output(SIM_PUMP_PIN));
+  cJSON_AddNumberToObject(outputs, "pump_edges", sn_fake_gpio_get_edges(SIM_PUMP_PIN));
+  cJSON *ledc = cJSON_AddArrayToObject(outputs, "ledc");
+  for (int ch = LEDC_CHANNEL_0; ch < LEDC_CHANNEL_MAX; ch++) {
+    cJSON_AddItemToArray(ledc, cJSON_CreateNumber(sn_fake_ledc_get_level(ch)));
+  }
+  cJSON_AddNumberToObject(outputs, "screen_flushes", sn_fake_ssd1306_get_flushes());
+  return outputs;
+}
+
+// --------------------------------------------------------------------------------
+// Entry
+// --------------------------------------------------------------------------------
+
+void app_main(void) {
+  int seconds = atoi(env_or("SN_SIM_SECONDS", "60"));
+
+  ESP_ERROR_CHECK(sn_storage_init(NULL));
+  sn_mqtt_topic_cache_init(&s_topic_ctx);
+  ESP_ERROR_CHECK(adc_helper_init());
+  if (script_peripherals() != ESP_OK) exit(EXIT_FAILURE);
+
+#define X(driver) ESP_ERROR_CHECK_WITHOUT_ABORT(sn_driver_register(&driver##_driver));
+  DRIVERS(X)
+#undef X
+  sn_driver_bind_all_ports(gDevicePorts, gDevicePortsLen);
+  s_dht_port = find_dht_port();
+  sn_recovery_set_event_handler(on_device_event);
+
+  // the rule engine registers its consumer before the first reading
+  xTaskCreate(rule_engine_task, "rule_engine_task", 4096, NULL, 5, NULL);
+  vTaskDelay(pdMS_TO_TICKS(10));
+  xTaskCreate(sensor_poll_task, "sensor_poll_task", 4096, NULL, 4, NULL);
+
+  // the dht unplugged for a few frames at a quarter, long enough to go offline, the
+  // recovery has to bring it back before the end
+  vTaskDelay(pdMS_TO_TICKS(seconds * 250));
+  sn_fake_dht_inject_fault(SIM_DHT_PIN, SN_FAKE_DHT_TIMEOUT, SN_RECOVERY_FAIL_THRESHOLD + 2);
+  // a transient checksum error halfway, below the failures that take a port offline
+  vTaskDelay(pdMS_TO_TICKS(seconds * 250));
+  sn_fake_dht_inject_fault(SIM_DHT_PIN, SN_FAKE_DHT_BAD_CHECKSUM, 1);
+  vTaskDelay(pdMS_TO_TICKS(seconds * 500));
+
+  // a backend command through the dispatch path, drawn on the fake panel
+  cJSON *result = NULL;
+  char cmd[96];
+  snprintf(
+    cmd, sizeof(cmd),
+    "{\"localId\":%d,\"action\":\"set_message\",\"params\":{\"msg\":\"sim done\"}}", SIM_OLED_ID
+  );
+  if (dispatch_command(cmd, &result) != ESP_OK) ESP_LOGW(TAG, "set_message failed");
+  cJSON_Delete(result);
+  vTaskDelay(pdMS_TO_TICKS(200));
+
+  bool all_online = true;
+  uint32_t published = mqtt_sink_get_published();
+  cJSON *report = cJSON_CreateObject();
+  cJSON_AddNumberToObject(report, "seconds", seconds);
+  cJSON_AddNumberToObject(report, "published", published);
+  cJSON_AddItemToObject(report, "instances", instances_to_json(&all_online));
+  // the unplugged dht has to have gone offline and come back
+  uint32_t offline = __atomic_load_n(&s_dht_offline, __ATOMIC_RELAXED);
+  uint32_t online = __atomic_load_n(&s_dht_online, __ATOMIC_RELAXED);
+  bool recovered = offline > 0 && online >= offline;
+  cJSON *recovery = cJSON_AddObjectToObject(report, "recovery");
+  cJSON_AddStringToObject(recovery, "port", s_dht_port ? s_dht_port : "(none)");
+  cJSON_AddNumberToObject(recovery, "offline", offline);
+  cJSON_AddNumberToObject(recovery, "online", online);
+  cJSON_AddBoolToObject(recovery, "recovered", recovered);
+  cJSON_AddItemToObject(report, "outputs", outputs_to_json());
+  cJSON_AddItemToObject(report, "hal", sn_fake_hal_stats_to_json());
+  cJSON_AddItemToObject(report, "metrics", sn_metrics_to_json());
+
+  char *str = cJSON_Print(report);
+  printf("%s\n", str);
+  cJSON_free(str);
+  cJSON_Delete(report);
+
+  const char *pbm = env_or("SN_SIM_PBM", "screen.pbm");
+  if (sn_fake_ssd1306_write_pbm(pbm) != ESP_OK) ESP_LOGW(TAG, "No frame to write to %s", pbm);
+
+  exit(all_online && recovered && published > 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
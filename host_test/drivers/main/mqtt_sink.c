@@ -0,0 +1,21 @@
+#include "mqtt_sink.h"
+#include "cJSON.h"
+#include "sn_mqtt_manager.h"
+
+static uint32_t s_published = 0;
+
+esp_err_t sn_mqtt_publish_json_payload_signed(
+  cJSON *payload, const char *topic, int qos, bool retain
+) {
+  if (!payload || !topic) {
+    cJSON_Delete(payload);
+    return ESP_ERR_INVALID_ARG;
+  }
+  __atomic_fetch_add(&s_published, 1, __ATOMIC_RELAXED);
+  cJSON_Delete(payload);
+  return ESP_OK;
+}
+
+uint32_t mqtt_sink_get_published(void) {
+  return __atomic_load_n(&s_published, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,19 @@
+// --------------------------------------------------------------------------------
+// mqtt_sink.h
+//
+// description: publish side of sn_mqtt_manager for the driver simulation, every
+// payload is counted and dropped
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_MQTT_SINK_H
+#define SN_MQTT_SINK_H
+
+#include <stdint.h>
+
+/*
+ * @brief Payloads published so far
+ */
+uint32_t mqtt_sink_get_published(void);
+
+#endif // !SN_MQTT_SINK_H
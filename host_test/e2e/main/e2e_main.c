@@ -0,0 +1,374 @@
+#include "cJSON.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sn_command_executor.h"
+#include "sn_driver.h"
+#include "sn_driver_registry.h"
+#include "sn_fake_hal.h"
+#include "sn_host_series.h"
+#include "sn_json.h"
+#include "sn_metrics.h"
+#include "sn_mqtt_manager.h"
+#include "sn_mqtt_router.h"
+#include "sn_sntp.h"
+#include "sn_storage.h"
+#include "sn_topic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "SN_E2E";
+
+extern void sensor_poll_task(void *pvParam);
+
+#define E2E_OUT_ID     0x7B
+#define E2E_ORPHAN_ID  0x7A
+#define E2E_NAME_LEN   16
+#define E2E_CMD_PREFIX "e2e-"
+
+// the actuator the commands drive and the command apis
+#define E2E_OUT_DESC ((sn_actuator_port_t){.local_id = E2E_OUT_ID, .usage_type = PUT_VIRTUAL})
+// no registered driver supports it, the port is bound without one
+#define E2E_ORPHAN_DESC                                                                            \
+  ((sn_actuator_port_t){.local_id = E2E_ORPHAN_ID, .usage_type = PUT_VIRTUAL})
+#define E2E_FIXED_PORTS(X)                                                                         \
+  X(ACTUATOR_PORT_LITERAL("e2e-out", "virtual", E2E_OUT_DESC))                                     \
+  X(ACTUATOR_PORT_LITERAL("e2e-orphan", "unknown", E2E_ORPHAN_DESC))                               \
+  X(COMMAND_PORT_LITERAL("state", "state", ((sn_command_api_port_t){.local_id = 0x7D})))          \
+  X(COMMAND_PORT_LITERAL("metrics", "metrics", ((sn_command_api_port_t){.local_id = 0x7C})))
+
+#define GEN_PORT_ENTRY(LITERAL) LITERAL,
+const sn_device_port_desc_t gDevicePorts[] = {E2E_FIXED_PORTS(GEN_PORT_ENTRY)};
+#undef GEN_PORT_ENTRY
+const size_t gDevicePortsLen = sizeof(gDevicePorts) / sizeof(sn_device_port_desc_t);
+
+static const sn_mqtt_topic_context_t s_topic_ctx = {
+  .orgId = "6650c0ffee0000000000beef",
+  .deviceId = "6650c0ffee0000000000e2e0",
+};
+
+// clang-format off
+#define E2E_SERIES(X)                                                          \
+  X(cmd_ack,    "cmd.ack.us")    /* backend publish to the ack at the broker */ \
+  X(telemetry,  "telemetry.ms")  /* sample ts to the broker */                 \
+  X(publish,    "publish.ms")    /* signing to the broker */
+// clang-format on
+
+typedef enum {
+#define GEN_SERIES_ENUM(NAME, KEY) E2E_S_##NAME,
+  E2E_SERIES(GEN_SERIES_ENUM) E2E_S_MAX
+#undef GEN_SERIES_ENUM
+} e2e_series_e;
+
+static sn_host_series_t s_series[E2E_S_MAX] = {
+#define GEN_SERIES_INIT(NAME, KEY) SN_HOST_SERIES_INIT(KEY),
+  E2E_SERIES(GEN_SERIES_INIT)
+#undef GEN_SERIES_INIT
+};
+
+typedef struct {
+  int sensors;
+  uint32_t sample_ms;
+  uint32_t cmd_rate; // per second
+  int seconds;
+  uint32_t drain_ms;
+  sn_fake_mqtt_link_t link;
+} e2e_config_t;
+
+static int env_int(const char *name, int fallback) {
+  const char *v = getenv(name);
+  return v && v[0] ? atoi(v) : fallback;
+}
+
+static e2e_config_t load_config(void) {
+  const int max_sensors = MAX_INSTANCES - (int)gDevicePortsLen;
+  e2e_config_t cfg = {
+    .sensors = env_int("SN_E2E_SENSORS", 8),
+    .sample_ms = env_int("SN_E2E_SAMPLE_MS", 500),
+    .cmd_rate = env_int("SN_E2E_CMD_RATE", 20),
+    .seconds = env_int("SN_E2E_SECONDS", 30),
+    .drain_ms = env_int("SN_E2E_DRAIN_MS", 3000),
+    .link =
+      {.delay_ms = env_int("SN_E2E_DELAY_MS", 20),
+       .jitter_ms = env_int("SN_E2E_JITTER_MS", 5),
+       .loss_permille = env_int("SN_E2E_LOSS_PERMILLE", 0),
+       .rto_ms = env_int("SN_E2E_RTO_MS", 200)},
+  };
+  if (cfg.sensors > max_sensors) cfg.sensors = max_sensors;
+  if (cfg.sensors < 0) cfg.sensors = 0;
+  if (!cfg.sample_ms) cfg.sample_ms = 1;
+  return cfg;
+}
+
+// --------------------------------------------------------------------------------
+// Device
+// --------------------------------------------------------------------------------
+
+static sn_device_port_desc_t s_ports[MAX_INSTANCES];
+static sn_port_measurement_map_t s_maps[MAX_INSTANCES][2];
+static char s_names[MAX_INSTANCES][E2E_NAME_LEN];
+
+static size_t build_ports(const e2e_config_t *cfg) {
+  size_t n = 0;
+  for (int i = 0; i < cfg->sensors; i++, n++) {
+    s_maps[i][0] = (sn_port_measurement_map_t)MEASUREMENT_MAP_ENTRY(0x01 + i, ST_TEMPERATURE, "C");
+    s_maps[i][1] = (sn_port_measurement_map_t)MEASUREMENT_MAP_ENTRY_NULL();
+    snprintf(s_names[i], E2E_NAME_LEN, "virt-%d", i);
+    s_ports[n] = (sn_device_port_desc_t)SENSOR_PORT_LITERAL(
+      s_names[i], "virtual",
+      ((sn_sensor_port_t){.usage_type = PUT_VIRTUAL,
+                          .usage.virt = {.base = 25, .amplitude = 5, .noise = 0.5f,
+                                         .period_ms = 60000},
+                          .measurements = s_maps[i],
+                          .sample_rate_ms = cfg->sample_ms})
+    );
+  }
+  for (size_t i = 0; i < gDevicePortsLen; i++) s_ports[n++] = gDevicePorts[i];
+  return n;
+}
+
+// same hand over as main.c, the router runs on the mqtt task
+static void on_command_msg(const char *topic, const char *payload) {
+  sn_command_executor_submit(payload);
+}
+
+static esp_err_t start_device(void) {
+  sn_mqtt_config_t conf = {.uri = "mqtt://loopback"};
+  esp_err_t err = sn_mqtt_init(&conf);
+  if (err == ESP_OK) err = sn_mqtt_start();
+  if (err == ESP_OK) err = sn_command_executor_start();
+  if (err == ESP_OK) {
+    const char *topic = sn_mqtt_topic_cache_get()->command_topic;
+    err = sn_mqtt_router_subscriber_add(topic, on_command_msg, 1);
+  }
+  return err;
+}
+
+// --------------------------------------------------------------------------------
+// Backend, runs on the broker task
+// --------------------------------------------------------------------------------
+
+static uint32_t s_cmd_total = 0;
+static int64_t *s_cmd_sent_us = NULL; // 0 once acked
+static uint32_t s_cmd_sent = 0;
+static uint32_t s_acks_ok = 0;
+static uint32_t s_acks_err = 0;
+static uint32_t s_acks_unknown = 0;
+static uint32_t s_telemetry = 0;
+
+// one-off commands checked before the run
+#define E2E_PROBE_GROUP  "probe-group"
+#define E2E_PROBE_ORPHAN "probe-orphan"
+static bool s_probe_group_ok = false;
+static bool s_probe_orphan_ok = false;
+static int s_probe_sensors = 0;
+
+// the group runs on every virtual instance and skips the driverless port, the direct
+// command to that port is rejected
+static bool on_probe_ack(const char *id, const cJSON *ack) {
+  const char *status = NULL;
+  bool ok = json_get_string(ack, "status", &status) && !strcmp(status, "success");
+  if (!strcmp(id, E2E_PROBE_GROUP)) {
+    int applied = -1, failed = -1;
+    json_get_int(ack, "applied", &applied);
+    json_get_int(ack, "failed", &failed);
+    s_probe_group_ok = ok && applied == s_probe_sensors + 1 && failed == 0;
+    return true;
+  }
+  if (!strcmp(id, E2E_PROBE_ORPHAN)) {
+    s_probe_orphan_ok = !ok;
+    return true;
+  }
+  return false;
+}
+
+static void on_telemetry(const char *topic, const char *data, int len, void *arg) {
+  unsigned long long now_ms = sn_get_unix_timestamp_ms();
+  cJSON *wrapper = cJSON_ParseWithLength(data, len);
+  if (!wrapper) return;
+  s_telemetry++;
+
+  double signed_ms = 0, sample_ms = 0;
+  if (json_get_number(wrapper, "ts", &signed_ms) && signed_ms > 0) {
+    sn_host_series_add(
+      &s_series[E2E_S_publish], (uint32_t)(now_ms - (unsigned long long)signed_ms)
+    );
+  }
+  const char *raw = NULL;
+  cJSON *reading = json_get_string(wrapper, "raw_payload", &raw) ? cJSON_Parse(raw) : NULL;
+  if (json_get_number(reading, "ts", &sample_ms) && sample_ms > 0) {
+    sn_host_series_add(
+      &s_series[E2E_S_telemetry], (uint32_t)(now_ms - (unsigned long long)sample_ms)
+    );
+  }
+  cJSON_Delete(reading);
+  cJSON_Delete(wrapper);
+}
+
+static void on_ack(const char *topic, const char *data, int len, void *arg) {
+  int64_t now_us = esp_timer_get_time();
+  cJSON *ack = cJSON_ParseWithLength(data, len);
+  if (!ack) return;
+
+  const char *id = NULL, *status = NULL;
+  uint32_t seq = UINT32_MAX;
+  if (json_get_string(ack, "id", &id) && on_probe_ack(id, ack)) {
+    // not part of the measured commands
+    cJSON_Delete(ack);
+    return;
+  }
+  if (id && !strncmp(id, E2E_CMD_PREFIX, strlen(E2E_CMD_PREFIX))) {
+    seq = strtoul(id + strlen(E2E_CMD_PREFIX), NULL, 10);
+  }
+  if (seq < s_cmd_total && s_cmd_sent_us[seq]) {
+    sn_host_series_add(&s_series[E2E_S_cmd_ack], (uint32_t)(now_us - s_cmd_sent_us[seq]));
+    s_cmd_sent_us[seq] = 0;
+    bool ok = json_get_string(ack, "status", &status) && !strcmp(status, "success");
+    ok ? s_acks_ok++ : s_acks_err++;
+  } else {
+    s_acks_unknown++;
+  }
+  cJSON_Delete(ack);
+}
+
+static void send_command(uint32_t seq) {
+  char payload[160];
+  snprintf(
+    payload, sizeof(payload),
+    "{\"id\":\"" E2E_CMD_PREFIX "%u\",\"localId\":%d,\"action\":\"set_value\","
+    "\"params\":{\"value\":%u}}",
+    (unsigned)seq, E2E_OUT_ID, (unsigned)(seq % 100)
+  );
+  s_cmd_sent_us[seq] = esp_timer_get_time();
+  if (sn_fake_mqtt_publish(sn_mqtt_topic_cache_get()->command_topic, payload, 0) != ESP_OK) {
+    s_cmd_sent_us[seq] = 0;
+    return;
+  }
+  s_cmd_sent++;
+}
+
+// fixed rate, several commands per tick when the rate is above the tick rate
+static void inject_commands(const e2e_config_t *cfg) {
+  int64_t start = esp_timer_get_time();
+  int64_t end = start + cfg->seconds * 1000000LL;
+  int64_t period_us = cfg->cmd_rate ? 1000000LL / cfg->cmd_rate : 0;
+  uint32_t seq = 0;
+  for (int64_t now = start; now < end; now = esp_timer_get_time()) {
+    while (period_us && seq < s_cmd_total && start + seq * period_us <= now) send_command(seq++);
+    vTaskDelay(1);
+  }
+}
+
+static void send_probes(const e2e_config_t *cfg) {
+  char payload[160];
+  s_probe_sensors = cfg->sensors;
+  // same hand over as the org topic subscriber of main.c
+  sn_command_executor_submit_group(
+    "{\"id\":\"" E2E_PROBE_GROUP "\",\"action\":\"set_value\",\"params\":{\"value\":1},"
+    "\"ackWindowMs\":0}"
+  );
+  snprintf(
+    payload, sizeof(payload),
+    "{\"id\":\"" E2E_PROBE_ORPHAN "\",\"localId\":%d,\"action\":\"set_value\","
+    "\"params\":{\"value\":1}}",
+    E2E_ORPHAN_ID
+  );
+  sn_fake_mqtt_publish(sn_mqtt_topic_cache_get()->command_topic, payload, 0);
+}
+
+static uint32_t acks_missing(void) {
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < s_cmd_total; i++) n += s_cmd_sent_us[i] != 0;
+  return n;
+}
+
+// --------------------------------------------------------------------------------
+// Entry
+// --------------------------------------------------------------------------------
+
+void app_main(void) {
+  e2e_config_t cfg = load_config();
+
+  ESP_ERROR_CHECK(sn_storage_init(NULL));
+  ESP_ERROR_CHECK(sn_storage_set_device_secret("e2e-secret-0123456789abcdef"));
+  sn_mqtt_topic_cache_init(&s_topic_ctx);
+  const sn_mqtt_topic_cache_t *topics = sn_mqtt_topic_cache_get();
+
+  // the per message logs of the manager and the router would measure the console
+  esp_log_level_set("*", ESP_LOG_ERROR);
+  esp_log_level_set(TAG, ESP_LOG_INFO);
+
+  sn_fake_mqtt_set_link(&cfg.link);
+  ESP_ERROR_CHECK(sn_fake_mqtt_subscribe(topics->telemetry_topic, on_telemetry, NULL));
+  ESP_ERROR_CHECK(sn_fake_mqtt_subscribe(topics->command_ack_topic, on_ack, NULL));
+
+  sn_driver_register(&virtual_driver);
+  sn_driver_register(&state_driver);
+  sn_driver_register(&metrics_driver);
+  sn_driver_bind_all_ports(s_ports, build_ports(&cfg));
+
+  if (start_device() != ESP_OK) {
+    ESP_LOGE(TAG, "Device did not come up on the loopback broker");
+    exit(EXIT_FAILURE);
+  }
+
+  s_cmd_total = cfg.cmd_rate * cfg.seconds;
+  s_cmd_sent_us = calloc(s_cmd_total ? s_cmd_total : 1, sizeof(int64_t));
+  if (!s_cmd_sent_us) exit(EXIT_FAILURE);
+
+  send_probes(&cfg);
+  sn_metrics_reset();
+  int64_t run_start = esp_timer_get_time();
+  xTaskCreate(sensor_poll_task, "sensor_poll_task", 4096, NULL, 4, NULL);
+  inject_commands(&cfg);
+  double elapsed = (esp_timer_get_time() - run_start) / 1e6;
+
+  // what is still in flight gets drain_ms to arrive
+  for (uint32_t waited = 0; waited < cfg.drain_ms && acks_missing(); waited += 50) {
+    vTaskDelay(pdMS_TO_TICKS(50));
+  }
+  uint32_t missing = acks_missing();
+
+  cJSON *report = cJSON_CreateObject();
+  cJSON *c = cJSON_AddObjectToObject(report, "config");
+  cJSON_AddNumberToObject(c, "sensors", cfg.sensors);
+  cJSON_AddNumberToObject(c, "sample_ms", cfg.sample_ms);
+  cJSON_AddNumberToObject(c, "cmd_rate", cfg.cmd_rate);
+  cJSON_AddNumberToObject(c, "seconds", elapsed);
+  cJSON_AddNumberToObject(c, "delay_ms", cfg.link.delay_ms);
+  cJSON_AddNumberToObject(c, "jitter_ms", cfg.link.jitter_ms);
+  cJSON_AddNumberToObject(c, "loss_permille", cfg.link.loss_permille);
+  cJSON_AddNumberToObject(c, "rto_ms", cfg.link.rto_ms);
+
+  cJSON *t = cJSON_AddObjectToObject(report, "throughput");
+  cJSON_AddNumberToObject(t, "telemetry_expected_s", cfg.sensors * 1000.0 / cfg.sample_ms);
+  cJSON_AddNumberToObject(t, "telemetry_s", s_telemetry / elapsed);
+  cJSON_AddNumberToObject(t, "commands_s", s_cmd_sent / elapsed);
+  cJSON_AddNumberToObject(t, "acks_s", (s_acks_ok + s_acks_err) / elapsed);
+
+  cJSON *a = cJSON_AddObjectToObject(report, "acks");
+  cJSON_AddNumberToObject(a, "ok", s_acks_ok);
+  cJSON_AddNumberToObject(a, "error", s_acks_err);
+  cJSON_AddNumberToObject(a, "unknown", s_acks_unknown);
+  cJSON_AddNumberToObject(a, "missing", missing);
+  cJSON *p = cJSON_AddObjectToObject(report, "probes");
+  cJSON_AddBoolToObject(p, "group", s_probe_group_ok);
+  cJSON_AddBoolToObject(p, "orphan", s_probe_orphan_ok);
+
+  cJSON *l = cJSON_AddObjectToObject(report, "latency");
+  for (int i = 0; i < E2E_S_MAX; i++) {
+    cJSON_AddItemToObject(l, s_series[i].key, sn_host_series_to_json(&s_series[i]));
+  }
+  cJSON_AddItemToObject(report, "broker", sn_fake_mqtt_stats_to_json());
+  cJSON_AddItemToObject(report, "metrics", sn_metrics_to_json());
+
+  char *str = cJSON_Print(report);
+  printf("%s\n", str);
+  cJSON_free(str);
+  cJSON_Delete(report);
+
+  bool probes_ok = s_probe_group_ok && s_probe_orphan_ok;
+  exit(missing == 0 && s_telemetry > 0 && probes_ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,135 @@
+// --------------------------------------------------------------------------------
+// fleet.h
+//
+// description: simulated nodes and the backend stand-in of the fleet harness. The
+// nodes run the register, verify and online flow of main.c on one event loop task,
+// the backend answers them from the broker task
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_FLEET_H
+#define SN_FLEET_H
+
+#include "esp_err.h"
+#include "sn_driver/port_desc.h"
+#include "sn_fake_hal.h"
+#include "sn_host_series.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FLEET_ORG_ID      "6650c0ffee0000000000beef"
+#define FLEET_OUT_ID      0x7B
+#define FLEET_MAX_SENSORS 8
+#define FLEET_CMD_PREFIX  "f-"
+
+// the actuator of every node, its set_value commands come from the backend
+#define FLEET_OUT_DESC ((sn_actuator_port_t){.local_id = FLEET_OUT_ID, .usage_type = PUT_VIRTUAL})
+#define FLEET_OUT_PORT ACTUATOR_PORT_LITERAL("fleet-out", "virtual", FLEET_OUT_DESC)
+
+typedef struct {
+  int nodes;
+  int sensors;            // virtual sensors per node
+  uint32_t sample_ms;     // telemetry period of a node
+  uint32_t status_ms;     // status period of a node
+  uint32_t ramp_ms;       // boots spread over this window
+  uint32_t timeout_ms;    // register or verify ack, the node starts over after it
+  uint32_t reconnect_ms;  // after a dropped connection
+  uint32_t cmd_rate;      // per second over the fleet
+  uint16_t kill_permille; // online nodes dropped at half time
+  int seconds;
+  uint32_t drain_ms;
+  sn_fake_mqtt_link_t link;
+} fleet_config_t;
+
+// clang-format off
+#define FLEET_COUNTERS(X)                                                       \
+  X(connects)      /* connacks seen by the nodes */                            \
+  X(registered)    /* register acks taken */                                   \
+  X(verified)      /* verify acks with ok */                                   \
+  X(timeouts)      /* register or verify attempts that started over */         \
+  X(reconnects)    /* online connections after the first one */                \
+  X(drops)         /* connections broken on purpose */                         \
+  X(telemetry_tx)  /* readings published by the nodes */                       \
+  X(status_tx)     /* status published by the nodes */                         \
+  X(commands_rx)   /* commands executed by the nodes */                        \
+  X(registers_rx)  /* register requests at the backend */                      \
+  X(verifies_rx)   /* verify requests at the backend */                        \
+  X(telemetry_rx)  /* readings at the backend */                               \
+  X(status_rx)     /* status at the backend, wills excluded */                 \
+  X(wills_rx)      /* last wills at the backend */                             \
+  X(commands_tx)   /* commands sent by the backend */                          \
+  X(acks_rx)       /* command acks at the backend */                           \
+  X(acks_unknown)  /* acks without a pending command */                        \
+  X(bad_sig)       /* wrappers failing the hmac check */                       \
+  X(unknown_dev)   /* messages from a device id never handed out */
+
+#define FLEET_SERIES(X)                                                         \
+  X(register_ms,   "register.ms")   /* boot to register ack */                  \
+  X(online_ms,     "online.ms")     /* boot to the online connack */            \
+  X(telemetry_ms,  "telemetry.ms")  /* sample ts to the backend */              \
+  X(cmd_ack_us,    "cmd.ack.us")    /* backend publish to the ack */
+// clang-format on
+
+typedef enum {
+#define GEN_COUNTER_ENUM(NAME) FLEET_C_##NAME,
+  FLEET_COUNTERS(GEN_COUNTER_ENUM) FLEET_C_MAX
+#undef GEN_COUNTER_ENUM
+} fleet_counter_e;
+
+typedef enum {
+#define GEN_SERIES_ENUM(NAME, KEY) FLEET_S_##NAME,
+  FLEET_SERIES(GEN_SERIES_ENUM) FLEET_S_MAX
+#undef GEN_SERIES_ENUM
+} fleet_series_e;
+
+extern uint32_t gFleetCounters[FLEET_C_MAX];
+extern const char *const gFleetCounterNames[FLEET_C_MAX];
+extern sn_host_series_t gFleetSeries[FLEET_S_MAX];
+
+static inline void fleet_count(fleet_counter_e c) {
+  __atomic_fetch_add(&gFleetCounters[c], 1, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t fleet_counter(fleet_counter_e c) {
+  return __atomic_load_n(&gFleetCounters[c], __ATOMIC_RELAXED);
+}
+
+// --------------------------------------------------------------------------------
+// Nodes (fleet_node.c)
+// --------------------------------------------------------------------------------
+
+/*
+ * @brief Allocate the nodes and start the event loop, the boots are spread over
+ * cfg->ramp_ms. The model ports must be bound already, they give the capabilities
+ */
+esp_err_t fleet_nodes_start(const fleet_config_t *cfg);
+
+/*
+ * @brief Break the connection of about permille of the online nodes, their wills go
+ * out and they reconnect after cfg->reconnect_ms
+ */
+void fleet_nodes_drop(uint16_t permille);
+
+/*
+ * @brief Nodes with a live online connection
+ */
+int fleet_nodes_online(void);
+
+// --------------------------------------------------------------------------------
+// Backend (fleet_backend.c)
+// --------------------------------------------------------------------------------
+
+esp_err_t fleet_backend_start(const fleet_config_t *cfg);
+
+/*
+ * @brief Send one set_value command to the next online device, round robin
+ * @return false when no device is online yet or the command table is full
+ */
+bool fleet_backend_send_command(void);
+
+/*
+ * @brief Commands sent and not acked yet
+ */
+uint32_t fleet_backend_acks_missing(void);
+
+#endif // !SN_FLEET_H
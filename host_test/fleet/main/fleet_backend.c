@@ -0,0 +1,273 @@
+#include "fleet.h"
+#include "cJSON.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "sn_json.h"
+#include "sn_security.h"
+#include "sn_sntp.h"
+#include "sn_topic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "FLEET_BACKEND";
+
+#define FLEET_DEVICE_ID_FMT    "6650f1ee%016llx" // 24 hex digits like the backend ids
+#define FLEET_DEVICE_ID_LEN    24
+#define FLEET_SECRET_BYTES     16
+#define FLEET_DEVICES_PER_NODE 4 // registrations a node may burn through timeouts
+
+// Registry of the handed out ids, the index is in the id. Written on the broker task,
+// the command sender only reads the online flags
+typedef struct {
+  char secret[FLEET_SECRET_BYTES * 2 + 1];
+  bool online; // between its online status and its will
+} fleet_device_t;
+
+static fleet_device_t *s_devices = NULL;
+static uint32_t s_devices_cap = 0;
+static uint32_t s_devices_len = 0;
+static uint32_t s_cmd_cursor = 0;
+
+static int64_t *s_cmd_sent_us = NULL; // 0 once acked
+static uint32_t s_cmd_total = 0;
+static uint32_t s_cmd_next = 0;
+
+// --------------------------------------------------------------------------------
+// Helpers
+// --------------------------------------------------------------------------------
+
+// org/<org>/device/<id>/..., -1 for an id this backend did not hand out
+static int device_from_topic(const char *topic) {
+  const char *id = strstr(topic, "/device/");
+  if (!id) return -1;
+  id += strlen("/device/");
+  if (strlen(id) <= FLEET_DEVICE_ID_LEN) return -1;
+  char expected[FLEET_DEVICE_ID_LEN + 1];
+  char *end = NULL;
+  unsigned long long idx = strtoull(id + 8, &end, 16);
+  uint32_t len = __atomic_load_n(&s_devices_len, __ATOMIC_ACQUIRE);
+  if (!end || *end != '/' || end - id != FLEET_DEVICE_ID_LEN || idx >= len) return -1;
+  snprintf(expected, sizeof(expected), FLEET_DEVICE_ID_FMT, idx);
+  return strncmp(id, expected, FLEET_DEVICE_ID_LEN) == 0 ? (int)idx : -1;
+}
+
+static bool wrapper_signed_by(const cJSON *wrapper, const char *secret) {
+  const char *raw = NULL, *sig = NULL;
+  if (!json_get_string(wrapper, "raw_payload", &raw) || !json_get_string(wrapper, "sig", &sig)) {
+    return false;
+  }
+  unsigned char hmac[32];
+  char hex[65];
+  sn_security_calculate_hmac(
+    (const unsigned char *)secret, strlen(secret), (const unsigned char *)raw, strlen(raw), hmac
+  );
+  sn_security_byte_to_hex_string(hmac, sizeof(hmac), hex);
+  return strcmp(hex, sig) == 0;
+}
+
+// the wrapper of a known device with a good signature, NULL otherwise
+static cJSON *parse_signed(const char *topic, const char *data, int len) {
+  int idx = device_from_topic(topic);
+  if (idx < 0) {
+    fleet_count(FLEET_C_unknown_dev);
+    return NULL;
+  }
+  cJSON *wrapper = cJSON_ParseWithLength(data, len);
+  if (!wrapper_signed_by(wrapper, s_devices[idx].secret)) {
+    fleet_count(FLEET_C_bad_sig);
+    cJSON_Delete(wrapper);
+    return NULL;
+  }
+  return wrapper;
+}
+
+static cJSON *parse_raw_payload(const cJSON *wrapper) {
+  const char *raw = NULL;
+  return json_get_string(wrapper, "raw_payload", &raw) ? cJSON_Parse(raw) : NULL;
+}
+
+static void reply(const char *topic, cJSON *json) {
+  char *str = json ? cJSON_PrintUnformatted(json) : NULL;
+  cJSON_Delete(json);
+  if (!str) return;
+  sn_fake_mqtt_publish(topic, str, 0);
+  cJSON_free(str);
+}
+
+// --------------------------------------------------------------------------------
+// Sinks, run on the broker task
+// --------------------------------------------------------------------------------
+
+static void on_register(const char *topic, const char *data, int len, void *arg) {
+  fleet_count(FLEET_C_registers_rx);
+  const char *temp_id = strrchr(topic, '/');
+  if (!temp_id) return;
+  temp_id++;
+
+  cJSON *wrapper = cJSON_ParseWithLength(data, len);
+  cJSON *capabilities = parse_raw_payload(wrapper);
+  const char *hw_id = NULL;
+  bool ok = json_get_string(capabilities, "hw_id", &hw_id) &&
+            cJSON_IsArray(cJSON_GetObjectItemCaseSensitive(capabilities, "sensors"));
+  cJSON_Delete(capabilities);
+  cJSON_Delete(wrapper);
+  if (!ok || s_devices_len >= s_devices_cap) {
+    ESP_LOGW(TAG, "Register from %s refused", temp_id);
+    return;
+  }
+
+  uint32_t idx = s_devices_len;
+  uint8_t secret[FLEET_SECRET_BYTES];
+  esp_fill_random(secret, sizeof(secret));
+  sn_security_byte_to_hex_string(secret, sizeof(secret), s_devices[idx].secret);
+  s_devices[idx].online = false;
+  __atomic_store_n(&s_devices_len, idx + 1, __ATOMIC_RELEASE);
+
+  char device_id[32];
+  snprintf(device_id, sizeof(device_id), FLEET_DEVICE_ID_FMT, (unsigned long long)idx);
+  cJSON *ack = cJSON_CreateObject();
+  cJSON_AddStringToObject(ack, "deviceId", device_id);
+  cJSON_AddStringToObject(ack, "device_secret", s_devices[idx].secret);
+
+  char ack_topic[MAX_TOPIC_LEN];
+  sn_build_device_topic(
+    ack_topic, sizeof(ack_topic), TOPIC_REGISTER_ACK_FMT, FLEET_ORG_ID, temp_id
+  );
+  reply(ack_topic, ack);
+}
+
+static void on_verify(const char *topic, const char *data, int len, void *arg) {
+  fleet_count(FLEET_C_verifies_rx);
+  int idx = device_from_topic(topic);
+  cJSON *wrapper = parse_signed(topic, data, len);
+  bool ok = wrapper != NULL;
+  cJSON_Delete(wrapper);
+  if (idx < 0) return;
+
+  // same device topic with -ack appended
+  char ack_topic[MAX_TOPIC_LEN];
+  snprintf(ack_topic, sizeof(ack_topic), "%s-ack", topic);
+  cJSON *ack = cJSON_CreateObject();
+  cJSON_AddBoolToObject(ack, "ok", ok);
+  reply(ack_topic, ack);
+}
+
+static void on_telemetry(const char *topic, const char *data, int len, void *arg) {
+  unsigned long long now_ms = sn_get_unix_timestamp_ms();
+  cJSON *wrapper = parse_signed(topic, data, len);
+  if (!wrapper) return;
+  fleet_count(FLEET_C_telemetry_rx);
+
+  double sample_ms = 0;
+  cJSON *reading = parse_raw_payload(wrapper);
+  if (json_get_number(reading, "ts", &sample_ms) && sample_ms > 0) {
+    sn_host_series_add(
+      &gFleetSeries[FLEET_S_telemetry_ms], (uint32_t)(now_ms - (unsigned long long)sample_ms)
+    );
+  }
+  cJSON_Delete(reading);
+  cJSON_Delete(wrapper);
+}
+
+// the will of a node is the signed lwt payload, {"online": false}. A node publishes its
+// status once subscribed to its command topic, commands only go to nodes in between
+static void on_status(const char *topic, const char *data, int len, void *arg) {
+  cJSON *wrapper = parse_signed(topic, data, len);
+  if (!wrapper) return;
+  cJSON *status = parse_raw_payload(wrapper);
+  bool online = true;
+  json_get_bool(status, "online", &online);
+  fleet_count(online ? FLEET_C_status_rx : FLEET_C_wills_rx);
+  __atomic_store_n(&s_devices[device_from_topic(topic)].online, online, __ATOMIC_RELEASE);
+  cJSON_Delete(status);
+  cJSON_Delete(wrapper);
+}
+
+static void on_ack(const char *topic, const char *data, int len, void *arg) {
+  int64_t now_us = esp_timer_get_time();
+  cJSON *ack = cJSON_ParseWithLength(data, len);
+  if (!ack) return;
+
+  const char *id = NULL;
+  uint32_t seq = UINT32_MAX;
+  if (json_get_string(ack, "id", &id) &&
+      !strncmp(id, FLEET_CMD_PREFIX, strlen(FLEET_CMD_PREFIX))) {
+    seq = strtoul(id + strlen(FLEET_CMD_PREFIX), NULL, 10);
+  }
+  if (seq < s_cmd_total && s_cmd_sent_us[seq]) {
+    sn_host_series_add(&gFleetSeries[FLEET_S_cmd_ack_us], (uint32_t)(now_us - s_cmd_sent_us[seq]));
+    s_cmd_sent_us[seq] = 0;
+    fleet_count(FLEET_C_acks_rx);
+  } else {
+    fleet_count(FLEET_C_acks_unknown);
+  }
+  cJSON_Delete(ack);
+}
+
+// --------------------------------------------------------------------------------
+// Api
+// --------------------------------------------------------------------------------
+
+esp_err_t fleet_backend_start(const fleet_config_t *cfg) {
+  if (!cfg) return ESP_ERR_INVALID_ARG;
+  s_devices_cap = cfg->nodes * FLEET_DEVICES_PER_NODE;
+  s_devices = calloc(s_devices_cap, sizeof(fleet_device_t));
+  s_cmd_total = cfg->cmd_rate * cfg->seconds;
+  s_cmd_sent_us = calloc(s_cmd_total ? s_cmd_total : 1, sizeof(int64_t));
+  if (!s_devices || !s_cmd_sent_us) return ESP_ERR_NO_MEM;
+
+  struct {
+    const char *fmt;
+    sn_fake_mqtt_sink_t sink;
+  } subs[] = {
+    {TOPIC_REGISTER_FMT, on_register},
+    {TOPIC_DEV_VERIFY_FMT, on_verify},
+    {TOPIC_DEV_FMT "telemetry", on_telemetry},
+    {TOPIC_DEV_FMT "status", on_status},
+    {TOPIC_DEV_FMT "command-ack", on_ack},
+  };
+  for (size_t i = 0; i < sizeof(subs) / sizeof(subs[0]); i++) {
+    char filter[MAX_TOPIC_LEN];
+    sn_build_device_topic(filter, sizeof(filter), subs[i].fmt, FLEET_ORG_ID, "+");
+    esp_err_t err = sn_fake_mqtt_subscribe(filter, subs[i].sink, NULL);
+    if (err != ESP_OK) return err;
+  }
+  return ESP_OK;
+}
+
+bool fleet_backend_send_command(void) {
+  uint32_t len = __atomic_load_n(&s_devices_len, __ATOMIC_ACQUIRE);
+  if (s_cmd_next >= s_cmd_total) return false;
+
+  for (uint32_t tries = 0; tries < len; tries++) {
+    uint32_t idx = s_cmd_cursor++ % len;
+    if (!__atomic_load_n(&s_devices[idx].online, __ATOMIC_ACQUIRE)) continue;
+
+    char device_id[32], topic[MAX_TOPIC_LEN], payload[160];
+    uint32_t seq = s_cmd_next++;
+    snprintf(device_id, sizeof(device_id), FLEET_DEVICE_ID_FMT, (unsigned long long)idx);
+    sn_build_device_topic(topic, sizeof(topic), TOPIC_DEV_FMT "command", FLEET_ORG_ID, device_id);
+    snprintf(
+      payload, sizeof(payload),
+      "{\"id\":\"" FLEET_CMD_PREFIX "%u\",\"localId\":%d,\"action\":\"set_value\","
+      "\"params\":{\"value\":%u}}",
+      (unsigned)seq, FLEET_OUT_ID, (unsigned)(seq % 100)
+    );
+    s_cmd_sent_us[seq] = esp_timer_get_time();
+    if (sn_fake_mqtt_publish(topic, payload, 0) != ESP_OK) {
+      s_cmd_sent_us[seq] = 0;
+      return false;
+    }
+    fleet_count(FLEET_C_commands_tx);
+    return true;
+  }
+  return false;
+}
+
+uint32_t fleet_backend_acks_missing(void) {
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < s_cmd_next; i++) n += s_cmd_sent_us[i] != 0;
+  return n;
+}
@@ -0,0 +1,218 @@
+#include "fleet.h"
+#include "cJSON.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sn_driver.h"
+#include "sn_driver_registry.h"
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *TAG = "SN_FLEET";
+
+#define FLEET_NAME_LEN 16
+
+// the actuator the commands drive, the sensors are added per run
+#define FLEET_FIXED_PORTS(X) X(FLEET_OUT_PORT)
+
+#define GEN_PORT_ENTRY(LITERAL) LITERAL,
+const sn_device_port_desc_t gDevicePorts[] = {FLEET_FIXED_PORTS(GEN_PORT_ENTRY)};
+#undef GEN_PORT_ENTRY
+const size_t gDevicePortsLen = sizeof(gDevicePorts) / sizeof(sn_device_port_desc_t);
+
+uint32_t gFleetCounters[FLEET_C_MAX];
+
+const char *const gFleetCounterNames[FLEET_C_MAX] = {
+#define GEN_COUNTER_NAME(NAME) #NAME,
+  FLEET_COUNTERS(GEN_COUNTER_NAME)
+#undef GEN_COUNTER_NAME
+};
+
+sn_host_series_t gFleetSeries[FLEET_S_MAX] = {
+#define GEN_SERIES_INIT(NAME, KEY) SN_HOST_SERIES_INIT(KEY),
+  FLEET_SERIES(GEN_SERIES_INIT)
+#undef GEN_SERIES_INIT
+};
+
+// counters sampled once a second for the timeline of the report
+#define FLEET_TIMELINE(X) X(connects) X(registered) X(telemetry_rx) X(acks_rx) X(wills_rx)
+
+static int env_int(const char *name, int fallback) {
+  const char *v = getenv(name);
+  return v && v[0] ? atoi(v) : fallback;
+}
+
+static fleet_config_t load_config(void) {
+  fleet_config_t cfg = {
+    .nodes = env_int("SN_FLEET_NODES", 1000),
+    .sensors = env_int("SN_FLEET_SENSORS", 2),
+    .sample_ms = env_int("SN_FLEET_SAMPLE_MS", 5000),
+    .status_ms = env_int("SN_FLEET_STATUS_MS", 30000),
+    .ramp_ms = env_int("SN_FLEET_RAMP_MS", 10000),
+    .timeout_ms = env_int("SN_FLEET_TIMEOUT_MS", 5000),
+    .reconnect_ms = env_int("SN_FLEET_RECONNECT_MS", 2000),
+    .cmd_rate = env_int("SN_FLEET_CMD_RATE", 50),
+    .kill_permille = env_int("SN_FLEET_KILL_PERMILLE", 0),
+    .seconds = env_int("SN_FLEET_SECONDS", 60),
+    .drain_ms = env_int("SN_FLEET_DRAIN_MS", 3000),
+    .link =
+      {.delay_ms = env_int("SN_FLEET_DELAY_MS", 20),
+       .jitter_ms = env_int("SN_FLEET_JITTER_MS", 5),
+       .loss_permille = env_int("SN_FLEET_LOSS_PERMILLE", 0),
+       .rto_ms = env_int("SN_FLEET_RTO_MS", 200)},
+  };
+  if (cfg.nodes < 1) cfg.nodes = 1;
+  if (cfg.sensors < 0) cfg.sensors = 0;
+  if (cfg.sensors > FLEET_MAX_SENSORS) cfg.sensors = FLEET_MAX_SENSORS;
+  if (!cfg.sample_ms) cfg.sample_ms = 1;
+  if (cfg.kill_permille > 1000) cfg.kill_permille = 1000;
+  return cfg;
+}
+
+// --------------------------------------------------------------------------------
+// Model: the ports every node has, bound once so the capabilities describe them
+// --------------------------------------------------------------------------------
+
+static sn_device_port_desc_t s_ports[FLEET_MAX_SENSORS + 1];
+static sn_port_measurement_map_t s_maps[FLEET_MAX_SENSORS][2];
+static char s_names[FLEET_MAX_SENSORS][FLEET_NAME_LEN];
+
+static size_t build_model(const fleet_config_t *cfg) {
+  size_t n = 0;
+  for (int i = 0; i < cfg->sensors; i++, n++) {
+    s_maps[i][0] = (sn_port_measurement_map_t)MEASUREMENT_MAP_ENTRY(0x01 + i, ST_TEMPERATURE, "C");
+    s_maps[i][1] = (sn_port_measurement_map_t)MEASUREMENT_MAP_ENTRY_NULL();
+    snprintf(s_names[i], FLEET_NAME_LEN, "virt-%d", i);
+    s_ports[n] = (sn_device_port_desc_t)SENSOR_PORT_LITERAL(
+      s_names[i], "virtual",
+      ((sn_sensor_port_t){.usage_type = PUT_VIRTUAL,
+                          .usage.virt = {.base = 25, .amplitude = 5, .period_ms = 600000},
+                          .measurements = s_maps[i],
+                          .sample_rate_ms = cfg->sample_ms})
+    );
+  }
+  for (size_t i = 0; i < gDevicePortsLen; i++) s_ports[n++] = gDevicePorts[i];
+  return n;
+}
+
+static size_t heap_used(void) { return mallinfo2().uordblks; }
+
+// --------------------------------------------------------------------------------
+// Entry
+// --------------------------------------------------------------------------------
+
+void app_main(void) {
+  fleet_config_t cfg = load_config();
+
+  // the per node logs would measure the console
+  esp_log_level_set("*", ESP_LOG_ERROR);
+  esp_log_level_set(TAG, ESP_LOG_INFO);
+
+  sn_fake_mqtt_set_link(&cfg.link);
+  ESP_ERROR_CHECK(fleet_backend_start(&cfg));
+
+  sn_driver_register(&virtual_driver);
+  sn_driver_bind_all_ports(s_ports, build_model(&cfg));
+
+  size_t heap_before = heap_used();
+  int64_t run_start = esp_timer_get_time();
+  ESP_ERROR_CHECK(fleet_nodes_start(&cfg));
+
+  cJSON *timeline = cJSON_CreateObject();
+#define GEN_TIMELINE_ARRAY(NAME) cJSON *tl_##NAME = cJSON_AddArrayToObject(timeline, #NAME);
+  FLEET_TIMELINE(GEN_TIMELINE_ARRAY)
+#undef GEN_TIMELINE_ARRAY
+  cJSON *tl_online = cJSON_AddArrayToObject(timeline, "online");
+  uint32_t last[FLEET_C_MAX] = {0};
+
+  // commands at a fixed rate, the counters sampled on every second
+  int64_t end = run_start + cfg.seconds * 1000000LL;
+  int64_t period_us = cfg.cmd_rate ? 1000000LL / cfg.cmd_rate : 0;
+  int64_t next_cmd = run_start, next_sample = run_start + 1000000LL;
+  bool dropped = cfg.kill_permille == 0;
+  for (int64_t now = run_start; now < end; now = esp_timer_get_time()) {
+    while (period_us && next_cmd <= now) {
+      fleet_backend_send_command();
+      next_cmd += period_us;
+    }
+    if (!dropped && now >= run_start + cfg.seconds * 500000LL) {
+      fleet_nodes_drop(cfg.kill_permille);
+      dropped = true;
+    }
+    if (now >= next_sample) {
+#define GEN_TIMELINE_SAMPLE(NAME)                                                                  \
+  {                                                                                                \
+    uint32_t v = fleet_counter(FLEET_C_##NAME);                                                    \
+    cJSON_AddItemToArray(tl_##NAME, cJSON_CreateNumber(v - last[FLEET_C_##NAME]));                 \
+    last[FLEET_C_##NAME] = v;                                                                      \
+  }
+      FLEET_TIMELINE(GEN_TIMELINE_SAMPLE)
+#undef GEN_TIMELINE_SAMPLE
+      cJSON_AddItemToArray(tl_online, cJSON_CreateNumber(fleet_nodes_online()));
+      next_sample += 1000000LL;
+    }
+    vTaskDelay(1);
+  }
+  double elapsed = (esp_timer_get_time() - run_start) / 1e6;
+  size_t heap_run = heap_used();
+
+  // what is still in flight gets drain_ms to arrive
+  for (uint32_t waited = 0; waited < cfg.drain_ms && fleet_backend_acks_missing(); waited += 50) {
+    vTaskDelay(pdMS_TO_TICKS(50));
+  }
+  uint32_t missing = fleet_backend_acks_missing();
+
+  cJSON *report = cJSON_CreateObject();
+  cJSON *c = cJSON_AddObjectToObject(report, "config");
+  cJSON_AddNumberToObject(c, "nodes", cfg.nodes);
+  cJSON_AddNumberToObject(c, "sensors", cfg.sensors);
+  cJSON_AddNumberToObject(c, "sample_ms", cfg.sample_ms);
+  cJSON_AddNumberToObject(c, "status_ms", cfg.status_ms);
+  cJSON_AddNumberToObject(c, "ramp_ms", cfg.ramp_ms);
+  cJSON_AddNumberToObject(c, "cmd_rate", cfg.cmd_rate);
+  cJSON_AddNumberToObject(c, "kill_permille", cfg.kill_permille);
+  cJSON_AddNumberToObject(c, "seconds", elapsed);
+  cJSON_AddNumberToObject(c, "delay_ms", cfg.link.delay_ms);
+  cJSON_AddNumberToObject(c, "jitter_ms", cfg.link.jitter_ms);
+  cJSON_AddNumberToObject(c, "loss_permille", cfg.link.loss_permille);
+
+  cJSON *r = cJSON_AddObjectToObject(report, "rates");
+  cJSON_AddNumberToObject(r, "connects_s", fleet_counter(FLEET_C_connects) / elapsed);
+  cJSON_AddNumberToObject(
+    r, "telemetry_expected_s", cfg.nodes * cfg.sensors * 1000.0 / cfg.sample_ms
+  );
+  cJSON_AddNumberToObject(r, "telemetry_s", fleet_counter(FLEET_C_telemetry_rx) / elapsed);
+  cJSON_AddNumberToObject(r, "commands_s", fleet_counter(FLEET_C_commands_tx) / elapsed);
+  cJSON_AddNumberToObject(r, "acks_s", fleet_counter(FLEET_C_acks_rx) / elapsed);
+
+  cJSON *n = cJSON_AddObjectToObject(report, "counters");
+  for (int i = 0; i < FLEET_C_MAX; i++) {
+    cJSON_AddNumberToObject(n, gFleetCounterNames[i], fleet_counter(i));
+  }
+  cJSON_AddNumberToObject(n, "online", fleet_nodes_online());
+  cJSON_AddNumberToObject(n, "acks_missing", missing);
+
+  cJSON *l = cJSON_AddObjectToObject(report, "latency");
+  for (int i = 0; i < FLEET_S_MAX; i++) {
+    cJSON_AddItemToObject(l, gFleetSeries[i].key, sn_host_series_to_json(&gFleetSeries[i]));
+  }
+  cJSON_AddItemToObject(report, "timeline", timeline);
+  cJSON_AddItemToObject(report, "broker", sn_fake_mqtt_stats_to_json());
+  cJSON *m = cJSON_AddObjectToObject(report, "memory");
+  cJSON_AddNumberToObject(m, "per_node", (double)(heap_run - heap_before) / cfg.nodes);
+
+  char *str = cJSON_Print(report);
+  printf("%s\n", str);
+  cJSON_free(str);
+  cJSON_Delete(report);
+
+  // every node verified, every signature good, and every will from a node we dropped
+  bool ok = fleet_counter(FLEET_C_verified) >= (uint32_t)cfg.nodes &&
+            fleet_counter(FLEET_C_bad_sig) == 0 && fleet_counter(FLEET_C_telemetry_rx) > 0 &&
+            fleet_counter(FLEET_C_wills_rx) == fleet_counter(FLEET_C_drops) &&
+            (missing == 0 || cfg.kill_permille);
+  ESP_LOGI(TAG, "%s", ok ? "Fleet run passed" : "Fleet run failed");
+  exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
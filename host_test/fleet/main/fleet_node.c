@@ -0,0 +1,542 @@
+#include "fleet.h"
+#include "cJSON.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "mqtt_client.h"
+#include "sn_capability.h"
+#include "sn_driver.h"
+#include "sn_driver_registry.h"
+#include "sn_json.h"
+#include "sn_security.h"
+#include "sn_sntp.h"
+#include "sn_topic.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "FLEET_NODE";
+
+#define FLEET_NAME_LEN     16
+#define FLEET_ID_LEN       32
+#define FLEET_SECRET_LEN   65
+#define FLEET_EVENT_QUEUE  1024
+#define FLEET_LOOP_STACK   8192
+#define FLEET_LOOP_PRIO    4
+#define FLEET_RETRY_MS     2000
+#define FLEET_READINGS_MAX 4
+
+typedef enum {
+  NODE_IDLE = 0,    // waiting for its boot
+  NODE_REGISTERING, // ephemeral client on register/<temp id>
+  NODE_VERIFYING,   // ephemeral client on device/<id>/verify
+  NODE_ONLINE,      // main client, with the status topic as will
+  NODE_DOWN,        // main client lost its connection
+} node_state_e;
+
+typedef struct {
+  uint32_t idx;
+  node_state_e state;
+  bool connected;
+  bool was_online;
+  esp_mqtt_client_handle_t client;
+  int64_t boot_us;
+  int64_t timer_us; // the live entry of the timer heap, 0 when none
+  int64_t next_status_us;
+  char temp_id[16];
+  char hw_id[20];
+  char device_id[FLEET_ID_LEN];
+  char secret[FLEET_SECRET_LEN];
+  sn_device_port_desc_t ports[FLEET_MAX_SENSORS];
+  sn_port_measurement_map_t maps[FLEET_MAX_SENSORS][2];
+  char names[FLEET_MAX_SENSORS][FLEET_NAME_LEN];
+  sn_driver_ctx_u sensors[FLEET_MAX_SENSORS];
+  sn_driver_ctx_u out;
+} fleet_node_t;
+
+typedef enum {
+  FLEET_EV_MQTT = 0,
+  FLEET_EV_DROP,
+} fleet_event_kind_e;
+
+// topic and data are owned by the event
+typedef struct {
+  fleet_event_kind_e kind;
+  fleet_node_t *node;
+  esp_mqtt_client_handle_t client;
+  esp_mqtt_event_id_t id;
+  char *topic;
+  char *data;
+  int len;
+} fleet_event_t;
+
+typedef struct {
+  int64_t due_us;
+  fleet_node_t *node;
+} fleet_timer_t;
+
+static fleet_config_t s_cfg;
+static fleet_node_t *s_nodes = NULL;
+static QueueHandle_t s_events = NULL;
+
+// min-heap of node timers, only the loop task touches it. A node keeps one live
+// entry, the ones it replaced are skipped when they come up
+static fleet_timer_t *s_timers = NULL;
+static size_t s_timers_len = 0;
+static size_t s_timers_cap = 0;
+
+static int s_online = 0; // written by the loop task only
+
+static inline void online_add(int d) { __atomic_add_fetch(&s_online, d, __ATOMIC_RELAXED); }
+
+// --------------------------------------------------------------------------------
+// Timers
+// --------------------------------------------------------------------------------
+
+static void timer_set(fleet_node_t *node, int64_t due_us) {
+  if (s_timers_len == s_timers_cap) {
+    size_t cap = s_timers_cap ? s_timers_cap * 2 : 1024;
+    fleet_timer_t *timers = realloc(s_timers, cap * sizeof(*timers));
+    if (!timers) {
+      ESP_LOGE(TAG, "No memory for the timer of node %u", (unsigned)node->idx);
+      return;
+    }
+    s_timers = timers;
+    s_timers_cap = cap;
+  }
+  fleet_timer_t t = {.due_us = due_us, .node = node};
+  size_t i = s_timers_len++;
+  while (i && t.due_us < s_timers[(i - 1) / 2].due_us) {
+    s_timers[i] = s_timers[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  s_timers[i] = t;
+  node->timer_us = due_us;
+}
+
+static fleet_timer_t timer_pop(void) {
+  fleet_timer_t top = s_timers[0];
+  fleet_timer_t last = s_timers[--s_timers_len];
+  size_t i = 0;
+  for (;;) {
+    size_t c = 2 * i + 1;
+    if (c >= s_timers_len) break;
+    if (c + 1 < s_timers_len && s_timers[c + 1].due_us < s_timers[c].due_us) c++;
+    if (s_timers[c].due_us >= last.due_us) break;
+    s_timers[i] = s_timers[c];
+    i = c;
+  }
+  if (s_timers_len) s_timers[i] = last;
+  return top;
+}
+
+// --------------------------------------------------------------------------------
+// Node side of the mqtt client, the handler runs on the broker task
+// --------------------------------------------------------------------------------
+
+static void node_mqtt_handler(void *arg, esp_event_base_t base, int32_t id, void *data) {
+  esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)data;
+  fleet_event_t ev = {
+    .kind = FLEET_EV_MQTT, .node = (fleet_node_t *)arg, .client = event->client, .id = id
+  };
+  if (id == MQTT_EVENT_DATA) {
+    ev.topic = strndup(event->topic, event->topic_len);
+    ev.data = strndup(event->data, event->data_len);
+    ev.len = event->data_len;
+    if (!ev.topic || !ev.data) {
+      free(ev.topic);
+      free(ev.data);
+      return;
+    }
+  } else if (id != MQTT_EVENT_CONNECTED && id != MQTT_EVENT_DISCONNECTED) {
+    return;
+  }
+  // blocks the broker when the loop falls behind, like a full socket buffer
+  xQueueSend(s_events, &ev, portMAX_DELAY);
+}
+
+static esp_mqtt_client_handle_t node_client(fleet_node_t *node, const char *will_topic) {
+  char client_id[FLEET_ID_LEN];
+  snprintf(client_id, sizeof(client_id), "fleet-%u", (unsigned)node->idx);
+  esp_mqtt_client_config_t conf = {
+    .broker.address.uri = "mqtt://loopback",
+    .credentials.client_id = client_id,
+  };
+
+  char *will = NULL;
+  if (will_topic) {
+    cJSON *payload = sn_security_sign_and_wrap_payload_with_secret(
+      create_lwt_payload_json(), node->secret
+    );
+    will = payload ? cJSON_PrintUnformatted(payload) : NULL;
+    cJSON_Delete(payload);
+    if (!will) return NULL;
+    conf.session.last_will.topic = will_topic;
+    conf.session.last_will.msg = will;
+    conf.session.last_will.qos = 1;
+  }
+
+  esp_mqtt_client_handle_t client = esp_mqtt_client_init(&conf);
+  cJSON_free(will);
+  if (!client) return NULL;
+  esp_mqtt_client_register_event(client, MQTT_EVENT_ANY, node_mqtt_handler, node);
+  if (esp_mqtt_client_start(client) != ESP_OK) {
+    esp_mqtt_client_destroy(client);
+    return NULL;
+  }
+  return client;
+}
+
+static void node_close(fleet_node_t *node) {
+  if (!node->client) return;
+  esp_mqtt_client_stop(node->client);
+  esp_mqtt_client_destroy(node->client);
+  node->client = NULL;
+  if (node->connected && node->state == NODE_ONLINE) online_add(-1);
+  node->connected = false;
+}
+
+static int publish_json(fleet_node_t *node, const char *topic, cJSON *json, int qos) {
+  if (!json) return -1;
+  char *str = cJSON_PrintUnformatted(json);
+  cJSON_Delete(json);
+  if (!str) return -1;
+  int msg_id = esp_mqtt_client_publish(node->client, topic, str, 0, qos, 0);
+  cJSON_free(str);
+  return msg_id;
+}
+
+static inline void node_topic(const fleet_node_t *node, char *buf, size_t len, const char *fmt) {
+  sn_build_device_topic(buf, len, fmt, FLEET_ORG_ID, node->device_id);
+}
+
+// --------------------------------------------------------------------------------
+// Flow of main.c: register, verify, online
+// --------------------------------------------------------------------------------
+
+static void node_boot(fleet_node_t *node) {
+  node_close(node);
+  node->state = NODE_REGISTERING;
+  node->device_id[0] = '\0';
+  node->secret[0] = '\0';
+  snprintf(node->temp_id, sizeof(node->temp_id), "temp-%08lx", (unsigned long)esp_random());
+  node->client = node_client(node, NULL);
+  timer_set(node, esp_timer_get_time() + s_cfg.timeout_ms * 1000LL);
+}
+
+// a fresh device has no secret, the register request goes out unsigned
+static void node_send_register(fleet_node_t *node) {
+  char topic[MAX_TOPIC_LEN];
+  sn_build_device_topic(topic, sizeof(topic), TOPIC_REGISTER_ACK_FMT, FLEET_ORG_ID, node->temp_id);
+  esp_mqtt_client_subscribe(node->client, topic, 1);
+
+  cJSON *capabilities = device_ports_to_capabilities_json();
+  if (!capabilities) return;
+  cJSON_ReplaceItemInObject(capabilities, "hw_id", cJSON_CreateString(node->hw_id));
+  sn_build_device_topic(topic, sizeof(topic), TOPIC_REGISTER_FMT, FLEET_ORG_ID, node->temp_id);
+  publish_json(node, topic, sn_security_sign_and_wrap_payload_with_secret(capabilities, NULL), 1);
+}
+
+static void node_send_verify(fleet_node_t *node) {
+  char topic[MAX_TOPIC_LEN];
+  node_topic(node, topic, sizeof(topic), TOPIC_DEV_VERIFY_ACK_FMT);
+  esp_mqtt_client_subscribe(node->client, topic, 1);
+
+  node_topic(node, topic, sizeof(topic), TOPIC_DEV_VERIFY_FMT);
+  cJSON *payload = sn_security_sign_and_wrap_payload_with_secret(
+    cJSON_Parse("{\"fw_ver\":\"v1.0.0\"}"), node->secret
+  );
+  publish_json(node, topic, payload, 1);
+}
+
+static void node_on_register_ack(fleet_node_t *node, const char *data) {
+  cJSON *ack = cJSON_Parse(data);
+  const char *device_id = NULL, *secret = NULL;
+  bool ok = json_get_string(ack, "deviceId", &device_id) &&
+            json_get_string(ack, "device_secret", &secret) &&
+            strlen(device_id) < sizeof(node->device_id) && strlen(secret) < sizeof(node->secret);
+  if (ok) {
+    strcpy(node->device_id, device_id);
+    strcpy(node->secret, secret);
+  }
+  cJSON_Delete(ack);
+  if (!ok) return; // the timeout starts it over
+
+  fleet_count(FLEET_C_registered);
+  int64_t now = esp_timer_get_time();
+  sn_host_series_add(&gFleetSeries[FLEET_S_register_ms], (uint32_t)((now - node->boot_us) / 1000));
+  node_close(node);
+  node->state = NODE_VERIFYING;
+  node->client = node_client(node, NULL);
+  timer_set(node, now + s_cfg.timeout_ms * 1000LL);
+}
+
+static void node_on_verify_ack(fleet_node_t *node, const char *data) {
+  cJSON *ack = cJSON_Parse(data);
+  bool ok = false;
+  json_get_bool(ack, "ok", &ok);
+  cJSON_Delete(ack);
+  if (!ok) return;
+
+  fleet_count(FLEET_C_verified);
+  char topic[MAX_TOPIC_LEN];
+  node_topic(node, topic, sizeof(topic), TOPIC_DEV_FMT "status");
+  node_close(node);
+  node->state = NODE_ONLINE;
+  node->client = node_client(node, topic);
+  timer_set(node, esp_timer_get_time() + s_cfg.timeout_ms * 1000LL);
+}
+
+static void node_publish_status(fleet_node_t *node) {
+  char topic[MAX_TOPIC_LEN];
+  node_topic(node, topic, sizeof(topic), TOPIC_DEV_FMT "status");
+  cJSON *status = cJSON_CreateObject();
+  if (!status) return;
+  cJSON_AddNumberToObject(status, "ts", sn_get_unix_timestamp_ms());
+  cJSON_AddBoolToObject(status, "online", true);
+  cJSON *json = sn_security_sign_and_wrap_payload_with_secret(status, node->secret);
+  if (publish_json(node, topic, json, 0) >= 0) fleet_count(FLEET_C_status_tx);
+}
+
+static void node_on_online(fleet_node_t *node) {
+  char topic[MAX_TOPIC_LEN];
+  node_topic(node, topic, sizeof(topic), TOPIC_DEV_FMT "command");
+  esp_mqtt_client_subscribe(node->client, topic, 1);
+
+  int64_t now = esp_timer_get_time();
+  if (node->was_online) {
+    fleet_count(FLEET_C_reconnects);
+  } else {
+    sn_host_series_add(&gFleetSeries[FLEET_S_online_ms], (uint32_t)((now - node->boot_us) / 1000));
+  }
+  node->was_online = true;
+  node->state = NODE_ONLINE;
+  online_add(1);
+  // like status_poll_task, a status right away then one per period
+  node_publish_status(node);
+  node->next_status_us = now + s_cfg.status_ms * 1000LL;
+  // the first sample lands anywhere in the period so the fleet does not beat
+  timer_set(node, now + (esp_random() % s_cfg.sample_ms) * 1000LL);
+}
+
+// same payload as sensor_poll_task, one signed reading per publish
+static void node_publish_telemetry(fleet_node_t *node) {
+  char topic[MAX_TOPIC_LEN];
+  node_topic(node, topic, sizeof(topic), TOPIC_DEV_FMT "telemetry");
+  for (int i = 0; i < s_cfg.sensors; i++) {
+    sn_sensor_reading_t readings[FLEET_READINGS_MAX];
+    int n = 0;
+    if (virtual_driver.read_multi(&node->sensors[i], readings, FLEET_READINGS_MAX, &n) != ESP_OK) {
+      continue;
+    }
+    for (int r = 0; r < n; r++) {
+      cJSON *json = sn_security_sign_and_wrap_payload_with_secret(
+        sensor_reading_to_json_obj(&readings[r]), node->secret
+      );
+      if (publish_json(node, topic, json, 0) >= 0) fleet_count(FLEET_C_telemetry_tx);
+    }
+  }
+}
+
+// same ack as sn_command_executor: the driver result with the correlation id
+static void node_on_command(fleet_node_t *node, const char *data) {
+  cJSON *command = cJSON_Parse(data);
+  if (!command) return;
+
+  const char *id = NULL, *action = NULL;
+  double local_id = 0;
+  json_get_string(command, "id", &id);
+  json_get_number(command, "localId", &local_id);
+  json_get_string(command, "action", &action);
+  const cJSON *params = cJSON_GetObjectItemCaseSensitive(command, "params");
+
+  cJSON *result = NULL;
+  if ((int)local_id != FLEET_OUT_ID) {
+    result = build_error_fmt("No device with localId %d", (int)local_id);
+  } else if (!action || strcmp(action, virtual_driver.command_desc->action) != 0) {
+    result = build_error_fmt("Unknown action");
+  } else if (virtual_driver.control(&node->out, params, &result) != ESP_OK && !result) {
+    result = build_error_fmt("Command failed");
+  }
+  fleet_count(FLEET_C_commands_rx);
+
+  if (result) {
+    if (id && id[0]) cJSON_AddStringToObject(result, "id", id);
+    char topic[MAX_TOPIC_LEN];
+    node_topic(node, topic, sizeof(topic), TOPIC_DEV_FMT "command-ack");
+    publish_json(node, topic, result, 1);
+  }
+  cJSON_Delete(command);
+}
+
+static void node_on_timer(fleet_node_t *node) {
+  int64_t now = esp_timer_get_time();
+  switch (node->state) {
+    case NODE_IDLE: node_boot(node); break;
+    case NODE_REGISTERING:
+    case NODE_VERIFYING:
+      // no ack in time, start over like a rebooted device
+      fleet_count(FLEET_C_timeouts);
+      node_close(node);
+      node->state = NODE_IDLE;
+      timer_set(node, now + FLEET_RETRY_MS * 1000LL);
+      break;
+    case NODE_ONLINE:
+      if (!node->connected) {
+        // the online connack did not come, keep the client and try again
+        fleet_count(FLEET_C_timeouts);
+        esp_mqtt_client_start(node->client);
+        timer_set(node, now + s_cfg.timeout_ms * 1000LL);
+        break;
+      }
+      node_publish_telemetry(node);
+      if (now >= node->next_status_us) {
+        node_publish_status(node);
+        node->next_status_us = now + s_cfg.status_ms * 1000LL;
+      }
+      timer_set(node, now + s_cfg.sample_ms * 1000LL);
+      break;
+    case NODE_DOWN:
+      esp_mqtt_client_start(node->client);
+      node->state = NODE_ONLINE;
+      timer_set(node, now + s_cfg.timeout_ms * 1000LL);
+      break;
+  }
+}
+
+static void node_on_mqtt(fleet_node_t *node, const fleet_event_t *ev) {
+  // events of a client the node already closed
+  if (ev->client != node->client) return;
+
+  switch (ev->id) {
+    case MQTT_EVENT_CONNECTED:
+      fleet_count(FLEET_C_connects);
+      if (node->connected) break;
+      node->connected = true;
+      if (node->state == NODE_REGISTERING) node_send_register(node);
+      if (node->state == NODE_VERIFYING) node_send_verify(node);
+      if (node->state == NODE_ONLINE) node_on_online(node);
+      break;
+    case MQTT_EVENT_DISCONNECTED:
+      if (node->connected && node->state == NODE_ONLINE) online_add(-1);
+      node->connected = false;
+      if (node->state != NODE_ONLINE) break;
+      node->state = NODE_DOWN;
+      timer_set(node, esp_timer_get_time() + s_cfg.reconnect_ms * 1000LL);
+      break;
+    case MQTT_EVENT_DATA: {
+      const char *leaf = strrchr(ev->topic, '/');
+      leaf = leaf ? leaf + 1 : ev->topic;
+      if (node->state == NODE_REGISTERING && strstr(ev->topic, "/register-ack/")) {
+        node_on_register_ack(node, ev->data);
+      } else if (node->state == NODE_VERIFYING && !strcmp(leaf, "verify-ack")) {
+        node_on_verify_ack(node, ev->data);
+      } else if (node->state == NODE_ONLINE && !strcmp(leaf, "command")) {
+        node_on_command(node, ev->data);
+      }
+    } break;
+    default: break;
+  }
+}
+
+static void node_on_drop(fleet_node_t *node) {
+  if (node->state != NODE_ONLINE || !node->connected) return;
+  if (sn_fake_mqtt_drop(node->client) == ESP_OK) fleet_count(FLEET_C_drops);
+}
+
+// --------------------------------------------------------------------------------
+// Event loop, every node runs on it
+// --------------------------------------------------------------------------------
+
+static void fleet_loop_task(void *arg) {
+  for (;;) {
+    int64_t now = esp_timer_get_time();
+    while (s_timers_len && s_timers[0].due_us <= now) {
+      fleet_timer_t t = timer_pop();
+      if (t.node->timer_us != t.due_us) continue; // replaced
+      t.node->timer_us = 0;
+      node_on_timer(t.node);
+    }
+
+    TickType_t wait = portMAX_DELAY;
+    if (s_timers_len) {
+      int64_t left_us = s_timers[0].due_us - esp_timer_get_time();
+      wait = left_us > 0 ? pdMS_TO_TICKS((left_us + 999) / 1000) : 0;
+    }
+    fleet_event_t ev;
+    if (xQueueReceive(s_events, &ev, wait) != pdTRUE) continue;
+    if (ev.kind == FLEET_EV_DROP) {
+      node_on_drop(ev.node);
+    } else {
+      node_on_mqtt(ev.node, &ev);
+    }
+    free(ev.topic);
+    free(ev.data);
+  }
+}
+
+// --------------------------------------------------------------------------------
+// Api
+// --------------------------------------------------------------------------------
+
+static esp_err_t node_init(fleet_node_t *node, uint32_t idx) {
+  node->idx = idx;
+  snprintf(node->hw_id, sizeof(node->hw_id), "F1EE7%07X", (unsigned)idx);
+  for (int i = 0; i < s_cfg.sensors; i++) {
+    node->maps[i][0] = (sn_port_measurement_map_t
+    )MEASUREMENT_MAP_ENTRY(0x01 + i, ST_TEMPERATURE, "C");
+    node->maps[i][1] = (sn_port_measurement_map_t)MEASUREMENT_MAP_ENTRY_NULL();
+    // the name seeds the phase and the noise of the signal
+    snprintf(node->names[i], FLEET_NAME_LEN, "n%u-s%d", (unsigned)idx, i);
+    node->ports[i] = (sn_device_port_desc_t)SENSOR_PORT_LITERAL(
+      node->names[i], "virtual",
+      ((sn_sensor_port_t){.usage_type = PUT_VIRTUAL,
+                          .usage.virt = {.base = 25, .amplitude = 5, .noise = 0.5f,
+                                         .period_ms = 600000},
+                          .measurements = node->maps[i],
+                          .sample_rate_ms = s_cfg.sample_ms})
+    );
+    esp_err_t err = virtual_driver.init(&node->ports[i], &node->sensors[i], sizeof(node->out));
+    if (err != ESP_OK) return err;
+  }
+  static const sn_device_port_desc_t out = FLEET_OUT_PORT;
+  return virtual_driver.init(&out, &node->out, sizeof(sn_driver_ctx_u));
+}
+
+esp_err_t fleet_nodes_start(const fleet_config_t *cfg) {
+  if (!cfg || cfg->nodes <= 0 || cfg->sensors > FLEET_MAX_SENSORS) return ESP_ERR_INVALID_ARG;
+  s_cfg = *cfg;
+  if (!s_cfg.sample_ms) s_cfg.sample_ms = 1;
+
+  s_nodes = calloc(s_cfg.nodes, sizeof(fleet_node_t));
+  s_events = xQueueCreate(FLEET_EVENT_QUEUE, sizeof(fleet_event_t));
+  if (!s_nodes || !s_events) return ESP_ERR_NO_MEM;
+
+  int64_t now = esp_timer_get_time();
+  for (int i = 0; i < s_cfg.nodes; i++) {
+    fleet_node_t *node = &s_nodes[i];
+    esp_err_t err = node_init(node, i);
+    if (err != ESP_OK) return err;
+    node->boot_us = now + (int64_t)s_cfg.ramp_ms * 1000 * i / s_cfg.nodes;
+    timer_set(node, node->boot_us);
+  }
+  ESP_LOGI(TAG, "%d nodes, %u bytes each", s_cfg.nodes, (unsigned)sizeof(fleet_node_t));
+
+  BaseType_t ok = xTaskCreate(
+    fleet_loop_task, "fleet_loop", FLEET_LOOP_STACK, NULL, FLEET_LOOP_PRIO, NULL
+  );
+  return ok == pdPASS ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void fleet_nodes_drop(uint16_t permille) {
+  for (int i = 0; i < s_cfg.nodes; i++) {
+    if (esp_random() % 1000 >= permille) continue;
+    fleet_event_t ev = {.kind = FLEET_EV_DROP, .node = &s_nodes[i]};
+    xQueueSend(s_events, &ev, portMAX_DELAY);
+  }
+}
+
+int fleet_nodes_online(void) { return __atomic_load_n(&s_online, __ATOMIC_RELAXED); }
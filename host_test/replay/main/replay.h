@@ -0,0 +1,74 @@
+// --------------------------------------------------------------------------------
+// replay.h
+//
+// description: rule transitions and the commands they dispatched, as recorded on the
+// device or produced by the replay, and the diff of the two
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_REPLAY_H
+#define SN_REPLAY_H
+
+#include "cJSON.h"
+#include "esp_err.h"
+#include "sn_recorder.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// strings are borrowed from the log image or the rules of the firmware
+typedef struct {
+  local_id_t local_id;
+  int32_t result;
+  const char *action;
+  const char *params_json;
+} replay_cmd_t;
+
+typedef struct {
+  unsigned long long ts; // of the reading that caused it
+  local_id_t rule_id;
+  local_id_t src_id;
+  uint8_t from;
+  uint8_t to;
+  float value;
+  uint32_t cmds;     // first command in the track
+  uint32_t cmds_len; // dispatched on the transition
+} replay_transition_t;
+
+typedef struct {
+  replay_transition_t *items;
+  size_t len;
+  size_t cap;
+  replay_cmd_t *cmds;
+  size_t cmds_len;
+  size_t cmds_cap;
+  bool open;        // a dispatch belongs to the last transition
+  uint32_t orphans; // dispatches without a transition before them
+} replay_track_t;
+
+/*
+ * @brief Take a transition or a dispatch, a boot ends the last transition. Other
+ * records are ignored
+ */
+esp_err_t replay_track_add(replay_track_t *track, const sn_rec_t *rec);
+
+void replay_track_free(replay_track_t *track);
+
+typedef struct {
+  uint32_t matched;
+  uint32_t changed;         // other state or other commands
+  uint32_t missing;         // recorded, not replayed
+  uint32_t extra;           // replayed, not recorded
+  uint32_t results_changed; // same commands, other dispatch results
+} replay_diff_t;
+
+/*
+ * @brief Match the transitions of both tracks on (reading ts, source, rule) and compare
+ * the target state and the commands. Sorts both tracks
+ * @param entries (optional) filled with the first max_entries differences
+ */
+replay_diff_t replay_track_diff(
+  replay_track_t *recorded, replay_track_t *replayed, cJSON *entries, int max_entries
+);
+
+#endif // !SN_REPLAY_H
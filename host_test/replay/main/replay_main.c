@@ -0,0 +1,302 @@
+#include "replay.h"
+#include "cJSON.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sn_adc_helper.h"
+#include "sn_capability.h"
+#include "sn_driver.h"
+#include "sn_driver_registry.h"
+#include "sn_fake_hal.h"
+#include "sn_json.h"
+#include "sn_rules/sn_rule_engine.h"
+#include "sn_storage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "SN_REPLAY";
+
+#define REPLAY_MAX_BANDS   16
+#define REPLAY_MAX_ENTRIES 20 // differences listed in the report
+
+typedef struct {
+  local_id_t rule_id;
+  double low;
+  double high;
+} replay_band_t;
+
+typedef struct {
+  uint32_t boots;
+  uint32_t readings;
+  uint32_t commands;
+  uint32_t commands_skipped; // group or truncated payloads
+  uint32_t commands_expired;
+  uint32_t commands_invalid;
+} replay_counts_t;
+
+static replay_band_t s_bands[REPLAY_MAX_BANDS];
+static int s_bands_len = 0;
+
+static const char *env_or(const char *name, const char *fallback) {
+  const char *v = getenv(name);
+  return v && v[0] ? v : fallback;
+}
+
+static uint8_t *load_file(const char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return NULL;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *buf = size > 0 ? malloc(size) : NULL;
+  if (buf && fread(buf, 1, size, f) != (size_t)size) {
+    free(buf);
+    buf = NULL;
+  }
+  fclose(f);
+  *len = buf ? (size_t)size : 0;
+  return buf;
+}
+
+// SN_REPLAY_BANDS="0xfe:30:85,0x10:5:40", rule id and the new low and high
+static void parse_bands(const char *spec) {
+  while (spec && *spec && s_bands_len < REPLAY_MAX_BANDS) {
+    char *end = NULL;
+    replay_band_t b = {.rule_id = (local_id_t)strtol(spec, &end, 0)};
+    if (*end != ':') break;
+    b.low = strtod(end + 1, &end);
+    if (*end != ':') break;
+    b.high = strtod(end + 1, &end);
+    s_bands[s_bands_len++] = b;
+    spec = *end == ',' ? end + 1 : NULL;
+  }
+}
+
+static void apply_bands(void) {
+  for (int i = 0; i < s_bands_len; i++) {
+    esp_err_t err = sn_rule_engine_set_band(s_bands[i].rule_id, s_bands[i].low, s_bands[i].high);
+    if (err != ESP_OK) {
+      ESP_LOGW(TAG, "Band of rule 0x%02x: %s", s_bands[i].rule_id, esp_err_to_name(err));
+    }
+  }
+}
+
+// --------------------------------------------------------------------------------
+// Log
+// --------------------------------------------------------------------------------
+
+typedef struct {
+  sn_rec_t *recs;
+  size_t len;
+} replay_log_t;
+
+static void collect(const sn_rec_t *rec, void *arg) {
+  replay_log_t *log = arg;
+  log->recs[log->len++] = *rec;
+}
+
+// A log that wrapped starts mid run, the rules are put back in the state the device had:
+// the from of their first transition, or the band of their first reading if they did
+// not move before the next boot
+static void seed_states(const replay_log_t *log) {
+  if (log->len && log->recs[0].type == SN_REC_BOOT) return;
+  for (size_t r = 0; r < gRulesLen; r++) {
+    const sn_rule_desc_t *d = &gRules[r];
+    bool seen_reading = false;
+    sn_rule_state_e state = RS_NORMAL;
+    for (size_t i = 0; i < log->len; i++) {
+      const sn_rec_t *rec = &log->recs[i];
+      if (rec->type == SN_REC_BOOT) break;
+      if (rec->type == SN_REC_TRANSITION && rec->transition.rule_id == d->id) {
+        state = rec->transition.from;
+        break;
+      }
+      if (rec->type == SN_REC_READING && rec->reading.local_id == d->src_id && !seen_reading) {
+        state = sn_rule_eval_state(d, rec->reading.value);
+        seen_reading = true;
+      }
+    }
+    sn_rule_engine_set_state(d->id, state);
+  }
+}
+
+// --------------------------------------------------------------------------------
+// Replay
+// --------------------------------------------------------------------------------
+
+static void on_replayed(const sn_rec_t *rec, void *arg) {
+  if (replay_track_add(arg, rec) != ESP_OK) {
+    ESP_LOGE(TAG, "Out of memory");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void dispatch_and_drop(const cJSON *command) {
+  cJSON *result = NULL;
+  sn_dispatch_command_json(command, &result);
+  cJSON_Delete(result);
+}
+
+// The dispatch of sn_command_executor without the queue and the ack. Batches run in
+// order, group commands depend on the topic context and are not replayed
+static void replay_command(const sn_rec_t *rec, replay_counts_t *counts) {
+  if (rec->command.flags & (SN_REC_COMMAND_GROUP | SN_REC_COMMAND_TRUNCATED)) {
+    counts->commands_skipped++;
+    return;
+  }
+  cJSON *root = cJSON_Parse(rec->command.payload);
+  if (!root) {
+    counts->commands_invalid++;
+    return;
+  }
+  double expires = 0;
+  if (json_get_number(root, "expiresAt", &expires) && expires > 0 && rec->ts > expires) {
+    counts->commands_expired++;
+    cJSON_Delete(root);
+    return;
+  }
+  counts->commands++;
+  const cJSON *commands = cJSON_GetObjectItemCaseSensitive(root, "commands");
+  if (cJSON_IsArray(commands)) {
+    const cJSON *it = NULL;
+    cJSON_ArrayForEach(it, commands) dispatch_and_drop(it);
+  } else {
+    dispatch_and_drop(root);
+  }
+  cJSON_Delete(root);
+}
+
+static void replay(const replay_log_t *log, replay_track_t *replayed, replay_counts_t *counts) {
+  sn_fake_recorder_set_tap(on_replayed, replayed);
+  for (size_t i = 0; i < log->len; i++) {
+    const sn_rec_t *rec = &log->recs[i];
+    switch (rec->type) {
+      case SN_REC_BOOT:
+        // a reboot starts every rule over in the normal state
+        counts->boots++;
+        replay_track_add(replayed, rec);
+        sn_rule_engine_init();
+        apply_bands();
+        break;
+      case SN_REC_READING:
+        counts->readings++;
+        sn_fake_clock_set_ms(rec->ts);
+        sn_rule_engine_process(&rec->reading);
+        break;
+      case SN_REC_COMMAND:
+        sn_fake_clock_set_ms(rec->ts);
+        replay_command(rec, counts);
+        break;
+      default:
+        // transitions and dispatches are the expected output
+        break;
+    }
+  }
+  sn_fake_recorder_set_tap(NULL, NULL);
+  sn_fake_clock_set_ms(0);
+}
+
+// --------------------------------------------------------------------------------
+// Entry
+// --------------------------------------------------------------------------------
+
+void app_main(void) {
+  const char *path = env_or("SN_REPLAY_LOG", "reclog.bin");
+  parse_bands(getenv("SN_REPLAY_BANDS"));
+
+  // every dispatch logs its result
+  esp_log_level_set("*", ESP_LOG_ERROR);
+  esp_log_level_set(TAG, ESP_LOG_INFO);
+
+  size_t image_len = 0;
+  uint8_t *image = load_file(path, &image_len);
+  sn_rec_log_stats_t stats = {0};
+  replay_log_t log = {0};
+  if (image) {
+    // count first, the records point into the image
+    sn_recorder_walk(image, image_len, NULL, NULL, &stats);
+    log.recs = malloc((stats.records ? stats.records : 1) * sizeof(sn_rec_t));
+    if (log.recs) sn_recorder_walk(image, image_len, collect, &log, NULL);
+  }
+  if (!log.len) {
+    ESP_LOGE(TAG, "No records in %s", path);
+    exit(EXIT_FAILURE);
+  }
+
+  // the model of main/src/device_port_specs.c on the fake peripherals
+  ESP_ERROR_CHECK(sn_storage_init(NULL));
+  ESP_ERROR_CHECK(adc_helper_init());
+#define X(driver) ESP_ERROR_CHECK_WITHOUT_ABORT(sn_driver_register(&driver##_driver));
+  DRIVERS(X)
+#undef X
+  sn_driver_bind_all_ports(gDevicePorts, gDevicePortsLen);
+  ESP_ERROR_CHECK(sn_rule_engine_init());
+  apply_bands();
+  seed_states(&log);
+
+  replay_track_t recorded = {0}, replayed = {0};
+  for (size_t i = 0; i < log.len; i++) {
+    if (replay_track_add(&recorded, &log.recs[i]) != ESP_OK) exit(EXIT_FAILURE);
+  }
+
+  replay_counts_t counts = {0};
+  int64_t start = esp_timer_get_time();
+  replay(&log, &replayed, &counts);
+  double wall_ms = (esp_timer_get_time() - start) / 1000.0;
+  double span_ms = (double)(stats.last_ts - stats.first_ts);
+
+  cJSON *report = cJSON_CreateObject();
+  cJSON *l = cJSON_AddObjectToObject(report, "log");
+  cJSON_AddStringToObject(l, "path", path);
+  cJSON_AddNumberToObject(l, "bytes", image_len);
+  cJSON_AddNumberToObject(l, "sectors", stats.sectors);
+  cJSON_AddNumberToObject(l, "corrupt", stats.corrupt);
+  cJSON_AddNumberToObject(l, "records", stats.records);
+  cJSON_AddNumberToObject(l, "first_ts", (double)stats.first_ts);
+  cJSON_AddNumberToObject(l, "span_s", span_ms / 1000);
+
+  cJSON *r = cJSON_AddObjectToObject(report, "replay");
+  cJSON_AddNumberToObject(r, "boots", counts.boots);
+  cJSON_AddNumberToObject(r, "readings", counts.readings);
+  cJSON_AddNumberToObject(r, "commands", counts.commands);
+  cJSON_AddNumberToObject(r, "commands_skipped", counts.commands_skipped);
+  cJSON_AddNumberToObject(r, "commands_expired", counts.commands_expired);
+  cJSON_AddNumberToObject(r, "commands_invalid", counts.commands_invalid);
+  cJSON_AddNumberToObject(r, "wall_ms", wall_ms);
+  cJSON_AddNumberToObject(r, "speedup", wall_ms > 0 ? span_ms / wall_ms : 0);
+  cJSON *bands = cJSON_AddArrayToObject(r, "bands");
+  for (int i = 0; i < s_bands_len; i++) {
+    cJSON *b = cJSON_CreateObject();
+    cJSON_AddNumberToObject(b, "rule", s_bands[i].rule_id);
+    cJSON_AddNumberToObject(b, "low", s_bands[i].low);
+    cJSON_AddNumberToObject(b, "high", s_bands[i].high);
+    cJSON_AddItemToArray(bands, b);
+  }
+
+  cJSON *d = cJSON_AddObjectToObject(report, "diff");
+  cJSON *entries = cJSON_CreateArray();
+  replay_diff_t diff = replay_track_diff(&recorded, &replayed, entries, REPLAY_MAX_ENTRIES);
+  cJSON_AddNumberToObject(d, "recorded", recorded.len);
+  cJSON_AddNumberToObject(d, "replayed", replayed.len);
+  cJSON_AddNumberToObject(d, "matched", diff.matched);
+  cJSON_AddNumberToObject(d, "changed", diff.changed);
+  cJSON_AddNumberToObject(d, "missing", diff.missing);
+  cJSON_AddNumberToObject(d, "extra", diff.extra);
+  cJSON_AddNumberToObject(d, "results_changed", diff.results_changed);
+  cJSON_AddNumberToObject(d, "orphans", recorded.orphans);
+  cJSON_AddItemToObject(d, "first", entries);
+
+  char *str = cJSON_Print(report);
+  printf("%s\n", str);
+  cJSON_free(str);
+  cJSON_Delete(report);
+
+  // with retuned bands the differences are the answer, not a failure
+  bool ok = s_bands_len > 0 || (diff.changed == 0 && diff.missing == 0 && diff.extra == 0);
+  ESP_LOGI(TAG, "%s", ok ? "Replay passed" : "Replay diverged from the recording");
+  replay_track_free(&recorded);
+  replay_track_free(&replayed);
+  free(log.recs);
+  free(image);
+  exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,191 @@
+#include "replay.h"
+#include "sn_rules/sn_rule_engine.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool grow(void **items, size_t *cap, size_t need, size_t size) {
+  if (need <= *cap) return true;
+  size_t next = *cap ? *cap * 2 : 256;
+  while (next < need) next *= 2;
+  void *p = realloc(*items, next * size);
+  if (!p) return false;
+  *items = p;
+  *cap = next;
+  return true;
+}
+
+esp_err_t replay_track_add(replay_track_t *track, const sn_rec_t *rec) {
+  if (!track || !rec) return ESP_ERR_INVALID_ARG;
+
+  switch (rec->type) {
+    case SN_REC_BOOT:
+      track->open = false;
+      break;
+    case SN_REC_TRANSITION: {
+      if (!grow((void **)&track->items, &track->cap, track->len + 1, sizeof(*track->items))) {
+        return ESP_ERR_NO_MEM;
+      }
+      track->items[track->len++] = (replay_transition_t){
+        .ts = rec->ts,
+        .rule_id = rec->transition.rule_id,
+        .src_id = rec->transition.src_id,
+        .from = rec->transition.from,
+        .to = rec->transition.to,
+        .value = rec->transition.value,
+        .cmds = track->cmds_len,
+      };
+      track->open = true;
+      break;
+    }
+    case SN_REC_DISPATCH: {
+      if (!track->open) {
+        track->orphans++;
+        break;
+      }
+      if (!grow(
+            (void **)&track->cmds, &track->cmds_cap, track->cmds_len + 1, sizeof(*track->cmds)
+          )) {
+        return ESP_ERR_NO_MEM;
+      }
+      track->cmds[track->cmds_len++] = (replay_cmd_t){
+        .local_id = rec->dispatch.local_id,
+        .result = rec->dispatch.result,
+        .action = rec->dispatch.action,
+        .params_json = rec->dispatch.params_json,
+      };
+      track->items[track->len - 1].cmds_len++;
+      break;
+    }
+    default:
+      break;
+  }
+  return ESP_OK;
+}
+
+void replay_track_free(replay_track_t *track) {
+  free(track->items);
+  free(track->cmds);
+  memset(track, 0, sizeof(*track));
+}
+
+// --------------------------------------------------------------------------------
+// Diff
+// --------------------------------------------------------------------------------
+
+static int compare_key(const replay_transition_t *a, const replay_transition_t *b) {
+  if (a->ts != b->ts) return a->ts < b->ts ? -1 : 1;
+  if (a->src_id != b->src_id) return a->src_id < b->src_id ? -1 : 1;
+  if (a->rule_id != b->rule_id) return a->rule_id < b->rule_id ? -1 : 1;
+  return 0;
+}
+
+// the commands index breaks ties, it grows with the order of the track
+static int compare_transition(const void *a, const void *b) {
+  const replay_transition_t *x = a, *y = b;
+  int c = compare_key(x, y);
+  if (c) return c;
+  return x->cmds < y->cmds ? -1 : x->cmds > y->cmds;
+}
+
+static bool str_eq(const char *a, const char *b) {
+  return (!a || !b) ? a == b : strcmp(a, b) == 0;
+}
+
+static bool same_commands(
+  const replay_track_t *ta, const replay_transition_t *a, const replay_track_t *tb,
+  const replay_transition_t *b, bool *same_results
+) {
+  *same_results = true;
+  if (a->cmds_len != b->cmds_len) return false;
+  for (uint32_t i = 0; i < a->cmds_len; i++) {
+    const replay_cmd_t *x = &ta->cmds[a->cmds + i], *y = &tb->cmds[b->cmds + i];
+    if (x->local_id != y->local_id || !str_eq(x->action, y->action) ||
+        !str_eq(x->params_json, y->params_json))
+      return false;
+    if (x->result != y->result) *same_results = false;
+  }
+  return true;
+}
+
+static const char *state_name(uint8_t state) {
+  switch (state) {
+    case RS_NORMAL:
+      return "normal";
+    case RS_HIGH:
+      return "high";
+    case RS_LOW:
+      return "low";
+  }
+  return "?";
+}
+
+static cJSON *side_to_json(const replay_track_t *track, const replay_transition_t *t) {
+  cJSON *side = cJSON_CreateObject();
+  cJSON_AddStringToObject(side, "from", state_name(t->from));
+  cJSON_AddStringToObject(side, "to", state_name(t->to));
+  cJSON *cmds = cJSON_AddArrayToObject(side, "commands");
+  for (uint32_t i = 0; i < t->cmds_len; i++) {
+    const replay_cmd_t *c = &track->cmds[t->cmds + i];
+    char line[320];
+    snprintf(
+      line, sizeof(line), "0x%02x %s %s -> %d", c->local_id, c->action ? c->action : "",
+      c->params_json ? c->params_json : "", (int)c->result
+    );
+    cJSON_AddItemToArray(cmds, cJSON_CreateString(line));
+  }
+  return side;
+}
+
+static void add_entry(
+  cJSON *entries, int max_entries, const char *kind, const replay_track_t *ta,
+  const replay_transition_t *a, const replay_track_t *tb, const replay_transition_t *b
+) {
+  if (!entries || cJSON_GetArraySize(entries) >= max_entries) return;
+  const replay_transition_t *key = a ? a : b;
+  cJSON *e = cJSON_CreateObject();
+  cJSON_AddStringToObject(e, "kind", kind);
+  cJSON_AddNumberToObject(e, "ts", (double)key->ts);
+  cJSON_AddNumberToObject(e, "rule", key->rule_id);
+  cJSON_AddNumberToObject(e, "src", key->src_id);
+  cJSON_AddNumberToObject(e, "value", key->value);
+  if (a) cJSON_AddItemToObject(e, "recorded", side_to_json(ta, a));
+  if (b) cJSON_AddItemToObject(e, "replayed", side_to_json(tb, b));
+  cJSON_AddItemToArray(entries, e);
+}
+
+replay_diff_t replay_track_diff(
+  replay_track_t *recorded, replay_track_t *replayed, cJSON *entries, int max_entries
+) {
+  replay_diff_t diff = {0};
+  qsort(recorded->items, recorded->len, sizeof(replay_transition_t), compare_transition);
+  qsort(replayed->items, replayed->len, sizeof(replay_transition_t), compare_transition);
+
+  size_t i = 0, j = 0;
+  while (i < recorded->len || j < replayed->len) {
+    const replay_transition_t *a = i < recorded->len ? &recorded->items[i] : NULL;
+    const replay_transition_t *b = j < replayed->len ? &replayed->items[j] : NULL;
+    int c = !a ? 1 : !b ? -1 : compare_key(a, b);
+    if (c < 0) {
+      diff.missing++;
+      add_entry(entries, max_entries, "missing", recorded, a, replayed, NULL);
+      i++;
+    } else if (c > 0) {
+      diff.extra++;
+      add_entry(entries, max_entries, "extra", recorded, NULL, replayed, b);
+      j++;
+    } else {
+      bool same_results;
+      if (a->to == b->to && same_commands(recorded, a, replayed, b, &same_results)) {
+        diff.matched++;
+        if (!same_results) diff.results_changed++;
+      } else {
+        diff.changed++;
+        add_entry(entries, max_entries, "changed", recorded, a, replayed, b);
+      }
+      i++;
+      j++;
+    }
+  }
+  return diff;
+}
@@ -0,0 +1,37 @@
+#include "cJSON.h"
+#include "scale_stats.h"
+#include "sn_metrics.h"
+#include "sn_mqtt_manager.h"
+#include "sn_security.h"
+#include "sn_sntp.h"
+#include "esp_timer.h"
+
+// The publish half of sn_mqtt_manager without a broker: the payload is signed and
+// serialized like on the device, then counted instead of queued to the client
+esp_err_t sn_mqtt_publish_json_payload_signed(
+  cJSON *payload, const char *topic, int qos, bool retain
+) {
+  if (!payload || !topic) return ESP_ERR_INVALID_ARG;
+
+  const cJSON *ts = cJSON_GetObjectItemCaseSensitive(payload, "ts");
+  unsigned long long sample_ms = cJSON_IsNumber(ts) ? (unsigned long long)ts->valuedouble : 0;
+
+  int64_t sign_start = esp_timer_get_time();
+  cJSON *json = sn_security_sign_and_wrap_payload(payload);
+  sn_metric_observe(SN_MH_sign_time, (uint32_t)(esp_timer_get_time() - sign_start));
+  if (!json) {
+    sn_metric_inc(SN_MC_mqtt_pub_fail);
+    return ESP_ERR_NO_MEM;
+  }
+  char *str = cJSON_PrintUnformatted(json);
+  cJSON_Delete(json);
+  if (!str) {
+    sn_metric_inc(SN_MC_mqtt_pub_fail);
+    return ESP_ERR_NO_MEM;
+  }
+  cJSON_free(str);
+
+  if (sample_ms) scale_stats_add(SCALE_S_publish, sn_get_unix_timestamp_ms() - sample_ms);
+  sn_metric_inc(SN_MC_mqtt_pub_ok);
+  return ESP_OK;
+}
@@ -0,0 +1,272 @@
+#include "cJSON.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "scale_stats.h"
+#include "sn_driver.h"
+#include "sn_driver_registry.h"
+#include "sn_metrics.h"
+#include "sn_rules/sn_rule_engine.h"
+#include "sn_security.h"
+#include "sn_sntp.h"
+#include "sn_storage.h"
+#include "sn_telemetry_queue.h"
+#include "sn_topic.h"
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *TAG = "SN_SCALE";
+
+extern void sensor_poll_task(void *pvParam);
+
+// measurement ids cycle over 0x01..SCALE_SENSOR_ID_MAX, the state table and the rule
+// engine key by local_id so ports past that share ids (local_id_t is 8 bits)
+#define SCALE_SENSOR_ID_MAX 0x7A
+#define SCALE_OUT_ID        0x7B
+#define SCALE_MEAS_MAX      4 // readings per read_multi in sensor_poll_task
+#define SCALE_NAME_LEN      16
+#define SCALE_PROBE_QUEUE   64
+
+// fixed ports: the actuator the rules write to and the command apis
+#define SCALE_OUT_DESC ((sn_actuator_port_t){.local_id = SCALE_OUT_ID, .usage_type = PUT_VIRTUAL})
+#define SCALE_FIXED_PORTS(X)                                                                       \
+  X(ACTUATOR_PORT_LITERAL("scale-out", "virtual", SCALE_OUT_DESC))                                 \
+  X(COMMAND_PORT_LITERAL("state", "state", ((sn_command_api_port_t){.local_id = 0x7D})))          \
+  X(COMMAND_PORT_LITERAL("metrics", "metrics", ((sn_command_api_port_t){.local_id = 0x7C})))
+
+#define GEN_PORT_ENTRY(LITERAL) LITERAL,
+const sn_device_port_desc_t gDevicePorts[] = {SCALE_FIXED_PORTS(GEN_PORT_ENTRY)};
+#undef GEN_PORT_ENTRY
+const size_t gDevicePortsLen = sizeof(gDevicePorts) / sizeof(sn_device_port_desc_t);
+
+// --------------------------------------------------------------------------------
+// Rules: one per sensor id 0x01..0x40, band 35..65 over the 50 +- 30 virtual signal
+// --------------------------------------------------------------------------------
+
+#define SCALE_RULES 64
+
+static const sn_command_t scale_on_low[] = {
+  {.local_id = SCALE_OUT_ID, .action = "set_value", .params_json = "{\"value\":0}"},
+  COMMAND_NULL_ENTRY
+};
+static const sn_command_t scale_on_normal[] = {
+  {.local_id = SCALE_OUT_ID, .action = "set_value", .params_json = "{\"value\":1}"},
+  COMMAND_NULL_ENTRY
+};
+static const sn_command_t scale_on_high[] = {
+  {.local_id = SCALE_OUT_ID, .action = "set_value", .params_json = "{\"value\":2}"},
+  COMMAND_NULL_ENTRY
+};
+
+#define SCALE_RULE(I)                                                                              \
+  {.id = 0x7F + (I),                                                                               \
+   .src_id = 0x01 + (I),                                                                           \
+   .name = "scale rule",                                                                           \
+   .low = 35,                                                                                      \
+   .high = 65,                                                                                     \
+   .on_low = scale_on_low,                                                                         \
+   .on_normal = scale_on_normal,                                                                   \
+   .on_high = scale_on_high},
+#define SCALE_RULE8(B)                                                                             \
+  SCALE_RULE(B) SCALE_RULE(B + 1) SCALE_RULE(B + 2) SCALE_RULE(B + 3) SCALE_RULE(B + 4)            \
+    SCALE_RULE(B + 5) SCALE_RULE(B + 6) SCALE_RULE(B + 7)
+
+const sn_rule_desc_t gRules[SCALE_RULES] = {
+  SCALE_RULE8(0) SCALE_RULE8(8) SCALE_RULE8(16) SCALE_RULE8(24) SCALE_RULE8(32) SCALE_RULE8(40)
+    SCALE_RULE8(48) SCALE_RULE8(56)
+};
+const size_t gRulesLen = SCALE_RULES;
+
+static const sn_mqtt_topic_context_t s_topic_ctx = {
+  .orgId = "6650c0ffee0000000000beef",
+  .deviceId = "6650c0ffee00000000005ca1",
+};
+
+// --------------------------------------------------------------------------------
+// Ports built from the environment
+// --------------------------------------------------------------------------------
+
+typedef struct {
+  int ports;
+  int measurements;
+  uint32_t rate_ms;
+  float noise;
+  uint16_t fail_permille;
+  int seconds;
+} scale_config_t;
+
+static sn_device_port_desc_t s_ports[MAX_INSTANCES];
+static sn_port_measurement_map_t s_maps[MAX_INSTANCES][SCALE_MEAS_MAX + 1];
+static char s_names[MAX_INSTANCES][SCALE_NAME_LEN];
+
+static int env_int(const char *name, int fallback) {
+  const char *v = getenv(name);
+  return v && v[0] ? atoi(v) : fallback;
+}
+
+static scale_config_t load_config(void) {
+  const int max_ports = MAX_INSTANCES - (int)gDevicePortsLen;
+  scale_config_t cfg = {
+    .ports = env_int("SN_SCALE_PORTS", 256),
+    .measurements = env_int("SN_SCALE_MEASUREMENTS", 1),
+    .rate_ms = env_int("SN_SCALE_RATE_MS", 1000),
+    .noise = env_int("SN_SCALE_NOISE", 2),
+    .fail_permille = env_int("SN_SCALE_FAIL_PERMILLE", 0),
+    .seconds = env_int("SN_SCALE_SECONDS", 30),
+  };
+  if (cfg.ports > max_ports) {
+    ESP_LOGW(TAG, "%d ports requested, the instance table holds %d", cfg.ports, max_ports);
+    cfg.ports = max_ports;
+  }
+  if (cfg.measurements < 1) cfg.measurements = 1;
+  if (cfg.measurements > SCALE_MEAS_MAX) cfg.measurements = SCALE_MEAS_MAX;
+  return cfg;
+}
+
+static size_t build_ports(const scale_config_t *cfg) {
+  size_t n = 0;
+  int id = 0;
+  for (int i = 0; i < cfg->ports; i++, n++) {
+    for (int m = 0; m < cfg->measurements; m++) {
+      s_maps[i][m] = (sn_port_measurement_map_t
+      )MEASUREMENT_MAP_ENTRY(0x01 + id++ % SCALE_SENSOR_ID_MAX, ST_TEMPERATURE, "C");
+    }
+    s_maps[i][cfg->measurements] = (sn_port_measurement_map_t)MEASUREMENT_MAP_ENTRY_NULL();
+    snprintf(s_names[i], SCALE_NAME_LEN, "virt-%d", i);
+    s_ports[n] = (sn_device_port_desc_t)SENSOR_PORT_LITERAL(
+      s_names[i], "virtual",
+      ((sn_sensor_port_t){.usage_type = PUT_VIRTUAL,
+                          .usage.virt = {.base = 50,
+                                         .amplitude = 30,
+                                         .noise = cfg->noise,
+                                         .period_ms = 20000,
+                                         .fail_permille = cfg->fail_permille},
+                          .measurements = s_maps[i],
+                          .sample_rate_ms = cfg->rate_ms})
+    );
+  }
+  for (size_t i = 0; i < gDevicePortsLen; i++) s_ports[n++] = gDevicePorts[i];
+  return n;
+}
+
+// --------------------------------------------------------------------------------
+// Probes
+// --------------------------------------------------------------------------------
+
+// the virtual driver with its read timed against the schedule of the instance
+static sn_driver_desc_t s_probed_driver;
+static int64_t s_last_read_us[MAX_INSTANCES];
+
+static esp_err_t probed_read_multi(
+  void *ctxv, sn_sensor_reading_t *out_buf, int max_out, int *out_count
+) {
+  sn_device_instance_t *inst = sn_device_instance_from_ctx(ctxv);
+  int idx = (int)(inst - gDeviceInstances);
+  int64_t now = esp_timer_get_time();
+  if (s_last_read_us[idx]) {
+    int64_t due = s_last_read_us[idx] + (int64_t)sn_device_instance_get_interval(inst) * 1000;
+    scale_stats_add(SCALE_S_read_late, now > due ? (uint32_t)(now - due) : 0);
+  }
+  s_last_read_us[idx] = now;
+  return virtual_driver.read_multi(ctxv, out_buf, max_out, out_count);
+}
+
+static void probe_consumer_task(void *arg) {
+  QueueHandle_t queue = (QueueHandle_t)arg;
+  sn_sensor_reading_t reading;
+  for (;;) {
+    if (xQueueReceive(queue, &reading, portMAX_DELAY) != pdTRUE) continue;
+    scale_stats_add(SCALE_S_fanout, (uint32_t)(sn_get_unix_timestamp_ms() - reading.ts));
+  }
+}
+
+static size_t heap_used(void) { return mallinfo2().uordblks; }
+
+// --------------------------------------------------------------------------------
+// Entry
+// --------------------------------------------------------------------------------
+
+void app_main(void) {
+  scale_config_t cfg = load_config();
+
+  ESP_ERROR_CHECK(sn_storage_init(NULL));
+  ESP_ERROR_CHECK(sn_storage_set_device_secret("scale-secret-0123456789abcdef"));
+  sn_mqtt_topic_cache_init(&s_topic_ctx);
+
+  // the per port and per command logs would measure the console
+  esp_log_level_set("*", ESP_LOG_ERROR);
+  esp_log_level_set(TAG, ESP_LOG_INFO);
+
+  s_probed_driver = virtual_driver;
+  s_probed_driver.read_multi = probed_read_multi;
+  sn_driver_register(&s_probed_driver);
+  sn_driver_register(&state_driver);
+  sn_driver_register(&metrics_driver);
+
+  size_t heap_before = heap_used();
+  size_t len = build_ports(&cfg);
+  int64_t bind_start = esp_timer_get_time();
+  sn_driver_bind_all_ports(s_ports, len);
+  int64_t bind_us = esp_timer_get_time() - bind_start;
+  size_t heap_bound = heap_used();
+
+  size_t online = 0;
+  FOR_EACH_INSTANCE(it, gDeviceInstances, gDeviceInstancesLen) online += it->online;
+  ESP_LOGI(TAG, "%u/%u ports online", (unsigned)online, (unsigned)len);
+
+  QueueHandle_t probe_queue = xQueueCreate(SCALE_PROBE_QUEUE, sizeof(sn_sensor_reading_t));
+  register_consumer(probe_queue);
+  xTaskCreate(probe_consumer_task, "scale_probe", 4096, probe_queue, 6, NULL);
+  xTaskCreate(rule_engine_task, "rule_engine_task", 4096, NULL, 5, NULL);
+  vTaskDelay(pdMS_TO_TICKS(10));
+
+  sn_metrics_reset();
+  int64_t run_start = esp_timer_get_time();
+  xTaskCreate(sensor_poll_task, "sensor_poll_task", 4096, NULL, 4, NULL);
+  vTaskDelay(pdMS_TO_TICKS(cfg.seconds * 1000));
+  double elapsed = (esp_timer_get_time() - run_start) / 1e6;
+
+  size_t still_online = 0;
+  FOR_EACH_SENSOR_INSTANCE(it, gDeviceInstances, gDeviceInstancesLen) still_online += it->online;
+
+  cJSON *report = cJSON_CreateObject();
+  cJSON *c = cJSON_AddObjectToObject(report, "config");
+  cJSON_AddNumberToObject(c, "ports", cfg.ports);
+  cJSON_AddNumberToObject(c, "measurements", cfg.measurements);
+  cJSON_AddNumberToObject(c, "rate_ms", cfg.rate_ms);
+  cJSON_AddNumberToObject(c, "noise", cfg.noise);
+  cJSON_AddNumberToObject(c, "fail_permille", cfg.fail_permille);
+  cJSON_AddNumberToObject(c, "seconds", elapsed);
+  cJSON_AddNumberToObject(c, "max_instances", MAX_INSTANCES);
+  cJSON_AddNumberToObject(c, "rules", gRulesLen);
+
+  cJSON *t = cJSON_AddObjectToObject(report, "throughput");
+  cJSON_AddNumberToObject(t, "reads_expected_s", cfg.ports * 1000.0 / cfg.rate_ms);
+  cJSON_AddNumberToObject(t, "reads_s", gMetricCounters[SN_MC_sensor_read_ok] / elapsed);
+  cJSON_AddNumberToObject(t, "read_fail_s", gMetricCounters[SN_MC_sensor_read_fail] / elapsed);
+  cJSON_AddNumberToObject(t, "fanout_s", gMetricCounters[SN_MC_tq_sent] / elapsed);
+  cJSON_AddNumberToObject(t, "fanout_drop_s", gMetricCounters[SN_MC_tq_drop] / elapsed);
+  cJSON_AddNumberToObject(t, "rule_eval_s", gMetricCounters[SN_MC_rule_eval] / elapsed);
+  cJSON_AddNumberToObject(t, "commands_s", gMetricCounters[SN_MC_cmd_ok] / elapsed);
+  cJSON_AddNumberToObject(t, "published_s", gMetricCounters[SN_MC_mqtt_pub_ok] / elapsed);
+  cJSON_AddNumberToObject(t, "online", still_online);
+
+  cJSON_AddItemToObject(report, "latency", scale_stats_to_json());
+
+  cJSON *m = cJSON_AddObjectToObject(report, "memory");
+  cJSON_AddNumberToObject(m, "instance_table", sizeof(sn_device_instance_t) * MAX_INSTANCES);
+  cJSON_AddNumberToObject(m, "bind_heap", (double)(heap_bound - heap_before));
+  cJSON_AddNumberToObject(m, "bind_us", bind_us);
+  cJSON_AddNumberToObject(m, "heap_end", heap_used());
+
+  cJSON_AddItemToObject(report, "metrics", sn_metrics_to_json());
+
+  char *str = cJSON_Print(report);
+  printf("%s\n", str);
+  cJSON_free(str);
+  cJSON_Delete(report);
+  exit(EXIT_SUCCESS);
+}
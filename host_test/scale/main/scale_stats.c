@@ -0,0 +1,21 @@
+#include "scale_stats.h"
+#include "sn_host_series.h"
+
+static sn_host_series_t s_series[SCALE_S_MAX] = {
+#define GEN_SERIES_INIT(NAME, KEY) SN_HOST_SERIES_INIT(KEY),
+  SCALE_SERIES(GEN_SERIES_INIT)
+#undef GEN_SERIES_INIT
+};
+
+void scale_stats_add(scale_series_e series, uint32_t value) {
+  sn_host_series_add(&s_series[series], value);
+}
+
+cJSON *scale_stats_to_json(void) {
+  cJSON *root = cJSON_CreateObject();
+  if (!root) return NULL;
+  for (int i = 0; i < SCALE_S_MAX; i++) {
+    cJSON_AddItemToObject(root, s_series[i].key, sn_host_series_to_json(&s_series[i]));
+  }
+  return root;
+}
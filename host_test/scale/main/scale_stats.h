@@ -0,0 +1,38 @@
+// --------------------------------------------------------------------------------
+// scale_stats.h
+//
+// description: latency series of the scale test (sn_host_series.h)
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SCALE_STATS_H
+#define SCALE_STATS_H
+
+#include "cJSON.h"
+#include <stdint.h>
+
+// clang-format off
+#define SCALE_SERIES(X)                                                        \
+  X(read_late,  "read.late.us")  /* read start after the instance was due */  \
+  X(fanout,     "fanout.ms")     /* sample ts to a telemetry consumer */      \
+  X(publish,    "publish.ms")    /* sample ts to the signed payload */
+// clang-format on
+
+typedef enum {
+#define GEN_SERIES_ENUM(NAME, KEY) SCALE_S_##NAME,
+  SCALE_SERIES(GEN_SERIES_ENUM) SCALE_S_MAX
+#undef GEN_SERIES_ENUM
+} scale_series_e;
+
+/*
+ * @brief Record a sample, safe from any task
+ */
+void scale_stats_add(scale_series_e series, uint32_t value);
+
+/*
+ * @brief { "read.late.us": { "n": 7680, "p50": 12, "p90": 40, "p99": 880, "p999": 1900,
+ * "max": 2300 }, ... }
+ */
+cJSON *scale_stats_to_json(void);
+
+#endif // !SCALE_STATS_H
@@ -0,0 +1,246 @@
+#include "cJSON.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sn_bus.h"
+#include "sn_driver.h"
+#include "sn_metrics.h"
+#include "unit.h"
+#include <string.h>
+
+// two ports on one controller, one on the other, the fake i2c acks every address
+#define I2C_PORT(NAME, ADDR, SDA, SCL)                                                             \
+  ACTUATOR_PORT_LITERAL(                                                                           \
+    NAME, "bus",                                                                                   \
+    ((sn_actuator_port_t){                                                                         \
+      .usage.i2c = {.addr = (ADDR), .sda = (SDA), .scl = (SCL)}, .usage_type = PUT_I2C             \
+    })                                                                                             \
+  )
+
+static const sn_device_port_desc_t s_port_a = I2C_PORT("bus-a", 0x3C, GPIO_NUM_21, GPIO_NUM_22);
+static const sn_device_port_desc_t s_port_a2 = I2C_PORT("bus-a2", 0x3D, GPIO_NUM_21, GPIO_NUM_22);
+static const sn_device_port_desc_t s_port_b = I2C_PORT("bus-b", 0x3C, GPIO_NUM_18, GPIO_NUM_19);
+static const sn_device_port_desc_t s_port_gpio = ACTUATOR_PORT_LITERAL(
+  "bus-gpio", "bus",
+  ((sn_actuator_port_t){.usage.gpio.pin = GPIO_NUM_5, .usage_type = PUT_GPIO})
+);
+
+#define LOG_MAX  32
+#define LOG_END  1000 // queued last at low priority, everything before it has run
+#define LOG_PEER 2000 // the task sharing the priority of the worker
+
+// ids of the transactions in the order the worker ran them
+static intptr_t s_log[LOG_MAX];
+static int s_log_len = 0;
+
+static SemaphoreHandle_t s_gate = NULL;
+static SemaphoreHandle_t s_gate_entered = NULL;
+static SemaphoreHandle_t s_peer_go = NULL;
+static SemaphoreHandle_t s_peer_done = NULL;
+
+static esp_err_t log_txn(sn_bus_t *bus, void *arg) {
+  if (s_log_len < LOG_MAX) s_log[s_log_len++] = (intptr_t)arg;
+  return ESP_OK;
+}
+
+static esp_err_t gate_txn(sn_bus_t *bus, void *arg) {
+  xSemaphoreGive(s_gate_entered);
+  xSemaphoreTake(s_gate, portMAX_DELAY);
+  return ESP_OK;
+}
+
+// Hold the worker inside a transaction, what is queued meanwhile runs in one drain
+static void close_gate(sn_bus_t *bus) {
+  sn_bus_submit_async(bus, SN_BUS_PRIO_HIGH, gate_txn, NULL, NULL, NULL);
+  xSemaphoreTake(s_gate_entered, portMAX_DELAY);
+}
+
+// low priority is taken last, once the end marker ran the queues are empty
+static void open_gate(sn_bus_t *bus) {
+  xSemaphoreGive(s_gate);
+  sn_bus_submit(bus, SN_BUS_PRIO_LOW, log_txn, (void *)LOG_END);
+}
+
+static sn_bus_t *bus_up(void) {
+  if (!s_gate) {
+    s_gate = xSemaphoreCreateBinary();
+    s_gate_entered = xSemaphoreCreateBinary();
+    s_peer_go = xSemaphoreCreateBinary();
+    s_peer_done = xSemaphoreCreateBinary();
+  }
+  s_log_len = 0;
+  sn_bus_t *bus = NULL;
+  if (sn_bus_init() != ESP_OK || sn_bus_acquire(&s_port_a, &bus) != ESP_OK) return NULL;
+  return bus;
+}
+
+static bool log_is(const intptr_t *expected, int len) {
+  return s_log_len == len && memcmp(s_log, expected, len * sizeof(*expected)) == 0;
+}
+
+static double stat(const cJSON *json, const char *bus, const char *key) {
+  const cJSON *it = cJSON_GetObjectItemCaseSensitive(
+    cJSON_GetObjectItemCaseSensitive(json, bus), key
+  );
+  return cJSON_IsNumber(it) ? it->valuedouble : -1.0;
+}
+
+void unit_bus_priority(void) {
+  sn_bus_t *bus = bus_up();
+  if (!UNIT_CHECK(bus)) return;
+
+  close_gate(bus);
+  sn_bus_submit_async(bus, SN_BUS_PRIO_LOW, log_txn, (void *)1, NULL, NULL);
+  sn_bus_submit_async(bus, SN_BUS_PRIO_NORMAL, log_txn, (void *)2, NULL, NULL);
+  sn_bus_submit_async(bus, SN_BUS_PRIO_HIGH, log_txn, (void *)3, NULL, NULL);
+  sn_bus_submit_async(bus, SN_BUS_PRIO_LOW, log_txn, (void *)4, NULL, NULL);
+  sn_bus_submit_async(bus, SN_BUS_PRIO_HIGH, log_txn, (void *)5, NULL, NULL);
+  open_gate(bus);
+
+  // by priority, in submit order within one
+  static const intptr_t expected[] = {3, 5, 2, 1, 4, LOG_END};
+  UNIT_CHECK(log_is(expected, 6));
+}
+
+static void peer_task(void *arg) {
+  xSemaphoreTake(s_peer_go, portMAX_DELAY);
+  log_txn(NULL, (void *)LOG_PEER);
+  xSemaphoreGive(s_peer_done);
+  vTaskDelete(NULL);
+}
+
+static esp_err_t wake_peer_txn(sn_bus_t *bus, void *arg) {
+  xSemaphoreGive(s_peer_go);
+  return log_txn(bus, arg);
+}
+
+// A drain longer than SN_BUS_BATCH lets a task of the same priority in
+void unit_bus_batch(void) {
+  sn_bus_t *bus = bus_up();
+  if (!UNIT_CHECK(bus)) return;
+  UNIT_CHECK(xTaskCreate(peer_task, "bus_peer", 2048, NULL, SN_BUS_WORKER_PRIORITY, NULL));
+
+  close_gate(bus);
+  sn_bus_submit_async(bus, SN_BUS_PRIO_NORMAL, wake_peer_txn, (void *)1, NULL, NULL);
+  for (intptr_t i = 2; i <= SN_BUS_QUEUE_LEN; i++) {
+    sn_bus_submit_async(bus, SN_BUS_PRIO_NORMAL, log_txn, (void *)i, NULL, NULL);
+  }
+  open_gate(bus);
+  UNIT_CHECK(xSemaphoreTake(s_peer_done, pdMS_TO_TICKS(1000)));
+
+  // the peer got in after at most one batch, the drain then went on in order
+  int peer = -1;
+  for (int i = 0; i < s_log_len; i++) {
+    if (s_log[i] == LOG_PEER) peer = i;
+  }
+  UNIT_CHECK(peer >= 0 && peer <= SN_BUS_BATCH);
+  UNIT_CHECK(s_log_len == SN_BUS_QUEUE_LEN + 2 && s_log[s_log_len - 1] == LOG_END);
+  intptr_t next = 1;
+  for (int i = 0; i < s_log_len - 1; i++) {
+    if (i != peer) UNIT_CHECK(s_log[i] == next++);
+  }
+}
+
+void unit_bus_shared(void) {
+  // none starts non NULL, the acquire of a gpio port clears it
+  sn_bus_t *a = bus_up(), *a2 = NULL, *b = NULL, *none = (sn_bus_t *)&s_log;
+  if (!UNIT_CHECK(a)) return;
+  UNIT_CHECK(sn_bus_acquire(&s_port_a2, &a2) == ESP_OK && a2 == a);
+  UNIT_CHECK(sn_bus_acquire(&s_port_b, &b) == ESP_OK && b && b != a);
+  UNIT_CHECK(sn_bus_i2c_handle(a) && sn_bus_i2c_handle(b) != sn_bus_i2c_handle(a));
+  UNIT_CHECK(sn_bus_acquire(&s_port_gpio, &none) == ESP_OK && !none);
+  UNIT_CHECK(sn_bus_i2c_probe(a, 0x3D) == ESP_OK);
+
+  cJSON *json = sn_bus_stats_to_json();
+  UNIT_CHECK(cJSON_GetArraySize(json) == 2);
+  UNIT_CHECK(stat(json, "i2c0", "txn") >= 0 && stat(json, "i2c1", "txn") >= 0);
+  cJSON_Delete(json);
+}
+
+static esp_err_t inner_txn(sn_bus_t *bus, void *arg) {
+  log_txn(bus, arg);
+  return ESP_ERR_INVALID_CRC;
+}
+
+static esp_err_t outer_txn(sn_bus_t *bus, void *arg) {
+  log_txn(bus, (void *)1);
+  esp_err_t err = sn_bus_submit(bus, SN_BUS_PRIO_HIGH, inner_txn, (void *)2);
+  log_txn(bus, (void *)3);
+  return err;
+}
+
+// a transaction submitting to its own bus would wait on itself forever
+void unit_bus_reentry(void) {
+  sn_bus_t *bus = bus_up();
+  if (!UNIT_CHECK(bus)) return;
+  UNIT_CHECK(sn_bus_submit(bus, SN_BUS_PRIO_LOW, outer_txn, NULL) == ESP_ERR_INVALID_CRC);
+  static const intptr_t expected[] = {1, 2, 3};
+  UNIT_CHECK(log_is(expected, 3));
+}
+
+void unit_bus_queue_full(void) {
+  sn_bus_t *bus = bus_up();
+  if (!UNIT_CHECK(bus)) return;
+  uint32_t drops = __atomic_load_n(&gMetricCounters[SN_MC_bus_drop], __ATOMIC_RELAXED);
+
+  close_gate(bus);
+  for (intptr_t i = 1; i <= SN_BUS_QUEUE_LEN; i++) {
+    UNIT_CHECK(
+      sn_bus_submit_async(bus, SN_BUS_PRIO_HIGH, log_txn, (void *)i, NULL, NULL) == ESP_OK
+    );
+  }
+  UNIT_CHECK(
+    sn_bus_submit_async(bus, SN_BUS_PRIO_HIGH, log_txn, (void *)99, NULL, NULL)
+    == ESP_ERR_TIMEOUT
+  );
+  UNIT_CHECK(__atomic_load_n(&gMetricCounters[SN_MC_bus_drop], __ATOMIC_RELAXED) == drops + 1);
+  // every priority has its own queue
+  UNIT_CHECK(
+    sn_bus_submit_async(bus, SN_BUS_PRIO_NORMAL, log_txn, (void *)100, NULL, NULL) == ESP_OK
+  );
+  open_gate(bus);
+
+  UNIT_CHECK(s_log_len == SN_BUS_QUEUE_LEN + 2);
+  for (int i = 0; i < s_log_len; i++) UNIT_CHECK(s_log[i] != 99);
+  cJSON *json = sn_bus_stats_to_json();
+  UNIT_CHECK(stat(json, "i2c0", "hwm") >= SN_BUS_QUEUE_LEN + 1);
+  cJSON_Delete(json);
+}
+
+static int64_t s_busy_us = 0;
+
+static esp_err_t busy_txn(sn_bus_t *bus, void *arg) {
+  int64_t start = esp_timer_get_time();
+  vTaskDelay(pdMS_TO_TICKS((intptr_t)arg));
+  s_busy_us += esp_timer_get_time() - start;
+  return ESP_OK;
+}
+
+// util is the busy share of the time since the previous call, txn and wakeups the
+// counts over it
+void unit_bus_stats(void) {
+  sn_bus_t *bus = bus_up();
+  if (!UNIT_CHECK(bus)) return;
+  cJSON_Delete(sn_bus_stats_to_json());
+
+  int64_t start = esp_timer_get_time();
+  s_busy_us = 0;
+  for (int i = 0; i < 5; i++) sn_bus_submit(bus, SN_BUS_PRIO_NORMAL, busy_txn, (void *)10);
+  vTaskDelay(pdMS_TO_TICKS(50));
+  int64_t window = esp_timer_get_time() - start;
+
+  cJSON *json = sn_bus_stats_to_json();
+  UNIT_CHECK_NEAR(stat(json, "i2c0", "util"), (double)s_busy_us * 1000 / window, 20);
+  UNIT_CHECK(stat(json, "i2c0", "txn") == 5);
+  UNIT_CHECK(stat(json, "i2c0", "wakeups") >= 1 && stat(json, "i2c0", "wakeups") <= 6);
+  UNIT_CHECK(stat(json, "i2c0", "waitMax") >= 0);
+  cJSON_Delete(json);
+
+  // the window starts again at every call, the since boot values stay
+  json = sn_bus_stats_to_json();
+  UNIT_CHECK(stat(json, "i2c0", "util") == 0);
+  UNIT_CHECK(stat(json, "i2c0", "txn") == 0 && stat(json, "i2c0", "wakeups") == 0);
+  UNIT_CHECK(stat(json, "i2c0", "hwm") >= 1);
+  cJSON_Delete(json);
+}
@@ -0,0 +1,62 @@
+#include "sn_driver/filter.h"
+#include "unit.h"
+
+#define EPS 1e-4
+
+SN_FILTER_CHAIN(s_median3, SN_FILTER_MEDIAN(3));
+SN_FILTER_CHAIN(s_median4, SN_FILTER_MEDIAN(4));
+SN_FILTER_CHAIN(s_ema, SN_FILTER_EMA(0.5f));
+SN_FILTER_CHAIN(s_kalman, SN_FILTER_KALMAN(0.0f, 1.0f));
+SN_FILTER_CHAIN(
+  s_chain, SN_FILTER_MEDIAN(3), SN_FILTER_EMA(0.5f), SN_FILTER_CLAMP(0.0f, 20.0f)
+);
+
+static void feed(sn_filter_chain_t *chain, const float *in, const float *out, int n) {
+  sn_filter_chain_reset(chain);
+  for (int i = 0; i < n; i++) {
+    UNIT_CHECK_NEAR(sn_filter_chain_apply(chain, in[i]), out[i], EPS);
+  }
+}
+
+void unit_filter_median(void) {
+  // the spike never gets through once the window holds three samples
+  static const float in[] = {10, 100, 12, 11, 13};
+  static const float out[] = {10, 55, 12, 12, 12};
+  feed(&s_median3, in, out, 5);
+
+  // even window, mean of the two middle samples
+  static const float in4[] = {4, 1, 3, 2, 8};
+  static const float out4[] = {4, 2.5f, 3, 2.5f, 2.5f};
+  feed(&s_median4, in4, out4, 5);
+}
+
+void unit_filter_ema(void) {
+  static const float in[] = {10, 20, 20, 0};
+  static const float out[] = {10, 15, 17.5f, 8.75f};
+  feed(&s_ema, in, out, 4);
+}
+
+// with no process noise the estimate is the running mean of the samples
+void unit_filter_kalman(void) {
+  static const float in[] = {10, 20, 20, 14};
+  static const float out[] = {10, 15, 50.0f / 3, 16};
+  feed(&s_kalman, in, out, 4);
+  UNIT_CHECK_NEAR(s_kalman.state[0].kalman.p, 0.25, EPS);
+}
+
+// median -> ema -> clamp, each stage sees the output of the previous one
+void unit_filter_chain(void) {
+  // median 10, 55, 12 -> ema 10, 32.5, 22.25 -> clamp 10, 20, 20
+  static const float in[] = {10, 100, 12};
+  static const float out[] = {10, 20, 20};
+  feed(&s_chain, in, out, 3);
+  UNIT_CHECK_NEAR(s_chain.state[1].ema.y, 22.25, EPS);
+
+  // a reset seeds every stage again with the next sample
+  sn_filter_chain_reset(&s_chain);
+  UNIT_CHECK_NEAR(sn_filter_chain_apply(&s_chain, 5), 5, EPS);
+  UNIT_CHECK_NEAR(sn_filter_chain_apply(&s_chain, -40), 0, EPS);
+
+  // no chain passes the value through
+  UNIT_CHECK_NEAR(sn_filter_chain_apply(NULL, 7), 7, EPS);
+}
@@ -0,0 +1,70 @@
+#include "cJSON.h"
+#include "sn_driver.h"
+#include "sn_driver_registry.h"
+#include "sn_json.h"
+#include "unit.h"
+#include <string.h>
+
+#define LIGHT_PIN GPIO_NUM_35
+
+static const sn_port_measurement_map_t s_light_map[] = {
+  MEASUREMENT_MAP_ENTRY(0x04, ST_LIGHT_INTENSITY, "lux"),
+  MEASUREMENT_MAP_ENTRY_NULL(),
+};
+
+static const sn_device_port_desc_t s_light_port = SENSOR_PORT_LITERAL(
+  "light", "lm393",
+  ((sn_sensor_port_t){
+    .usage_type = PUT_GPIO, .usage.gpio.pin = LIGHT_PIN, .measurements = s_light_map
+  })
+);
+
+static sn_device_instance_t s_inst;
+
+static esp_err_t control(const char *params) {
+  cJSON *json = cJSON_Parse(params);
+  cJSON *result = NULL;
+  esp_err_t err = light_intensity_driver.control(&s_inst.ctx, json, &result);
+  cJSON_Delete(result);
+  cJSON_Delete(json);
+  return err;
+}
+
+// bright_mv, dark_mv and the points of the curve as reported
+static void report(double out[3]) {
+  cJSON *cal = light_intensity_driver.report_calibration(&s_inst.ctx);
+  out[0] = out[1] = out[2] = -1;
+  json_get_number(cal, "bright_mv", &out[0]);
+  json_get_number(cal, "dark_mv", &out[1]);
+  json_get_number(cal, "curve", &out[2]);
+  cJSON_Delete(cal);
+}
+
+// a rejected command changes nothing, even when it asks for a reset first
+void unit_light_cal_rejected(void) {
+  static const char *rejected[] = {
+    "{\"reset\":true,\"curve\":[[100,1],[50,2]]}",        // mv not increasing
+    "{\"reset\":true,\"bright_mv\":300,\"dark_mv\":300}",  // endpoints equal
+    "{\"bright_mv\":400,\"curve\":[[1,-5],[2,3]]}",        // negative lux
+    "{\"reset\":true,\"curve\":[[1,2],[3]]}",              // not [mv, lux]
+  };
+  double cal[3];
+  memset(&s_inst, 0, sizeof(s_inst));
+  esp_err_t err = light_intensity_driver.init(&s_light_port, &s_inst.ctx, sizeof(s_inst.ctx));
+  if (!UNIT_CHECK(err == ESP_OK)) return;
+  UNIT_CHECK(control("{\"reset\":true}") == ESP_OK);
+  UNIT_CHECK(control("{\"bright_mv\":200,\"dark_mv\":2500}") == ESP_OK);
+  UNIT_CHECK(control("{\"curve\":[[100,1000],[2000,10]]}") == ESP_OK);
+
+  for (size_t i = 0; i < sizeof(rejected) / sizeof(rejected[0]); i++) {
+    UNIT_CHECK(control(rejected[i]) == ESP_ERR_INVALID_ARG);
+    report(cal);
+    UNIT_CHECK(cal[0] == 200 && cal[1] == 2500 && cal[2] == 2);
+  }
+
+  // a valid reset still drops both
+  UNIT_CHECK(control("{\"reset\":true}") == ESP_OK);
+  report(cal);
+  UNIT_CHECK(cal[0] != 200 && cal[1] != 2500 && cal[2] == 0);
+  light_intensity_driver.deinit(&s_inst.ctx);
+}
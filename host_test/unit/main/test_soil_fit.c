@@ -0,0 +1,112 @@
+#include "cJSON.h"
+#include "sn_adc_helper.h"
+#include "sn_driver.h"
+#include "sn_driver_registry.h"
+#include "sn_json.h"
+#include "unit.h"
+#include <string.h>
+
+// the fake converts 2048 to 1550 mV at 12 dB
+#define SOIL_PIN GPIO_NUM_34
+#define SOIL_RAW 2048
+
+static const sn_port_measurement_map_t s_soil_map[] = {
+  MEASUREMENT_MAP_ENTRY(0x03, ST_MOISTURE, "%"),
+  MEASUREMENT_MAP_ENTRY_NULL(),
+};
+
+static const sn_device_port_desc_t s_soil_port = SENSOR_PORT_LITERAL(
+  "soil", "soil_adc",
+  ((sn_sensor_port_t){
+    .usage_type = PUT_GPIO, .usage.gpio.pin = SOIL_PIN, .measurements = s_soil_map
+  })
+);
+
+// the ctx lives inline in an instance as when bound
+static sn_device_instance_t s_inst;
+
+static esp_err_t control(const char *params) {
+  cJSON *json = cJSON_Parse(params);
+  cJSON *result = NULL;
+  esp_err_t err = soil_moisture_driver.control(&s_inst.ctx, json, &result);
+  cJSON_Delete(result);
+  cJSON_Delete(json);
+  return err;
+}
+
+static double item(const cJSON *arr, int i) {
+  const cJSON *it = cJSON_GetArrayItem(arr, i);
+  return cJSON_IsNumber(it) ? it->valuedouble : -1.0;
+}
+
+static esp_err_t soil_up(void) {
+  memset(&s_inst, 0, sizeof(s_inst));
+  esp_err_t err = soil_moisture_driver.init(&s_soil_port, &s_inst.ctx, sizeof(s_inst.ctx));
+  // a fit stored by a previous case
+  return err == ESP_OK ? control("{\"fit\":[]}") : err;
+}
+
+void unit_soil_fit(void) {
+  adc1_channel_t ch = adc_helper_pin_to_channel(SOIL_PIN);
+  adc_helper_fit_t fit;
+  if (!UNIT_CHECK(soil_up() == ESP_OK)) return;
+  UNIT_CHECK(!adc_helper_get_fit(ch, &fit));
+  uint32_t base = adc_helper_raw_to_mv(ch, SOIL_RAW);
+  UNIT_CHECK(base == 1550);
+
+  // offset only, exact
+  UNIT_CHECK(control("{\"fit\":[100, 1.0]}") == ESP_OK);
+  UNIT_CHECK(adc_helper_get_fit(ch, &fit));
+  UNIT_CHECK(fit.offset == 100 * 65536 && fit.gain == 65536 && fit.curve == 0);
+  UNIT_CHECK(adc_helper_raw_to_mv(ch, SOIL_RAW) == base + 100);
+
+  // 0.5 * 1550 + 1e-4 * 1550^2 = 1015.25
+  UNIT_CHECK(control("{\"fit\":[0, 0.5, 0.0001]}") == ESP_OK);
+  UNIT_CHECK_NEAR(adc_helper_raw_to_mv(ch, SOIL_RAW), 1015.25, 1.0);
+
+  cJSON *cal = soil_moisture_driver.report_calibration(&s_inst.ctx);
+  const cJSON *arr = cJSON_GetObjectItemCaseSensitive(cal, "fit");
+  UNIT_CHECK(cJSON_GetArraySize(arr) == 3);
+  UNIT_CHECK_NEAR(item(arr, 0), 0.0, 1e-4);
+  UNIT_CHECK_NEAR(item(arr, 1), 0.5, 1e-4);
+  UNIT_CHECK_NEAR(item(arr, 2), 0.0001, 1e-6);
+  cJSON_Delete(cal);
+
+  // the calibration points and the fit in one command
+  UNIT_CHECK(control("{\"dry_mv\":3000,\"wet_mv\":1200,\"fit\":[-20, 1.0]}") == ESP_OK);
+  UNIT_CHECK(adc_helper_raw_to_mv(ch, SOIL_RAW) == base - 20);
+
+  UNIT_CHECK(control("{\"fit\":[]}") == ESP_OK);
+  UNIT_CHECK(!adc_helper_get_fit(ch, &fit));
+  UNIT_CHECK(adc_helper_raw_to_mv(ch, SOIL_RAW) == base);
+}
+
+// nothing changes when any part of the command is invalid
+void unit_soil_fit_rejected(void) {
+  static const char *rejected[] = {
+    "{\"fit\":[0]}",           // no gain
+    "{\"fit\":[0, 0]}",        // gain <= 0
+    "{\"fit\":[0, 5]}",        // gain too high
+    "{\"fit\":[600, 1]}",      // offset too large
+    "{\"fit\":[0, 1, 0.01]}",  // curve too strong
+    "{\"fit\":[0, 1, 0, 0]}",  // too many terms
+    "{\"fit\":[\"0\", 1]}",    // not a number
+    "{\"fit\":[0, 2], \"dry_mv\":500, \"wet_mv\":900}", // wet above dry
+  };
+  adc1_channel_t ch = adc_helper_pin_to_channel(SOIL_PIN);
+  adc_helper_fit_t fit;
+  if (!UNIT_CHECK(soil_up() == ESP_OK)) return;
+  UNIT_CHECK(control("{\"fit\":[50, 1.0]}") == ESP_OK);
+
+  for (size_t i = 0; i < sizeof(rejected) / sizeof(rejected[0]); i++) {
+    UNIT_CHECK(control(rejected[i]) == ESP_ERR_INVALID_ARG);
+    UNIT_CHECK(adc_helper_get_fit(ch, &fit) && fit.offset == 50 * 65536 && fit.gain == 65536);
+  }
+
+  cJSON *cal = soil_moisture_driver.report_calibration(&s_inst.ctx);
+  double dry = 0;
+  json_get_number(cal, "dry_mv", &dry);
+  UNIT_CHECK(dry != 500);
+  cJSON_Delete(cal);
+  control("{\"fit\":[]}");
+}
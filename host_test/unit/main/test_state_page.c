@@ -0,0 +1,68 @@
+#include "cJSON.h"
+#include "sn_driver_registry.h"
+#include "sn_json.h"
+#include "sn_mqtt_manager.h"
+#include "sn_state_table.h"
+#include "unit.h"
+#include <stdio.h>
+#include <string.h>
+
+// room left in a message for the ack envelope and the longest command id
+#define ACK_ENVELOPE_MAX 160
+
+static cJSON *get_state(const char *params) {
+  cJSON *json = cJSON_Parse(params);
+  cJSON *result = NULL;
+  esp_err_t err = state_driver.control(NULL, json, &result);
+  cJSON_Delete(json);
+  if (err != ESP_OK) {
+    cJSON_Delete(result);
+    return NULL;
+  }
+  return result;
+}
+
+// Every port local_id written with the widest rows, paged through from the start
+void unit_state_page(void) {
+  for (int id = LOCAL_ID_MIN; id < SN_STATE_TABLE_LEN - 1; id++) {
+    sn_state_table_update(id, -12345.678f, 1731000000000ULL + id);
+  }
+
+  int rows = 0, pages = 0, next = 0;
+  int expected = LOCAL_ID_MIN;
+  do {
+    char params[48];
+    snprintf(params, sizeof(params), "{\"offset\":%d}", next);
+    cJSON *result = get_state(params);
+    if (!UNIT_CHECK(result)) return;
+
+    char *str = cJSON_PrintUnformatted(result);
+    UNIT_CHECK(str && strlen(str) + ACK_ENVELOPE_MAX < SN_MQTT_PAYLOAD_MAX);
+    cJSON_free(str);
+
+    const cJSON *state = cJSON_GetObjectItemCaseSensitive(result, "state");
+    const cJSON *page = cJSON_GetObjectItemCaseSensitive(state, "rows");
+    UNIT_CHECK(cJSON_GetArraySize(page) <= SN_STATE_TABLE_PAGE_MAX);
+    const cJSON *row = NULL;
+    cJSON_ArrayForEach(row, page) {
+      UNIT_CHECK(cJSON_GetArrayItem(row, 0)->valueint == expected++);
+      rows++;
+    }
+    double v = 0;
+    next = json_get_number(state, "next", &v) ? (int)v : -1;
+    UNIT_CHECK(next == -1 || next == expected);
+    cJSON_Delete(result);
+  } while (next > 0 && ++pages < SN_STATE_TABLE_LEN);
+
+  UNIT_CHECK(rows == SN_STATE_TABLE_LEN - 1 - LOCAL_ID_MIN);
+
+  // a smaller page
+  cJSON *result = get_state("{\"offset\":5,\"limit\":2}");
+  const cJSON *state = cJSON_GetObjectItemCaseSensitive(result, "state");
+  double v = 0;
+  UNIT_CHECK(cJSON_GetArraySize(cJSON_GetObjectItemCaseSensitive(state, "rows")) == 2);
+  UNIT_CHECK(json_get_number(state, "next", &v) && v == 7);
+  cJSON_Delete(result);
+
+  UNIT_CHECK(!get_state("{\"limit\":100}"));
+}
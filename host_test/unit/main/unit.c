@@ -0,0 +1,48 @@
+#include "unit.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *s_case = NULL;
+static int s_case_failures = 0;
+static int s_cases = 0;
+static int s_failed = 0;
+static int s_checks = 0;
+
+bool sn_unit_check(bool ok, const char *expr, const char *file, int line) {
+  s_checks++;
+  if (!ok) {
+    s_case_failures++;
+    printf("  %s:%d: %s: check failed: %s\n", file, line, s_case, expr);
+  }
+  return ok;
+}
+
+bool sn_unit_check_near(
+  double actual, double expected, double tol, const char *expr, const char *file, int line
+) {
+  bool ok = fabs(actual - expected) <= tol;
+  if (!sn_unit_check(ok, expr, file, line)) {
+    printf("    actual %g, expected %g (+/- %g)\n", actual, expected, tol);
+  }
+  return ok;
+}
+
+void sn_unit_run(const char *name, sn_unit_fn_t fn) {
+  const char *filter = getenv("SN_UNIT_FILTER");
+  if (filter && !strstr(name, filter)) return;
+
+  s_case = name;
+  s_case_failures = 0;
+  fn();
+  s_cases++;
+  if (s_case_failures) s_failed++;
+  printf("%-4s %s\n", s_case_failures ? "FAIL" : "ok", name);
+  s_case = NULL;
+}
+
+int sn_unit_summary(void) {
+  printf("%d cases, %d failed, %d checks\n", s_cases, s_failed, s_checks);
+  return s_failed;
+}
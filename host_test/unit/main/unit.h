@@ -0,0 +1,68 @@
+// --------------------------------------------------------------------------------
+// unit.h
+//
+// description: minimal unit test runner. A case checks its expectations with the
+// UNIT_CHECK macros, a failed check prints its expression and location and the case
+// goes on. The exit code is 1 if any check failed.
+// author: nd2204
+// --------------------------------------------------------------------------------
+
+#ifndef SN_UNIT_H
+#define SN_UNIT_H
+
+#include <stdbool.h>
+
+// every case of the suite, defined as void unit_<name>(void) by the test_*.c files
+// clang-format off
+#define UNIT_CASES(X)          \
+  X(bus_priority)              \
+  X(bus_batch)                 \
+  X(bus_shared)                \
+  X(bus_reentry)               \
+  X(bus_queue_full)            \
+  X(bus_stats)                 \
+  X(filter_median)             \
+  X(filter_ema)                \
+  X(filter_kalman)             \
+  X(filter_chain)              \
+  X(light_cal_rejected)        \
+  X(soil_fit)                  \
+  X(soil_fit_rejected)         \
+  X(state_page)
+// clang-format on
+
+#define GEN_UNIT_DECL(NAME) void unit_##NAME(void);
+UNIT_CASES(GEN_UNIT_DECL)
+#undef GEN_UNIT_DECL
+
+typedef void (*sn_unit_fn_t)(void);
+
+/*
+ * @brief Record the outcome of a check in the running case
+ * @return ok
+ */
+bool sn_unit_check(bool ok, const char *expr, const char *file, int line);
+
+/*
+ * @brief Same as sn_unit_check for |actual - expected| <= tol, prints both values
+ */
+bool sn_unit_check_near(
+  double actual, double expected, double tol, const char *expr, const char *file, int line
+);
+
+#define UNIT_CHECK(EXPR) sn_unit_check((EXPR), #EXPR, __FILE__, __LINE__)
+#define UNIT_CHECK_NEAR(ACTUAL, EXPECTED, TOL)                                                     \
+  sn_unit_check_near((ACTUAL), (EXPECTED), (TOL), #ACTUAL, __FILE__, __LINE__)
+
+/*
+ * @brief Run fn unless the name is filtered out by SN_UNIT_FILTER (substring)
+ */
+void sn_unit_run(const char *name, sn_unit_fn_t fn);
+
+/*
+ * @brief Print the totals
+ * @return number of failed cases
+ */
+int sn_unit_summary(void);
+
+#endif // !SN_UNIT_H
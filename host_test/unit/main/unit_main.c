@@ -0,0 +1,26 @@
+#include "esp_log.h"
+#include "sn_adc_helper.h"
+#include "sn_driver.h"
+#include "sn_rules/sn_rule_engine.h"
+#include "sn_storage.h"
+#include "unit.h"
+#include <stdlib.h>
+
+// the cases bind their own ports, nothing comes from the device model
+const sn_device_port_desc_t gDevicePorts[1] = {{0}};
+const size_t gDevicePortsLen = 0;
+const sn_rule_desc_t gRules[1] = {{0}};
+const size_t gRulesLen = 0;
+
+void app_main(void) {
+  ESP_ERROR_CHECK(sn_storage_init(NULL));
+  ESP_ERROR_CHECK(adc_helper_init());
+  // the failures are printed by the runner, not logged
+  esp_log_level_set("*", ESP_LOG_NONE);
+
+#define RUN_UNIT(NAME) sn_unit_run(#NAME, unit_##NAME);
+  UNIT_CASES(RUN_UNIT)
+#undef RUN_UNIT
+
+  exit(sn_unit_summary() == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
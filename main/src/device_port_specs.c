@@ -10,19 +10,35 @@
 
 // Define globals (device metadata)
 
+// Conditioning of the readings, run by the poll task after read_multi. One chain per
+// measurement, the stages keep the history of their signal
+
+// the dht11 reads in whole degrees with the odd bad frame that passes the checksum
+SN_FILTER_CHAIN(
+  dht1_temperature_filter, SN_FILTER_MEDIAN(3), SN_FILTER_KALMAN(0.01f, 0.25f),
+  SN_FILTER_CLAMP(0.0f, 50.0f)
+);
+SN_FILTER_CHAIN(
+  dht1_humidity_filter, SN_FILTER_MEDIAN(3), SN_FILTER_EMA(0.5f), SN_FILTER_CLAMP(20.0f, 90.0f)
+);
+// splashes and loose contacts on the probe, the rule thresholds sit on this one
+SN_FILTER_CHAIN(soil1_moisture_filter, SN_FILTER_MEDIAN(5), SN_FILTER_CLAMP(0.0f, 100.0f));
+// passing shadows
+SN_FILTER_CHAIN(light1_intensity_filter, SN_FILTER_MEDIAN(3), SN_FILTER_EMA(0.3f));
+
 // TODO: Add persistence for sensors and actuator states
 static const sn_port_measurement_map_t dht1_temperature_map =
-  MEASUREMENT_MAP_ENTRY(0x01, ST_TEMPERATURE, "C");
+  MEASUREMENT_MAP_ENTRY_FILTERED(0x01, ST_TEMPERATURE, "C", dht1_temperature_filter);
 
 static const sn_port_measurement_map_t dht1_humidity_map =
-  MEASUREMENT_MAP_ENTRY(0x02, ST_HUMIDITY, "%");
+  MEASUREMENT_MAP_ENTRY_FILTERED(0x02, ST_HUMIDITY, "%", dht1_humidity_filter);
 
 static const sn_port_measurement_map_t dht1_map[] = {
   dht1_temperature_map, dht1_humidity_map, MEASUREMENT_MAP_ENTRY_NULL()
 };
 
 static const sn_port_measurement_map_t soil1_moisture_map =
-  MEASUREMENT_MAP_ENTRY(0x03, ST_MOISTURE, "%");
+  MEASUREMENT_MAP_ENTRY_FILTERED(0x03, ST_MOISTURE, "%", soil1_moisture_filter);
 
 static const sn_port_measurement_map_t soil1_map[] = {
   soil1_moisture_map,
@@ -30,7 +46,7 @@ static const sn_port_measurement_map_t soil1_map[] = {
 };
 
 static const sn_port_measurement_map_t light1_intensity =
-  MEASUREMENT_MAP_ENTRY(0x04, ST_LIGHT_INTENSITY, "lux");
+  MEASUREMENT_MAP_ENTRY_FILTERED(0x04, ST_LIGHT_INTENSITY, "lux", light1_intensity_filter);
 
 static const sn_port_measurement_map_t light1_map[] = {
   light1_intensity,
@@ -76,6 +92,7 @@ static const sn_port_measurement_map_t light1_map[] = {
   X(oled, "oled-screen", "ssd1306",                                                                \
     ((sn_actuator_port_t){                                                                         \
       .local_id = 0x0E,                                                                            \
+      .usage.i2c.addr = 0x3C,                                                                      \
       .usage.i2c.scl = GPIO_NUM_22,                                                                \
       .usage.i2c.sda = GPIO_NUM_21,                                                                \
       .usage_type = PUT_I2C,                                                                       \
@@ -85,6 +102,18 @@ static const sn_port_measurement_map_t light1_map[] = {
   X(sensor_control, "sensor control", "sensor_control",                                            \
     ((sn_command_api_port_t){                                                                      \
       .local_id = 0x7E,                                                                            \
+    }))                                                                                            \
+  X(state, "state", "state",                                                                       \
+    ((sn_command_api_port_t){                                                                      \
+      .local_id = 0x7D,                                                                            \
+    }))                                                                                            \
+  X(metrics, "metrics", "metrics",                                                                 \
+    ((sn_command_api_port_t){                                                                      \
+      .local_id = 0x7C,                                                                            \
+    }))                                                                                            \
+  X(profile, "profile", "profile",                                                                 \
+    ((sn_command_api_port_t){                                                                      \
+      .local_id = 0x7B,                                                                            \
     }))
 
 SENSOR_PORT_DESCS(DEFINE_SENSOR_PORT_CONST_VAR)
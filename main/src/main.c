@@ -4,8 +4,12 @@
 // mqtt
 #include "sn_mqtt_router.h"
 #include "sn_mqtt_manager.h"
+#include "sn_command_executor.h"
+#include "sn_shadow.h"
+#include "sn_trace_mqtt.h"
 // internet and time
 #include "sn_inet.h"
+#include "sn_recorder.h"
 #include "sn_rules/sn_rule_engine.h"
 #include "sn_security.h"
 #include "sn_sntp.h"
@@ -14,6 +18,7 @@
 // drivers
 #include "sn_driver.h"
 #include "sn_driver_registry.h"
+#include "sn_recovery.h"
 
 // esp-idf framework libs
 #include <esp_log.h>
@@ -36,23 +41,26 @@ static esp_err_t init_device_config();
 static esp_err_t init_drivers(void);
 static esp_err_t start_mqtt_registration_verification();
 
-// mqtt command callback
+// mqtt command callback, runs on the mqtt event task so only hand it over to the executor
 static void on_command_msg(const char *topic, const char *payload) {
   ESP_LOGI("CMD", "Command received: %s", payload);
-  cJSON *out = NULL;
-  dispatch_command(payload, &out);
-  if (out) {
-    char *payload_str = cJSON_PrintUnformatted(out);
-    const sn_mqtt_topic_cache_t *cache = sn_mqtt_topic_cache_get();
-    sn_mqtt_publish_enqueue(cache->command_ack_topic, payload_str, 1, false);
-    cJSON_free(payload_str);
-    cJSON_Delete(out);
-  }
+  sn_command_executor_submit(payload);
+}
+
+// org and cluster wide commands, filtered locally by the executor
+static void on_group_command_msg(const char *topic, const char *payload) {
+  ESP_LOGI("CMD", "Group command received on %s", topic);
+  sn_command_executor_submit_group(payload);
 }
+
 void app_main(void) {
   GOTO_IF_ESP_ERROR(end, init_drivers());
   // Init modules
   GOTO_IF_ESP_ERROR(end, sn_storage_init(NULL));
+#if CONFIG_SN_RECORDER_ENABLE
+  // field recording is best effort, a missing partition only loses the log
+  ESP_ERROR_CHECK_WITHOUT_ABORT(sn_recorder_init());
+#endif
   GOTO_IF_ESP_ERROR(end, sn_inet_init(NULL));
   // Connect to the internet using wifi this will block and wait for the connection
   GOTO_IF_ESP_ERROR(end, sn_inet_wifi_connect(WIFI_SSID, WIFI_PASS));
@@ -79,7 +87,15 @@ void app_main(void) {
   cJSON_Delete(payload);
 
   sn_mqtt_start();
+  sn_command_executor_start();
   sn_mqtt_router_subscriber_add(cache->command_topic, on_command_msg, 1);
+  sn_mqtt_router_subscriber_add(cache->org_command_topic, on_group_command_msg, 1);
+  if (cache->cluster_command_topic[0] != '\0') {
+    sn_mqtt_router_subscriber_add(cache->cluster_command_topic, on_group_command_msg, 1);
+  }
+  sn_shadow_start();
+  sn_trace_mqtt_start();
+  sn_recovery_set_event_handler(publish_device_event);
 
   xTaskCreatePinnedToCore(sensor_poll_task, "sensor_poll_task", 4096, NULL, 4, NULL, 0);
   xTaskCreatePinnedToCore(status_poll_task, "status_task", 4096, NULL, 5, NULL, 1);
@@ -96,8 +112,13 @@ static esp_err_t init_device_config() {
 
   // Init organization id
   if (CONFIG_ORG_ID[0] != '\0') sn_storage_set_org_id(CONFIG_ORG_ID);
+  // Init cluster id, a cluster provisioned at runtime survives a build without one
+  if (CONFIG_CLUSTER_ID[0] != '\0') sn_storage_set_cluster_id(CONFIG_CLUSTER_ID);
 
   sn_mqtt_topic_context_t ctx = {.orgId = CONFIG_ORG_ID};
+  if (sn_storage_get_cluster_id(ctx.clusterId, sizeof(ctx.clusterId)) != ESP_OK) {
+    ctx.clusterId[0] = '\0';
+  }
   if (sn_storage_get_device_id(ctx.deviceId, sizeof(ctx.deviceId)) != ESP_OK) {
     uint32_t r = esp_random();
     snprintf(ctx.deviceId, sizeof(ctx.deviceId), "temp-%08lx", r);
@@ -106,7 +127,6 @@ static esp_err_t init_device_config() {
   print_topic_cache();
 
   // sn_storage_get_org_id(ctx.orgId, sizeof(ctx.orgId));
-  // sn_storage_get_cluster_id(ctx.clusterId, sizeof(ctx.clusterId));
   // sn_storage_list_all();
   return ESP_OK;
 }
@@ -1,11 +1,19 @@
 #include "esp_timer.h"
+#include "sn_actor.h"
+#include "sn_metrics.h"
 #include "sn_mqtt_manager.h"
 #include "sn_topic.h"
+#include "sn_trace.h"
+#include "sn_state_table.h"
 #include "sn_telemetry_queue.h"
 #include "sn_driver.h"
+#include "sn_recovery.h"
 
 static const char *TAG = "SENSOR_POLL_TASK";
 
+// readings a single read_multi may return
+#define READINGS_MAX 4
+
 static esp_err_t mqtt_publish_telemetry(const sn_sensor_reading_t *reading) {
   if (!reading) return ESP_ERR_INVALID_ARG;
   const char *topic = sn_mqtt_topic_cache_get()->telemetry_topic;
@@ -13,42 +21,83 @@ static esp_err_t mqtt_publish_telemetry(const sn_sensor_reading_t *reading) {
   return sn_mqtt_publish_json_payload_signed(json, topic, 0, false);
 }
 
+typedef struct {
+  sn_sensor_reading_t *readings;
+  int max;
+  int count;
+  esp_err_t rc;
+  bool offline; // not read, the port went offline while the call was queued
+} read_call_t;
+
+// Runs on the instance's actor so a read never overlaps control, calibration or recovery
+static void read_on_actor(sn_device_instance_t *inst, void *arg) {
+  read_call_t *call = (read_call_t *)arg;
+  // recovery may have taken the port offline while the read was queued
+  if (!inst->online) {
+    call->offline = true;
+    return;
+  }
+  call->rc = inst->driver->read_multi((void *)&inst->ctx, call->readings, call->max, &call->count);
+}
+
 void sensor_poll_task(void *pvParam) {
   size_t len = sn_driver_get_instance_len();
   sn_device_instance_t *instances = sn_driver_get_device_instances();
 
-  sn_sensor_reading_t readings[4];
+  sn_sensor_reading_t readings[READINGS_MAX];
   for (;;) {
     FOR_EACH_SENSOR_INSTANCE(it, instances, len) {
       uint64_t now_ms = esp_timer_get_time() / 1000ULL;
       // check schedule
-      if ((now_ms - it->last_read_ms) < it->interval_ms) continue;
+      if ((now_ms - it->last_read_ms) < sn_device_instance_get_interval(it)) continue;
       if (!it->online || !it->driver || !it->driver->read_multi) continue;
-      int outcount = 0;
-      esp_err_t r = it->driver->read_multi((void *)&it->ctx, readings, sizeof(readings), &outcount);
+      read_call_t call = {.readings = readings, .max = READINGS_MAX, .rc = ESP_FAIL};
+      int64_t read_start = esp_timer_get_time();
+      SN_TRACE_BEGIN("sensor.read", it->port->desc.s.measurements[0].local_id);
+      esp_err_t posted = sn_actor_call_sync(it, read_on_actor, &call);
+      esp_err_t r = call.rc;
+      int outcount = call.count;
+      SN_TRACE_END("sensor.read", posted == ESP_OK && r == ESP_OK ? outcount : 0);
+      sn_metric_observe(SN_MH_sensor_read_time, (uint32_t)(esp_timer_get_time() - read_start));
+      // A busy mailbox or a port gone offline meanwhile is not a failed read, the errors
+      // of the driver itself (a dht without a frame times out) are
+      if (posted != ESP_OK || call.offline) continue;
+      // frame started in the background, the next pass picks it up
+      if (r == ESP_ERR_NOT_FINISHED) continue;
       if (r == ESP_OK && outcount > 0) {
+        sn_metric_inc(SN_MC_sensor_read_ok);
         it->last_read_ms = now_ms;
-        it->consecutive_failures = 0;
+        sn_recovery_record_read(it, true);
 
         for (int i = 0; i < outcount; i++) {
+          const sn_port_measurement_map_t *m =
+            pm_find_by_local_id(it->port->desc.s.measurements, readings[i].local_id);
+          if (m && m->filter) {
+            readings[i].value = sn_filter_chain_apply(m->filter, readings[i].value);
+          }
+          sn_state_table_update(readings[i].local_id, readings[i].value, readings[i].ts);
           // notify subscriber
+          SN_TRACE_BEGIN("sensor.distribute", readings[i].local_id);
           distribute_reading(&readings[i]);
+          SN_TRACE_END("sensor.distribute", readings[i].local_id);
           // send reading to publisher task
           mqtt_publish_telemetry(&readings[i]);
         }
         vTaskDelay(pdMS_TO_TICKS(20));
       } else {
-        it->consecutive_failures++;
+        sn_metric_inc(SN_MC_sensor_read_fail);
+        sn_recovery_record_read(it, false);
+        FOR_EACH_MEASUREMENT(m, it->port->desc.s.measurements) {
+          sn_state_table_mark_bad(m->local_id);
+        }
         ESP_LOGW(
           TAG, "Read failed for port=%s driver=%s rc=%d fails=%d", it->port->port_name,
           it->driver ? it->driver->name : "(null)", r, it->consecutive_failures
         );
-        if (it->consecutive_failures >= 3) {
-          it->online = false;
-          ESP_LOGW(TAG, "Marking port %s offline after consecutive failures", it->port->port_name);
-        }
       }
     }
+    // offline ports are re-probed on their actors, never here
+    sn_recovery_poll(esp_timer_get_time() / 1000ULL);
     vTaskDelay(pdMS_TO_TICKS(500));
   }
 }
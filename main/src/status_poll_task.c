@@ -2,8 +2,14 @@
 #include <esp_log.h>
 #include <esp_heap_caps.h>
 #include "freertos/idf_additions.h"
+#include <string.h>
+#include "sn_common.h"
+#include "sn_device_event.h"
+#include "sn_bus.h"
 #include "sn_inet.h"
+#include "sn_metrics.h"
 #include "sn_mqtt_manager.h"
+#include "sn_recovery.h"
 #include "sn_sntp.h"
 #include "sn_topic.h"
 
@@ -13,6 +19,26 @@ static const char *TAG = "STATUS_POLL_TASK";
 #define STATUS_POLL_INTERVAL_MS 8000 // 8 seconds
 #endif
 
+// metrics go out on the status topic once every N status messages
+#ifndef METRICS_EXPORT_EVERY
+#define METRICS_EXPORT_EVERY 4
+#endif
+
+// thresholds of the device events, each one fires once when crossed and re-arms
+// after recovering 25% above it
+#ifndef HEAP_LOW_THRESHOLD
+#define HEAP_LOW_THRESHOLD (16 * 1024)
+#endif
+#ifndef HEAP_LARGEST_BLOCK_THRESHOLD
+#define HEAP_LARGEST_BLOCK_THRESHOLD (8 * 1024)
+#endif
+// bytes of stack never touched, fires once per task
+#ifndef STACK_LOW_THRESHOLD
+#define STACK_LOW_THRESHOLD 512
+#endif
+
+#define STATUS_MAX_TASKS 32
+
 static inline float get_memory_usage(void) {
   size_t free_heap = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
   size_t total_heap = heap_caps_get_total_size(MALLOC_CAP_DEFAULT);
@@ -20,57 +46,343 @@ static inline float get_memory_usage(void) {
   return 1.0f - ((float)free_heap / (float)total_heap);
 }
 
-// track CPU time
-static uint64_t s_last_idle_time = 0;
-static uint64_t s_last_total_time = 0;
-static float s_last_cpu_usage = 0.0f;
+// --------------------------------------------------------------------------------
+// Task snapshot, shared by the cpu and stack accounting
+// --------------------------------------------------------------------------------
 
-static float get_cpu_usage(void) {
-  // Approximation using idle task time deltas
-  // (lightweight method; accurate enough for monitoring)
-  uint64_t idle_time = esp_cpu_get_cycle_count();
-  uint64_t total_time = esp_timer_get_time(); // microseconds
+static TaskStatus_t s_task_status[STATUS_MAX_TASKS];
+static UBaseType_t s_task_len = 0;
+static configRUN_TIME_COUNTER_TYPE s_task_total = 0;
+
+static bool sample_tasks(void) {
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+  s_task_len = uxTaskGetSystemState(s_task_status, STATUS_MAX_TASKS, &s_task_total);
+  if (s_task_len == 0) ESP_LOGW(TAG, "More than %d tasks, task stats skipped", STATUS_MAX_TASKS);
+  return s_task_len > 0;
+#else
+  return false;
+#endif
+}
+
+// --------------------------------------------------------------------------------
+// Heap and stacks
+// --------------------------------------------------------------------------------
+
+typedef struct {
+  size_t free;
+  size_t largest_block;
+  size_t min_free; // lowest free heap since boot
+  uint32_t alloc_fail;
+} heap_report_t;
+
+static bool s_heap_low = false;
+static bool s_heap_fragmented = false;
+static uint32_t s_alloc_fail_reported = 0;
+static UBaseType_t s_stack_alerted[STATUS_MAX_TASKS]; // xTaskNumber of reported tasks
+static int s_stack_alerted_len = 0;
+
+// runs in the failing allocation's context, only count
+static void on_alloc_failed(size_t size, uint32_t caps, const char *function_name) {
+  sn_metric_inc(SN_MC_heap_alloc_fail);
+}
+
+static void sample_heap(heap_report_t *out) {
+  out->free = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+  out->largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+  out->min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+  out->alloc_fail = __atomic_load_n(&gMetricCounters[SN_MC_heap_alloc_fail], __ATOMIC_RELAXED);
+}
 
-  if (s_last_total_time == 0) {
-    s_last_idle_time = idle_time;
-    s_last_total_time = total_time;
-    return 0.0f;
+static void emit_event(sn_device_event_e type, const char *source, double value, double threshold) {
+  sn_device_event_t event = {
+    .event_type = type,
+    .source = source,
+    .value = value,
+    .threshold = threshold,
+    .ts = sn_get_unix_timestamp_ms(),
+  };
+  ESP_LOGW(
+    TAG, "Event %d %s value=%.0f threshold=%.0f", type, source ? source : "", value, threshold
+  );
+  publish_device_event(&event);
+}
+
+// true once value went below threshold, false again after it recovered with margin
+static bool crossed(bool *state, size_t value, size_t threshold) {
+  if (!*state && value < threshold) {
+    *state = true;
+    return true;
+  }
+  if (*state && value > threshold + threshold / 4) *state = false;
+  return false;
+}
+
+static void check_memory(const heap_report_t *heap) {
+  if (crossed(&s_heap_low, heap->free, HEAP_LOW_THRESHOLD)) {
+    emit_event(DEVICE_EVENT_LOW_HEAP, NULL, heap->free, HEAP_LOW_THRESHOLD);
+  }
+  if (crossed(&s_heap_fragmented, heap->largest_block, HEAP_LARGEST_BLOCK_THRESHOLD)) {
+    emit_event(
+      DEVICE_EVENT_HEAP_FRAGMENTED, NULL, heap->largest_block, HEAP_LARGEST_BLOCK_THRESHOLD
+    );
+  }
+  if (heap->alloc_fail != s_alloc_fail_reported) {
+    emit_event(DEVICE_EVENT_ALLOC_FAILED, NULL, heap->alloc_fail - s_alloc_fail_reported, 0);
+    s_alloc_fail_reported = heap->alloc_fail;
   }
 
-  uint64_t delta_idle = idle_time - s_last_idle_time;
-  uint64_t delta_total = total_time - s_last_total_time;
-  s_last_idle_time = idle_time;
-  s_last_total_time = total_time;
+  // the high-water mark never goes back up, one event per task is enough
+  for (UBaseType_t i = 0; i < s_task_len; i++) {
+    const TaskStatus_t *t = &s_task_status[i];
+    if (t->usStackHighWaterMark >= STACK_LOW_THRESHOLD) continue;
 
-  if (delta_total == 0) return s_last_cpu_usage;
-  float usage = 1.0f - ((float)delta_idle / (float)delta_total);
-  if (usage < 0) usage = 0;
-  if (usage > 1) usage = 1;
-  s_last_cpu_usage = usage;
-  return usage;
+    bool alerted = false;
+    for (int j = 0; j < s_stack_alerted_len && !alerted; j++) {
+      alerted = s_stack_alerted[j] == t->xTaskNumber;
+    }
+    if (alerted || s_stack_alerted_len >= STATUS_MAX_TASKS) continue;
+    s_stack_alerted[s_stack_alerted_len++] = t->xTaskNumber;
+    emit_event(DEVICE_EVENT_STACK_LOW, t->pcTaskName, t->usStackHighWaterMark, STACK_LOW_THRESHOLD);
+  }
 }
 
-static inline esp_err_t publish_status(const sn_status_reading_t *status) {
+// --------------------------------------------------------------------------------
+// CPU accounting from the FreeRTOS run-time stats (needs
+// CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS, see sdkconfig.defaults)
+// --------------------------------------------------------------------------------
+
+// tasks below this share (per-mille of one core) are left out of the status
+#define CPU_TASK_MIN_PERMILLE 1
+
+typedef struct {
+  UBaseType_t number; // xTaskNumber, stable for the task's lifetime
+  configRUN_TIME_COUNTER_TYPE runtime;
+} cpu_task_sample_t;
+
+typedef struct {
+  const char *name;
+  uint16_t permille; // share of one core over the last interval
+} cpu_task_share_t;
+
+typedef struct {
+  float usage; // average over the cores
+  uint16_t core_permille[portNUM_PROCESSORS];
+  cpu_task_share_t tasks[STATUS_MAX_TASKS];
+  int tasks_len;
+} cpu_report_t;
+
+static cpu_task_sample_t s_prev[STATUS_MAX_TASKS];
+static int s_prev_len = 0;
+static configRUN_TIME_COUNTER_TYPE s_prev_total = 0;
+
+static configRUN_TIME_COUNTER_TYPE prev_runtime_of(UBaseType_t number, bool *found) {
+  for (int i = 0; i < s_prev_len; i++) {
+    if (s_prev[i].number == number) {
+      *found = true;
+      return s_prev[i].runtime;
+    }
+  }
+  *found = false;
+  return 0;
+}
+
+// Shares are computed from the task snapshot over the interval since the previous
+// call, the first call only takes the baseline
+static bool sample_cpu(cpu_report_t *out) {
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+  configRUN_TIME_COUNTER_TYPE total = s_task_total;
+  UBaseType_t n = s_task_len;
+  if (n == 0) return false;
+
+  // the run-time counter ticks in us on every core, so one core is worth delta_total
+  configRUN_TIME_COUNTER_TYPE delta_total = total - s_prev_total;
+  bool has_baseline = s_prev_total != 0 && delta_total > 0;
+  memset(out, 0, sizeof(*out));
+
+  for (UBaseType_t i = 0; i < n && has_baseline; i++) {
+    const TaskStatus_t *t = &s_task_status[i];
+    bool found = false;
+    configRUN_TIME_COUNTER_TYPE prev = prev_runtime_of(t->xTaskNumber, &found);
+    // a task created during the interval ran at most for its whole counter
+    uint64_t permille = (uint64_t)(t->ulRunTimeCounter - (found ? prev : 0)) * 1000 / delta_total;
+    permille = MIN(permille, 1000);
+
+    bool idle = false;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+      if (t->xHandle == xTaskGetIdleTaskHandleForCore(core)) {
+        out->core_permille[core] = 1000 - permille;
+        idle = true;
+      }
+    }
+    if (!idle && permille >= CPU_TASK_MIN_PERMILLE && out->tasks_len < STATUS_MAX_TASKS) {
+      out->tasks[out->tasks_len++] = (cpu_task_share_t){t->pcTaskName, (uint16_t)permille};
+    }
+  }
+
+  for (UBaseType_t i = 0; i < n; i++) {
+    s_prev[i].number = s_task_status[i].xTaskNumber;
+    s_prev[i].runtime = s_task_status[i].ulRunTimeCounter;
+  }
+  s_prev_len = n;
+  s_prev_total = total;
+
+  uint32_t sum = 0;
+  for (int core = 0; core < portNUM_PROCESSORS; core++) sum += out->core_permille[core];
+  out->usage = (float)sum / (1000.0f * portNUM_PROCESSORS);
+  return has_baseline;
+#else
+  static bool warned = false;
+  if (!warned) ESP_LOGW(TAG, "CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS is off, cpu is not reported");
+  warned = true;
+  return false;
+#endif
+}
+
+/* Status payload:
+ * { "cpu": 0.21, "cpuCores": [310, 112], "tasks": {"mqtt_task": 41, ...}, "mem": ...,
+ *   "heap": {"free": 81234, "largest": 65536, "minFree": 60120, "allocFail": 0}, ... }
+ * cpuCores and tasks are per-mille of one core over the last status interval, the task
+ * names are the FreeRTOS ones (actor_wk0, publisher_task, LVGL, mqtt_task...)
+ */
+static inline esp_err_t publish_status(
+  const sn_status_reading_t *status, const cpu_report_t *cpu, const heap_report_t *heap
+) {
   if (!status) return ESP_ERR_INVALID_ARG;
   const char *topic = sn_mqtt_topic_cache_get()->status_topic;
   cJSON *json = cJSON_CreateObject();
   cJSON_AddNumberToObject(json, "cpu", status->cpu);
+  if (cpu) {
+    cJSON *cores = cJSON_AddArrayToObject(json, "cpuCores");
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+      cJSON_AddItemToArray(cores, cJSON_CreateNumber(cpu->core_permille[core]));
+    }
+    cJSON *tasks = cJSON_AddObjectToObject(json, "tasks");
+    for (int i = 0; i < cpu->tasks_len; i++) {
+      cJSON_AddNumberToObject(tasks, cpu->tasks[i].name, cpu->tasks[i].permille);
+    }
+  }
   cJSON_AddNumberToObject(json, "mem", status->mem);
+  cJSON *heap_json = cJSON_AddObjectToObject(json, "heap");
+  cJSON_AddNumberToObject(heap_json, "free", heap->free);
+  cJSON_AddNumberToObject(heap_json, "largest", heap->largest_block);
+  cJSON_AddNumberToObject(heap_json, "minFree", heap->min_free);
+  cJSON_AddNumberToObject(heap_json, "allocFail", heap->alloc_fail);
   cJSON_AddNumberToObject(json, "wifi", status->wifi);
   cJSON_AddNumberToObject(json, "ts", status->ts);
   cJSON_AddBoolToObject(json, "online", true);
   return sn_mqtt_publish_json_payload_signed(json, topic, 0, false);
 }
 
+// Signing escapes the raw payload into a string (a quote takes two bytes) and adds the
+// ts and the signature, a raw chunk this size always fits SN_MQTT_PAYLOAD_MAX once signed
+#define STATUS_CHUNK_MAX ((SN_MQTT_PAYLOAD_MAX - 160) / 2)
+
+static esp_err_t publish_chunk(const char *key, const char *sub, cJSON *chunk, uint64_t ts) {
+  const char *topic = sn_mqtt_topic_cache_get()->status_topic;
+  cJSON *json = cJSON_CreateObject();
+  cJSON *parent = sub ? cJSON_AddObjectToObject(json, key) : json;
+  cJSON_AddItemToObject(parent, sub ? sub : key, chunk);
+  cJSON_AddNumberToObject(json, "ts", ts);
+  return sn_mqtt_publish_json_payload_signed(json, topic, 0, false);
+}
+
+/* Publish the members of obj as {key: {sub: {...}}, "ts": ts} (or {key: {...}} without
+ * sub), as many members per message as fit STATUS_CHUNK_MAX. The backend merges the
+ * messages sharing a ts. Consumes obj
+ */
+static esp_err_t publish_split(const char *key, const char *sub, cJSON *obj, uint64_t ts) {
+  if (!obj) return ESP_ERR_NO_MEM;
+  esp_err_t ret = ESP_OK;
+  cJSON *chunk = NULL;
+  size_t used = 0;
+
+  for (cJSON *item = obj->child; item; item = obj->child) {
+    cJSON_DetachItemViaPointer(obj, item);
+    char *str = cJSON_PrintUnformatted(item);
+    // "key":value,
+    size_t len = (str ? strlen(str) : 0) + strlen(item->string) + 4;
+    cJSON_free(str);
+
+    if (chunk && used + len > STATUS_CHUNK_MAX) {
+      esp_err_t err = publish_chunk(key, sub, chunk, ts);
+      if (err != ESP_OK) ret = err;
+      chunk = NULL;
+    }
+    if (!chunk) {
+      chunk = cJSON_CreateObject();
+      used = strlen(key) + (sub ? strlen(sub) : 0) + 32; // envelope and ts
+    }
+    cJSON_AddItemToObject(chunk, item->string, item);
+    used += len;
+  }
+  if (chunk) {
+    esp_err_t err = publish_chunk(key, sub, chunk, ts);
+    if (err != ESP_OK) ret = err;
+  }
+  cJSON_Delete(obj);
+  return ret;
+}
+
+// the metrics are too large for one message once signed, every section is split
+static inline esp_err_t publish_metrics(unsigned long long ts) {
+  cJSON *metrics = sn_metrics_to_json();
+  if (!metrics) return ESP_ERR_NO_MEM;
+  esp_err_t ret = ESP_OK;
+  for (cJSON *section = metrics->child; section; section = metrics->child) {
+    cJSON_DetachItemViaPointer(metrics, section);
+    // keep the key, the section is consumed by publish_split
+    char sub[8];
+    snprintf(sub, sizeof(sub), "%s", section->string);
+    esp_err_t err = publish_split("metrics", sub, section, ts);
+    if (err != ESP_OK) ret = err;
+  }
+  cJSON_Delete(metrics);
+  // utilization of the shared i2c/spi buses since the previous export
+  esp_err_t err = publish_split("buses", NULL, sn_bus_stats_to_json(), ts);
+  return ret != ESP_OK ? ret : err;
+}
+
+// stack high-water marks in bytes, sent with the metrics to keep the status small
+static inline esp_err_t publish_stacks(unsigned long long ts) {
+  if (s_task_len == 0) return ESP_OK;
+  cJSON *stacks = cJSON_CreateObject();
+  if (!stacks) return ESP_ERR_NO_MEM;
+  for (UBaseType_t i = 0; i < s_task_len; i++) {
+    // StackType_t is a byte on esp-idf, the mark is in bytes
+    cJSON_AddNumberToObject(
+      stacks, s_task_status[i].pcTaskName, s_task_status[i].usStackHighWaterMark
+    );
+  }
+  return publish_split("stacks", NULL, stacks, ts);
+}
+
+// per-port health scores (see sn_recovery.h), sent with the metrics
+static inline esp_err_t publish_health(unsigned long long ts) {
+  return publish_split("health", NULL, sn_recovery_health_to_json(), ts);
+}
+
 void status_poll_task(void *pvParams) {
   ESP_LOGI(TAG, "Status poll task started");
   sn_status_reading_t reading = {0};
+  cpu_report_t cpu;
+  heap_report_t heap;
+  uint32_t polls = 0;
+  heap_caps_register_failed_alloc_callback(on_alloc_failed);
   for (;;) {
+    sample_tasks();
+    sample_heap(&heap);
+    check_memory(&heap);
+    bool has_cpu = sample_cpu(&cpu);
     reading.mem = get_memory_usage();
-    reading.cpu = get_cpu_usage();
+    reading.cpu = has_cpu ? cpu.usage : 0.0f;
     reading.wifi = sn_inet_get_wifi_rssi();
     reading.ts = sn_get_unix_timestamp_ms();
-    publish_status(&reading);
+    publish_status(&reading, has_cpu ? &cpu : NULL, &heap);
+    if (++polls % METRICS_EXPORT_EVERY == 0) {
+      publish_metrics(reading.ts);
+      publish_stacks(reading.ts);
+      publish_health(reading.ts);
+    }
     vTaskDelay(pdMS_TO_TICKS(STATUS_POLL_INTERVAL_MS));
   }
 }
@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+"""Compare two host benchmark results (host_test/bench) and flag regressions.
+
+usage: bench_compare.py base.json head.json [--threshold 10]
+
+Exits with 1 when a case got slower than the threshold (percent of ns/op) or does
+more allocations per op than the base.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path, encoding="utf-8") as f:
+        doc = json.load(f)
+    return doc.get("rev", ""), {r["name"]: r for r in doc["results"]}
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("base")
+    ap.add_argument("head")
+    ap.add_argument("--threshold", type=float, default=10.0, help="allowed ns/op increase in %%")
+    args = ap.parse_args()
+
+    base_rev, base = load(args.base)
+    head_rev, head = load(args.head)
+    print("%-28s %12s %12s %8s %10s %10s" % (
+        "case", base_rev[:12] or "base", head_rev[:12] or "head", "delta", "allocs", "B/op"))
+
+    failed = False
+    for name, h in head.items():
+        b = base.get(name)
+        if not b:
+            print("%-28s %12s %12.1f %8s %10.2f %10.1f" % (
+                name, "-", h["ns_per_op"], "new", h["allocs_per_op"], h["bytes_per_op"]))
+            continue
+
+        delta = (h["ns_per_op"] - b["ns_per_op"]) * 100.0 / b["ns_per_op"] if b["ns_per_op"] else 0
+        more_allocs = h["allocs_per_op"] > b["allocs_per_op"] + 0.01
+        slower = delta > args.threshold
+        flag = " <-- regression" if slower or more_allocs else ""
+        failed |= slower or more_allocs
+        print("%-28s %12.1f %12.1f %+7.1f%% %4.2f->%-4.2f %10.1f%s" % (
+            name, b["ns_per_op"], h["ns_per_op"], delta, b["allocs_per_op"], h["allocs_per_op"],
+            h["bytes_per_op"], flag))
+
+    for name in base.keys() - head.keys():
+        print("%-28s removed" % name)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""Convert siams-node trace dumps to Chrome trace JSON (chrome://tracing, Perfetto).
+
+Accepts, mixed in one or more files:
+  - console dumps, lines containing "SNTRACE,<ts_us>,<ph>,<core>,<task>,<name>,<arg>"
+  - mqtt chunks from the trace topic, one JSON message per line, either signed
+    ({"raw_payload": "..."}) or plain ({"dump": ..., "events": [...]})
+
+usage: trace_to_chrome.py dump.log [more.log ...] -o trace.json
+"""
+
+import argparse
+import json
+import sys
+
+WRAP = 1 << 32
+
+
+def parse_console(line):
+    _, rest = line.split("SNTRACE,", 1)
+    ts, ph, core, task, name, arg = rest.strip().split(",", 5)
+    return [int(ts), ph, int(core), task, name, int(arg)]
+
+
+def parse_mqtt(line):
+    msg = json.loads(line)
+    if "raw_payload" in msg:
+        msg = json.loads(msg["raw_payload"])
+    return msg.get("dump"), msg.get("seq", 0), msg.get("events", [])
+
+
+def read_events(paths):
+    """Events in recording order, mqtt chunks are reordered by (dump, seq)."""
+    console, chunks = [], []
+    for path in paths:
+        with open(path, encoding="utf-8", errors="replace") as f:
+            for line in f:
+                line = line.strip()
+                if "SNTRACE," in line:
+                    console.append(parse_console(line))
+                elif line.startswith("{"):
+                    try:
+                        chunks.append(parse_mqtt(line))
+                    except (ValueError, KeyError):
+                        continue
+    chunks.sort(key=lambda c: (c[0] or 0, c[1]))
+    return console + [e for _, _, events in chunks for e in events]
+
+
+def to_chrome(events):
+    out, tids = [], {}
+    base, prev, offset = None, None, 0
+    for ts, ph, core, task, name, arg in events:
+        # the device keeps the low 32 bits of esp_timer
+        if prev is not None and ts < prev and prev - ts > WRAP // 2:
+            offset += WRAP
+        prev = ts
+        ts += offset
+        if base is None:
+            base = ts
+
+        task = task or "?"
+        tid = tids.setdefault(task, len(tids) + 1)
+        # begin/end pair up per thread, so a task stays one thread and the core it
+        # ran on goes to the args
+        ev = {"name": name, "ph": ph, "ts": ts - base, "pid": 1, "tid": tid,
+              "args": {"arg": arg, "core": core}}
+        if ph == "i":
+            ev["s"] = "t"
+        out.append(ev)
+
+    meta = [{"name": "process_name", "ph": "M", "pid": 1, "args": {"name": "siams-node"}}]
+    meta += [{"name": "thread_name", "ph": "M", "pid": 1, "tid": tid, "args": {"name": task}}
+             for task, tid in tids.items()]
+    return {"traceEvents": meta + out, "displayTimeUnit": "ms"}
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("inputs", nargs="+", help="console logs or mqtt chunk dumps")
+    ap.add_argument("-o", "--output", help="output file (default: stdout)")
+    args = ap.parse_args()
+
+    trace = to_chrome(read_events(args.inputs))
+    if args.output:
+        with open(args.output, "w", encoding="utf-8") as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+    print("%d events" % (len(trace["traceEvents"])), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()